@@ -0,0 +1,1015 @@
+/*
+ * Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+ * This code is distributed under the license: MIT License
+ * Originally written by Zhenrong WANG
+ * mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+ */
+
+/*
+* The node monitoring agent, run every minute on every node of the clusters. It
+* writes the same line as scripts/nowmon_agt.sh, but reads /proc/stat, /proc/meminfo
+* and statvfs directly instead of forking top, lscpu, df, bc and awk. Only for the
+* GNU/Linux distributions, like hpcmgr.
+*
+* With --push, it keeps running on a node and pushes batched samples to the collector
+* (--collect) on the master over TCP. The collector appends all the samples to the
+* cluster mon_data, the readers keyed by minute take one row per node and minute.
+* nowmon_mgr.sh still appends the null lines of the stopped nodes. See the usage
+* above main().
+*
+* The collector also keeps the latest sample of each node in memory and serves
+* them as OpenMetrics text on GET /metrics (port 19887), so scraping doesn't touch
+* the mon_data files.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define NOWMON_AGT_VERSION "0.2.0.0003"
+#define CLUSTER_DATA_DIR "/hpc_data/cluster_data/"
+#define NOWMON_STAT_FILE "/usr/hpc-now/.nowmon_agt.stat" /* The /proc/stat of the last run */
+#define NOWMON_SAMPLE_US 200000 /* The sampling window if there is no valid last run */
+#define NOWMON_CPU_MAX 4096
+#define NOWMON_PORT 19886
+#define NOWMON_METRICS_PORT 19887 /* OpenMetrics of the collector, 0 to disable */
+#define NOWMON_NODES_MAX 4096
+#define NOWMON_INTERVAL_DEFAULT 10 /* Seconds between two samples in the push mode */
+#define NOWMON_BATCH_DEFAULT 6 /* Samples per push */
+#define NOWMON_BATCH_MAX 360
+#define NOWMON_STOR_REFRESH 60 /* Seconds, du -sh on CLOUD_D is not cheap */
+#define NOWMON_LINE_MAX 1024
+#define NOWMON_PUSH_BUFFER 262144 /* Lines kept while the collector is unreachable */
+#define NOWMON_CLIENT_MAX 512
+#define NOWMON_CLIENT_IDLE 600 /* Seconds before an idle agent connection is closed, the agent reconnects */
+#define NOWMON_SCRAPE_IDLE 30 /* Seconds before an incomplete scrape is closed */
+#define NOWMON_PUSH_PID_FILE "/usr/hpc-now/.nowmon_push.pid"
+#define NOWMON_COL_PID_FILE "/usr/hpc-now/.nowmon_col.pid"
+#define NOWMON_HEADER "date,time_m,time_s,node_name,cpu_tot_cores,mem_tot_gb,mem_used_gb,mem_util_%,stor_app,stor_data,cpu_util,idle_cores,low_cores,mid_low_cores,mid_high_cores,high_cores,full_cores"
+
+typedef struct{
+  unsigned long long user;
+  unsigned long long total;
+} cpu_ticks;
+
+/* The latest sample of a node kept by the collector */
+typedef struct{
+  char node_name[64];
+  double values[13]; /* cpu_tot_cores ... full_cores, the storage in bytes */
+  time_t updated;
+  unsigned long long samples;
+} nowmon_node_state;
+
+/* The mon_data columns from cpu_tot_cores as the metric names, stor_* are converted to bytes */
+char nowmon_metric_names[13][32]={"cpu_tot_cores","mem_tot_mib","mem_used_mib","mem_util_percent","stor_app_bytes","stor_data_bytes","cpu_util_percent","idle_cores","low_cores","mid_low_cores","mid_high_cores","high_cores","full_cores"};
+
+/*
+ * Read the aggregated line (index 0) and the per-core lines of /proc/stat.
+ * return -1: failed to read
+ * return N>0: the number of cores
+ */
+int read_proc_stat(char* stat_file, cpu_ticks* ticks, int max_num){
+  char line[512]="";
+  char name[16]="";
+  unsigned long long fields[8];
+  int field_num;
+  int core_num=0;
+  int i;
+  FILE* file_p=fopen(stat_file,"r");
+  if(file_p==NULL){
+    return -1;
+  }
+  while(fgets(line,511,file_p)!=NULL){
+    if(strncmp(line,"cpu",3)!=0){
+      break;
+    }
+    memset(fields,0,sizeof(fields));
+    field_num=sscanf(line,"%15s %llu %llu %llu %llu %llu %llu %llu %llu",name,&fields[0],&fields[1],&fields[2],&fields[3],&fields[4],&fields[5],&fields[6],&fields[7]);
+    if(field_num<5){
+      continue;
+    }
+    if(strcmp(name,"cpu")==0){
+      i=0;
+    }
+    else if(core_num<max_num-1){
+      i=core_num+1;
+      core_num++;
+    }
+    else{
+      continue;
+    }
+    /* user nice system idle iowait irq softirq steal, guest is counted in user */
+    ticks[i].user=fields[0];
+    ticks[i].total=fields[0]+fields[1]+fields[2]+fields[3]+fields[4]+fields[5]+fields[6]+fields[7];
+  }
+  fclose(file_p);
+  return (core_num>0)?core_num:-1;
+}
+
+/* The user% of a core, as the 'us' of top */
+double cpu_user_util(cpu_ticks* prev, cpu_ticks* curr){
+  if(curr->total<=prev->total||curr->user<prev->user){
+    return 0;
+  }
+  return (double)(curr->user-prev->user)*100/(double)(curr->total-prev->total);
+}
+
+/* kB value of a /proc/meminfo key, 0 if not found */
+unsigned long long meminfo_value(char* meminfo, char* key){
+  char* ptr=strstr(meminfo,key);
+  if(ptr==NULL){
+    return 0;
+  }
+  return strtoull(ptr+strlen(key),NULL,10);
+}
+
+/*
+ * Total and used memory in MiB, used = total - free - buffers - cached - sreclaimable
+ * as the 'used' of top.
+ * return -1: failed to read
+ * return 0: normal exit
+ */
+int read_meminfo(double* mem_tot, double* mem_used){
+  char meminfo[8192]="";
+  unsigned long long total,available_sum;
+  size_t read_size;
+  FILE* file_p=fopen("/proc/meminfo","r");
+  if(file_p==NULL){
+    return -1;
+  }
+  read_size=fread(meminfo,1,8191,file_p);
+  fclose(file_p);
+  meminfo[read_size]='\0';
+  total=meminfo_value(meminfo,"MemTotal:");
+  available_sum=meminfo_value(meminfo,"MemFree:")+meminfo_value(meminfo,"Buffers:")+meminfo_value(meminfo,"\nCached:")+meminfo_value(meminfo,"SReclaimable:");
+  if(total==0){
+    return -1;
+  }
+  *mem_tot=(double)total/1024;
+  *mem_used=(available_sum<total)?(double)(total-available_sum)/1024:0;
+  return 0;
+}
+
+/* Human readable size in powers of 1000, rounded up like df -H */
+void human_size_si(unsigned long long bytes, char* size_string, unsigned int maxlen){
+  char units[]="BkMGTPE";
+  double value=(double)bytes;
+  long long rounded;
+  int unit=0;
+  while(value>=1000&&unit<6){
+    value/=1000;
+    unit++;
+  }
+  if(unit==0){
+    snprintf(size_string,maxlen-1,"%llu",bytes);
+    return;
+  }
+  if(value<10){
+    rounded=(long long)(value*10);
+    if((double)rounded<value*10){
+      rounded++;
+    }
+    if(rounded<100){
+      snprintf(size_string,maxlen-1,"%lld.%lld%c",rounded/10,rounded%10,units[unit]);
+      return;
+    }
+    value=10;
+  }
+  rounded=(long long)value;
+  if((double)rounded<value){
+    rounded++;
+  }
+  if(rounded>=1000&&unit<6){
+    snprintf(size_string,maxlen-1,"1.0%c",units[unit+1]);
+    return;
+  }
+  snprintf(size_string,maxlen-1,"%lld%c",rounded,units[unit]);
+}
+
+/*
+ * The used size of the filesystem mounted at a path containing the keyword, as
+ * df -TH | grep KEYWORD. Empty if no such mount.
+ */
+void mount_used_size(char* keyword, char* size_string, unsigned int maxlen){
+  char line[1024]="";
+  char device[512]="";
+  char mount_point[512]="";
+  struct statvfs fs_info;
+  FILE* file_p=fopen("/proc/mounts","r");
+  strcpy(size_string,"");
+  if(file_p==NULL){
+    return;
+  }
+  while(fgets(line,1023,file_p)!=NULL){
+    if(sscanf(line,"%511s %511s",device,mount_point)!=2||strstr(mount_point,keyword)==NULL){
+      continue;
+    }
+    if(statvfs(mount_point,&fs_info)==0&&fs_info.f_blocks>0){
+      human_size_si((unsigned long long)(fs_info.f_blocks-fs_info.f_bfree)*fs_info.f_frsize,size_string,maxlen);
+      break;
+    }
+  }
+  fclose(file_p);
+}
+
+/* du -sh of a directory, only for the clouds without separate mounts */
+void dir_used_size(char* dir, char* size_string, unsigned int maxlen){
+  char cmdline[256]="";
+  FILE* pipe_p=NULL;
+  strcpy(size_string,"");
+  snprintf(cmdline,255,"du -sh %s 2>/dev/null",dir);
+  pipe_p=popen(cmdline,"r");
+  if(pipe_p==NULL){
+    return;
+  }
+  if(fscanf(pipe_p,"%15s",size_string)!=1){
+    strcpy(size_string,"");
+  }
+  pclose(pipe_p);
+}
+
+/* stor_app and stor_data as the script, du -sh on CLOUD_D whose data dirs are not separate mounts */
+void nowmon_storage(char* stor_app, char* stor_data, unsigned int maxlen){
+  if(access("/root/CLOUD_D",F_OK)==0){
+    dir_used_size("/hpc_apps/",stor_app,maxlen);
+    dir_used_size("/hpc_data/",stor_data,maxlen);
+  }
+  else{
+    mount_used_size("/hpc_apps",stor_app,maxlen);
+    mount_used_size("/hpc_data",stor_data,maxlen);
+  }
+}
+
+/* Format a mon_data line (with the ending newline) from two /proc/stat samples, timestamped now */
+void nowmon_line(cpu_ticks* prev, cpu_ticks* curr, int core_num, char* hostname, char* stor_app, char* stor_data, char* line, unsigned int maxlen){
+  char date_string[16]="";
+  char time_m[8]="";
+  char time_s[12]="";
+  int bucket_num[6]={0};
+  double core_util;
+  double cpu_util;
+  double mem_tot=0;
+  double mem_used=0;
+  int i;
+  time_t current_time;
+  struct tm* time_p=NULL;
+  time(&current_time);
+  time_p=localtime(&current_time);
+  strftime(date_string,15,"%Y-%m-%d",time_p);
+  strftime(time_m,7,"%H:%M",time_p);
+  strftime(time_s,11,"%H:%M:%S",time_p);
+  cpu_util=cpu_user_util(&prev[0],&curr[0]);
+  /* idle, low (0,25), mid_low [25,50), mid_high [50,75), high [75,100), full */
+  for(i=1;i<=core_num;i++){
+    core_util=cpu_user_util(&prev[i],&curr[i]);
+    if(core_util<0.05){
+      bucket_num[0]++;
+    }
+    else if(core_util>=99.95){
+      bucket_num[5]++;
+    }
+    else if(core_util<25){
+      bucket_num[1]++;
+    }
+    else if(core_util<50){
+      bucket_num[2]++;
+    }
+    else if(core_util<75){
+      bucket_num[3]++;
+    }
+    else{
+      bucket_num[4]++;
+    }
+  }
+  read_meminfo(&mem_tot,&mem_used);
+  snprintf(line,maxlen-1,"%s,%s,%s,%s,%d,%.1f,%.1f,%.4f,%s,%s,%.1f,%d,%d,%d,%d,%d,%d\n",date_string,time_m,time_s,hostname,core_num,mem_tot,mem_used,(mem_tot>0)?mem_used*100/mem_tot:0,stor_app,stor_data,cpu_util,bucket_num[0],bucket_num[1],bucket_num[2],bucket_num[3],bucket_num[4],bucket_num[5]);
+}
+
+/*
+ * Append lines to the cluster mon_data, creating it with the header.
+ * return -1: failed to write
+ * return 0: normal exit
+ */
+int nowmon_append_cluster(char* lines, size_t length){
+  char mon_data[256]="";
+  FILE* file_p=NULL;
+  snprintf(mon_data,255,"%smon_data.csv",CLUSTER_DATA_DIR);
+  if(access(mon_data,F_OK)!=0){
+    mkdir(CLUSTER_DATA_DIR,0755);
+    file_p=fopen(mon_data,"w");
+    if(file_p==NULL){
+      return -1;
+    }
+    fprintf(file_p,"#---GENERATED BY HPC-NOW CLUSTER SERVICES---#\n%s\n",NOWMON_HEADER);
+    fclose(file_p);
+  }
+  file_p=fopen(mon_data,"a");
+  if(file_p==NULL){
+    return -1;
+  }
+  fwrite(lines,1,length,file_p);
+  fclose(file_p);
+  return 0;
+}
+
+/*
+ * Overwrite the latest line of a compute node, read by nowmon_mgr.sh.
+ * return -1: failed to write
+ * return 0: normal exit
+ */
+int nowmon_write_latest(char* node_name, char* line, size_t length){
+  char mon_data[256]="";
+  FILE* file_p=NULL;
+  snprintf(mon_data,255,"%smon_data_%s.csv",CLUSTER_DATA_DIR,node_name);
+  file_p=fopen(mon_data,"w");
+  if(file_p==NULL){
+    return -1;
+  }
+  fwrite(line,1,length,file_p);
+  fclose(file_p);
+  return 0;
+}
+
+/*
+ * Keep a single instance of a daemon with its pid file.
+ * return 1: another instance is running
+ * return 0: the pid file is written (or the check only)
+ */
+int nowmon_pid_lock(char* pid_file, int check_only){
+  int pid=0;
+  FILE* file_p=fopen(pid_file,"r");
+  if(file_p!=NULL){
+    if(fscanf(file_p,"%d",&pid)!=1){
+      pid=0;
+    }
+    fclose(file_p);
+  }
+  if(pid>0&&pid!=(int)getpid()&&kill(pid,0)==0){
+    return 1;
+  }
+  if(check_only!=0){
+    return 0;
+  }
+  mkdir("/usr/hpc-now",0755);
+  file_p=fopen(pid_file,"w");
+  if(file_p!=NULL){
+    fprintf(file_p,"%d\n",(int)getpid());
+    fclose(file_p);
+  }
+  return 0;
+}
+
+/* return -1: failed to connect, N: the socket */
+int nowmon_connect(char* host, int port){
+  char port_string[8]="";
+  struct addrinfo hints;
+  struct addrinfo* result=NULL;
+  int socket_fd;
+  memset(&hints,0,sizeof(struct addrinfo));
+  hints.ai_family=AF_INET;
+  hints.ai_socktype=SOCK_STREAM;
+  snprintf(port_string,7,"%d",port);
+  if(getaddrinfo(host,port_string,&hints,&result)!=0||result==NULL){
+    return -1;
+  }
+  socket_fd=socket(result->ai_family,result->ai_socktype,result->ai_protocol);
+  if(socket_fd>-1&&connect(socket_fd,result->ai_addr,result->ai_addrlen)!=0){
+    close(socket_fd);
+    socket_fd=-1;
+  }
+  freeaddrinfo(result);
+  return socket_fd;
+}
+
+int nowmon_send_all(int socket_fd, char* buffer, size_t length){
+  ssize_t sent;
+  size_t sent_total=0;
+  while(sent_total<length){
+    sent=send(socket_fd,buffer+sent_total,length-sent_total,MSG_NOSIGNAL);
+    if(sent<0&&errno==EINTR){
+      continue;
+    }
+    if(sent<1){
+      return -1;
+    }
+    sent_total+=(size_t)sent;
+  }
+  return 0;
+}
+
+/*
+ * Sample every interval seconds (aligned to the wall clock) and push the lines
+ * to the collector every batch samples over a persistent connection. The lines
+ * are kept while the collector is unreachable, the oldest ones are dropped if
+ * the buffer is full.
+ */
+int nowmon_push(char* host, int port, int interval, int batch){
+  char hostname[64]="";
+  char stor_app[16]="";
+  char stor_data[16]="";
+  char line[NOWMON_LINE_MAX]="";
+  char* buffer=NULL;
+  char* line_end=NULL;
+  cpu_ticks* prev=NULL;
+  cpu_ticks* curr=NULL;
+  size_t used=0;
+  size_t line_len;
+  int batched=0;
+  int socket_fd=-1;
+  char peek_byte;
+  int core_num;
+  time_t current_time;
+  time_t stor_time=0;
+  if(gethostname(hostname,63)!=0){
+    return 1;
+  }
+  buffer=(char*)malloc(NOWMON_PUSH_BUFFER);
+  prev=(cpu_ticks*)calloc(NOWMON_CPU_MAX+1,sizeof(cpu_ticks));
+  curr=(cpu_ticks*)calloc(NOWMON_CPU_MAX+1,sizeof(cpu_ticks));
+  if(buffer==NULL||prev==NULL||curr==NULL){
+    free(buffer);
+    free(prev);
+    free(curr);
+    return 1;
+  }
+  read_proc_stat("/proc/stat",prev,NOWMON_CPU_MAX+1);
+  while(1){
+    current_time=time(NULL);
+    sleep(interval-(int)(current_time%interval));
+    core_num=read_proc_stat("/proc/stat",curr,NOWMON_CPU_MAX+1);
+    if(core_num<1){
+      continue;
+    }
+    current_time=time(NULL);
+    if(current_time-stor_time>=NOWMON_STOR_REFRESH){
+      nowmon_storage(stor_app,stor_data,16);
+      stor_time=current_time;
+    }
+    nowmon_line(prev,curr,core_num,hostname,stor_app,stor_data,line,NOWMON_LINE_MAX);
+    memcpy(prev,curr,sizeof(cpu_ticks)*(core_num+1));
+    line_len=strlen(line);
+    while(used+line_len>NOWMON_PUSH_BUFFER){
+      line_end=(char*)memchr(buffer,'\n',used);
+      if(line_end==NULL){
+        used=0;
+        batched=0;
+        break;
+      }
+      memmove(buffer,line_end+1,used-(size_t)(line_end+1-buffer));
+      used-=(size_t)(line_end+1-buffer);
+      batched--;
+    }
+    memcpy(buffer+used,line,line_len);
+    used+=line_len;
+    batched++;
+    if(batched<batch){
+      continue;
+    }
+    /* The collector closes the idle connections, reconnect rather than send into a closed one */
+    if(socket_fd>-1&&recv(socket_fd,&peek_byte,1,MSG_PEEK|MSG_DONTWAIT)==0){
+      close(socket_fd);
+      socket_fd=-1;
+    }
+    if(socket_fd<0){
+      socket_fd=nowmon_connect(host,port);
+      if(socket_fd<0){
+        continue;
+      }
+    }
+    if(nowmon_send_all(socket_fd,buffer,used)!=0){
+      close(socket_fd);
+      socket_fd=-1;
+      continue;
+    }
+    used=0;
+    batched=0;
+  }
+  return 0;
+}
+
+/* Only the loopback and the private networks (including the 100.64/10 of some clouds) */
+int nowmon_private_peer(struct sockaddr_in* peer){
+  unsigned long address=ntohl(peer->sin_addr.s_addr);
+  if((address>>24)==10||(address>>24)==127||(address>>20)==0xAC1||(address>>16)==0xC0A8||(address>>22)==0x191){
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * A mon_data line has 17 fields, the 4th is the node name.
+ * return 1: valid, 0: invalid
+ */
+int nowmon_line_valid(char* line, char* node_name, unsigned int maxlen){
+  int field_num=1;
+  unsigned int name_len=0;
+  char* ptr=line;
+  if(*line<'0'||*line>'9'){
+    return 0;
+  }
+  for(;*ptr!='\0';ptr++){
+    if(*ptr==','){
+      field_num++;
+      continue;
+    }
+    if(field_num!=4){
+      continue;
+    }
+    if(name_len+1>=maxlen||!((*ptr>='a'&&*ptr<='z')||(*ptr>='A'&&*ptr<='Z')||(*ptr>='0'&&*ptr<='9')||*ptr=='-'||*ptr=='_'||*ptr=='.')){
+      return 0;
+    }
+    node_name[name_len]=*ptr;
+    name_len++;
+  }
+  node_name[name_len]='\0';
+  return (field_num==17&&name_len>0)?1:0;
+}
+
+/* Bytes of a df -H style size, e.g. 12G or 1.5T */
+double nowmon_size_bytes(char* size_string){
+  char* unit_p=NULL;
+  char units[]="kMGTPE";
+  char* unit_found=NULL;
+  double value=strtod(size_string,&unit_p);
+  double scale=1;
+  if(unit_p==NULL||*unit_p=='\0'){
+    return value;
+  }
+  unit_found=strchr(units,*unit_p);
+  if(unit_found==NULL){
+    return value;
+  }
+  for(unit_p=units;unit_p<=unit_found;unit_p++){
+    scale*=1000;
+  }
+  return value*scale;
+}
+
+/*
+ * Keep a valid mon_data line as the latest sample of its node.
+ * return -1: the node table is full
+ * return 0: normal exit
+ */
+int nowmon_state_update(nowmon_node_state* nodes, int* node_num, char* node_name, char* line){
+  char line_copy[NOWMON_LINE_MAX]="";
+  char* fields[17];
+  char* ptr=NULL;
+  int field_num=1;
+  int i;
+  for(i=0;i<*node_num;i++){
+    if(strcmp(nodes[i].node_name,node_name)==0){
+      break;
+    }
+  }
+  if(i==*node_num){
+    if(*node_num>=NOWMON_NODES_MAX){
+      return -1;
+    }
+    memset(&nodes[i],0,sizeof(nowmon_node_state));
+    snprintf(nodes[i].node_name,63,"%s",node_name);
+    (*node_num)++;
+  }
+  snprintf(line_copy,NOWMON_LINE_MAX-1,"%s",line);
+  fields[0]=line_copy;
+  for(ptr=line_copy;*ptr!='\0'&&field_num<17;ptr++){
+    if(*ptr==','){
+      *ptr='\0';
+      fields[field_num]=ptr+1;
+      field_num++;
+    }
+  }
+  if(field_num<17){
+    return 0;
+  }
+  for(field_num=0;field_num<13;field_num++){
+    if(field_num==4||field_num==5){
+      nodes[i].values[field_num]=nowmon_size_bytes(fields[field_num+4]);
+    }
+    else{
+      nodes[i].values[field_num]=atof(fields[field_num+4]);
+    }
+  }
+  nodes[i].updated=time(NULL);
+  nodes[i].samples++;
+  return 0;
+}
+
+/*
+ * Render the OpenMetrics text of the node table into a growing buffer.
+ * return -1: failed to allocate memory
+ * return 0: normal exit
+ */
+int nowmon_metrics_render(nowmon_node_state* nodes, int node_num, unsigned long long rejected, char** text, size_t* text_max, size_t* text_len){
+  size_t need=(size_t)(node_num+1)*16*256+1024; /* A metric line is less than 256 bytes */
+  char* new_text=NULL;
+  int i,j;
+  if(*text_max<need){
+    new_text=(char*)realloc(*text,need);
+    if(new_text==NULL){
+      return -1;
+    }
+    *text=new_text;
+    *text_max=need;
+  }
+  *text_len=0;
+  for(j=0;j<13;j++){
+    *text_len+=snprintf(*text+*text_len,*text_max-*text_len,"# TYPE hpcnow_node_%s gauge\n",nowmon_metric_names[j]);
+    for(i=0;i<node_num;i++){
+      *text_len+=snprintf(*text+*text_len,*text_max-*text_len,"hpcnow_node_%s{node=\"%s\"} %.4f\n",nowmon_metric_names[j],nodes[i].node_name,nodes[i].values[j]);
+    }
+  }
+  *text_len+=snprintf(*text+*text_len,*text_max-*text_len,"# TYPE hpcnow_node_last_sample_timestamp_seconds gauge\n");
+  for(i=0;i<node_num;i++){
+    *text_len+=snprintf(*text+*text_len,*text_max-*text_len,"hpcnow_node_last_sample_timestamp_seconds{node=\"%s\"} %lld\n",nodes[i].node_name,(long long)nodes[i].updated);
+  }
+  *text_len+=snprintf(*text+*text_len,*text_max-*text_len,"# TYPE hpcnow_collector_samples counter\n");
+  for(i=0;i<node_num;i++){
+    *text_len+=snprintf(*text+*text_len,*text_max-*text_len,"hpcnow_collector_samples_total{node=\"%s\"} %llu\n",nodes[i].node_name,nodes[i].samples);
+  }
+  *text_len+=snprintf(*text+*text_len,*text_max-*text_len,"# TYPE hpcnow_collector_rejected_lines counter\nhpcnow_collector_rejected_lines_total %llu\n# EOF\n",rejected);
+  return 0;
+}
+
+/*
+ * Answer a scrape once the request header is complete, GET /metrics only.
+ * return 1: the request is not complete yet
+ * return 0: answered, the connection can be closed
+ */
+int nowmon_metrics_serve(int socket_fd, char* request, nowmon_node_state* nodes, int node_num, unsigned long long rejected, char** text, size_t* text_max){
+  char header[256]="";
+  size_t text_len=0;
+  if(strstr(request,"\r\n\r\n")==NULL&&strstr(request,"\n\n")==NULL){
+    return 1;
+  }
+  if(strncmp(request,"GET /metrics ",13)!=0&&strncmp(request,"GET /metrics?",13)!=0){
+    snprintf(header,255,"HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    nowmon_send_all(socket_fd,header,strlen(header));
+    return 0;
+  }
+  if(nowmon_metrics_render(nodes,node_num,rejected,text,text_max,&text_len)!=0){
+    snprintf(header,255,"HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    nowmon_send_all(socket_fd,header,strlen(header));
+    return 0;
+  }
+  snprintf(header,255,"HTTP/1.1 200 OK\r\nContent-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",(unsigned long)text_len);
+  if(nowmon_send_all(socket_fd,header,strlen(header))==0){
+    nowmon_send_all(socket_fd,*text,text_len);
+  }
+  return 0;
+}
+
+/*
+ * The collector on the master: accept the pushes of the node agents and append
+ * all the lines to the cluster mon_data. Scrapes are answered on the metrics port
+ * from the latest samples in memory. The idle connections are closed, so that the
+ * dead agents and the stuck scrapes don't hold the client slots.
+ */
+int nowmon_collect(int port, int metrics_port){
+  char node_name[64]="";
+  char (*client_buffers)[NOWMON_LINE_MAX]=NULL;
+  char* append_buffer=NULL;
+  char* line_start=NULL;
+  char* line_end=NULL;
+  char* metrics_text=NULL;
+  int* client_fds=NULL;
+  int* client_kinds=NULL; /* 0: an agent pushing lines, 1: a metrics scrape */
+  size_t* client_used=NULL;
+  time_t* client_active=NULL; /* The last time a slot received anything */
+  time_t current_time;
+  size_t metrics_max=0;
+  nowmon_node_state* nodes=NULL;
+  int node_num=0;
+  unsigned long long rejected=0;
+  size_t append_used;
+  size_t line_len;
+  int listen_fd;
+  int metrics_fd=-1;
+  int socket_opt_val=1;
+  int max_fd;
+  int i;
+  ssize_t received;
+  struct sockaddr_in server_address;
+  struct sockaddr_in peer_address;
+  socklen_t peer_len;
+  struct timeval select_timeout;
+  fd_set read_fds;
+  client_buffers=(char (*)[NOWMON_LINE_MAX])malloc(sizeof(char)*NOWMON_LINE_MAX*NOWMON_CLIENT_MAX);
+  client_fds=(int*)malloc(sizeof(int)*NOWMON_CLIENT_MAX);
+  client_kinds=(int*)malloc(sizeof(int)*NOWMON_CLIENT_MAX);
+  client_used=(size_t*)malloc(sizeof(size_t)*NOWMON_CLIENT_MAX);
+  client_active=(time_t*)malloc(sizeof(time_t)*NOWMON_CLIENT_MAX);
+  append_buffer=(char*)malloc(NOWMON_PUSH_BUFFER);
+  nodes=(nowmon_node_state*)malloc(sizeof(nowmon_node_state)*NOWMON_NODES_MAX);
+  if(client_buffers==NULL||client_fds==NULL||client_kinds==NULL||client_used==NULL||client_active==NULL||append_buffer==NULL||nodes==NULL){
+    free(client_buffers);
+    free(client_fds);
+    free(client_kinds);
+    free(client_used);
+    free(client_active);
+    free(append_buffer);
+    free(nodes);
+    return 1;
+  }
+  for(i=0;i<NOWMON_CLIENT_MAX;i++){
+    client_fds[i]=-1;
+    client_kinds[i]=0;
+    client_used[i]=0;
+    client_active[i]=0;
+  }
+  listen_fd=socket(AF_INET,SOCK_STREAM,0);
+  if(listen_fd<0){
+    return 1;
+  }
+  setsockopt(listen_fd,SOL_SOCKET,SO_REUSEADDR,&socket_opt_val,sizeof(socket_opt_val));
+  memset(&server_address,0,sizeof(server_address));
+  server_address.sin_family=AF_INET;
+  server_address.sin_addr.s_addr=htonl(INADDR_ANY);
+  server_address.sin_port=htons(port);
+  if(bind(listen_fd,(struct sockaddr*)&server_address,sizeof(server_address))!=0||listen(listen_fd,64)!=0){
+    close(listen_fd);
+    return 1;
+  }
+  /* The collector still works without the metrics port */
+  if(metrics_port>0){
+    metrics_fd=socket(AF_INET,SOCK_STREAM,0);
+    socket_opt_val=1;
+    server_address.sin_port=htons(metrics_port);
+    if(metrics_fd>-1&&(setsockopt(metrics_fd,SOL_SOCKET,SO_REUSEADDR,&socket_opt_val,sizeof(socket_opt_val))!=0||bind(metrics_fd,(struct sockaddr*)&server_address,sizeof(server_address))!=0||listen(metrics_fd,16)!=0)){
+      close(metrics_fd);
+      metrics_fd=-1;
+    }
+  }
+  while(1){
+    FD_ZERO(&read_fds);
+    FD_SET(listen_fd,&read_fds);
+    max_fd=listen_fd;
+    if(metrics_fd>-1){
+      FD_SET(metrics_fd,&read_fds);
+      if(metrics_fd>max_fd){
+        max_fd=metrics_fd;
+      }
+    }
+    current_time=time(NULL);
+    for(i=0;i<NOWMON_CLIENT_MAX;i++){
+      if(client_fds[i]>-1&&current_time-client_active[i]>((client_kinds[i]==1)?NOWMON_SCRAPE_IDLE:NOWMON_CLIENT_IDLE)){
+        close(client_fds[i]);
+        client_fds[i]=-1;
+      }
+      if(client_fds[i]>-1){
+        FD_SET(client_fds[i],&read_fds);
+        if(client_fds[i]>max_fd){
+          max_fd=client_fds[i];
+        }
+      }
+    }
+    /* Wake up now and then to close the idle slots */
+    select_timeout.tv_sec=NOWMON_SCRAPE_IDLE;
+    select_timeout.tv_usec=0;
+    if(select(max_fd+1,&read_fds,NULL,NULL,&select_timeout)<0){
+      if(errno==EINTR){
+        continue;
+      }
+      break;
+    }
+    if(FD_ISSET(listen_fd,&read_fds)){
+      peer_len=sizeof(peer_address);
+      socket_opt_val=accept(listen_fd,(struct sockaddr*)&peer_address,&peer_len);
+      if(socket_opt_val>-1){
+        for(i=0;i<NOWMON_CLIENT_MAX;i++){
+          if(client_fds[i]<0){
+            break;
+          }
+        }
+        if(i==NOWMON_CLIENT_MAX||socket_opt_val>=FD_SETSIZE||nowmon_private_peer(&peer_address)==0){
+          close(socket_opt_val);
+        }
+        else{
+          client_fds[i]=socket_opt_val;
+          client_kinds[i]=0;
+          client_used[i]=0;
+          client_active[i]=time(NULL);
+        }
+      }
+    }
+    if(metrics_fd>-1&&FD_ISSET(metrics_fd,&read_fds)){
+      peer_len=sizeof(peer_address);
+      socket_opt_val=accept(metrics_fd,(struct sockaddr*)&peer_address,&peer_len);
+      if(socket_opt_val>-1){
+        for(i=0;i<NOWMON_CLIENT_MAX;i++){
+          if(client_fds[i]<0){
+            break;
+          }
+        }
+        if(i==NOWMON_CLIENT_MAX||socket_opt_val>=FD_SETSIZE||nowmon_private_peer(&peer_address)==0){
+          close(socket_opt_val);
+        }
+        else{
+          client_fds[i]=socket_opt_val;
+          client_kinds[i]=1;
+          client_used[i]=0;
+          client_active[i]=time(NULL);
+        }
+      }
+    }
+    append_used=0;
+    for(i=0;i<NOWMON_CLIENT_MAX;i++){
+      if(client_fds[i]<0||!FD_ISSET(client_fds[i],&read_fds)){
+        continue;
+      }
+      received=recv(client_fds[i],client_buffers[i]+client_used[i],NOWMON_LINE_MAX-1-client_used[i],0);
+      if(received<1){
+        close(client_fds[i]);
+        client_fds[i]=-1;
+        continue;
+      }
+      client_used[i]+=(size_t)received;
+      client_buffers[i][client_used[i]]='\0';
+      client_active[i]=time(NULL);
+      if(client_kinds[i]==1){
+        if(nowmon_metrics_serve(client_fds[i],client_buffers[i],nodes,node_num,rejected,&metrics_text,&metrics_max)==0||client_used[i]==NOWMON_LINE_MAX-1){
+          close(client_fds[i]);
+          client_fds[i]=-1;
+        }
+        continue;
+      }
+      line_start=client_buffers[i];
+      while((line_end=strchr(line_start,'\n'))!=NULL){
+        *line_end='\0';
+        line_len=(size_t)(line_end-line_start);
+        if(nowmon_line_valid(line_start,node_name,64)==1){
+          /* A full node table only misses the metrics, the samples are still appended */
+          nowmon_state_update(nodes,&node_num,node_name,line_start);
+          *line_end='\n';
+          if(append_used+line_len+1>NOWMON_PUSH_BUFFER){
+            nowmon_append_cluster(append_buffer,append_used);
+            append_used=0;
+          }
+          memcpy(append_buffer+append_used,line_start,line_len+1);
+          append_used+=line_len+1;
+          if(strcmp(node_name,"master")!=0){
+            nowmon_write_latest(node_name,line_start,line_len+1);
+          }
+        }
+        else{
+          rejected++;
+        }
+        line_start=line_end+1;
+      }
+      client_used[i]-=(size_t)(line_start-client_buffers[i]);
+      memmove(client_buffers[i],line_start,client_used[i]);
+      /* A line longer than the buffer is not a mon_data line */
+      if(client_used[i]==NOWMON_LINE_MAX-1){
+        client_used[i]=0;
+      }
+    }
+    if(append_used>0){
+      nowmon_append_cluster(append_buffer,append_used);
+    }
+  }
+  close(listen_fd);
+  if(metrics_fd>-1){
+    close(metrics_fd);
+  }
+  return 1;
+}
+
+/*
+ * Usage:
+ * nowmon_agt                        Sample once since the last run and write the line (the cron mode)
+ * nowmon_agt --push HOST [--port N] [--interval S] [--batch N] [--daemon]
+ *                                   Sample every S seconds and push every N samples to the collector
+ * nowmon_agt --collect [--port N] [--metrics-port N] [--daemon]
+ *                                   Run the collector on the master, --metrics-port 0 disables the metrics
+ */
+int main(int argc, char* argv[]){
+  char hostname[64]="";
+  char stor_app[16]="";
+  char stor_data[16]="";
+  char line[NOWMON_LINE_MAX]="";
+  char push_host[256]="";
+  char pid_file[128]="";
+  cpu_ticks* prev=NULL;
+  cpu_ticks* curr=NULL;
+  int collect_flag=0;
+  int daemon_flag=0;
+  int port=NOWMON_PORT;
+  int metrics_port=NOWMON_METRICS_PORT;
+  int interval=NOWMON_INTERVAL_DEFAULT;
+  int batch=NOWMON_BATCH_DEFAULT;
+  int prev_num=-1;
+  int core_num;
+  int i;
+  FILE* file_p=NULL;
+
+  for(i=1;i<argc;i++){
+    if(strcmp(argv[i],"--version")==0){
+      printf("%s\n",NOWMON_AGT_VERSION);
+      return 0;
+    }
+    else if(strcmp(argv[i],"--collect")==0){
+      collect_flag=1;
+    }
+    else if(strcmp(argv[i],"--daemon")==0){
+      daemon_flag=1;
+    }
+    else if(strcmp(argv[i],"--push")==0&&i+1<argc){
+      snprintf(push_host,255,"%s",argv[++i]);
+    }
+    else if(strcmp(argv[i],"--port")==0&&i+1<argc){
+      port=atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i],"--metrics-port")==0&&i+1<argc){
+      metrics_port=atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i],"--interval")==0&&i+1<argc){
+      interval=atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i],"--batch")==0&&i+1<argc){
+      batch=atoi(argv[++i]);
+    }
+  }
+  if(port<1||port>65535){
+    port=NOWMON_PORT;
+  }
+  if(metrics_port<0||metrics_port>65535){
+    metrics_port=NOWMON_METRICS_PORT;
+  }
+  if(interval<1||interval>3600){
+    interval=NOWMON_INTERVAL_DEFAULT;
+  }
+  if(batch<1||batch>NOWMON_BATCH_MAX){
+    batch=NOWMON_BATCH_DEFAULT;
+  }
+  if(collect_flag==1||strlen(push_host)>0){
+    signal(SIGPIPE,SIG_IGN);
+    strcpy(pid_file,(collect_flag==1)?NOWMON_COL_PID_FILE:NOWMON_PUSH_PID_FILE);
+    if(nowmon_pid_lock(pid_file,1)!=0){
+      return 0;
+    }
+    if(daemon_flag==1&&daemon(0,0)!=0){
+      return 1;
+    }
+    nowmon_pid_lock(pid_file,0);
+    if(collect_flag==1){
+      return nowmon_collect(port,metrics_port);
+    }
+    return nowmon_push(push_host,port,interval,batch);
+  }
+
+  if(gethostname(hostname,63)!=0){
+    return 1;
+  }
+  prev=(cpu_ticks*)calloc(NOWMON_CPU_MAX+1,sizeof(cpu_ticks));
+  curr=(cpu_ticks*)calloc(NOWMON_CPU_MAX+1,sizeof(cpu_ticks));
+  if(prev==NULL||curr==NULL){
+    free(prev);
+    free(curr);
+    return 1;
+  }
+  /* Utilization since the last run, or over a short window for the first run */
+  prev_num=read_proc_stat(NOWMON_STAT_FILE,prev,NOWMON_CPU_MAX+1);
+  core_num=read_proc_stat("/proc/stat",curr,NOWMON_CPU_MAX+1);
+  if(core_num<1){
+    free(prev);
+    free(curr);
+    return 1;
+  }
+  if(prev_num!=core_num||curr[0].total<=prev[0].total){
+    read_proc_stat("/proc/stat",prev,NOWMON_CPU_MAX+1);
+    usleep(NOWMON_SAMPLE_US);
+    core_num=read_proc_stat("/proc/stat",curr,NOWMON_CPU_MAX+1);
+  }
+  mkdir("/usr/hpc-now",0755);
+  file_p=fopen(NOWMON_STAT_FILE,"w");
+  if(file_p!=NULL){
+    for(i=0;i<=core_num;i++){
+      if(i==0){
+        fprintf(file_p,"cpu %llu 0 0 %llu 0 0 0 0\n",curr[i].user,curr[i].total-curr[i].user);
+      }
+      else{
+        fprintf(file_p,"cpu%d %llu 0 0 %llu 0 0 0 0\n",i-1,curr[i].user,curr[i].total-curr[i].user);
+      }
+    }
+    fclose(file_p);
+  }
+  nowmon_storage(stor_app,stor_data,16);
+  nowmon_line(prev,curr,core_num,hostname,stor_app,stor_data,line,NOWMON_LINE_MAX);
+  free(prev);
+  free(curr);
+  if(strcmp(hostname,"master")==0){
+    return (nowmon_append_cluster(line,strlen(line))==0)?0:1;
+  }
+  return (nowmon_write_latest(hostname,line,strlen(line))==0)?0:1;
+}
@@ -87,23 +87,27 @@ int app_operation(char* workdir, char* crypto_keyfile, char* user_name, char* op
     }
     char remote_commands[CMDLINE_LENGTH]="";
     int run_flag=0;
+    remote_batch batch;
     if(strcmp(option,"build")==0||strcmp(option,"install")==0){
         snprintf(remote_commands,CMDLINE_LENGTH-1,"nohup hpcmgr %s --app=%s --inst=%s --repo=%s > /hpc_apps/%s_apps/appman_%s.log 2>&1 &",option,app_name,inst_loc,repo_loc,user_name,app_name);
     }
     else{
         snprintf(remote_commands,CMDLINE_LENGTH-1,"nohup hpcmgr remove --app=%s --inst=%s > /hpc_apps/%s_apps/appman_%s.log 2>&1 &",app_name,inst_loc,user_name,app_name);
     }
-    
-    run_flag=remote_exec_general(workdir,crypto_keyfile,sshkey_dir,user_name,remote_commands,"",0,2,"","");
-    if(run_flag!=0){
-        return 1;
-    }
+    /* Start and follow the log in one session, Ctrl+C stops the tail -f and returns here. */
+    remote_batch_init(&batch,1,1);
+    remote_batch_add(&batch,"exec",remote_commands,"");
+    snprintf(remote_commands,CMDLINE_LENGTH-1,"tail -f /hpc_apps/%s_apps/appman_%s.log",user_name,app_name);
+    remote_batch_add(&batch,"exec",remote_commands,"");
     printf(GENERAL_BOLD "[ -INFO- ] App operation is in progress. Detailed info as below.\n");
     printf("[  ****  ] You can press 'ctrl C' to stop viewing the log.\n" RESET_DISPLAY "\n");
-    snprintf(remote_commands,CMDLINE_LENGTH-1,"tail -f /hpc_apps/%s_apps/appman_%s.log",user_name,app_name);
-    run_flag=remote_exec_general(workdir,crypto_keyfile,sshkey_dir,user_name,remote_commands,"-t",0,1,"","");
-    if(run_flag!=0){
+    run_flag=remote_batch_run(workdir,crypto_keyfile,sshkey_dir,user_name,&batch);
+    if(run_flag==3){
         return 3;
     }
+    if(batch.steps[0].exit_code!=0){
+        printf(FATAL_RED_BOLD "[ FATAL: ] Failed to start the app operation." RESET_DISPLAY "\n");
+        return 1;
+    }
     return 0;
 }
\ No newline at end of file
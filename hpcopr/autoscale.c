@@ -0,0 +1,658 @@
+/*
+ * Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+ * This code is distributed under the license: MIT License
+ * Originally written by Zhenrong WANG
+ * mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+
+#include "now_macros.h"
+#include "general_funcs.h"
+#include "cluster_general_funcs.h"
+#include "cluster_operations.h"
+#include "monman.h"
+#include "mon_store.h"
+#include "jobman.h"
+#include "autoscale.h"
+
+/*
+ * The policy, the state and the decision log of a cluster live in its conf and
+ * log subdirs, so they move with the cluster when it is renamed.
+ */
+int autoscale_files(char* workdir, char* conf_file, char* state_file, char* log_file, unsigned int maxlen){
+    char confdir[DIR_LENGTH]="";
+    char logdir[DIR_LENGTH]="";
+    if(create_and_get_subdir(workdir,"conf",confdir,DIR_LENGTH)!=0||create_and_get_subdir(workdir,"log",logdir,DIR_LENGTH)!=0){
+        return -1;
+    }
+    snprintf(conf_file,maxlen-1,"%s%sautoscale.conf",confdir,PATH_SLASH);
+    snprintf(state_file,maxlen-1,"%s%sautoscale.state",confdir,PATH_SLASH);
+    snprintf(log_file,maxlen-1,"%s%sautoscale.log",logdir,PATH_SLASH);
+    return 0;
+}
+
+/*
+ * Write the defaults if the conf file is absent. Invalid values keep the defaults.
+ * return -1: Failed to create the conf file
+ * return  0: Normal exit
+ */
+int autoscale_conf(char* conf_file, autoscale_policy* policy){
+    char conf_keys[9][24]={"min_nodes:","max_nodes:","max_step:","up_delay_sec:","down_delay_sec:","up_cooldown_sec:","down_cooldown_sec:","reserve_cores:","add_nodes:"};
+    int* conf_values[9]={&policy->min_nodes,&policy->max_nodes,&policy->max_step,&policy->up_delay,&policy->down_delay,&policy->up_cooldown,&policy->down_cooldown,&policy->reserve_cores,&policy->add_nodes};
+    char conf_line[LINE_LENGTH_SHORT]="";
+    char header[LINE_LENGTH_TINY]="";
+    char tail[LINE_LENGTH_TINY]="";
+    int value;
+    int i;
+    FILE* file_p=NULL;
+    policy->min_nodes=0;
+    policy->max_nodes=AUTOSCALE_MAX_NODES;
+    policy->max_step=AUTOSCALE_MAX_STEP;
+    policy->up_delay=AUTOSCALE_UP_DELAY;
+    policy->down_delay=AUTOSCALE_DOWN_DELAY;
+    policy->up_cooldown=AUTOSCALE_UP_COOLDOWN;
+    policy->down_cooldown=AUTOSCALE_DOWN_COOLDOWN;
+    policy->reserve_cores=0;
+    policy->add_nodes=0;
+    if(file_exist_or_not(conf_file)!=0){
+        file_p=fopen(conf_file,"w+");
+        if(file_p==NULL){
+            return -1;
+        }
+        for(i=0;i<9;i++){
+            fprintf(file_p,"%s  %d\n",conf_keys[i],*conf_values[i]);
+        }
+        fclose(file_p);
+        return 0;
+    }
+    file_p=fopen(conf_file,"r");
+    if(file_p==NULL){
+        return 0;
+    }
+    while(fngetline(file_p,conf_line,LINE_LENGTH_SHORT)!=1){
+        get_seq_nstring(conf_line,' ',1,header,LINE_LENGTH_TINY);
+        get_seq_nstring(conf_line,' ',2,tail,LINE_LENGTH_TINY);
+        value=string_to_positive_num(tail);
+        for(i=0;i<9;i++){
+            if(strcmp(header,conf_keys[i])==0&&value>-1){
+                *conf_values[i]=value;
+                break;
+            }
+        }
+    }
+    fclose(file_p);
+    if(policy->max_step<1){
+        policy->max_step=1;
+    }
+    if(policy->max_nodes<policy->min_nodes){
+        policy->max_nodes=policy->min_nodes;
+    }
+    return 0;
+}
+
+/*
+ * return -1: No state yet, the state is reset
+ * return  0: Normal exit
+ */
+int autoscale_state_read(char* state_file, autoscale_state* state){
+    char line_buffer[LINE_LENGTH_SHORT]="";
+    char header[32]="";
+    char tail[32]="";
+    int_64bit value;
+    FILE* file_p=NULL;
+    memset(state,0,sizeof(autoscale_state));
+    strcpy(state->last_action,"none");
+    file_p=fopen(state_file,"r");
+    if(file_p==NULL){
+        return -1;
+    }
+    while(fngetline(file_p,line_buffer,LINE_LENGTH_SHORT)!=1){
+        if(sscanf(line_buffer,"%31s %31s",header,tail)!=2){
+            continue;
+        }
+        if(strcmp(header,"last_action:")==0){
+            strncpy(state->last_action,tail,15);
+            continue;
+        }
+        if(sscanf(tail,"%lld",&value)!=1||value<0){
+            continue;
+        }
+        if(strcmp(header,"up_since:")==0){
+            state->up_since=value;
+        }
+        else if(strcmp(header,"down_since:")==0){
+            state->down_since=value;
+        }
+        else if(strcmp(header,"last_time:")==0){
+            state->last_time=value;
+        }
+        else if(strcmp(header,"last_count:")==0){
+            state->last_count=(int)value;
+        }
+    }
+    fclose(file_p);
+    return 0;
+}
+
+/*
+ * Written to a temp file and renamed, a killed loop never leaves a partial state.
+ * return -1: Failed to write the state
+ * return  0: Normal exit
+ */
+int autoscale_state_write(char* state_file, autoscale_state* state){
+    char state_temp[FILENAME_LENGTH]="";
+    FILE* file_p=NULL;
+    snprintf(state_temp,FILENAME_LENGTH-1,"%s.tmp",state_file);
+    file_p=fopen(state_temp,"w+");
+    if(file_p==NULL){
+        return -1;
+    }
+    fprintf(file_p,"up_since: %lld\ndown_since: %lld\nlast_time: %lld\nlast_action: %s\nlast_count: %d\n",state->up_since,state->down_since,state->last_time,state->last_action,state->last_count);
+    fclose(file_p);
+    rm_file_or_dir(state_file);
+    if(rename(state_temp,state_file)!=0){
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Parse the output of squeue -h -o '%T|%C|%N'. A simulated queue is a file of
+ * the same lines, i.e. PENDING|8| or RUNNING|16|compute[1-2].
+ * return -1: Failed to open the queue file
+ * return N>=0: The busy nodes listed
+ */
+int autoscale_queue_parse(char* queue_file, autoscale_input* input, char (*busy_nodes)[32], int max_num){
+    char line_buffer[LINE_LENGTH_SMALL]="";
+    char* fields[3];
+    char* ptr=NULL;
+    int field_num;
+    int cores;
+    FILE* file_p=fopen(queue_file,"r");
+    input->pending_jobs=0;
+    input->pending_cores=0;
+    input->busy_node_num=0;
+    if(file_p==NULL){
+        return -1;
+    }
+    while(fngetline(file_p,line_buffer,LINE_LENGTH_SMALL)!=1){
+        fields[0]=line_buffer;
+        field_num=1;
+        for(ptr=line_buffer;*ptr!='\0';ptr++){
+            if(*ptr=='|'&&field_num<3){
+                *ptr='\0';
+                fields[field_num]=ptr+1;
+                field_num++;
+            }
+        }
+        if(field_num<3){
+            continue;
+        }
+        if(strcmp(fields[0],"PENDING")==0){
+            cores=string_to_positive_num(fields[1]);
+            input->pending_jobs++;
+            input->pending_cores+=(cores>0)?cores:1;
+        }
+        else if((strcmp(fields[0],"RUNNING")==0||strcmp(fields[0],"COMPLETING")==0||strcmp(fields[0],"CONFIGURING")==0)&&strlen(fields[2])>0){
+            input->busy_node_num+=job_nodelist_expand(fields[2],busy_nodes+input->busy_node_num,max_num-input->busy_node_num);
+        }
+    }
+    fclose(file_p);
+    return input->busy_node_num;
+}
+
+/*
+ * Sum the mean idle cores of the running nodes in the latest AUTOSCALE_MON_WINDOW,
+ * and count the trailing nodes (the ones shutdown_compute_nodes takes first)
+ * that have no running jobs and stayed fully idle in the window. The nodes
+ * without recent samples are never taken as idle.
+ * return -3: Failed to allocate memory
+ * return N>=0: The nodes with recent samples
+ */
+int autoscale_idle_load(char* store_dir, int_64bit now, char (*busy_nodes)[32], autoscale_input* input){
+    char (*store_nodes)[32]=NULL;
+    char node_name[32]="";
+    int_64bit* ts_block=NULL;
+    double* idle_block=NULL;
+    int_64bit row,row_total,read_num,j;
+    int store_node_num;
+    int node_id;
+    int node_samples;
+    int sampled_num=0;
+    int tail_open=1;
+    int i;
+    double node_sum;
+    double node_min;
+    double idle_sum=0;
+    input->idle_cores=0;
+    input->idle_tail=0;
+    store_nodes=(char (*)[32])malloc(sizeof(char)*32*MON_STORE_NODES_MAX);
+    ts_block=(int_64bit*)malloc(sizeof(int_64bit)*MON_STORE_STRIDE);
+    idle_block=(double*)malloc(sizeof(double)*MON_STORE_STRIDE);
+    if(store_nodes==NULL||ts_block==NULL||idle_block==NULL){
+        free(store_nodes);
+        free(ts_block);
+        free(idle_block);
+        return -3;
+    }
+    store_node_num=mon_store_node_load(store_dir,store_nodes,MON_STORE_NODES_MAX);
+    for(i=input->nodes_on;i>0;i--){
+        snprintf(node_name,31,"compute%d",i);
+        node_id=(store_node_num>0)?mon_store_node_id(store_nodes,store_node_num,node_name):-1;
+        node_samples=0;
+        node_sum=0;
+        node_min=0;
+        if(node_id>-1){
+            row=mon_store_seek(store_dir,node_id,now-AUTOSCALE_MON_WINDOW);
+            row_total=mon_store_rows(store_dir,node_id);
+            while(row<row_total){
+                read_num=mon_store_read(store_dir,node_id,"ts",row,MON_STORE_STRIDE,ts_block);
+                if(read_num<1||mon_store_read(store_dir,node_id,"idle_cores",row,read_num,idle_block)!=read_num){
+                    break;
+                }
+                for(j=0;j<read_num&&ts_block[j]<=now;j++){
+                    if(node_samples==0||idle_block[j]<node_min){
+                        node_min=idle_block[j];
+                    }
+                    node_sum+=idle_block[j];
+                    node_samples++;
+                }
+                row+=j;
+                if(j<read_num){
+                    break;
+                }
+            }
+        }
+        if(node_samples>0){
+            idle_sum+=node_sum/node_samples;
+            sampled_num++;
+        }
+        if(tail_open==1&&node_samples>0&&node_min>=input->node_cores&&mon_store_node_id(busy_nodes,input->busy_node_num,node_name)<0){
+            input->idle_tail++;
+        }
+        else{
+            tail_open=0;
+        }
+    }
+    input->idle_cores=(int)(idle_sum+0.5);
+    free(store_nodes);
+    free(ts_block);
+    free(idle_block);
+    return sampled_num;
+}
+
+/*
+ * The hysteresis is in both the thresholds and the time. Scaling up needs
+ * pending jobs whose cores exceed the idle ones for up_delay seconds, scaling
+ * down needs an empty queue and whole idle nodes beyond reserve_cores for
+ * down_delay seconds. Any action restarts both cooldowns. The min_nodes and
+ * max_nodes bounds are enforced without the delays, but after the cooldowns.
+ * Only the state is updated here, so the policy runs without a cluster.
+ * return 0: No action
+ * return 1: An action is decided
+ */
+int autoscale_decide(autoscale_policy* policy, autoscale_state* state, autoscale_input* input, int_64bit now, autoscale_action* action){
+    int node_cores=(input->node_cores>0)?input->node_cores:1;
+    int unmet=input->pending_cores-input->idle_cores;
+    int nodes_down=input->nodes_all-input->nodes_on;
+    int count;
+    strcpy(action->action,"none");
+    action->count=0;
+    strcpy(action->reason,"steady");
+    if(input->nodes_on<policy->min_nodes&&nodes_down>0){
+        state->up_since=0;
+        state->down_since=0;
+        if(now-state->last_time<policy->up_cooldown){
+            snprintf(action->reason,127,"below min_nodes, cooling down");
+            return 0;
+        }
+        count=policy->min_nodes-input->nodes_on;
+        strcpy(action->action,"turnon");
+        action->count=(count<nodes_down)?count:nodes_down;
+        snprintf(action->reason,127,"below min_nodes %d",policy->min_nodes);
+    }
+    else if(input->nodes_on>policy->max_nodes){
+        state->up_since=0;
+        state->down_since=0;
+        if(now-state->last_time<policy->down_cooldown){
+            snprintf(action->reason,127,"above max_nodes, cooling down");
+            return 0;
+        }
+        count=input->nodes_on-policy->max_nodes;
+        strcpy(action->action,"shutdown");
+        action->count=(count<policy->max_step)?count:policy->max_step;
+        snprintf(action->reason,127,"above max_nodes %d",policy->max_nodes);
+    }
+    else if(input->pending_jobs>0&&unmet>0){
+        state->down_since=0;
+        if(state->up_since==0){
+            state->up_since=now;
+        }
+        count=(unmet+node_cores-1)/node_cores;
+        if(count>policy->max_step){
+            count=policy->max_step;
+        }
+        if(count>policy->max_nodes-input->nodes_on){
+            count=policy->max_nodes-input->nodes_on;
+        }
+        if(count<1){
+            snprintf(action->reason,127,"%d core(s) unmet, max_nodes %d reached",unmet,policy->max_nodes);
+            return 0;
+        }
+        if(now-state->up_since<policy->up_delay){
+            snprintf(action->reason,127,"%d core(s) unmet for %llds of %ds",unmet,now-state->up_since,policy->up_delay);
+            return 0;
+        }
+        if(now-state->last_time<policy->up_cooldown){
+            snprintf(action->reason,127,"%d core(s) unmet, cooling down",unmet);
+            return 0;
+        }
+        if(nodes_down>0){
+            strcpy(action->action,"turnon");
+            action->count=(count<nodes_down)?count:nodes_down;
+        }
+        else if(policy->add_nodes==1){
+            strcpy(action->action,"add");
+            action->count=count;
+        }
+        else{
+            snprintf(action->reason,127,"%d core(s) unmet, all nodes running and add_nodes off",unmet);
+            return 0;
+        }
+        snprintf(action->reason,127,"%d core(s) unmet by %d pending job(s)",unmet,input->pending_jobs);
+    }
+    else{
+        count=(input->idle_cores-policy->reserve_cores)/node_cores;
+        if(count>input->idle_tail){
+            count=input->idle_tail;
+        }
+        if(count>input->nodes_on-policy->min_nodes){
+            count=input->nodes_on-policy->min_nodes;
+        }
+        if(count>policy->max_step){
+            count=policy->max_step;
+        }
+        state->up_since=0;
+        if(input->pending_jobs>0||count<1){
+            state->down_since=0;
+            return 0;
+        }
+        if(state->down_since==0){
+            state->down_since=now;
+        }
+        if(now-state->down_since<policy->down_delay){
+            snprintf(action->reason,127,"%d node(s) idle for %llds of %ds",count,now-state->down_since,policy->down_delay);
+            return 0;
+        }
+        if(now-state->last_time<policy->down_cooldown){
+            snprintf(action->reason,127,"%d node(s) idle, cooling down",count);
+            return 0;
+        }
+        strcpy(action->action,"shutdown");
+        action->count=count;
+        snprintf(action->reason,127,"%d node(s) idle, %d idle core(s)",count,input->idle_cores);
+    }
+    state->up_since=0;
+    state->down_since=0;
+    state->last_time=now;
+    strncpy(state->last_action,action->action,15);
+    state->last_count=action->count;
+    return 1;
+}
+
+/*
+ * shutdown_compute_nodes takes the last N nodes including the down ones, so the
+ * down nodes are added to the count.
+ * echo_flag=1: print the cluster operation and its arguments instead of running it
+ * return 0: No action or the action succeeded (or echoed)
+ * return others: The return value of the cluster operation
+ */
+int autoscale_apply(char* workdir, char* crypto_keyfile, autoscale_input* input, autoscale_action* action, int echo_flag, tf_exec_config* tf_run){
+    char num_string[16]="";
+    if(strcmp(action->action,"turnon")==0){
+        snprintf(num_string,15,"%d",action->count);
+        if(echo_flag==1){
+            printf("[  ****  ] turn_on_compute_nodes param=\"%s\" batch_flag_local=0\n",num_string);
+            return 0;
+        }
+        return turn_on_compute_nodes(workdir,crypto_keyfile,num_string,0,tf_run);
+    }
+    else if(strcmp(action->action,"shutdown")==0){
+        snprintf(num_string,15,"%d",input->nodes_all-input->nodes_on+action->count);
+        if(echo_flag==1){
+            printf("[  ****  ] shutdown_compute_nodes param=\"%s\" batch_flag_local=0\n",num_string);
+            return 0;
+        }
+        return shutdown_compute_nodes(workdir,crypto_keyfile,num_string,0,tf_run);
+    }
+    else if(strcmp(action->action,"add")==0){
+        snprintf(num_string,15,"%d",action->count);
+        if(echo_flag==1){
+            printf("[  ****  ] add_compute_node add_number_string=\"%s\" pool_flag=1\n",num_string);
+            return 0;
+        }
+        return add_compute_node(workdir,crypto_keyfile,num_string,1,tf_run);
+    }
+    return 0;
+}
+
+/*
+ * One round of the autoscaler. With a queue_file, the queue is simulated and
+ * the local monitor data is used as is, nothing is fetched from the cluster.
+ * dry_flag=0: decide and echo the action without running it. The dry rounds keep
+ *            their own state file, so they never move the delays and cooldowns
+ *            of the live autoscaler.
+ * return -1: Failed to get the cluster or the queue
+ * return -3: Failed to allocate memory
+ * return -5: The cluster is locked by another operation, skipped
+ * return others: The return value of autoscale_apply
+ */
+int autoscale_once(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* queue_file, int dry_flag, tf_exec_config* tf_run){
+    char cluster_name[CLUSTER_ID_LENGTH_MAX_PLUS]="";
+    char stackdir[DIR_LENGTH]="";
+    char conf_file[FILENAME_LENGTH]="";
+    char state_file[FILENAME_LENGTH]="";
+    char dry_state_file[FILENAME_LENGTH]="";
+    char log_file[FILENAME_LENGTH]="";
+    char queue_real[FILENAME_LENGTH]="";
+    char mon_data_file[FILENAME_LENGTH]="";
+    char store_dir[FILENAME_LENGTH]="";
+    char cores_string[8]="";
+    char (*busy_nodes)[32]=NULL;
+    autoscale_policy policy;
+    autoscale_state state;
+    autoscale_input input;
+    autoscale_action action;
+    int_64bit now;
+    int run_flag=0;
+    FILE* file_p=NULL;
+    if(get_cluster_nname(cluster_name,CLUSTER_ID_LENGTH_MAX_PLUS,workdir)!=0||autoscale_files(workdir,conf_file,state_file,log_file,FILENAME_LENGTH)!=0){
+        return -1;
+    }
+    if(check_pslock(workdir,decryption_status(workdir))!=0){
+        printf(WARN_YELLO_BOLD "[ -WARN- ] The cluster is currently locked (operation-in-progress). Skipped this round." RESET_DISPLAY "\n");
+        return -5;
+    }
+    autoscale_conf(conf_file,&policy);
+    if(dry_flag==0){
+        strncpy(dry_state_file,state_file,FILENAME_LENGTH-9);
+        strcat(dry_state_file,".dryrun");
+        /* The first dry round starts from the live state */
+        if(autoscale_state_read(dry_state_file,&state)!=0){
+            autoscale_state_read(state_file,&state);
+        }
+        strcpy(state_file,dry_state_file);
+    }
+    else{
+        autoscale_state_read(state_file,&state);
+    }
+    memset(&input,0,sizeof(autoscale_input));
+    create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH);
+    decrypt_files(workdir,crypto_keyfile);
+    getstate(workdir,crypto_keyfile);
+    delete_decrypted_files(workdir,crypto_keyfile);
+    input.nodes_all=get_compute_node_num(stackdir,crypto_keyfile,"all");
+    input.nodes_on=get_compute_node_num(stackdir,crypto_keyfile,"on");
+    get_state_nvalue(workdir,crypto_keyfile,"compute_node_cores:",cores_string,8);
+    input.node_cores=string_to_positive_num(cores_string);
+    if(input.nodes_all<0||input.nodes_on<0){
+        return -1;
+    }
+    if(strlen(queue_file)==0){
+        mk_pdir(NOW_TMP_DIR);
+        snprintf(queue_real,FILENAME_LENGTH-1,"%s%sautoscale_queue_%s.txt",NOW_TMP_DIR,PATH_SLASH,cluster_name);
+        rm_file_or_dir(queue_real);
+        /* An empty queue would read as no running jobs, so a failed query must not reach the decision. */
+        if(remote_exec_general(workdir,crypto_keyfile,sshkey_dir,"root","squeue -h -o '%T|%C|%N'","",0,3,queue_real,NULL_STREAM)!=0){
+            printf(FATAL_RED_BOLD "[ FATAL: ] Failed to get the Slurm queue of the cluster %s. Skipped this round." RESET_DISPLAY "\n",cluster_name);
+            rm_file_or_dir(queue_real);
+            return -1;
+        }
+        if(get_cluster_mon_data(cluster_name,crypto_keyfile,sshkey_dir,mon_data_file)!=0){
+            snprintf(mon_data_file,FILENAME_LENGTH-1,"%s%smon_data_%s.csv",NOW_MON_DIR,PATH_SLASH,cluster_name);
+        }
+    }
+    else{
+        strncpy(queue_real,queue_file,FILENAME_LENGTH-1);
+        snprintf(mon_data_file,FILENAME_LENGTH-1,"%s%smon_data_%s.csv",NOW_MON_DIR,PATH_SLASH,cluster_name);
+    }
+    busy_nodes=(char (*)[32])malloc(sizeof(char)*32*MON_STORE_NODES_MAX);
+    if(busy_nodes==NULL){
+        return -3;
+    }
+    if(autoscale_queue_parse(queue_real,&input,busy_nodes,MON_STORE_NODES_MAX)<0){
+        printf(FATAL_RED_BOLD "[ FATAL: ] Failed to get the Slurm queue of the cluster %s." RESET_DISPLAY "\n",cluster_name);
+        free(busy_nodes);
+        return -1;
+    }
+    if(strlen(queue_file)==0){
+        rm_file_or_dir(queue_real);
+    }
+    mon_store_dir(cluster_name,store_dir,FILENAME_LENGTH);
+    mon_store_update(mon_data_file,store_dir);
+    now=(int_64bit)time(NULL);
+    if(autoscale_idle_load(store_dir,now,busy_nodes,&input)<1&&input.nodes_on>0){
+        printf(WARN_YELLO_BOLD "[ -WARN- ] No recent monitor data, the running nodes are taken as busy." RESET_DISPLAY "\n");
+    }
+    free(busy_nodes);
+    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Queue: " HIGH_CYAN_BOLD "%d" RESET_DISPLAY " pending job(s), " HIGH_CYAN_BOLD "%d" RESET_DISPLAY " core(s). Nodes: %d/%d running, %d idle core(s).\n",input.pending_jobs,input.pending_cores,input.nodes_on,input.nodes_all,input.idle_cores);
+    if(autoscale_decide(&policy,&state,&input,now,&action)==0){
+        printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " No action: %s.\n",action.reason);
+    }
+    else if(dry_flag==0){
+        printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Dry run: " HIGH_GREEN_BOLD "%s %d" RESET_DISPLAY " node(s), %s.\n",action.action,action.count,action.reason);
+        autoscale_apply(workdir,crypto_keyfile,&input,&action,1,tf_run);
+    }
+    else{
+        printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Autoscaling: " HIGH_GREEN_BOLD "%s %d" RESET_DISPLAY " node(s), %s.\n",action.action,action.count,action.reason);
+        run_flag=autoscale_apply(workdir,crypto_keyfile,&input,&action,0,tf_run);
+        if(run_flag!=0){
+            printf(WARN_YELLO_BOLD "[ -WARN- ] The autoscaling action failed (%d). Retry after the cooldown." RESET_DISPLAY "\n",run_flag);
+        }
+    }
+    if(autoscale_state_write(state_file,&state)!=0){
+        printf(WARN_YELLO_BOLD "[ -WARN- ] Failed to save the autoscaling state." RESET_DISPLAY "\n");
+    }
+    file_p=fopen(log_file,"a+");
+    if(file_p!=NULL){
+        fprintf(file_p,"%lld,%d,%d,%d,%d,%d,%s,%d,%s,%d,%s\n",now,input.pending_jobs,input.pending_cores,input.idle_cores,input.nodes_on,input.nodes_all,action.action,action.count,(dry_flag==0)?"dry_run":"applied",run_flag,action.reason);
+        fclose(file_p);
+    }
+    return run_flag;
+}
+
+/*
+ * Only one autoscale loop per cluster. The pid of the loop is kept in the conf
+ * subdir, a stale pid (the loop was killed) doesn't hold the lock.
+ * Windows has no kill(pid,0), the lock is for Linux/Darwin.
+ * return -1: Failed to get or write the pid file
+ * return 1: Another loop is running, its pid is in loop_pid
+ * return 0: Locked by this process
+ */
+int autoscale_loop_lock(char* workdir, int* loop_pid){
+    *loop_pid=0;
+#ifdef _WIN32
+    return 0;
+#else
+    char confdir[DIR_LENGTH]="";
+    char pid_file[FILENAME_LENGTH]="";
+    FILE* file_p=NULL;
+    int pid=0;
+    if(create_and_get_subdir(workdir,"conf",confdir,DIR_LENGTH)!=0){
+        return -1;
+    }
+    snprintf(pid_file,FILENAME_LENGTH-1,"%s%sautoscale.pid",confdir,PATH_SLASH);
+    file_p=fopen(pid_file,"r");
+    if(file_p!=NULL){
+        if(fscanf(file_p,"%d",&pid)!=1){
+            pid=0;
+        }
+        fclose(file_p);
+    }
+    if(pid>0&&pid!=(int)getpid()&&kill(pid,0)==0){
+        *loop_pid=pid;
+        return 1;
+    }
+    file_p=fopen(pid_file,"w+");
+    if(file_p==NULL){
+        return -1;
+    }
+    fprintf(file_p,"%d\n",(int)getpid());
+    fclose(file_p);
+    return 0;
+#endif
+}
+
+/*
+ * loop_flag=0: run a round every interval seconds until killed
+ * dry_flag=0 : decide and record the actions without running them
+ * return -7: Another autoscale loop is running for the cluster
+ * return others: The return value of the last round
+ */
+int autoscale(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* queue_file, int dry_flag, int loop_flag, char* interval_string, tf_exec_config* tf_run){
+    int interval=string_to_positive_num(interval_string);
+    int run_flag=0;
+    int loop_pid=0;
+    if(interval<1){
+        interval=AUTOSCALE_INTERVAL;
+    }
+    else if(interval<AUTOSCALE_INTERVAL_MIN){
+        interval=AUTOSCALE_INTERVAL_MIN;
+    }
+    if(loop_flag==0){
+        run_flag=autoscale_loop_lock(workdir,&loop_pid);
+        if(run_flag==1){
+            printf(FATAL_RED_BOLD "[ FATAL: ] Another autoscale loop (PID: %d) is running for this cluster." RESET_DISPLAY "\n",loop_pid);
+            return -7;
+        }
+        else if(run_flag!=0){
+            printf(FATAL_RED_BOLD "[ FATAL: ] Failed to lock the autoscale loop of this cluster." RESET_DISPLAY "\n");
+            return -7;
+        }
+        printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Autoscaling every %d seconds. Press Ctrl+C to stop.\n",interval);
+    }
+    while(1){
+        if(cluster_asleep_or_not(workdir,crypto_keyfile)==0){
+            printf(WARN_YELLO_BOLD "[ -WARN- ] The cluster is not running. Skipped this round." RESET_DISPLAY "\n");
+            run_flag=-1;
+        }
+        else{
+            run_flag=autoscale_once(workdir,crypto_keyfile,sshkey_dir,queue_file,dry_flag,tf_run);
+        }
+        if(loop_flag!=0){
+            break;
+        }
+        sleep_func(interval);
+    }
+    return run_flag;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+ * This code is distributed under the license: MIT License
+ * Originally written by Zhenrong WANG
+ * mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+ */
+
+#ifndef AUTOSCALE_H
+#define AUTOSCALE_H
+
+typedef struct{
+    int min_nodes;                      /* Running compute nodes kept at least */
+    int max_nodes;                      /* Compute nodes (running or down) at most, including the added ones */
+    int max_step;                       /* Nodes changed by a single action */
+    int up_delay;                       /* Seconds the unmet demand lasts before scaling up */
+    int down_delay;                     /* Seconds the idle nodes last before scaling down */
+    int up_cooldown;                    /* Seconds after an action before the next scale up */
+    int down_cooldown;                  /* Seconds after an action before the next scale down */
+    int reserve_cores;                  /* Idle cores kept when scaling down */
+    int add_nodes;                      /* 1: add new nodes once all the nodes are running */
+} autoscale_policy;
+
+typedef struct{
+    int_64bit up_since;                 /* Epoch seconds the unmet demand started, 0 means none */
+    int_64bit down_since;               /* Epoch seconds the idle nodes started, 0 means none */
+    int_64bit last_time;                /* Epoch seconds of the last action */
+    char last_action[16];
+    int last_count;
+} autoscale_state;
+
+typedef struct{
+    int pending_jobs;
+    int pending_cores;
+    int busy_node_num;                  /* Nodes with running jobs, in the queue */
+    int nodes_all;
+    int nodes_on;
+    int node_cores;
+    int idle_cores;                     /* Idle cores of the running nodes, from the monitor data */
+    int idle_tail;                      /* Trailing running nodes without jobs and fully idle */
+} autoscale_input;
+
+typedef struct{
+    char action[16];                    /* none, turnon, shutdown or add */
+    int count;                          /* Nodes to be changed */
+    char reason[128];
+} autoscale_action;
+
+int autoscale_files(char* workdir, char* conf_file, char* state_file, char* log_file, unsigned int maxlen);
+int autoscale_conf(char* conf_file, autoscale_policy* policy);
+int autoscale_state_read(char* state_file, autoscale_state* state);
+int autoscale_state_write(char* state_file, autoscale_state* state);
+int autoscale_queue_parse(char* queue_file, autoscale_input* input, char (*busy_nodes)[32], int max_num);
+int autoscale_idle_load(char* store_dir, int_64bit now, char (*busy_nodes)[32], autoscale_input* input);
+int autoscale_decide(autoscale_policy* policy, autoscale_state* state, autoscale_input* input, int_64bit now, autoscale_action* action);
+int autoscale_apply(char* workdir, char* crypto_keyfile, autoscale_input* input, autoscale_action* action, int echo_flag, tf_exec_config* tf_run);
+int autoscale_once(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* queue_file, int dry_run, tf_exec_config* tf_run);
+int autoscale_loop_lock(char* workdir, int* loop_pid);
+int autoscale(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* queue_file, int dry_run, int loop_flag, char* interval_string, tf_exec_config* tf_run);
+
+#endif
@@ -0,0 +1,584 @@
+/*
+ * Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+ * This code is distributed under the license: MIT License
+ * Originally written by Zhenrong WANG
+ * mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+ */
+
+/*
+ * The local listing index of the cluster bucket, kept in the conf dir of the
+ * workdir with the native engine (s3_engine.c). Three files:
+ * bucket_index.dat  : the objects sorted by the keys, one per line in the format
+ *                     of s3_list_objects: SIZE ETAG LAST_MODIFIED KEY
+ * bucket_index.idx  : R EPOCH /PREFIX lines, the prefixes listed from the bucket
+ *                     and when, then S OFFSET KEY lines, the offset in the .dat
+ *                     of every BUCKET_INDEX_STRIDE-th object
+ * bucket_index.delta: the changes made by hpcopr since the last merge, + LINE
+ *                     for a new object, - KEY for a deleted one
+ * A prefix is refreshed (listed and merged) only if no R line covers it within
+ * the index_ttl of S3_ENGINE_CONF. The changes made through the vendor CLIs
+ * invalidate the R lines of the prefixes they touch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "now_macros.h"
+#include "general_funcs.h"
+#include "time_process.h"
+#include "cluster_general_funcs.h"
+#include "s3_engine.h"
+#include "bucket_index.h"
+
+/*
+ * The base path of the index files, without the suffixes.
+ * return -1: failed to get the conf dir
+ * return 0: normal exit
+ */
+int bucket_index_base(char* workdir, char* index_base, unsigned int maxlen){
+    char confdir[DIR_LENGTH]="";
+    if(create_and_get_subdir(workdir,"conf",confdir,DIR_LENGTH)!=0){
+        return -1;
+    }
+    snprintf(index_base,maxlen-1,"%s%sbucket_index",confdir,PATH_SLASH);
+    return 0;
+}
+
+/*
+ * The key of a line SIZE ETAG LAST_MODIFIED KEY.
+ * return NULL: invalid line
+ */
+char* bucket_index_line_key(char* line){
+    char* key=line;
+    int i;
+    for(i=0;i<3&&key!=NULL;i++){
+        key=strchr(key,' ');
+        if(key!=NULL){
+            key++;
+        }
+    }
+    if(key==NULL||*key=='\0'){
+        return NULL;
+    }
+    return key;
+}
+
+/* For qsort: by the keys, then by the loading order. */
+int bucket_index_entry_cmp(const void* entry_a, const void* entry_b){
+    const bucket_index_entry* a=(const bucket_index_entry*)entry_a;
+    const bucket_index_entry* b=(const bucket_index_entry*)entry_b;
+    int result=strcmp(a->key,b->key);
+    if(result!=0){
+        return result;
+    }
+    return a->seq-b->seq;
+}
+
+/*
+ * Append the lines of a file to the entries. delta_flag 1: the file is a delta
+ * file. The keys starting with the skip_prefix are skipped, NULL skips nothing.
+ * The lines point into the new *buffer, the caller frees it after the entries.
+ * return -1: memory error
+ * return 1: the file doesn't exist
+ * return 0: normal exit
+ */
+int bucket_index_load(char* filename, int delta_flag, char* skip_prefix, bucket_index_entry** entries, int* entry_num, int* entry_max, char** buffer){
+    char* data=NULL;
+    char* next=NULL;
+    char* line=NULL;
+    char* key=NULL;
+    bucket_index_entry* new_entries=NULL;
+    *buffer=NULL;
+    if(file_exist_or_not(filename)!=0){
+        return 1;
+    }
+    *buffer=s3_file_to_buffer(filename);
+    if(*buffer==NULL){
+        return -1;
+    }
+    data=*buffer;
+    while(data!=NULL&&*data!='\0'){
+        next=strchr(data,'\n');
+        if(next!=NULL){
+            *next='\0';
+            next++;
+        }
+        line=data;
+        if(delta_flag==1){
+            if(strncmp(data,"- ",2)==0){
+                line=NULL;
+                key=data+2;
+            }
+            else if(strncmp(data,"+ ",2)==0){
+                line=data+2;
+                key=bucket_index_line_key(line);
+            }
+            else{
+                key=NULL;
+            }
+        }
+        else{
+            key=bucket_index_line_key(line);
+        }
+        data=next;
+        if(key==NULL||*key=='\0'||(line!=NULL&&*line=='-')){
+            continue;
+        }
+        if(skip_prefix!=NULL&&strncmp(key,skip_prefix,strlen(skip_prefix))==0){
+            continue;
+        }
+        if(*entry_num==*entry_max){
+            new_entries=(bucket_index_entry*)realloc(*entries,(*entry_max*2+1024)*sizeof(bucket_index_entry));
+            if(new_entries==NULL){
+                return -1;
+            }
+            *entries=new_entries;
+            *entry_max=*entry_max*2+1024;
+        }
+        (*entries)[*entry_num].line=line;
+        (*entries)[*entry_num].key=key;
+        (*entries)[*entry_num].seq=*entry_num;
+        (*entry_num)++;
+    }
+    return 0;
+}
+
+/*
+ * Keep the last entry of each key of the sorted entries, and drop the deleted
+ * ones unless keep_deleted is 1.
+ * return N: the number of the entries left
+ */
+int bucket_index_compact(bucket_index_entry* entries, int entry_num, int keep_deleted){
+    int i,j=0;
+    for(i=0;i<entry_num;i++){
+        if(i+1<entry_num&&strcmp(entries[i].key,entries[i+1].key)==0){
+            continue;
+        }
+        if(entries[i].line==NULL&&keep_deleted!=1){
+            continue;
+        }
+        entries[j]=entries[i];
+        j++;
+    }
+    return j;
+}
+
+/*
+ * Write the sorted and compacted entries to the .dat and the .idx files. The
+ * R lines are kept, except the ones covered by the refresh_prefix, which gets a
+ * new one. refresh_prefix NULL: no refresh. The delta file is removed.
+ * return -1: failed to write
+ * return 0: normal exit
+ */
+int bucket_index_write(char* index_base, bucket_index_entry* entries, int entry_num, char* refresh_prefix){
+    char dat_file[FILENAME_LENGTH]="";
+    char idx_file[FILENAME_LENGTH]="";
+    char tmp_dat[FILENAME_LENGTH]="";
+    char tmp_idx[FILENAME_LENGTH]="";
+    char line_buffer[FILENAME_LENGTH_EXT]="";
+    char record_prefix[FILENAME_LENGTH]="";
+    long long record_epoch;
+    int_64bit offset=0;
+    int i;
+    FILE* idx_old=NULL;
+    FILE* dat_p=NULL;
+    FILE* idx_p=NULL;
+    snprintf(dat_file,FILENAME_LENGTH-1,"%s.dat",index_base);
+    snprintf(idx_file,FILENAME_LENGTH-1,"%s.idx",index_base);
+    snprintf(tmp_dat,FILENAME_LENGTH-1,"%s.dat.tmp",index_base);
+    snprintf(tmp_idx,FILENAME_LENGTH-1,"%s.idx.tmp",index_base);
+    dat_p=fopen(tmp_dat,"wb");
+    idx_p=fopen(tmp_idx,"wb");
+    if(dat_p==NULL||idx_p==NULL){
+        if(dat_p!=NULL){
+            fclose(dat_p);
+        }
+        if(idx_p!=NULL){
+            fclose(idx_p);
+        }
+        return -1;
+    }
+    idx_old=fopen(idx_file,"r");
+    if(idx_old!=NULL){
+        while(fngetline(idx_old,line_buffer,FILENAME_LENGTH_EXT)!=1){
+            strcpy(record_prefix,"");
+            if(line_buffer[0]!='R'||sscanf(line_buffer,"R %lld /%511[^\n]",&record_epoch,record_prefix)<1){
+                continue;
+            }
+            if(refresh_prefix!=NULL&&strncmp(record_prefix,refresh_prefix,strlen(refresh_prefix))==0){
+                continue;
+            }
+            fprintf(idx_p,"%s\n",line_buffer);
+        }
+        fclose(idx_old);
+    }
+    if(refresh_prefix!=NULL){
+        fprintf(idx_p,"R %lld /%s\n",(long long)time(NULL),refresh_prefix);
+    }
+    for(i=0;i<entry_num;i++){
+        if(i%BUCKET_INDEX_STRIDE==0){
+            fprintf(idx_p,"S %lld %s\n",(long long)offset,entries[i].key);
+        }
+        fprintf(dat_p,"%s\n",entries[i].line);
+        offset+=strlen(entries[i].line)+1;
+    }
+    fclose(dat_p);
+    fclose(idx_p);
+    rm_file_or_dir(dat_file);
+    rm_file_or_dir(idx_file);
+    if(rename(tmp_dat,dat_file)!=0||rename(tmp_idx,idx_file)!=0){
+        rm_file_or_dir(tmp_dat);
+        rm_file_or_dir(tmp_idx);
+        return -1;
+    }
+    snprintf(dat_file,FILENAME_LENGTH-1,"%s.delta",index_base);
+    rm_file_or_dir(dat_file);
+    return 0;
+}
+
+/*
+ * Merge the delta file, and the list_file (a fresh listing of the
+ * refresh_prefix) if not NULL, into the .dat file.
+ * return -1: failed
+ * return 0: normal exit
+ */
+int bucket_index_merge(char* index_base, char* list_file, char* refresh_prefix){
+    char dat_file[FILENAME_LENGTH]="";
+    char delta_file[FILENAME_LENGTH]="";
+    char* dat_buffer=NULL;
+    char* delta_buffer=NULL;
+    char* list_buffer=NULL;
+    bucket_index_entry* entries=NULL;
+    int entry_num=0,entry_max=0,run_flag=0;
+    snprintf(dat_file,FILENAME_LENGTH-1,"%s.dat",index_base);
+    snprintf(delta_file,FILENAME_LENGTH-1,"%s.delta",index_base);
+    if(bucket_index_load(dat_file,0,refresh_prefix,&entries,&entry_num,&entry_max,&dat_buffer)<0||bucket_index_load(delta_file,1,refresh_prefix,&entries,&entry_num,&entry_max,&delta_buffer)<0){
+        run_flag=-1;
+        goto free_and_exit;
+    }
+    if(list_file!=NULL&&bucket_index_load(list_file,0,NULL,&entries,&entry_num,&entry_max,&list_buffer)!=0){
+        run_flag=-1;
+        goto free_and_exit;
+    }
+    if(entry_num>0){
+        qsort(entries,entry_num,sizeof(bucket_index_entry),bucket_index_entry_cmp);
+    }
+    entry_num=bucket_index_compact(entries,entry_num,0);
+    run_flag=bucket_index_write(index_base,entries,entry_num,refresh_prefix);
+free_and_exit:
+    free(entries);
+    free(dat_buffer);
+    free(delta_buffer);
+    free(list_buffer);
+    return run_flag;
+}
+
+/*
+ * List the prefix from the bucket (all the levels) and merge it into the index.
+ * return -1: failed to merge
+ * return 1: failed to list
+ * return 0: normal exit
+ */
+int bucket_index_refresh(s3_target* target, char* index_base, char* prefix){
+    char list_file[FILENAME_LENGTH]="";
+    char randstr[7]="";
+    int run_flag;
+    trace_span span;
+    trace_span_start(&span,"bucket_index_refresh");
+    generate_random_nstring(randstr,7,1);
+    snprintf(list_file,FILENAME_LENGTH-1,"%ss3_%s.idx",NOW_TMP_DIR,randstr);
+    if(s3_list_objects(target,prefix,0,list_file)!=0){
+        rm_file_or_dir(list_file);
+        trace_span_end(&span,1);
+        return 1;
+    }
+    run_flag=bucket_index_merge(index_base,list_file,prefix);
+    rm_file_or_dir(list_file);
+    trace_span_end(&span,run_flag);
+    return run_flag;
+}
+
+/*
+ * Whether the prefix is covered by a refresh within the ttl (seconds).
+ * return 1: not fresh, or the ttl is 0 (the index is disabled)
+ * return 0: fresh
+ */
+int bucket_index_fresh(char* index_base, char* prefix, int ttl){
+    char idx_file[FILENAME_LENGTH]="";
+    char line_buffer[FILENAME_LENGTH_EXT]="";
+    char record_prefix[FILENAME_LENGTH]="";
+    long long record_epoch;
+    long long now_epoch=(long long)time(NULL);
+    int scan_num;
+    FILE* file_p=NULL;
+    if(ttl<1){
+        return 1;
+    }
+    snprintf(idx_file,FILENAME_LENGTH-1,"%s.idx",index_base);
+    file_p=fopen(idx_file,"r");
+    if(file_p==NULL){
+        return 1;
+    }
+    while(fngetline(file_p,line_buffer,FILENAME_LENGTH_EXT)!=1){
+        if(line_buffer[0]!='R'){
+            break;
+        }
+        strcpy(record_prefix,"");
+        scan_num=sscanf(line_buffer,"R %lld /%511[^\n]",&record_epoch,record_prefix);
+        if(scan_num<1||record_epoch+ttl<now_epoch||record_epoch>now_epoch){
+            continue;
+        }
+        if(strncmp(prefix,record_prefix,strlen(record_prefix))==0){
+            fclose(file_p);
+            return 0;
+        }
+    }
+    fclose(file_p);
+    return 1;
+}
+
+/*
+ * Drop the R lines overlapping the prefix, so that the next ls/rm under it
+ * lists the bucket again. The prefix "" drops all of them.
+ * return -1: failed to write
+ * return 0: normal exit
+ */
+int bucket_index_invalidate(char* index_base, char* prefix){
+    char idx_file[FILENAME_LENGTH]="";
+    char tmp_idx[FILENAME_LENGTH]="";
+    char line_buffer[FILENAME_LENGTH_EXT]="";
+    char record_prefix[FILENAME_LENGTH]="";
+    long long record_epoch;
+    FILE* idx_old=NULL;
+    FILE* idx_p=NULL;
+    snprintf(idx_file,FILENAME_LENGTH-1,"%s.idx",index_base);
+    snprintf(tmp_idx,FILENAME_LENGTH-1,"%s.idx.tmp",index_base);
+    idx_old=fopen(idx_file,"r");
+    if(idx_old==NULL){
+        return 0;
+    }
+    idx_p=fopen(tmp_idx,"wb");
+    if(idx_p==NULL){
+        fclose(idx_old);
+        return -1;
+    }
+    while(fngetline(idx_old,line_buffer,FILENAME_LENGTH_EXT)!=1){
+        if(line_buffer[0]=='R'){
+            strcpy(record_prefix,"");
+            sscanf(line_buffer,"R %lld /%511[^\n]",&record_epoch,record_prefix);
+            if(strncmp(record_prefix,prefix,strlen(prefix))==0||strncmp(prefix,record_prefix,strlen(record_prefix))==0){
+                continue;
+            }
+        }
+        fprintf(idx_p,"%s\n",line_buffer);
+    }
+    fclose(idx_old);
+    fclose(idx_p);
+    rm_file_or_dir(idx_file);
+    if(rename(tmp_idx,idx_file)!=0){
+        rm_file_or_dir(tmp_idx);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Append a change to the delta file, option put: a line SIZE ETAG
+ * LAST_MODIFIED KEY, delete: a key. The delta is merged into the .dat file
+ * once larger than BUCKET_INDEX_DELTA_MAX.
+ * return -3: invalid option
+ * return -1: failed to write
+ * return 0: normal exit
+ */
+int bucket_index_record(char* index_base, char* option, char* line_or_key){
+    char delta_file[FILENAME_LENGTH]="";
+    int_64bit delta_size;
+    long long delta_mtime;
+    FILE* file_p=NULL;
+    if(strcmp(option,"put")!=0&&strcmp(option,"delete")!=0){
+        return -3;
+    }
+    snprintf(delta_file,FILENAME_LENGTH-1,"%s.delta",index_base);
+    file_p=fopen(delta_file,"a");
+    if(file_p==NULL){
+        return -1;
+    }
+    fprintf(file_p,"%s %s\n",(strcmp(option,"put")==0)?"+":"-",line_or_key);
+    fclose(file_p);
+    if(get_file_size_mtime(delta_file,&delta_size,&delta_mtime)==0&&delta_size>BUCKET_INDEX_DELTA_MAX){
+        return bucket_index_merge(index_base,NULL,NULL);
+    }
+    return 0;
+}
+
+/*
+ * Record an object written by the engine. With an empty etag, the size and the
+ * etag come from a HEAD request; if that fails, the prefix is invalidated.
+ * return -1: failed to record
+ * return 0: normal exit
+ */
+int bucket_index_record_object(s3_target* target, char* index_base, char* key, int_64bit size, char* etag){
+    char line_buffer[FILENAME_LENGTH_EXT]="";
+    char object_etag[80]="";
+    char last_modified[64]="";
+    int_64bit object_size=size;
+    time_t now_time=time(NULL);
+    strncpy(object_etag,etag,79);
+    if(strlen(object_etag)==0&&s3_head_object(target,key,&object_size,object_etag,80)!=0){
+        return bucket_index_invalidate(index_base,key);
+    }
+    strftime(last_modified,63,"%Y-%m-%dT%H:%M:%S.000Z",gmtime(&now_time));
+    snprintf(line_buffer,FILENAME_LENGTH_EXT-1,"%lld %s %s %s",(long long)object_size,object_etag,last_modified,key);
+    return bucket_index_record(index_base,"put",line_buffer);
+}
+
+/*
+ * Write an object under the prefix to the list_file. delimiter_flag 1: the
+ * deeper objects are folded into the -1 - - SUBFOLDER/ lines, once each; the
+ * last_folder keeps the previous one.
+ */
+void bucket_index_emit(FILE* list_p, char* line, char* key, char* prefix, int delimiter_flag, char* last_folder, unsigned int folder_len){
+    char* slash=NULL;
+    unsigned int length;
+    if(delimiter_flag==1){
+        slash=strchr(key+strlen(prefix),'/');
+    }
+    if(slash==NULL){
+        fprintf(list_p,"%s\n",line);
+        return;
+    }
+    length=slash-key+1;
+    if(length>=folder_len||(strncmp(last_folder,key,length)==0&&last_folder[length]=='\0')){
+        return;
+    }
+    strncpy(last_folder,key,length);
+    last_folder[length]='\0';
+    fprintf(list_p,"-1 - - %s\n",last_folder);
+}
+
+/*
+ * Write the objects under the prefix from the index to the list_file, in the
+ * format of s3_list_objects. The .dat file is read from the offset of the last
+ * S line not after the prefix, and joined with the delta.
+ * return -1: failed to read the index or to create the list_file
+ * return 0: normal exit
+ */
+int bucket_index_scan(char* index_base, char* prefix, int delimiter_flag, char* list_file){
+    char dat_file[FILENAME_LENGTH]="";
+    char idx_file[FILENAME_LENGTH]="";
+    char delta_file[FILENAME_LENGTH]="";
+    char line_buffer[FILENAME_LENGTH_EXT]="";
+    char last_folder[FILENAME_LENGTH]="";
+    char* delta_buffer=NULL;
+    char* key=NULL;
+    char* offset_key=NULL;
+    long long offset,start_offset=0;
+    unsigned int prefix_len=strlen(prefix);
+    int entry_num=0,entry_max=0,delta_pos=0,replaced,result;
+    bucket_index_entry* entries=NULL;
+    FILE* idx_p=NULL;
+    FILE* dat_p=NULL;
+    FILE* list_p=NULL;
+    snprintf(dat_file,FILENAME_LENGTH-1,"%s.dat",index_base);
+    snprintf(idx_file,FILENAME_LENGTH-1,"%s.idx",index_base);
+    snprintf(delta_file,FILENAME_LENGTH-1,"%s.delta",index_base);
+    if(bucket_index_load(delta_file,1,NULL,&entries,&entry_num,&entry_max,&delta_buffer)<0){
+        free(entries);
+        free(delta_buffer);
+        return -1;
+    }
+    if(entry_num>0){
+        qsort(entries,entry_num,sizeof(bucket_index_entry),bucket_index_entry_cmp);
+    }
+    entry_num=bucket_index_compact(entries,entry_num,1);
+    while(delta_pos<entry_num&&strcmp(entries[delta_pos].key,prefix)<0){
+        delta_pos++;
+    }
+    idx_p=fopen(idx_file,"r");
+    if(idx_p!=NULL){
+        while(fngetline(idx_p,line_buffer,FILENAME_LENGTH_EXT)!=1){
+            if(line_buffer[0]!='S'||sscanf(line_buffer,"S %lld",&offset)!=1){
+                continue;
+            }
+            offset_key=strchr(line_buffer+2,' ');
+            if(offset_key==NULL||strcmp(offset_key+1,prefix)>0){
+                break;
+            }
+            start_offset=offset;
+        }
+        fclose(idx_p);
+    }
+    dat_p=fopen(dat_file,"rb");
+    list_p=fopen(list_file,"w+");
+    if(list_p==NULL){
+        if(dat_p!=NULL){
+            fclose(dat_p);
+        }
+        free(entries);
+        free(delta_buffer);
+        return -1;
+    }
+    if(dat_p!=NULL){
+        fseek_byte(dat_p,start_offset);
+        while(fngetline(dat_p,line_buffer,FILENAME_LENGTH_EXT)!=1){
+            key=bucket_index_line_key(line_buffer);
+            if(key==NULL){
+                continue;
+            }
+            result=strncmp(key,prefix,prefix_len);
+            if(result<0){
+                continue;
+            }
+            if(result>0){
+                break;
+            }
+            /* The delta entries before this key, and the one replacing it. */
+            replaced=0;
+            while(delta_pos<entry_num&&strncmp(entries[delta_pos].key,prefix,prefix_len)==0&&strcmp(entries[delta_pos].key,key)<=0){
+                replaced=(strcmp(entries[delta_pos].key,key)==0)?1:0;
+                if(entries[delta_pos].line!=NULL){
+                    bucket_index_emit(list_p,entries[delta_pos].line,entries[delta_pos].key,prefix,delimiter_flag,last_folder,FILENAME_LENGTH);
+                }
+                delta_pos++;
+            }
+            if(replaced==0){
+                bucket_index_emit(list_p,line_buffer,key,prefix,delimiter_flag,last_folder,FILENAME_LENGTH);
+            }
+        }
+        fclose(dat_p);
+    }
+    while(delta_pos<entry_num&&strncmp(entries[delta_pos].key,prefix,prefix_len)==0){
+        if(entries[delta_pos].line!=NULL){
+            bucket_index_emit(list_p,entries[delta_pos].line,entries[delta_pos].key,prefix,delimiter_flag,last_folder,FILENAME_LENGTH);
+        }
+        delta_pos++;
+    }
+    fclose(list_p);
+    free(entries);
+    free(delta_buffer);
+    return 0;
+}
+
+/*
+ * Binary search of a key in the sorted and compacted entries.
+ * return NULL: not found
+ */
+bucket_index_entry* bucket_index_find(bucket_index_entry* entries, int entry_num, char* key){
+    int low=0,high=entry_num-1,middle,result;
+    while(low<=high){
+        middle=low+(high-low)/2;
+        result=strcmp(entries[middle].key,key);
+        if(result==0){
+            return entries+middle;
+        }
+        if(result<0){
+            low=middle+1;
+        }
+        else{
+            high=middle-1;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+ * This code is distributed under the license: MIT License
+ * Originally written by Zhenrong WANG
+ * mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+ */
+
+#ifndef BUCKET_INDEX_H
+#define BUCKET_INDEX_H
+
+typedef struct{
+    char* line;     /* SIZE ETAG LAST_MODIFIED KEY as s3_list_objects writes, NULL for a deleted key */
+    char* key;      /* Points into the line, or the key of a deleted one */
+    int seq;        /* The loading order, the later one wins */
+} bucket_index_entry;
+
+int bucket_index_base(char* workdir, char* index_base, unsigned int maxlen);
+char* bucket_index_line_key(char* line);
+int bucket_index_entry_cmp(const void* entry_a, const void* entry_b);
+int bucket_index_load(char* filename, int delta_flag, char* skip_prefix, bucket_index_entry** entries, int* entry_num, int* entry_max, char** buffer);
+int bucket_index_compact(bucket_index_entry* entries, int entry_num, int keep_deleted);
+int bucket_index_write(char* index_base, bucket_index_entry* entries, int entry_num, char* refresh_prefix);
+int bucket_index_merge(char* index_base, char* list_file, char* refresh_prefix);
+int bucket_index_refresh(s3_target* target, char* index_base, char* prefix);
+int bucket_index_fresh(char* index_base, char* prefix, int ttl);
+int bucket_index_invalidate(char* index_base, char* prefix);
+int bucket_index_record(char* index_base, char* option, char* line_or_key);
+int bucket_index_record_object(s3_target* target, char* index_base, char* key, int_64bit size, char* etag);
+void bucket_index_emit(FILE* list_p, char* line, char* key, char* prefix, int delimiter_flag, char* last_folder, unsigned int folder_len);
+int bucket_index_scan(char* index_base, char* prefix, int delimiter_flag, char* list_file);
+bucket_index_entry* bucket_index_find(bucket_index_entry* entries, int entry_num, char* key);
+
+#endif
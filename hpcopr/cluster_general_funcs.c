@@ -23,6 +23,7 @@
 #include "time_process.h"
 #include "cluster_general_funcs.h"
 #include "general_print_info.h"
+#include "usage_and_logs.h"
 
 /*
  * return  0: valid cluster roles
@@ -227,70 +228,975 @@ int decrypt_bucket_info(char* workdir, char* crypto_keyfile, char* bucket_info){
     return system(cmdline);
 }
 
-int remote_copy(char* workdir, char* crypto_keyfile ,char* sshkey_dir, char* local_path, char* remote_path, char* username, char* option, char* recursive_flag, int silent_flag){
-    char real_recursive_flag[4]="";
-    char privkey_base[FILENAME_LENGTH]="";
-    char privkey_decrypted[FILENAME_LENGTH_EXT]="";
+/*
+ * Get the ssh/scp options to share one multiplexed master connection per
+ * master address and user, so that only the first remote call pays the full
+ * handshake. The idle timeout is read from SSH_MUX_CONF (idle_timeout_sec:),
+ * and 0 disables the multiplexing. Windows OpenSSH doesn't support it.
+ * return 1: disabled, the mux_options is empty
+ * return 0: normal exit
+ */
+int get_ssh_mux_options(char* mux_options, unsigned int maxlen){
+    strcpy(mux_options,"");
+#ifdef _WIN32
+    return 1;
+#else
+    char idle_time_string[16]="";
+    int idle_time=SSH_MUX_IDLE_DEFAULT;
+    FILE* file_p=NULL;
+    if(file_exist_or_not(SSH_MUX_CONF)!=0){
+        file_p=fopen(SSH_MUX_CONF,"w+");
+        if(file_p!=NULL){
+            fprintf(file_p,"idle_timeout_sec:  %d\n",SSH_MUX_IDLE_DEFAULT);
+            fclose(file_p);
+        }
+    }
+    else if(find_and_nget(SSH_MUX_CONF,LINE_LENGTH_SHORT,"idle_timeout_sec:","","",1,"idle_timeout_sec:","","",' ',2,idle_time_string,16)==0){
+        idle_time=string_to_positive_num(idle_time_string);
+    }
+    if(idle_time<1){
+        return 1;
+    }
+    if(folder_exist_or_not(SSH_MUX_DIR)!=0&&mk_pdir(SSH_MUX_DIR)!=0){
+        return 1;
+    }
+    snprintf(mux_options,maxlen-1,"-o ControlMaster=auto -o ControlPath=%s%%C -o ControlPersist=%d",SSH_MUX_DIR,idle_time);
+    return 0;
+#endif
+}
+
+/*
+ * Close the multiplexed master connection of a cluster user, e.g. after the
+ * user is deleted or the cluster is destroyed.
+ */
+int close_ssh_mux(char* workdir, char* crypto_keyfile, char* username){
+#ifdef _WIN32
+    return 1;
+#else
     char remote_address[32]="";
     char cmdline[CMDLINE_LENGTH]="";
+    if(get_state_nvalue(workdir,crypto_keyfile,"master_public_ip:",remote_address,32)!=0){
+        return -1;
+    }
+    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh -O exit -o ControlPath=%s%%C %s@%s %s",SSH_MUX_DIR,username,remote_address,SYSTEM_CMD_REDIRECT_NULL);
+    return system(cmdline);
+#endif
+}
+
+/*
+ * The key broker is a local ssh-agent owned by hpcopr. A key is decrypted once,
+ * loaded into the agent with a lifetime of KEY_BROKER_LIFETIME and deleted from
+ * the disk immediately. Within the lifetime, the remote calls sign with the key
+ * held in memory instead of decrypting it to a file again.
+ * The loaded keys are indexed in KEY_BROKER_DIR/keys.idx, one key per line:
+ * EXPIRE_EPOCH AGENT_PID KEY_MTIME PRIVKEY_BASE
+ * Windows has no user-owned agent socket, so the broker is for Linux/Darwin.
+ * return 1: the broker agent is not running
+ * return 0: the broker agent is running, and its pid is in agent_pid
+ */
+int key_broker_status(int* agent_pid){
+    *agent_pid=0;
+#ifdef _WIN32
+    return 1;
+#else
+    char pid_file[FILENAME_LENGTH]="";
+    char sock_file[FILENAME_LENGTH]="";
+    FILE* file_p=NULL;
+    int pid=0;
+    snprintf(pid_file,FILENAME_LENGTH-1,"%sagent.pid",KEY_BROKER_DIR);
+    snprintf(sock_file,FILENAME_LENGTH-1,"%sagent.sock",KEY_BROKER_DIR);
+    file_p=fopen(pid_file,"r");
+    if(file_p==NULL){
+        return 1;
+    }
+    if(fscanf(file_p,"SSH_AGENT_PID=%d",&pid)!=1){
+        fclose(file_p);
+        return 1;
+    }
+    fclose(file_p);
+    if(pid<1||kill(pid,0)!=0||file_exist_or_not(sock_file)!=0){
+        return 1;
+    }
+    *agent_pid=pid;
+    return 0;
+#endif
+}
+
+/*
+ * Start the broker agent if it is not running.
+ * return -1: not supported (Windows)
+ * return -3: failed to start the agent
+ * return 0: normal exit
+ */
+int key_broker_start(void){
+#ifdef _WIN32
+    return -1;
+#else
+    char filename_temp[FILENAME_LENGTH]="";
+    char cmdline[CMDLINE_LENGTH]="";
+    int agent_pid;
+    if(key_broker_status(&agent_pid)==0){
+        return 0;
+    }
+    if(folder_exist_or_not(KEY_BROKER_DIR)!=0&&mk_pdir(KEY_BROKER_DIR)!=0){
+        return -3;
+    }
+    chmod(KEY_BROKER_DIR,S_IRWXU);
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%sagent.sock",KEY_BROKER_DIR);
+    unlink(filename_temp);
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%skeys.idx",KEY_BROKER_DIR);
+    unlink(filename_temp);
+    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh-agent -s -a %sagent.sock -t %d 2>>%s | grep -o 'SSH_AGENT_PID=[0-9]*' > %sagent.pid",KEY_BROKER_DIR,KEY_BROKER_LIFETIME,SYSTEM_CMD_ERROR_LOG,KEY_BROKER_DIR);
+    if(system(cmdline)!=0||key_broker_status(&agent_pid)!=0){
+        return -3;
+    }
+    return 0;
+#endif
+}
+
+/*
+ * Get the identity options of ssh/scp for a private key.
+ * If the key broker works, the options point to the agent and the public key,
+ * and privkey_temp is empty.
+ * Otherwise, the key is decrypted to privkey_temp and the options point to it.
+ * The caller *MUST* call release_ssh_identity(privkey_temp) after the remote call.
+ * return -1: failed to decrypt the key
+ * return 1: fell back to a decrypted key file
+ * return 0: the key is served by the broker
+ */
+int get_ssh_identity(char* privkey_base, char* identity_option, unsigned int maxlen, char* privkey_temp, unsigned int temp_len){
+    char randstr[7]="";
+    strcpy(identity_option,"");
+    strcpy(privkey_temp,"");
+#ifndef _WIN32
+    char idx_file[FILENAME_LENGTH]="";
+    char pubkey[FILENAME_LENGTH]="";
+    char key_path[LINE_LENGTH]="";
+    char cmdline[CMDLINE_LENGTH]="";
+    char line_buffer[LINE_LENGTH]="";
+    long long expire_epoch,key_mtime;
+    int agent_pid,line_pid;
+    int broker_flag=0;
+    struct stat key_stat;
+    FILE* file_p=NULL;
+    if(key_broker_start()==0&&key_broker_status(&agent_pid)==0&&stat(privkey_base,&key_stat)==0){
+        snprintf(idx_file,FILENAME_LENGTH-1,"%skeys.idx",KEY_BROKER_DIR);
+        snprintf(pubkey,FILENAME_LENGTH-1,"%s.pub",privkey_base);
+        file_p=fopen(idx_file,"r");
+        if(file_p!=NULL){
+            while(broker_flag==0&&fngetline(file_p,line_buffer,LINE_LENGTH)==0){
+                if(sscanf(line_buffer,"%lld %d %lld %s",&expire_epoch,&line_pid,&key_mtime,key_path)!=4){
+                    continue;
+                }
+                /* Leave a margin so that the key doesn't expire during the remote call. */
+                if(line_pid==agent_pid&&key_mtime==(long long)key_stat.st_mtime&&expire_epoch>(long long)time(NULL)+60&&strcmp(key_path,privkey_base)==0){
+                    broker_flag=1;
+                }
+            }
+            fclose(file_p);
+        }
+        if(broker_flag==1&&file_exist_or_not(pubkey)==0){
+            snprintf(identity_option,maxlen-1,"-o IdentityAgent=%sagent.sock -o IdentitiesOnly=yes -i %s",KEY_BROKER_DIR,pubkey);
+            return 0;
+        }
+        generate_random_nstring(randstr,7,1);
+        if(file_convert(privkey_base,randstr,"decrypt")!=0){
+            return -1;
+        }
+        snprintf(privkey_temp,temp_len-1,"%s.%s",privkey_base,randstr);
+        if(chmod_ssh_privkey(privkey_temp)!=0){
+            release_ssh_identity(privkey_temp);
+            return -1;
+        }
+        if(file_exist_or_not(pubkey)!=0){
+            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh-keygen -y -f %s > %s 2>>%s",privkey_temp,pubkey,SYSTEM_CMD_ERROR_LOG);
+            system(cmdline);
+        }
+        snprintf(cmdline,CMDLINE_LENGTH-1,"SSH_AUTH_SOCK=%sagent.sock ssh-add -q -t %d %s %s",KEY_BROKER_DIR,KEY_BROKER_LIFETIME,privkey_temp,SYSTEM_CMD_REDIRECT);
+        if(file_exist_or_not(pubkey)==0&&system(cmdline)==0){
+            file_p=fopen(idx_file,"a");
+            if(file_p!=NULL){
+                fprintf(file_p,"%lld %d %lld %s\n",(long long)time(NULL)+KEY_BROKER_LIFETIME,agent_pid,(long long)key_stat.st_mtime,privkey_base);
+                fclose(file_p);
+            }
+            release_ssh_identity(privkey_temp);
+            snprintf(identity_option,maxlen-1,"-o IdentityAgent=%sagent.sock -o IdentitiesOnly=yes -i %s",KEY_BROKER_DIR,pubkey);
+            return 0;
+        }
+        snprintf(identity_option,maxlen-1,"-i %s",privkey_temp);
+        return 1;
+    }
+#endif
+    generate_random_nstring(randstr,7,1);
+    if(file_convert(privkey_base,randstr,"decrypt")!=0){
+        return -1;
+    }
+    snprintf(privkey_temp,temp_len-1,"%s.%s",privkey_base,randstr);
+    if(chmod_ssh_privkey(privkey_temp)!=0){
+        release_ssh_identity(privkey_temp);
+        return -1;
+    }
+    snprintf(identity_option,maxlen-1,"-i %s",privkey_temp);
+    return 1;
+}
+
+/*
+ * Delete the decrypted key file (if any) of get_ssh_identity.
+ */
+int release_ssh_identity(char* privkey_temp){
+    int run_flag=0;
+    if(strlen(privkey_temp)>0){
+        run_flag=rm_file_or_dir(privkey_temp);
+        strcpy(privkey_temp,"");
+    }
+    return run_flag;
+}
+
+/*
+ * Remove a key from the broker agent, e.g. before the key is deleted.
+ */
+int key_broker_remove(char* privkey_base){
+#ifdef _WIN32
+    return 1;
+#else
+    char cmdline[CMDLINE_LENGTH]="";
+    int agent_pid;
+    if(key_broker_status(&agent_pid)!=0){
+        return 1;
+    }
+    snprintf(cmdline,CMDLINE_LENGTH-1,"SSH_AUTH_SOCK=%sagent.sock ssh-add -q -d %s.pub %s",KEY_BROKER_DIR,privkey_base,SYSTEM_CMD_REDIRECT_NULL);
+    return system(cmdline);
+#endif
+}
+
+/*
+ * Get the master address and the ssh identity of a cluster user, the common
+ * part of the remote calls.
+ * The caller *MUST* call release_ssh_identity(privkey_temp) after the call.
+ * return -3: failed to get the ssh key
+ * return -5: failed to get the master address
+ * return -7: failed to get the cluster name
+ * return 0: normal exit
+ */
+int get_ssh_target(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* username, char* remote_address, unsigned int addr_len, char* identity_option, unsigned int id_len, char* privkey_temp, unsigned int temp_len){
+    char privkey_base[FILENAME_LENGTH]="";
     char cluster_name[CLUSTER_ID_LENGTH_MAX_PLUS]="";
     char cluster_role[16]="";
     char cluster_role_ext[16]="";
+    strcpy(privkey_temp,"");
+    if(get_cluster_nname(cluster_name,CLUSTER_ID_LENGTH_MAX_PLUS,workdir)!=0){
+        return -7;
+    }
+    if(get_state_nvalue(workdir,crypto_keyfile,"master_public_ip:",remote_address,addr_len)!=0){
+        return -5;
+    }
+    cluster_role_detect(workdir,cluster_role,cluster_role_ext,16);
+    if(strcmp(username,"root")==0&&strcmp(cluster_role,"opr")==0){
+        snprintf(privkey_base,FILENAME_LENGTH-1,"%s%snow-cluster-login",sshkey_dir,PATH_SLASH);
+    }
+    else{
+        snprintf(privkey_base,FILENAME_LENGTH-1,"%s%s.%s%s%s.key",sshkey_dir,PATH_SLASH,cluster_name,PATH_SLASH,username);
+    }
+    if(get_ssh_identity(privkey_base,identity_option,id_len,privkey_temp,temp_len)<0){
+        return -3;
+    }
+    return 0;
+}
+
+/*
+ * Build the scp command line of remote_copy without running it, e.g. for fanout_run.
+ * The caller *MUST* call release_ssh_identity(privkey_temp) after running it.
+ * return -1: invalid option
+ * return -3: failed to get the ssh key
+ * return -5: failed to get the master address
+ * return -7: failed to get the cluster name
+ * return 0: normal exit
+ */
+int remote_copy_cmdline(char* workdir, char* crypto_keyfile ,char* sshkey_dir, char* local_path, char* remote_path, char* username, char* option, char* recursive_flag, char* cmdline, unsigned int maxlen, char* privkey_temp, unsigned int temp_len){
+    char real_recursive_flag[4]="";
+    char remote_address[32]="";
+    char mux_options[LINE_LENGTH_SHORT]="";
+    char identity_option[LINE_LENGTH_SHORT]="";
+    int run_flag;
+    strcpy(privkey_temp,"");
+    if(strcmp(option,"put")!=0&&strcmp(option,"get")!=0){
+        return -1;
+    }
+    get_ssh_mux_options(mux_options,LINE_LENGTH_SHORT);
+    if(strcmp(recursive_flag,"-r")!=0){
+        strcpy(real_recursive_flag,"");
+    }
+    else{
+        strcpy(real_recursive_flag,"-r");
+    }
+    run_flag=get_ssh_target(workdir,crypto_keyfile,sshkey_dir,username,remote_address,32,identity_option,LINE_LENGTH_SHORT,privkey_temp,temp_len);
+    if(run_flag!=0){
+        return run_flag;
+    }
+    if(strcmp(option,"put")==0){
+        snprintf(cmdline,maxlen-1,"scp %s %s -o StrictHostKeyChecking=no %s %s %s@%s:%s",mux_options,real_recursive_flag,identity_option,local_path,username,remote_address,remote_path);
+    }
+    else{
+        snprintf(cmdline,maxlen-1,"scp %s %s -o StrictHostKeyChecking=no %s %s@%s:%s %s",mux_options,real_recursive_flag,identity_option,username,remote_address,remote_path,local_path);
+    }
+    return 0;
+}
+
+int remote_copy(char* workdir, char* crypto_keyfile ,char* sshkey_dir, char* local_path, char* remote_path, char* username, char* option, char* recursive_flag, int silent_flag){
+    char privkey_decrypted[FILENAME_LENGTH_EXT]="";
+    char scp_cmdline[CMDLINE_LENGTH]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    int run_flag;
+    trace_span span;
+    if(strcmp(option,"put")!=0&&strcmp(option,"get")!=0){
+        return -1;
+    }
+    trace_span_start(&span,"remote_copy");
+    run_flag=remote_copy_cmdline(workdir,crypto_keyfile,sshkey_dir,local_path,remote_path,username,option,recursive_flag,scp_cmdline,CMDLINE_LENGTH,privkey_decrypted,FILENAME_LENGTH_EXT);
+    if(run_flag==-7||run_flag==-3){
+        trace_span_end(&span,run_flag);
+        return run_flag;
+    }
+    else if(run_flag!=0){
+        trace_span_end(&span,1);
+        return 1;
+    }
+    if(silent_flag==0){
+        snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s %s",scp_cmdline,SYSTEM_CMD_REDIRECT);
+    }
+    else{
+        snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s",scp_cmdline);
+    }
+    run_flag=system(cmdline);
+    release_ssh_identity(privkey_decrypted);
+    trace_span_end(&span,run_flag);
+    if(run_flag!=0){
+        return 1;
+    }
+    else{
+        return 0;
+    }
+}
+
+/*
+ * Sync a file or folder between local and the cluster with rsync over the
+ * managed ssh session. rsync compares the rolling checksums of the blocks and
+ * only transfers the changes, and it keeps the mtimes and permissions.
+ * The paths follow the rsync rules: a source with a trailing '/' syncs the
+ * contents of the folder, rather than the folder itself. recursive 0: the
+ * folders are skipped like scp without -r, a local source folder is left to
+ * remote_copy to report.
+ * return -1: invalid option
+ * return -3: failed to get the ssh key
+ * return -5: failed to get the master address
+ * return -7: failed to get the cluster name
+ * return -9: rsync is not available locally or on the cluster, or a folder to
+ *            put without recursive, use remote_copy instead
+ * return 1: rsync failed
+ * return 0: normal exit
+ */
+int remote_sync(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* local_path, char* remote_path, char* username, char* option, int recursive, int silent_flag){
+    if(strcmp(option,"put")!=0&&strcmp(option,"get")!=0){
+        return -1;
+    }
+#ifdef _WIN32
+    return -9;
+#else
+    char remote_address[32]="";
+    char mux_options[LINE_LENGTH_SHORT]="";
+    char identity_option[LINE_LENGTH_SHORT]="";
+    char privkey_decrypted[FILENAME_LENGTH_EXT]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    int run_flag;
+    trace_span span;
+    if(system("rsync --version >/dev/null 2>&1")!=0){
+        return -9;
+    }
+    if(recursive==0&&strcmp(option,"put")==0&&folder_exist_or_not(local_path)==0){
+        return -9;
+    }
+    get_ssh_mux_options(mux_options,LINE_LENGTH_SHORT);
+    run_flag=get_ssh_target(workdir,crypto_keyfile,sshkey_dir,username,remote_address,32,identity_option,LINE_LENGTH_SHORT,privkey_decrypted,FILENAME_LENGTH_EXT);
+    if(run_flag!=0){
+        return run_flag;
+    }
+    /* rsync runs on both sides, the cluster images may not have it. */
+    snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"ssh %s -n -o StrictHostKeyChecking=no %s %s@%s \"command -v rsync\" >/dev/null 2>&1",mux_options,identity_option,username,remote_address);
+    if(system(cmdline)!=0){
+        release_ssh_identity(privkey_decrypted);
+        return -9;
+    }
+    trace_span_start(&span,"remote_sync");
+    if(strcmp(option,"put")==0){
+        snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"rsync -az %s--partial -e \"ssh %s -o StrictHostKeyChecking=no %s\" %s %s@%s:%s",(recursive==0)?"--no-r ":"",mux_options,identity_option,local_path,username,remote_address,remote_path);
+    }
+    else{
+        snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"rsync -az %s--partial -e \"ssh %s -o StrictHostKeyChecking=no %s\" %s@%s:%s %s",(recursive==0)?"--no-r ":"",mux_options,identity_option,username,remote_address,remote_path,local_path);
+    }
+    if(silent_flag==0){
+        strncat(cmdline," "SYSTEM_CMD_REDIRECT,CMDLINE_LENGTH_EXT-strlen(cmdline)-1);
+    }
+    run_flag=system(cmdline);
+    release_ssh_identity(privkey_decrypted);
+    trace_span_end(&span,run_flag);
+    if(run_flag!=0){
+        return 1;
+    }
+    return 0;
+#endif
+}
+
+/*
+ * The transfer journal records the items of a transfer once they are verified,
+ * so that a failed transfer can be continued with --resume. An item is a file,
+ * or a chunk FILE#SKIP+COUNT (in MiB) of a chunked upload. Each transfer has its own journal in
+ * XFER_JOURNAL_DIR, named by the hash of the cluster, the operation and the
+ * paths. One item per line, and a later line overrides an earlier one:
+ * SIZE MTIME HASH ITEM
+ * The SIZE and MTIME are of the source when the item was transferred, and the
+ * HASH is the sha256 of the item, or "-" if unknown.
+ * resume_flag 0 drops the journal of the same transfer and starts a new one.
+ * return -1: failed to create the journal folder
+ * return 1: resuming, but no journal found
+ * return 0: normal exit
+ */
+int xfer_journal_init(char* workdir, char* cmd_type, char* source_path, char* target_path, int resume_flag, char* journal_file, unsigned int maxlen){
+    char journal_key[CMDLINE_LENGTH]="";
+    strcpy(journal_file,"");
+    if(folder_exist_or_not(XFER_JOURNAL_DIR)!=0&&mk_pdir(XFER_JOURNAL_DIR)<0){
+        return -1;
+    }
+    snprintf(journal_key,CMDLINE_LENGTH-1,"%s|%s|%s|%s",workdir,cmd_type,source_path,target_path);
+    snprintf(journal_file,maxlen-1,"%s%016llx.jnl",XFER_JOURNAL_DIR,string_hash64(journal_key));
+    if(resume_flag==0){
+        if(file_exist_or_not(journal_file)==0){
+            rm_file_or_dir(journal_file);
+        }
+        return 0;
+    }
+    if(file_exist_or_not(journal_file)!=0){
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Check an item against the journal with the current size and mtime of its
+ * source. The metadata decides first, and the hash is only needed when the
+ * size is the same but the mtime is not, e.g. the source was touched.
+ * return -1: no journal
+ * return 0: recorded with the same size and mtime, no need to transfer again
+ * return 1: not recorded, or the size changed
+ * return 2: recorded with the same size but another mtime, the recorded hash is
+ *           in the recorded_hash for the caller to compare
+ */
+int xfer_journal_check(char* journal_file, char* item, int_64bit size, long long mtime, char* recorded_hash, unsigned int hash_len){
+    char line_buffer[FILENAME_LENGTH_EXT]="";
+    char hash_temp[80]="";
+    long long size_temp,mtime_temp;
+    int item_start,result=1;
+    FILE* file_p=NULL;
+    strcpy(recorded_hash,"");
+    if(strlen(journal_file)==0){
+        return -1;
+    }
+    file_p=fopen(journal_file,"r");
+    if(file_p==NULL){
+        return -1;
+    }
+    while(fngetline(file_p,line_buffer,FILENAME_LENGTH_EXT)!=1){
+        item_start=0;
+        if(sscanf(line_buffer,"%lld %lld %79s %n",&size_temp,&mtime_temp,hash_temp,&item_start)<3||item_start==0){
+            continue;
+        }
+        if(strcmp(line_buffer+item_start,item)!=0){
+            continue;
+        }
+        if(size_temp!=(long long)size){
+            result=1;
+            strcpy(recorded_hash,"");
+        }
+        else if(mtime_temp==mtime){
+            result=0;
+        }
+        else{
+            result=2;
+            strncpy(recorded_hash,hash_temp,hash_len-1);
+        }
+    }
+    fclose(file_p);
+    return result;
+}
+
+int xfer_journal_record(char* journal_file, char* item, int_64bit size, long long mtime, char* hash){
+    FILE* file_p=NULL;
+    if(strlen(journal_file)==0){
+        return -1;
+    }
+    file_p=fopen(journal_file,"a");
+    if(file_p==NULL){
+        return -1;
+    }
+    fprintf(file_p,"%lld %lld %s %s\n",(long long)size,mtime,(strlen(hash)==0)?"-":hash,item);
+    fclose(file_p);
+    return 0;
+}
+
+/*
+ * Get the sha256 of a MiB-aligned range of a local file, in the same way that
+ * now_chunk.sh put hashes the range on the cluster. Not for Windows.
+ */
+int get_file_range_sha256(char* filename, int skip_mb, int count_mb, char* sha256_string, unsigned int len){
+#ifdef _WIN32
+    return -1;
+#else
+    char randstr[7]="";
+    char hash_file[FILENAME_LENGTH]="";
+    char cmdline[CMDLINE_LENGTH]="";
+    FILE* file_p=NULL;
+    strcpy(sha256_string,"");
+    generate_random_nstring(randstr,7,1);
+    snprintf(hash_file,FILENAME_LENGTH-1,"%srange_%s.sha",NOW_TMP_DIR,randstr);
+    snprintf(cmdline,CMDLINE_LENGTH-1,"dd if=%s bs=1048576 skip=%d count=%d 2>/dev/null | %s | cut -c1-64 > %s",filename,skip_mb,count_mb,SHA256SUM_CMD,hash_file);
+    if(system(cmdline)!=0){
+        rm_file_or_dir(hash_file);
+        return 1;
+    }
+    file_p=fopen(hash_file,"r");
+    if(file_p!=NULL){
+        fngetline(file_p,sha256_string,len);
+        fclose(file_p);
+    }
+    rm_file_or_dir(hash_file);
+    return (strlen(sha256_string)==64)?0:1;
+#endif
+}
+
+/*
+ * Read the settings of the chunked parallel transfer from TRANSFER_CONF:
+ * streams: concurrent ssh streams, chunk_mb: MiB per chunk, threshold_mb: the
+ * minimum file size to use it. The compress: is read by get_transfer_compress_mode.
+ * Created with the defaults if absent. Invalid values fall back to the defaults,
+ * and too large values are capped.
+ * return 0: normal exit
+ */
+int get_transfer_conf(int* streams, int* chunk_mb, int* threshold_mb){
+    char value_string[16]="";
+    int value;
+    FILE* file_p=NULL;
+    *streams=PTX_STREAMS_DEFAULT;
+    *chunk_mb=PTX_CHUNK_MB_DEFAULT;
+    *threshold_mb=PTX_THRESHOLD_MB_DEFAULT;
+    if(file_exist_or_not(TRANSFER_CONF)!=0){
+        file_p=fopen(TRANSFER_CONF,"w+");
+        if(file_p!=NULL){
+            fprintf(file_p,"streams:  %d\nchunk_mb:  %d\nthreshold_mb:  %d\ncompress:  auto\n",PTX_STREAMS_DEFAULT,PTX_CHUNK_MB_DEFAULT,PTX_THRESHOLD_MB_DEFAULT);
+            fclose(file_p);
+        }
+        return 0;
+    }
+    if(find_and_nget(TRANSFER_CONF,LINE_LENGTH_SHORT,"streams:","","",1,"streams:","","",' ',2,value_string,16)==0){
+        value=string_to_positive_num(value_string);
+        if(value>0){
+            *streams=(value>PTX_STREAMS_MAX)?PTX_STREAMS_MAX:value;
+        }
+    }
+    if(find_and_nget(TRANSFER_CONF,LINE_LENGTH_SHORT,"chunk_mb:","","",1,"chunk_mb:","","",' ',2,value_string,16)==0){
+        value=string_to_positive_num(value_string);
+        if(value>0){
+            *chunk_mb=(value>PTX_CHUNK_MB_MAX)?PTX_CHUNK_MB_MAX:value;
+        }
+    }
+    if(find_and_nget(TRANSFER_CONF,LINE_LENGTH_SHORT,"threshold_mb:","","",1,"threshold_mb:","","",' ',2,value_string,16)==0){
+        value=string_to_positive_num(value_string);
+        if(value>0){
+            *threshold_mb=value;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Upload a large regular file over several concurrent ssh streams sharing the
+ * multiplexed master connection. The file is split into chunk_mb ranges. Each
+ * range is piped by dd to /usr/hpc-now/now_chunk.sh on the master node, which
+ * writes it in place and prints the sha256 of the range on disk. The ranges
+ * failed or not matching the local hash are sent again, up to PTX_RETRY_MAX
+ * extra rounds. Like scp, the remote_path can be a folder or a file.
+ * With a journal_file (see xfer_journal_init), the verified chunks are recorded,
+ * and the recorded chunks are skipped if the target already exists in full size.
+ * return -1: failed to open the local file
+ * return -3: failed to get the ssh key
+ * return -5: failed to get the master address
+ * return -7: failed to get the cluster name
+ * return -9: not applicable (Windows, a single chunk, or no now_chunk.sh on the cluster), use remote_copy instead
+ * return 1: some chunks still failed after the retries
+ * return 0: normal exit
+ */
+int parallel_put(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* local_path, char* remote_path, char* username, char* journal_file){
+#ifdef _WIN32
+    return -9;
+#else
+    char remote_address[32]="";
+    char mux_options[LINE_LENGTH_SHORT]="";
+    char identity_option[LINE_LENGTH_SHORT]="";
+    char privkey_decrypted[FILENAME_LENGTH_EXT]="";
+    char ssh_prefix[CMDLINE_LENGTH]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    char randstr[7]="";
+    char target_file[FILENAME_LENGTH]="";
+    char real_target[DIR_LENGTH]="";
+    char local_hash_file[FILENAME_LENGTH]="";
+    char remote_hash_file[FILENAME_LENGTH]="";
+    char local_hash[80]="";
+    char remote_hash[80]="";
+    char target_existed[8]="";
+    char chunk_item[FILENAME_LENGTH_EXT]="";
+    char* file_name=NULL;
+    int streams,chunk_mb,threshold_mb;
+    int i,j,chunk,chunk_num,task_num,round,fail_num,run_flag;
+    int_64bit file_size,chunk_bytes;
+    long long file_mtime;
+    int* chunk_ok=NULL;
+    int* chunk_ids=NULL;
+    fanout_task* tasks=NULL;
+    FILE* file_p=NULL;
+    trace_span span;
+    if(folder_exist_or_not(local_path)==0){
+        return -9;
+    }
+    if(get_file_size_mtime(local_path,&file_size,&file_mtime)!=0){
+        return -1;
+    }
+    get_transfer_conf(&streams,&chunk_mb,&threshold_mb);
+    chunk_bytes=(int_64bit)chunk_mb*1048576;
+    chunk_num=(int)((file_size+chunk_bytes-1)/chunk_bytes);
+    if(chunk_num<2){
+        return -9;
+    }
+    trace_span_start(&span,"parallel_put");
+    get_ssh_mux_options(mux_options,LINE_LENGTH_SHORT);
+    run_flag=get_ssh_target(workdir,crypto_keyfile,sshkey_dir,username,remote_address,32,identity_option,LINE_LENGTH_SHORT,privkey_decrypted,FILENAME_LENGTH_EXT);
+    if(run_flag!=0){
+        trace_span_end(&span,run_flag);
+        return run_flag;
+    }
+    snprintf(ssh_prefix,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no %s %s@%s",mux_options,identity_option,username,remote_address);
+    file_name=strrchr(local_path,'/');
+    file_name=(file_name==NULL)?local_path:file_name+1;
+    generate_random_nstring(randstr,7,1);
+    /* Allocate the full-size target first, so that the ranges can be written in any order. */
+    snprintf(target_file,FILENAME_LENGTH-1,"%sptx_%s.target",NOW_TMP_DIR,randstr);
+    snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s \"bash /usr/hpc-now/now_chunk.sh prepare %s %lld %s\" > %s 2>>%s",ssh_prefix,remote_path,(long long)file_size,file_name,target_file,SYSTEM_CMD_ERROR_LOG);
+    run_flag=system(cmdline);
+    file_p=fopen(target_file,"r");
+    if(file_p!=NULL){
+        fngetline(file_p,real_target,DIR_LENGTH);
+        fngetline(file_p,target_existed,8);
+        fclose(file_p);
+    }
+    rm_file_or_dir(target_file);
+    if(run_flag!=0||strlen(real_target)==0){
+        release_ssh_identity(privkey_decrypted);
+        trace_span_end(&span,-9);
+        return -9;
+    }
+    chunk_ok=(int*)malloc(chunk_num*sizeof(int));
+    chunk_ids=(int*)malloc(chunk_num*sizeof(int));
+    tasks=(fanout_task*)malloc(chunk_num*sizeof(fanout_task));
+    if(chunk_ok==NULL||chunk_ids==NULL||tasks==NULL){
+        free(chunk_ok);
+        free(chunk_ids);
+        free(tasks);
+        release_ssh_identity(privkey_decrypted);
+        trace_span_end(&span,-1);
+        return -1;
+    }
+    fail_num=chunk_num;
+    for(i=0;i<chunk_num;i++){
+        chunk_ok[i]=0;
+        /* A new or resized target has none of the recorded chunks. */
+        if(strcmp(target_existed,"1")!=0){
+            continue;
+        }
+        snprintf(chunk_item,FILENAME_LENGTH_EXT-1,"%s#%d+%d",local_path,i*chunk_mb,chunk_mb);
+        run_flag=xfer_journal_check(journal_file,chunk_item,file_size,file_mtime,remote_hash,80);
+        if(run_flag==2&&get_file_range_sha256(local_path,i*chunk_mb,chunk_mb,local_hash,80)==0&&strcmp(local_hash,remote_hash)==0){
+            run_flag=0;
+        }
+        if(run_flag==0){
+            chunk_ok[i]=1;
+            fail_num--;
+        }
+    }
+    for(round=0;round<=PTX_RETRY_MAX&&fail_num>0;round++){
+        task_num=0;
+        for(i=0;i<chunk_num;i++){
+            if(chunk_ok[i]==1){
+                continue;
+            }
+            snprintf(local_hash_file,FILENAME_LENGTH-1,"%sptx_%s_%d.lh",NOW_TMP_DIR,randstr,i);
+            snprintf(remote_hash_file,FILENAME_LENGTH-1,"%sptx_%s_%d.rh",NOW_TMP_DIR,randstr,i);
+            chunk_ids[task_num]=i;
+            snprintf(tasks[task_num].target,63,"chunk_%d",i);
+            strcpy(tasks[task_num].privkey_temp,"");
+            /* Wrapped in braces, so that the redirects added by fanout_run don't replace the hash outputs. */
+            snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"{ dd if=%s bs=1048576 skip=%d count=%d 2>/dev/null | %s \"bash /usr/hpc-now/now_chunk.sh put %s %d %d\" > %s && dd if=%s bs=1048576 skip=%d count=%d 2>/dev/null | %s | cut -c1-64 > %s; }",local_path,i*chunk_mb,chunk_mb,ssh_prefix,real_target,i*chunk_mb,chunk_mb,remote_hash_file,local_path,i*chunk_mb,chunk_mb,SHA256SUM_CMD,local_hash_file);
+            /* Never run a truncated command, e.g. with very long paths. The upload fails instead. */
+            if(strlen(cmdline)>=CMDLINE_LENGTH){
+                task_num=0;
+                round=PTX_RETRY_MAX;
+                break;
+            }
+            strcpy(tasks[task_num].cmdline,cmdline);
+            task_num++;
+        }
+        fanout_run(tasks,task_num,streams,PTX_CHUNK_TIMEOUT);
+        for(j=0;j<task_num;j++){
+            chunk=chunk_ids[j];
+            snprintf(local_hash_file,FILENAME_LENGTH-1,"%sptx_%s_%d.lh",NOW_TMP_DIR,randstr,chunk);
+            snprintf(remote_hash_file,FILENAME_LENGTH-1,"%sptx_%s_%d.rh",NOW_TMP_DIR,randstr,chunk);
+            strcpy(local_hash,"");
+            strcpy(remote_hash,"");
+            if(tasks[j].exit_code==0){
+                file_p=fopen(local_hash_file,"r");
+                if(file_p!=NULL){
+                    fngetline(file_p,local_hash,80);
+                    fclose(file_p);
+                }
+                file_p=fopen(remote_hash_file,"r");
+                if(file_p!=NULL){
+                    fngetline(file_p,remote_hash,80);
+                    fclose(file_p);
+                }
+                if(strlen(local_hash)==64&&strcmp(local_hash,remote_hash)==0){
+                    chunk_ok[chunk]=1;
+                    fail_num--;
+                    snprintf(chunk_item,FILENAME_LENGTH_EXT-1,"%s#%d+%d",local_path,chunk*chunk_mb,chunk_mb);
+                    xfer_journal_record(journal_file,chunk_item,file_size,file_mtime,local_hash);
+                }
+            }
+            rm_file_or_dir(local_hash_file);
+            rm_file_or_dir(remote_hash_file);
+        }
+    }
+    free(chunk_ok);
+    free(chunk_ids);
+    free(tasks);
+    release_ssh_identity(privkey_decrypted);
+    trace_span_end(&span,fail_num);
+    if(fail_num>0){
+        return 1;
+    }
+    return 0;
+#endif
+}
+
+/*
+ * The compression mode of the transfers, "compress:" in TRANSFER_CONF.
+ * auto (default): compress the data sampled as compressible. off: never.
+ * return 0: auto
+ * return 1: off
+ */
+int get_transfer_compress_mode(void){
+    char mode_string[16]="";
+    if(find_and_nget(TRANSFER_CONF,LINE_LENGTH_SHORT,"compress:","","",1,"compress:","","",' ',2,mode_string,16)==0&&strcmp(mode_string,"off")==0){
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * The sampled byte entropy of a local file, or the average of the first
+ * ENTROPY_SAMPLE_FILES files of a folder. Not for Windows.
+ * return -1: nothing to sample
+ * return N>=0: the entropy in milli-bits per byte
+ */
+int local_entropy_estimate(char* local_path){
+#ifdef _WIN32
+    return -1;
+#else
     char randstr[7]="";
-    int run_flag;
-    if(strcmp(option,"put")!=0&&strcmp(option,"get")!=0){
-        return -1;
+    char list_file[FILENAME_LENGTH]="";
+    char sample_file[FILENAME_LENGTH]="";
+    char cmdline[CMDLINE_LENGTH]="";
+    int entropy,sum=0,num=0;
+    FILE* file_p=NULL;
+    if(file_exist_or_not(local_path)==0){
+        return file_entropy_sample(local_path,ENTROPY_SAMPLE_NUM,ENTROPY_SAMPLE_SIZE);
     }
-    if(get_cluster_nname(cluster_name,CLUSTER_ID_LENGTH_MAX_PLUS,workdir)!=0){
-        return -7;
+    if(folder_exist_or_not(local_path)!=0){
+        return -1;
     }
-    if(strcmp(recursive_flag,"-r")!=0){
-        strcpy(real_recursive_flag,"");
+    generate_random_nstring(randstr,7,1);
+    snprintf(list_file,FILENAME_LENGTH-1,"%sentropy_%s.lst",NOW_TMP_DIR,randstr);
+    snprintf(cmdline,CMDLINE_LENGTH-1,"find %s -type f 2>/dev/null | head -n %d > %s",local_path,ENTROPY_SAMPLE_FILES,list_file);
+    system(cmdline);
+    file_p=fopen(list_file,"r");
+    if(file_p!=NULL){
+        while(fngetline(file_p,sample_file,FILENAME_LENGTH)!=1){
+            entropy=file_entropy_sample(sample_file,ENTROPY_SAMPLE_NUM,ENTROPY_SAMPLE_SIZE);
+            if(entropy>=0){
+                sum+=entropy;
+                num++;
+            }
+        }
+        fclose(file_p);
     }
-    else{
-        strcpy(real_recursive_flag,"-r");
+    rm_file_or_dir(list_file);
+    if(num==0){
+        return -1;
     }
-    get_state_nvalue(workdir,crypto_keyfile,"master_public_ip:",remote_address,32);
-    cluster_role_detect(workdir,cluster_role,cluster_role_ext,16);
-    if(strcmp(username,"root")==0&&strcmp(cluster_role,"opr")==0){
-        snprintf(privkey_base,FILENAME_LENGTH-1,"%s%snow-cluster-login",sshkey_dir,PATH_SLASH);
+    return sum/num;
+#endif
+}
+
+/*
+ * Copy a file or folder between local and the cluster as a zstd-compressed tar
+ * stream over the managed ssh session. zstd adapts the level to the link: the
+ * slower the link, the higher the level. The data sampled with a high entropy,
+ * e.g. archives or media, is left to remote_copy, since it would not shrink.
+ * Like scp -r, the target can be an existing folder or a new path. Folders are
+ * only copied with recursive=1, otherwise they are left to remote_copy as well.
+ * return -1: invalid option
+ * return -3: failed to get the ssh key
+ * return -5: failed to get the master address
+ * return -7: failed to get the cluster name
+ * return -9: not applicable (Windows, no zstd or now_chunk.sh, or not compressible), use remote_copy instead
+ * return 1: the transfer failed
+ * return 0: normal exit
+ */
+int remote_copy_compressed(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* local_path, char* remote_path, char* username, char* option, int recursive){
+    if(strcmp(option,"put")!=0&&strcmp(option,"get")!=0){
+        return -1;
     }
-    else{
-        snprintf(privkey_base,FILENAME_LENGTH-1,"%s%s.%s%s%s.key",sshkey_dir,PATH_SLASH,cluster_name,PATH_SLASH,username);
+#ifdef _WIN32
+    return -9;
+#else
+    char remote_address[32]="";
+    char mux_options[LINE_LENGTH_SHORT]="";
+    char identity_option[LINE_LENGTH_SHORT]="";
+    char privkey_decrypted[FILENAME_LENGTH_EXT]="";
+    char ssh_prefix[CMDLINE_LENGTH]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    char randstr[7]="";
+    char path_temp[DIR_LENGTH]="";
+    char entropy_file[FILENAME_LENGTH]="";
+    char entropy_string[16]="";
+    char extract_dir[FILENAME_LENGTH]="";
+    char extracted_path[FILENAME_LENGTH_EXT]="";
+    char* name_p=NULL;
+    int entropy=-1,run_flag;
+    unsigned int path_len;
+    FILE* file_p=NULL;
+    trace_span span;
+    if(get_transfer_compress_mode()!=0||system("zstd --version >/dev/null 2>&1")!=0){
+        return -9;
     }
-    generate_random_nstring(randstr,7,1);
-    if(file_convert(privkey_base,randstr,"decrypt")!=0){
-        return -3;
+    if(strcmp(option,"put")==0){
+        if(recursive==0&&folder_exist_or_not(local_path)==0){
+            return -9;
+        }
+        entropy=local_entropy_estimate(local_path);
+        if(entropy<0||entropy>=COMPRESS_ENTROPY_MAX){
+            return -9;
+        }
     }
-    snprintf(privkey_decrypted,FILENAME_LENGTH_EXT-1,"%s.%s",privkey_base,randstr);
-    if(chmod_ssh_privkey(privkey_decrypted)!=0){
-        rm_file_or_dir(privkey_decrypted);
-        return -3;
+    trace_span_start(&span,"remote_copy_compressed");
+    get_ssh_mux_options(mux_options,LINE_LENGTH_SHORT);
+    run_flag=get_ssh_target(workdir,crypto_keyfile,sshkey_dir,username,remote_address,32,identity_option,LINE_LENGTH_SHORT,privkey_decrypted,FILENAME_LENGTH_EXT);
+    if(run_flag!=0){
+        trace_span_end(&span,run_flag);
+        return run_flag;
     }
+    snprintf(ssh_prefix,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no %s %s@%s",mux_options,identity_option,username,remote_address);
+    generate_random_nstring(randstr,7,1);
     if(strcmp(option,"put")==0){
-        if(silent_flag==0){
-            snprintf(cmdline,CMDLINE_LENGTH-1,"scp %s -o StrictHostKeyChecking=no -i %s %s %s@%s:%s %s",real_recursive_flag,privkey_decrypted,local_path,username,remote_address,remote_path,SYSTEM_CMD_REDIRECT);
+        snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s \"which zstd && test -f /usr/hpc-now/now_chunk.sh\" %s",ssh_prefix,SYSTEM_CMD_REDIRECT_NULL);
+        if(system(cmdline)!=0){
+            release_ssh_identity(privkey_decrypted);
+            trace_span_end(&span,-9);
+            return -9;
+        }
+        strncpy(path_temp,local_path,DIR_LENGTH-1);
+        path_len=strlen(path_temp);
+        while(path_len>1&&path_temp[path_len-1]=='/'){
+            path_temp[--path_len]='\0';
+        }
+        name_p=strrchr(path_temp,'/');
+        if(name_p==NULL){
+            snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"tar -cf - %s | zstd %s -c | %s \"bash /usr/hpc-now/now_chunk.sh untar %s\" %s",path_temp,ZSTD_STREAM_OPTIONS,ssh_prefix,remote_path,SYSTEM_CMD_REDIRECT);
         }
         else{
-            snprintf(cmdline,CMDLINE_LENGTH-1,"scp %s -o StrictHostKeyChecking=no -i %s %s %s@%s:%s",real_recursive_flag,privkey_decrypted,local_path,username,remote_address,remote_path);
+            *name_p='\0';
+            snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"tar -cf - -C %s %s | zstd %s -c | %s \"bash /usr/hpc-now/now_chunk.sh untar %s\" %s",(strlen(path_temp)==0)?"/":path_temp,name_p+1,ZSTD_STREAM_OPTIONS,ssh_prefix,remote_path,SYSTEM_CMD_REDIRECT);
         }
+        run_flag=system(cmdline);
     }
     else{
-        if(silent_flag==0){
-            snprintf(cmdline,CMDLINE_LENGTH-1,"scp %s -o StrictHostKeyChecking=no -i %s %s@%s:%s %s %s",real_recursive_flag,privkey_decrypted,username,remote_address,remote_path,local_path,SYSTEM_CMD_REDIRECT);
+        /* Sample the remote data first, this also checks zstd and now_chunk.sh on the cluster. */
+        snprintf(entropy_file,FILENAME_LENGTH-1,"%sentropy_%s.out",NOW_TMP_DIR,randstr);
+        if(recursive==0){
+            snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s \"test -f %s && bash /usr/hpc-now/now_chunk.sh entropy %s\" > %s 2>>%s",ssh_prefix,remote_path,remote_path,entropy_file,SYSTEM_CMD_ERROR_LOG);
+        }
+        else{
+            snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s \"bash /usr/hpc-now/now_chunk.sh entropy %s\" > %s 2>>%s",ssh_prefix,remote_path,entropy_file,SYSTEM_CMD_ERROR_LOG);
+        }
+        run_flag=system(cmdline);
+        file_p=fopen(entropy_file,"r");
+        if(file_p!=NULL){
+            fngetline(file_p,entropy_string,16);
+            fclose(file_p);
+        }
+        rm_file_or_dir(entropy_file);
+        entropy=string_to_positive_num(entropy_string);
+        if(run_flag!=0||entropy<0||entropy>=COMPRESS_ENTROPY_MAX){
+            release_ssh_identity(privkey_decrypted);
+            trace_span_end(&span,-9);
+            return -9;
+        }
+        strncpy(path_temp,local_path,DIR_LENGTH-1);
+        path_len=strlen(path_temp);
+        while(path_len>1&&path_temp[path_len-1]=='/'){
+            path_temp[--path_len]='\0';
+        }
+        if(folder_exist_or_not(path_temp)==0){
+            strcpy(extract_dir,path_temp);
         }
         else{
-            snprintf(cmdline,CMDLINE_LENGTH-1,"scp %s -o StrictHostKeyChecking=no -i %s %s@%s:%s %s",real_recursive_flag,privkey_decrypted,username,remote_address,remote_path,local_path);
+            /* Extract beside the target and rename, so that the target can be a new name. */
+            snprintf(extract_dir,FILENAME_LENGTH-1,"%s.now_%s",path_temp,randstr);
+            if(mk_pdir(extract_dir)<0){
+                release_ssh_identity(privkey_decrypted);
+                trace_span_end(&span,1);
+                return 1;
+            }
+        }
+        snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s \"bash /usr/hpc-now/now_chunk.sh tar %s\" | zstd -q -dc | tar -xf - -C %s %s",ssh_prefix,remote_path,extract_dir,SYSTEM_CMD_REDIRECT);
+        run_flag=system(cmdline);
+        if(strcmp(extract_dir,path_temp)!=0){
+            name_p=remote_path+strlen(remote_path);
+            while(name_p>remote_path&&*(name_p-1)=='/'){
+                name_p--;
+            }
+            path_len=name_p-remote_path;
+            while(name_p>remote_path&&*(name_p-1)!='/'){
+                name_p--;
+            }
+            snprintf(extracted_path,FILENAME_LENGTH_EXT-1,"%s/%.*s",extract_dir,(int)(path_len-(name_p-remote_path)),name_p);
+            if(run_flag==0&&rename(extracted_path,path_temp)!=0){
+                run_flag=1;
+            }
+            rm_file_or_dir(extract_dir);
         }
     }
-    run_flag=system(cmdline);
-    rm_file_or_dir(privkey_decrypted);
+    release_ssh_identity(privkey_decrypted);
+    trace_span_end(&span,run_flag);
     if(run_flag!=0){
         return 1;
     }
-    else{
-        return 0;
-    }
+    return 0;
+#endif
 }
 
 int encrypt_user_privkey(char* ssh_privkey, char* crypto_keyfile){
@@ -433,7 +1339,9 @@ int get_user_sshkey(char* cluster_name, char* user_name, char* user_status, char
 
 int delete_user_sshkey(char* cluster_name, char* user_name, char* sshkey_dir){
     char user_privkey[FILENAME_LENGTH]="";
-    snprintf(user_privkey,FILENAME_LENGTH-1,"%s%s.%s%s%s.key*",sshkey_dir,PATH_SLASH,cluster_name,PATH_SLASH,cluster_name);
+    snprintf(user_privkey,FILENAME_LENGTH-1,"%s%s.%s%s%s.key",sshkey_dir,PATH_SLASH,cluster_name,PATH_SLASH,user_name);
+    key_broker_remove(user_privkey);
+    snprintf(user_privkey,FILENAME_LENGTH-1,"%s%s.%s%s%s.key*",sshkey_dir,PATH_SLASH,cluster_name,PATH_SLASH,user_name);
     return rm_file_or_dir(user_privkey);
 }
 
@@ -467,35 +1375,74 @@ int create_and_get_vaultdir(char* workdir, char* vaultdir){
     }
 }
 
+/*
+ * Build the 'at' job line to run hpcmgr on the master node.
+ * The "ready" and "ready_quick" types wait for each compute node to be reachable
+ * and to finish its initialization script, and then refresh the cluster. Master nodes with an older hpcmgr fall back to a
+ * fixed delay.
+ * return -3: invalid exec_type
+ * return -1: invalid delay_minutes
+ * return 0: normal exit
+ */
+int hpcmgr_at_job(char* exec_type, int delay_minutes, char* at_job, unsigned int maxlen){
+    char hpcmgr_cmd[128]="";
+    char at_time[32]="";
+    if(delay_minutes<0){
+        return -1;
+    }
+    if(strcmp(exec_type,"ready")==0){
+        strcpy(hpcmgr_cmd,"hpcmgr ready all || (sleep 420; hpcmgr connect; hpcmgr all)");
+    }
+    else if(strcmp(exec_type,"ready_quick")==0){
+        strcpy(hpcmgr_cmd,"hpcmgr ready quick || (sleep 60; hpcmgr quick)");
+    }
+    else if(strcmp(exec_type,"connect")==0||strcmp(exec_type,"all")==0||strcmp(exec_type,"clear")==0||strcmp(exec_type,"quick")==0){
+        snprintf(hpcmgr_cmd,127,"hpcmgr %s",exec_type);
+    }
+    else{
+        return -3;
+    }
+    if(delay_minutes==0){
+        strcpy(at_time,"now");
+    }
+    else{
+        snprintf(at_time,31,"now + %d minutes",delay_minutes);
+    }
+    snprintf(at_job,maxlen-1,"echo '%s' | at %s",hpcmgr_cmd,at_time);
+    return 0;
+}
+
 int remote_exec(char* workdir, char* crypto_keyfile, char* sshkey_folder, char* exec_type, int delay_minutes){
     char cmdline[CMDLINE_LENGTH]="";
+    char mux_options[LINE_LENGTH_SHORT]="";
+    char identity_option[LINE_LENGTH_SHORT]="";
     char opr_privkey_base[FILENAME_LENGTH]="";
     char opr_privkey_decrypted[FILENAME_LENGTH_EXT]="";
     char remote_address[32]="";
+    char at_job[256]="";
     int run_flag;
-    char randstr[7]="";
-    if(strcmp(exec_type,"connect")!=0&&strcmp(exec_type,"all")!=0&&strcmp(exec_type,"clear")!=0&&strcmp(exec_type,"quick")!=0){
-        return -3;
-    }
+    trace_span span;
     if(delay_minutes<0){
         return -1;
     }
+    if(hpcmgr_at_job(exec_type,delay_minutes,at_job,256)!=0){
+        return -3;
+    }
+    trace_span_start(&span,"remote_exec");
+    get_ssh_mux_options(mux_options,LINE_LENGTH_SHORT);
     if(get_state_nvalue(workdir,crypto_keyfile,"master_public_ip:",remote_address,32)!=0){
+        trace_span_end(&span,-7);
         return -7;
     }
-    generate_random_nstring(randstr,7,1);
     snprintf(opr_privkey_base,FILENAME_LENGTH-1,"%s%snow-cluster-login",sshkey_folder,PATH_SLASH);
-    if(file_convert(opr_privkey_base,randstr,"decrypt")!=0){
+    if(get_ssh_identity(opr_privkey_base,identity_option,LINE_LENGTH_SHORT,opr_privkey_decrypted,FILENAME_LENGTH_EXT)<0){
+        trace_span_end(&span,-5);
         return -5;
     }
-    snprintf(opr_privkey_decrypted,FILENAME_LENGTH_EXT-1,"%s.%s",opr_privkey_base,randstr);
-    if(chmod_ssh_privkey(opr_privkey_decrypted)!=0){
-        rm_file_or_dir(opr_privkey_decrypted);/* Delete the decrypted opr ssh private key. */
-        return -5;
-    }
-    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh -n -o StrictHostKeyChecking=no -i %s root@%s \"echo \"hpcmgr %s\" | at now + %d minutes\" %s",opr_privkey_decrypted,remote_address,exec_type,delay_minutes,SYSTEM_CMD_REDIRECT);
+    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -n -o StrictHostKeyChecking=no %s root@%s \"%s\" %s",mux_options,identity_option,remote_address,at_job,SYSTEM_CMD_REDIRECT);
     run_flag=system(cmdline);
-    rm_file_or_dir(opr_privkey_decrypted);/* Delete the decrypted opr ssh private key. */
+    release_ssh_identity(opr_privkey_decrypted);
+    trace_span_end(&span,run_flag);
     if(run_flag!=0){
         return 1;
     }
@@ -505,20 +1452,26 @@ int remote_exec(char* workdir, char* crypto_keyfile, char* sshkey_folder, char*
 int remote_exec_general(char* workdir, char* crypto_keyfile, char* sshkey_folder, char* username, char* commands, char* extra_options, int delay_minutes, int silent_flag, char* std_redirect, char* err_redirect){
     int run;
     char cmdline[CMDLINE_LENGTH]="";
+    char mux_options[LINE_LENGTH_SHORT]="";
+    char identity_option[LINE_LENGTH_SHORT]="";
     char privkey_base[FILENAME_LENGTH]="";
     char privkey_decrypted[FILENAME_LENGTH_EXT]="";
     char remote_address[32]="";
     char cluster_name[CLUSTER_ID_LENGTH_MAX_PLUS]="";
     char cluster_role[16]="";
     char cluster_role_ext[16]="";
-    char randstr[7]="";
+    trace_span span;
     if(delay_minutes<0){
         return -1;
     }
+    trace_span_start(&span,"remote_exec");
+    get_ssh_mux_options(mux_options,LINE_LENGTH_SHORT);
     if(get_state_nvalue(workdir,crypto_keyfile,"master_public_ip:",remote_address,32)!=0){
+        trace_span_end(&span,-5);
         return -5;
     }
     if(get_cluster_nname(cluster_name,CLUSTER_ID_LENGTH_MAX_PLUS,workdir)!=0){
+        trace_span_end(&span,-7);
         return -7;
     }
     cluster_role_detect(workdir,cluster_role,cluster_role_ext,16);
@@ -528,86 +1481,492 @@ int remote_exec_general(char* workdir, char* crypto_keyfile, char* sshkey_folder
     else{
         snprintf(privkey_base,FILENAME_LENGTH,"%s%s.%s%s%s.key",sshkey_folder,PATH_SLASH,cluster_name,PATH_SLASH,username);
     }
-    generate_random_nstring(randstr,7,1);
-    if(file_convert(privkey_base,randstr,"decrypt")!=0){
-        return -3;
-    }
-    snprintf(privkey_decrypted,FILENAME_LENGTH_EXT-1,"%s.%s",privkey_base,randstr);
-    if(chmod_ssh_privkey(privkey_decrypted)!=0){
-        rm_file_or_dir(privkey_decrypted); /* Delete the decrypted opr ssh private key. */
+    if(get_ssh_identity(privkey_base,identity_option,LINE_LENGTH_SHORT,privkey_decrypted,FILENAME_LENGTH_EXT)<0){
+        trace_span_end(&span,-3);
         return -3;
     }
     if(delay_minutes==0){
         if(silent_flag==0){
-            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"%s\" %s",extra_options,privkey_decrypted,username,remote_address,commands,SYSTEM_CMD_REDIRECT);
+            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"%s\" %s",mux_options,extra_options,identity_option,username,remote_address,commands,SYSTEM_CMD_REDIRECT);
         }
         else if(silent_flag==1){
-            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"%s\"",extra_options,privkey_decrypted,username,remote_address,commands);
+            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"%s\"",mux_options,extra_options,identity_option,username,remote_address,commands);
         }
         else if(silent_flag==2){
-            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"%s\" %s",extra_options,privkey_decrypted,username,remote_address,commands,SYSTEM_CMD_ERR_REDIRECT_NULL);
+            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"%s\" %s",mux_options,extra_options,identity_option,username,remote_address,commands,SYSTEM_CMD_ERR_REDIRECT_NULL);
         }
         else{
             if(strcmp(std_redirect,err_redirect)==0){
                 if(strlen(std_redirect)==0){
-                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"%s\"",extra_options,privkey_decrypted,username,remote_address,commands);
+                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"%s\"",mux_options,extra_options,identity_option,username,remote_address,commands);
                 }
                 else{
-                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"%s\" >%s 2>&1",extra_options,privkey_decrypted,username,remote_address,commands,std_redirect);
+                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"%s\" >%s 2>&1",mux_options,extra_options,identity_option,username,remote_address,commands,std_redirect);
                 }
             }
             else{
                 if(strlen(std_redirect)==0){
-                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"%s\" 2>%s",extra_options,privkey_decrypted,username,remote_address,commands,err_redirect);
+                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"%s\" 2>%s",mux_options,extra_options,identity_option,username,remote_address,commands,err_redirect);
                 }
                 else if(strlen(err_redirect)==0){
-                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"%s\" >%s 2>&1",extra_options,privkey_decrypted,username,remote_address,commands,std_redirect);
+                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"%s\" >%s 2>&1",mux_options,extra_options,identity_option,username,remote_address,commands,std_redirect);
                 }
                 else{
-                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"%s\" >%s 2>%s",extra_options,privkey_decrypted,username,remote_address,commands,std_redirect,err_redirect);
+                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"%s\" >%s 2>%s",mux_options,extra_options,identity_option,username,remote_address,commands,std_redirect,err_redirect);
                 }
             }
         }
     }
     else{
         if(silent_flag==0){
-            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"echo \"%s\" | at now + %d minutes\" %s",extra_options,privkey_decrypted,username,remote_address,commands,delay_minutes,SYSTEM_CMD_REDIRECT);
+            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"echo \"%s\" | at now + %d minutes\" %s",mux_options,extra_options,identity_option,username,remote_address,commands,delay_minutes,SYSTEM_CMD_REDIRECT);
         }
         else if(silent_flag==1){
-            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"echo \"%s\" | at now + %d minutes\"",extra_options,privkey_decrypted,username,remote_address,commands,delay_minutes);
+            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"echo \"%s\" | at now + %d minutes\"",mux_options,extra_options,identity_option,username,remote_address,commands,delay_minutes);
+        }
+        else if(silent_flag==2){
+            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"echo \"%s\" | at now + %d minutes\" %s",mux_options,extra_options,identity_option,username,remote_address,commands,delay_minutes,SYSTEM_CMD_ERR_REDIRECT_NULL);
+        }
+        else{
+            if(strcmp(std_redirect,err_redirect)==0){
+                if(strlen(std_redirect)==0){
+                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"echo \"%s\" | at now + %d minutes\"",mux_options,extra_options,identity_option,username,remote_address,commands,delay_minutes);
+                }
+                else{
+                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"echo \"%s\" | at now + %d minutes\" >%s 2>&1",mux_options,extra_options,identity_option,username,remote_address,commands,delay_minutes,std_redirect);
+                }
+            }
+            else{
+                if(strlen(std_redirect)==0){
+                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"echo \"%s\" | at now + %d minutes\" 2>%s",mux_options,extra_options,identity_option,username,remote_address,commands,delay_minutes,err_redirect);
+                }
+                else if(strlen(err_redirect)==0){
+                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"echo \"%s\" | at now + %d minutes\" >%s 2>&1",mux_options,extra_options,identity_option,username,remote_address,commands,delay_minutes,std_redirect);
+                }
+                else{
+                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s %s@%s \"echo \"%s\" | at now + %d minutes\" >%s 2>%s",mux_options,extra_options,identity_option,username,remote_address,commands,delay_minutes,std_redirect,err_redirect);
+                }
+            }
+        }
+    }
+    /*printf("#%s\n",cmdline);*/
+    run=system(cmdline);
+    release_ssh_identity(privkey_decrypted);
+    trace_span_end(&span,run);
+    if(run!=0){
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * stream_last 1: the output of the last step goes to the console as it runs,
+ * e.g. a job submission or a log to follow, and is not kept in the step output.
+ */
+int remote_batch_init(remote_batch* batch, int stop_on_error, int stream_last){
+    if(batch==NULL){
+        return -1;
+    }
+    memset(batch,0,sizeof(remote_batch));
+    batch->stop_on_error=(stop_on_error==1)?1:0;
+    batch->stream_last=(stream_last==1)?1:0;
+    return 0;
+}
+
+/*
+ * Add a step to a remote batch.
+ * step_type "put"   : param1 is the local file, param2 is the remote path
+ * step_type "secret": param1 is the secret string, param2 is the remote path.
+ *                     The secret is shipped as a 0600 file, so that it is not
+ *                     in the batch script or the command lines. The step that
+ *                     uses it should remove it.
+ * step_type "exec"  : param1 is the commands, param2 is ignored
+ * return -1: the batch is full
+ * return -3: invalid step_type or params
+ * return 0: normal exit
+ */
+int remote_batch_add(remote_batch* batch, char* step_type, char* param1, char* param2){
+    remote_batch_step* step=NULL;
+    if(batch->step_num>REMOTE_BATCH_STEPS_MAX-1){
+        return -1;
+    }
+    step=&(batch->steps[batch->step_num]);
+    if(strcmp(step_type,"put")==0||strcmp(step_type,"secret")==0){
+        if(strlen(param1)==0||strlen(param2)==0){
+            return -3;
+        }
+        strncpy(step->local_path,param1,FILENAME_LENGTH-1);
+        strncpy(step->remote_path,param2,FILENAME_LENGTH-1);
+    }
+    else if(strcmp(step_type,"exec")==0){
+        if(strlen(param1)==0){
+            return -3;
+        }
+        strncpy(step->commands,param1,CMDLINE_LENGTH-1);
+    }
+    else{
+        return -3;
+    }
+    strncpy(step->step_type,step_type,7);
+    step->exit_code=-1;
+    strcpy(step->output,"");
+    batch->step_num++;
+    return 0;
+}
+
+/*
+ * A line of the output of a step: printed if the step is streamed, otherwise
+ * kept in the step output up to REMOTE_BATCH_OUTPUT_LENGTH.
+ */
+void remote_batch_output(remote_batch* batch, int step_index, int stream_flag, char* line){
+    if(step_index<0||step_index>batch->step_num-1){
+        return;
+    }
+    if(stream_flag==1){
+        printf("%s\n",line);
+        fflush(stdout);
+        return;
+    }
+    if(strlen(batch->steps[step_index].output)+strlen(line)+2<REMOTE_BATCH_OUTPUT_LENGTH){
+        strcat(batch->steps[step_index].output,line);
+        strcat(batch->steps[step_index].output,"\n");
+    }
+}
+
+/*
+ * Run all the steps of a batch with only one ssh round-trip. The files to put
+ * and a generated script are packed to one tarball and streamed to the remote
+ * side, the script runs the steps in order and reports the exit code and the
+ * output of each step, which are read back to the batch as they come. Nothing
+ * of the output is written to the local disk. The step output keeps the first
+ * REMOTE_BATCH_OUTPUT_LENGTH bytes, use stream_last for the longer ones.
+ * Ctrl+C stops a streamed step, e.g. tail -f, and the run returns normally.
+ * return -1: empty batch
+ * return -3: failed to get the ssh key
+ * return -5: failed to get the master address
+ * return -7: failed to get the cluster name
+ * return -9: failed to prepare the local files
+ * return 3: failed to connect, no step reported
+ * return 1: one or more steps failed
+ * return 0: all the steps succeeded
+ */
+int remote_batch_run(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* username, remote_batch* batch){
+    char cmdline[CMDLINE_LENGTH]="";
+    char mux_options[LINE_LENGTH_SHORT]="";
+    char identity_option[LINE_LENGTH_SHORT]="";
+    char privkey_decrypted[FILENAME_LENGTH_EXT]="";
+    char remote_address[32]="";
+    char stage_dir[DIR_LENGTH]="";
+    char stage_file[FILENAME_LENGTH]="";
+    char bundle_file[FILENAME_LENGTH]="";
+    char remote_dir[64]="";
+    char randstr[7]="";
+    char line_buffer[LINE_LENGTH]="";
+    char* marker=NULL;
+    int i,step_index,step_code,run_flag;
+    int current_step=-1,stream_flag=0,report_num=0,fail_num=0;
+    FILE* file_p=NULL;
+    void (*sigint_handler)(int);
+    trace_span span;
+    if(batch==NULL||batch->step_num<1){
+        return -1;
+    }
+    for(i=0;i<batch->step_num;i++){
+        batch->steps[i].exit_code=-1;
+        strcpy(batch->steps[i].output,"");
+    }
+    trace_span_start(&span,"remote_batch");
+    get_ssh_mux_options(mux_options,LINE_LENGTH_SHORT);
+    generate_random_nstring(randstr,7,1);
+    snprintf(stage_dir,DIR_LENGTH-1,"%sbatch_%s",NOW_TMP_DIR,randstr);
+    snprintf(bundle_file,FILENAME_LENGTH-1,"%sbatch_%s.tgz",NOW_TMP_DIR,randstr);
+    snprintf(remote_dir,63,"/tmp/now_batch_%s",randstr);
+    if(mk_pdir(stage_dir)<0){
+        trace_span_end(&span,-9);
+        return -9;
+    }
+    for(i=0;i<batch->step_num;i++){
+        snprintf(stage_file,FILENAME_LENGTH-1,"%s%sput_%d",stage_dir,PATH_SLASH,i);
+        if(strcmp(batch->steps[i].step_type,"secret")==0){
+            file_p=fopen(stage_file,"wb");
+            if(file_p==NULL){
+                rm_file_or_dir(stage_dir);
+                trace_span_end(&span,-9);
+                return -9;
+            }
+            fclose(file_p);
+            chmod_ssh_privkey(stage_file);
+            file_p=fopen(stage_file,"wb");
+            if(file_p==NULL){
+                rm_file_or_dir(stage_dir);
+                trace_span_end(&span,-9);
+                return -9;
+            }
+            fprintf(file_p,"%s",batch->steps[i].local_path);
+            fclose(file_p);
+            continue;
+        }
+        if(strcmp(batch->steps[i].step_type,"put")!=0){
+            continue;
+        }
+        snprintf(cmdline,CMDLINE_LENGTH-1,"%s %s %s %s",COPY_FILE_CMD,batch->steps[i].local_path,stage_file,SYSTEM_CMD_REDIRECT);
+        if(system(cmdline)!=0){
+            rm_file_or_dir(stage_dir);
+            trace_span_end(&span,-9);
+            return -9;
+        }
+    }
+    snprintf(line_buffer,LINE_LENGTH-1,"%s%sbatch.sh",stage_dir,PATH_SLASH);
+    file_p=fopen(line_buffer,"wb");
+    if(file_p==NULL){
+        rm_file_or_dir(stage_dir);
+        trace_span_end(&span,-9);
+        return -9;
+    }
+    /* The batch dir holds the secrets, remove it even if the session is cut, e.g. a streamed tail -f stopped. */
+    fprintf(file_p,"#!/bin/bash\ntrap 'rm -rf %s' EXIT\ntrap 'exit 1' HUP INT TERM PIPE\nfailed=0\n",remote_dir);
+    for(i=0;i<batch->step_num;i++){
+        fprintf(file_p,"if [ $failed -eq 0 ]; then\n");
+        if(strcmp(batch->steps[i].step_type,"exec")!=0){
+            fprintf(file_p,"mv -f %s/put_%d %s > %s/out_%d 2>&1\n",remote_dir,i,batch->steps[i].remote_path,remote_dir,i);
+        }
+        else if(batch->stream_last==1&&i==batch->step_num-1){
+            fprintf(file_p,"echo \"#NOWBATCH_STREAM %d\"\n(\n%s\n) 2>&1 < /dev/null\n",i,batch->steps[i].commands);
+        }
+        else{
+            fprintf(file_p,"(\n%s\n) > %s/out_%d 2>&1 < /dev/null\n",batch->steps[i].commands,remote_dir,i);
+        }
+        fprintf(file_p,"rc=$?\nelse\nrc=-1\nfi\n");
+        fprintf(file_p,"echo \"#NOWBATCH_STEP %d $rc\"\ncat %s/out_%d 2>/dev/null\n",i,remote_dir,i);
+        if(batch->stop_on_error==1){
+            fprintf(file_p,"[ $rc -ne 0 ] && failed=1\n");
+        }
+    }
+    fprintf(file_p,"exit 0\n");
+    fclose(file_p);
+    snprintf(cmdline,CMDLINE_LENGTH-1,"tar -czf %s -C %s . %s",bundle_file,stage_dir,SYSTEM_CMD_REDIRECT);
+    run_flag=system(cmdline);
+    rm_file_or_dir(stage_dir);
+    if(run_flag!=0){
+        rm_file_or_dir(bundle_file);
+        trace_span_end(&span,-9);
+        return -9;
+    }
+    chmod_ssh_privkey(bundle_file);
+    run_flag=get_ssh_target(workdir,crypto_keyfile,sshkey_dir,username,remote_address,32,identity_option,LINE_LENGTH_SHORT,privkey_decrypted,FILENAME_LENGTH_EXT);
+    if(run_flag!=0){
+        rm_file_or_dir(bundle_file);
+        trace_span_end(&span,run_flag);
+        return run_flag;
+    }
+    /* No shell variables in the remote commands, so the quoting works for both sh and cmd. */
+    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no %s %s@%s \"umask 077 && mkdir -p %s && tar -xzf - -C %s && bash %s/batch.sh\" < %s 2>>%s",mux_options,identity_option,username,remote_address,remote_dir,remote_dir,remote_dir,bundle_file,SYSTEM_CMD_ERROR_LOG);
+#ifdef _WIN32
+    file_p=_popen(cmdline,"r");
+#else
+    file_p=popen(cmdline,"r");
+#endif
+    /* Ctrl+C stops the ssh (and the streamed step) only, the results are still read. */
+    sigint_handler=signal(SIGINT,SIG_IGN);
+    run_flag=1;
+    if(file_p!=NULL){
+        while(fngetline(file_p,line_buffer,LINE_LENGTH)!=1){
+            marker=strstr(line_buffer,"#NOWBATCH_");
+            if(marker!=NULL&&marker!=line_buffer){
+                /* The last output line of a step had no line break. */
+                *marker='\0';
+                remote_batch_output(batch,current_step,stream_flag,line_buffer);
+                *marker='#';
+                memmove(line_buffer,marker,strlen(marker)+1);
+            }
+            if(strncmp(line_buffer,"#NOWBATCH_STREAM ",17)==0&&sscanf(line_buffer+17,"%d",&step_index)==1&&step_index>-1&&step_index<batch->step_num){
+                current_step=step_index;
+                stream_flag=1;
+                continue;
+            }
+            if(strncmp(line_buffer,"#NOWBATCH_STEP ",15)==0&&sscanf(line_buffer+15,"%d %d",&step_index,&step_code)==2&&step_index>-1&&step_index<batch->step_num){
+                current_step=step_index;
+                batch->steps[current_step].exit_code=step_code;
+                stream_flag=0;
+                report_num++;
+                continue;
+            }
+            remote_batch_output(batch,current_step,stream_flag,line_buffer);
+        }
+#ifdef _WIN32
+        run_flag=_pclose(file_p);
+#else
+        run_flag=pclose(file_p);
+#endif
+    }
+    signal(SIGINT,sigint_handler);
+    release_ssh_identity(privkey_decrypted);
+    rm_file_or_dir(bundle_file);
+    trace_span_end(&span,run_flag);
+    if(report_num==0){
+        return 3;
+    }
+    for(i=0;i<batch->step_num;i++){
+        if(batch->steps[i].exit_code!=0){
+            fail_num++;
+        }
+    }
+    if(fail_num>0){
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Kill a timed-out fanout task: the direct children of its shell first (e.g. the
+ * scp, curl or both ends of a pipe), then the shell, so that nothing keeps
+ * writing the local files after the caller has moved on.
+ * Windows has no pid file for the task, it is left behind.
+ */
+void fanout_kill(char* pid_file){
+#ifndef _WIN32
+    char cmdline[CMDLINE_LENGTH]="";
+    char pid_string[16]="";
+    int pid;
+    FILE* file_p=fopen(pid_file,"r");
+    if(file_p==NULL){
+        return;
+    }
+    fngetline(file_p,pid_string,16);
+    fclose(file_p);
+    pid=string_to_positive_num(pid_string);
+    if(pid<2){
+        return;
+    }
+    snprintf(cmdline,CMDLINE_LENGTH-1,"pkill -TERM -P %d %s; kill -TERM %d %s",pid,SYSTEM_CMD_REDIRECT_NULL,pid,SYSTEM_CMD_REDIRECT_NULL);
+    system(cmdline);
+#endif
+}
+
+/*
+ * Run the command lines of the tasks concurrently as background jobs, with at
+ * most concurrency jobs at a time. A task not finished in timeout_sec is killed
+ * with the exit_code -1, and its slot is given to the next task.
+ * On Windows, the command lines should not contain double quotes.
+ * return -1: invalid params
+ * return N>=0: the number of failed or timed-out tasks
+ */
+int fanout_run(fanout_task* tasks, int task_num, int concurrency, int timeout_sec){
+    char randstr[7]="";
+    char done_file[FILENAME_LENGTH]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    char done_flag[8]="";
+#ifndef _WIN32
+    char script_file[FILENAME_LENGTH]="";
+    char pid_file[FILENAME_LENGTH]="";
+#endif
+    int i,running_num,finished_num=0,fail_num=0;
+    FILE* file_p=NULL;
+    time_t current_time;
+    trace_span span;
+    if(tasks==NULL||task_num<1){
+        return -1;
+    }
+    if(concurrency<1){
+        concurrency=FANOUT_CONCURRENCY_DEFAULT;
+    }
+    if(timeout_sec<1){
+        timeout_sec=FANOUT_TIMEOUT_DEFAULT;
+    }
+    trace_span_start(&span,"fanout_run");
+    generate_random_nstring(randstr,7,1);
+    for(i=0;i<task_num;i++){
+        tasks[i].state=0;
+        tasks[i].exit_code=-1;
+        tasks[i].elapsed_sec=0;
+    }
+    while(finished_num<task_num){
+        running_num=0;
+        for(i=0;i<task_num;i++){
+            if(tasks[i].state==1){
+                running_num++;
+            }
         }
-        else if(silent_flag==2){
-            snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"echo \"%s\" | at now + %d minutes\" %s",extra_options,privkey_decrypted,username,remote_address,commands,delay_minutes,SYSTEM_CMD_ERR_REDIRECT_NULL);
+        for(i=0;i<task_num&&running_num<concurrency;i++){
+            if(tasks[i].state!=0){
+                continue;
+            }
+            snprintf(done_file,FILENAME_LENGTH-1,"%sfanout_%s_%d.done",NOW_TMP_DIR,randstr,i);
+#ifdef _WIN32
+            snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s%s %s && echo 0 > %s || echo 1 > %s%s",START_BG_SHELL,tasks[i].cmdline,SYSTEM_CMD_REDIRECT,done_file,done_file,END_BG_SHELL);
+#else
+            /* The task runs as a script that records its pid, so that it can be killed on timeout. */
+            snprintf(script_file,FILENAME_LENGTH-1,"%sfanout_%s_%d.sh",NOW_TMP_DIR,randstr,i);
+            snprintf(pid_file,FILENAME_LENGTH-1,"%sfanout_%s_%d.pid",NOW_TMP_DIR,randstr,i);
+            file_p=fopen(script_file,"w+");
+            if(file_p==NULL){
+                tasks[i].state=2;
+                finished_num++;
+                continue;
+            }
+            fprintf(file_p,"echo $$ > %s\n%s %s && echo 0 > %s || echo 1 > %s\n",pid_file,tasks[i].cmdline,SYSTEM_CMD_REDIRECT,done_file,done_file);
+            fclose(file_p);
+            snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s/bin/sh %s%s",START_BG_SHELL,script_file,END_BG_SHELL);
+#endif
+            tasks[i].start_time=(long long)time(NULL);
+            if(system(cmdline)!=0){
+                tasks[i].state=2;
+                finished_num++;
+#ifndef _WIN32
+                rm_file_or_dir(script_file);
+#endif
+                continue;
+            }
+            tasks[i].state=1;
+            running_num++;
         }
-        else{
-            if(strcmp(std_redirect,err_redirect)==0){
-                if(strlen(std_redirect)==0){
-                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"echo \"%s\" | at now + %d minutes\"",extra_options,privkey_decrypted,username,remote_address,commands,delay_minutes);
-                }
-                else{
-                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"echo \"%s\" | at now + %d minutes\" >%s 2>&1",extra_options,privkey_decrypted,username,remote_address,commands,delay_minutes,std_redirect);
-                }
+        sleep_func(1);
+        time(&current_time);
+        for(i=0;i<task_num;i++){
+            if(tasks[i].state!=1){
+                continue;
             }
-            else{
-                if(strlen(std_redirect)==0){
-                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"echo \"%s\" | at now + %d minutes\" 2>%s",extra_options,privkey_decrypted,username,remote_address,commands,delay_minutes,err_redirect);
-                }
-                else if(strlen(err_redirect)==0){
-                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"echo \"%s\" | at now + %d minutes\" >%s 2>&1",extra_options,privkey_decrypted,username,remote_address,commands,delay_minutes,std_redirect);
-                }
-                else{
-                    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s -o StrictHostKeyChecking=no -i %s %s@%s \"echo \"%s\" | at now + %d minutes\" >%s 2>%s",extra_options,privkey_decrypted,username,remote_address,commands,delay_minutes,std_redirect,err_redirect);
-                }
+            snprintf(done_file,FILENAME_LENGTH-1,"%sfanout_%s_%d.done",NOW_TMP_DIR,randstr,i);
+            strcpy(done_flag,"");
+            file_p=fopen(done_file,"r");
+            if(file_p!=NULL){
+                fngetline(file_p,done_flag,8);
+                fclose(file_p);
+            }
+            tasks[i].elapsed_sec=(int)((long long)current_time-tasks[i].start_time);
+            /* The done file can be created before it is written, so wait for the flag. */
+            if(done_flag[0]=='0'||done_flag[0]=='1'){
+                tasks[i].exit_code=done_flag[0]-'0';
+                tasks[i].state=2;
+                finished_num++;
+                rm_file_or_dir(done_file);
+            }
+            else if(tasks[i].elapsed_sec>timeout_sec){
+                tasks[i].state=2;
+                finished_num++;
+#ifndef _WIN32
+                snprintf(pid_file,FILENAME_LENGTH-1,"%sfanout_%s_%d.pid",NOW_TMP_DIR,randstr,i);
+                fanout_kill(pid_file);
+                rm_file_or_dir(done_file);
+#endif
+            }
+#ifndef _WIN32
+            if(tasks[i].state==2){
+                snprintf(script_file,FILENAME_LENGTH-1,"%sfanout_%s_%d.sh",NOW_TMP_DIR,randstr,i);
+                snprintf(pid_file,FILENAME_LENGTH-1,"%sfanout_%s_%d.pid",NOW_TMP_DIR,randstr,i);
+                rm_file_or_dir(script_file);
+                rm_file_or_dir(pid_file);
             }
+#endif
         }
     }
-    /*printf("#%s\n",cmdline);*/
-    run=system(cmdline);
-    rm_file_or_dir(privkey_decrypted);
-    if(run!=0){
-        return 1;
+    for(i=0;i<task_num;i++){
+        if(tasks[i].exit_code!=0){
+            fail_num++;
+        }
     }
-    return 0;
+    trace_span_end(&span,fail_num);
+    return fail_num;
 }
 
 int get_ak_sk(char* secret_file, char* crypto_key_file, char* ak, char* sk, char* cloud_flag){
@@ -1027,10 +2386,14 @@ int decrypt_files(char* workdir, char* crypto_key_filename){
     char stackdir[DIR_LENGTH]="";
     int compute_node_num=0;
     int i;
+    trace_span span;
+    trace_span_start(&span,"decrypt");
     if(create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH)!=0){
+        trace_span_end(&span,-1);
         return -1;
     }
     if(get_file_sha_hash(crypto_key_filename,hash_key,33)!=0){
+        trace_span_end(&span,-1);
         return -1;
     }
     snprintf(filename_temp,FILENAME_LENGTH-1,"%s%scurrentstate.tmp",stackdir,PATH_SLASH);
@@ -1051,11 +2414,20 @@ int decrypt_files(char* workdir, char* crypto_key_filename){
     decrypt_single_file(NOW_CRYPTO_EXEC,filename_temp,hash_key);
     snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_natgw.tf.tmp",stackdir,PATH_SLASH);
     decrypt_single_file(NOW_CRYPTO_EXEC,filename_temp,hash_key);
+    if(compute_pool_or_not(stackdir)==0){
+        snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s.tmp",stackdir,PATH_SLASH,COMPUTE_POOL_STACK);
+        decrypt_single_file(NOW_CRYPTO_EXEC,filename_temp,hash_key);
+        snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s.tmp",stackdir,PATH_SLASH,COMPUTE_POOL_NODES);
+        decrypt_single_file(NOW_CRYPTO_EXEC,filename_temp,hash_key);
+        trace_span_end(&span,0);
+        return 0;
+    }
     compute_node_num=get_compute_node_num(stackdir,crypto_key_filename,"all");
     for(i=1;i<compute_node_num+1;i++){
         snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf.tmp",stackdir,PATH_SLASH,i);
         decrypt_single_file(NOW_CRYPTO_EXEC,filename_temp,hash_key);
     }
+    trace_span_end(&span,0);
     return 0;
 }
 
@@ -1128,10 +2500,14 @@ int delete_decrypted_files(char* workdir, char* crypto_key_filename){
     char vaultdir[DIR_LENGTH]="";
     int compute_node_num=0;
     int i;
+    trace_span span;
+    trace_span_start(&span,"encrypt_back");
     if(create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH)!=0||create_and_get_subdir(workdir,"vault",vaultdir,DIR_LENGTH)!=0){
+        trace_span_end(&span,-1);
         return -1;
     }
     if(get_file_sha_hash(crypto_key_filename,hash_key,33)!=0){
+        trace_span_end(&span,-3);
         return -3;
     }
     /* This is very important. AND ALSO RISKY! */
@@ -1175,14 +2551,21 @@ int delete_decrypted_files(char* workdir, char* crypto_key_filename){
     encrypt_and_delete(NOW_CRYPTO_EXEC,filename_temp,hash_key);
     snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_natgw.tf",stackdir,PATH_SLASH);
     encrypt_and_delete(NOW_CRYPTO_EXEC,filename_temp,hash_key);
-    compute_node_num=get_compute_node_num(stackdir,crypto_key_filename,"all");
-    for(i=1;i<compute_node_num+1;i++){
-        snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf",stackdir,PATH_SLASH,i);
-        encrypt_and_delete(NOW_CRYPTO_EXEC,filename_temp,hash_key);
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_STACK);
+    encrypt_and_delete(NOW_CRYPTO_EXEC,filename_temp,hash_key);
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_NODES);
+    encrypt_and_delete(NOW_CRYPTO_EXEC,filename_temp,hash_key);
+    if(compute_pool_or_not(stackdir)!=0){
+        compute_node_num=get_compute_node_num(stackdir,crypto_key_filename,"all");
+        for(i=1;i<compute_node_num+1;i++){
+            snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf",stackdir,PATH_SLASH,i);
+            encrypt_and_delete(NOW_CRYPTO_EXEC,filename_temp,hash_key);
+        }
     }
     /* User registry */
     snprintf(filename_temp,FILENAME_LENGTH-1,"%s%suser_passwords.txt",vaultdir,PATH_SLASH);
     encrypt_and_delete(NOW_CRYPTO_EXEC,filename_temp,hash_key);
+    trace_span_end(&span,0);
     return 0;
 }
 
@@ -1380,25 +2763,33 @@ int getstate(char* workdir, char* crypto_filename){
     char string_temp[64]="";
     char string_temp2[64]="";
     char pay_method[8]="";
+    char cluster_name[CLUSTER_ID_LENGTH_MAX_PLUS]="";
     int node_num_gs;
     int node_num_on_gs=0;
+    int compute_pool_flag;
     int i;
     FILE* file_p_tfstate=NULL;
     FILE* file_p_statefile=NULL;
     FILE* file_p_hostfile=NULL;
+    trace_span span;
+    trace_span_start(&span,"getstate");
     if(get_cloud_flag(workdir,crypto_filename,cloud_flag,16)!=0||create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH)!=0){
+        trace_span_end(&span,-3);
         return -3;
     }
     if(get_file_sha_hash(crypto_filename,hash_key,64)!=0){
+        trace_span_end(&span,-5);
         return -5;
     }
     snprintf(tfstate,FILENAME_LENGTH-1,"%s%sterraform.tfstate",stackdir,PATH_SLASH);
     if(file_exist_or_not(tfstate)!=0){
         snprintf(filename_temp,FILENAME_LENGTH-1,"%s%sterraform.tfstate.tmp",stackdir,PATH_SLASH);
         if(decrypt_single_file(NOW_CRYPTO_EXEC,filename_temp,hash_key)!=0){
+            trace_span_end(&span,-1);
             return -1;
         }
         if(file_exist_or_not(tfstate)!=0){
+            trace_span_end(&span,-1);
             return -1;
         }
     }
@@ -1406,21 +2797,26 @@ int getstate(char* workdir, char* crypto_filename){
     if(file_exist_or_not(master_tf)!=0){
         snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_master.tf.tmp",stackdir,PATH_SLASH);
         if(decrypt_single_file(NOW_CRYPTO_EXEC,filename_temp,hash_key)!=0){
+            trace_span_end(&span,-1);
             return -1;
         }
         if(file_exist_or_not(master_tf)!=0){
+            trace_span_end(&span,-1);
             return -1;
         }
     }
     snprintf(compute_template,FILENAME_LENGTH-1,"%s%scompute_template",stackdir,PATH_SLASH);
     if(file_exist_or_not(compute_template)!=0){
+        trace_span_end(&span,-1);
         return -1;
     }
+    compute_pool_flag=compute_pool_or_not(stackdir);
     file_p_tfstate=fopen(tfstate,"r");
     snprintf(statefile,FILENAME_LENGTH-1,"%s%scurrentstate",stackdir,PATH_SLASH);
     file_p_statefile=fopen(statefile,"w+");
     if(file_p_statefile==NULL){
         fclose(file_p_tfstate);
+        trace_span_end(&span,-1);
         return -1;
     }
     snprintf(hostfile,FILENAME_LENGTH-1,"%s%shostfile_latest",stackdir,PATH_SLASH);
@@ -1428,6 +2824,7 @@ int getstate(char* workdir, char* crypto_filename){
     if(file_p_hostfile==NULL){
         fclose(file_p_tfstate);
         fclose(file_p_statefile);
+        trace_span_end(&span,-1);
         return -1;
     }
     if(strcmp(cloud_flag,"CLOUD_D")==0){
@@ -1490,7 +2887,7 @@ int getstate(char* workdir, char* crypto_filename){
             find_and_nget(tfstate,LINE_LENGTH_SHORT,"\"instance_name\": \"database","","",90,"\"status\":","","",'\"',4,string_temp,64);
             fprintf(file_p_statefile,"database_status: %s\n",string_temp);
         }
-        for(i=0;i<node_num_gs;i++){
+        for(i=0;compute_pool_flag!=0&&i<node_num_gs;i++){
             snprintf(string_temp2,63,"\"instance_name\": \"compute%d",i+1);
             find_and_nget(tfstate,LINE_LENGTH_SHORT,string_temp2,"","",50,"private_ip","","",'\"',4,string_temp,64);
             fprintf(file_p_statefile,"compute%d_private_ip: %s\n",i+1,string_temp);
@@ -1519,7 +2916,7 @@ int getstate(char* workdir, char* crypto_filename){
         fprintf(file_p_statefile,"master_status: %s\n",string_temp);
         find_and_nget(tfstate,LINE_LENGTH_SHORT,"\"name\": \"db_state","","",30,"\"state\":","","",'\"',4,string_temp,64);
         fprintf(file_p_statefile,"database_status: %s\n",string_temp);
-        for(i=0;i<node_num_gs;i++){
+        for(i=0;compute_pool_flag!=0&&i<node_num_gs;i++){
             snprintf(string_temp2,63,"\"name\": \"compute%d",i+1);
             find_and_nget(tfstate,LINE_LENGTH_SHORT,string_temp2,"","",90,"private_ip","","",'\"',4,string_temp,64);
             fprintf(file_p_statefile,"compute%d_private_ip: %s\n",i+1,string_temp);
@@ -1553,7 +2950,7 @@ int getstate(char* workdir, char* crypto_filename){
         else{
             fprintf(file_p_statefile,"database_status: Stopped\n");
         }
-        for(i=0;i<node_num_gs;i++){
+        for(i=0;compute_pool_flag!=0&&i<node_num_gs;i++){
             snprintf(string_temp2,63,"\"name\": \"compute%d\",",i+1);
             find_and_nget(tfstate,LINE_LENGTH_SHORT,string_temp2,"","",50,"\"access_ip_v4\":","","",'\"',4,string_temp,64);
             fprintf(file_p_statefile,"compute%d_private_ip: %s\n",i+1,string_temp);
@@ -1583,7 +2980,7 @@ int getstate(char* workdir, char* crypto_filename){
         fprintf(file_p_statefile,"master_status: %s\n",string_temp);
         find_and_nget(tfstate,LINE_LENGTH_SHORT,"\"name\": \"database\",","","",100,"\"status\":","","",'\"',4,string_temp,64);
         fprintf(file_p_statefile,"database_status: %s\n",string_temp);
-        for(i=0;i<node_num_gs;i++){
+        for(i=0;compute_pool_flag!=0&&i<node_num_gs;i++){
             snprintf(string_temp2,63,"\"name\": \"compute%d\",",i+1);
             find_and_nget(tfstate,LINE_LENGTH_SHORT,string_temp2,"","",50,"\"internal_ip\":","","",'\"',4,string_temp,64);
             fprintf(file_p_statefile,"compute%d_private_ip: %s\n",i+1,string_temp);
@@ -1603,7 +3000,7 @@ int getstate(char* workdir, char* crypto_filename){
         fprintf(file_p_statefile,"master_private_ip: %s\n",string_temp);
         fprintf(file_p_hostfile,"%s\tmaster\n",string_temp);
         fprintf(file_p_statefile,"master_status: Running\ndatabase_status: Running\n");
-        for(i=0;i<node_num_gs;i++){
+        for(i=0;compute_pool_flag!=0&&i<node_num_gs;i++){
             snprintf(string_temp2,63,"\"name\": \"compute%d\",",i+1);
             find_and_nget(tfstate,LINE_LENGTH_SHORT,string_temp2,"","",80,"\"private_ip_address\":","","",'\"',4,string_temp,64);
             fprintf(file_p_statefile,"compute%d_private_ip: %s\n",i+1,string_temp);
@@ -1637,7 +3034,7 @@ int getstate(char* workdir, char* crypto_filename){
         else{
             fprintf(file_p_statefile,"database_status: RUNNING\n");
         }
-        for(i=0;i<node_num_gs;i++){
+        for(i=0;compute_pool_flag!=0&&i<node_num_gs;i++){
             snprintf(string_temp2,63,"\"name\": \"compute%d\",",i+1);
             find_and_nget(tfstate,LINE_LENGTH_SHORT,string_temp2,"","",80,"\"network_ip\":","","",'\"',4,string_temp,64);
             fprintf(file_p_statefile,"compute%d_private_ip: %s\n",i+1,string_temp);
@@ -1656,7 +3053,13 @@ int getstate(char* workdir, char* crypto_filename){
         get_seq_nstring(string_temp2,',',1,string_temp,64);
         fprintf(file_p_statefile,"shared_volume_gb: %s\n",string_temp);
     }
-
+    if(compute_pool_flag==0){
+        node_num_on_gs=0;
+        node_num_gs=get_compute_pool_state(tfstate,cloud_flag,file_p_statefile,file_p_hostfile,&node_num_on_gs);
+        if(node_num_gs<0){
+            node_num_gs=0;
+        }
+    }
     fprintf(file_p_statefile,"total_compute_nodes: %d\n",node_num_gs);
     fprintf(file_p_statefile,"running_compute_nodes: %d\n",node_num_on_gs);
     fprintf(file_p_statefile,"down_compute_nodes: %d\n",node_num_gs-node_num_on_gs);
@@ -1664,6 +3067,10 @@ int getstate(char* workdir, char* crypto_filename){
     fclose(file_p_statefile);
     fclose(file_p_hostfile);
     fclose(file_p_tfstate);
+    if(get_cluster_nname(cluster_name,CLUSTER_ID_LENGTH_MAX_PLUS,workdir)==0){
+        update_operator_metrics("cluster",cluster_name,"",node_num_on_gs,node_num_gs,compute_cores);
+    }
+    trace_span_end(&span,0);
     return 0;
 }
 
@@ -1865,28 +3272,309 @@ int generate_sshkey(char* sshkey_folder, char* pubkey){
 }
 
 /* Should write a real C function, instead of calling system commands. But it is totally OK.*/
+/*
+ * Get the path of a rotated segment of the log archive.
+ * return -1: the segment doesn't exist
+ * return 0: a plain segment ARCHIVE.N
+ * return 1: a compressed segment ARCHIVE.N.tar.gz
+ */
+int get_log_segment_file(char* logarchive, int segment, char* segment_file, unsigned int maxlen){
+    snprintf(segment_file,maxlen-1,"%s.%d",logarchive,segment);
+    if(file_exist_or_not(segment_file)==0){
+        return 0;
+    }
+    snprintf(segment_file,maxlen-1,"%s.%d.tar.gz",logarchive,segment);
+    if(file_exist_or_not(segment_file)==0){
+        return 1;
+    }
+    return -1;
+}
+
+/*
+ * Get the segment number that the live log archive will be rotated to, and the
+ * epoch of its first indexed run (0 if no run is indexed yet).
+ * The index ARCHIVE.idx has one line per run: RUN_ID SEGMENT START END EPOCH
+ */
+int get_log_archive_segment(char* logarchive, int_64bit* first_epoch){
+    char index_file[FILENAME_LENGTH]="";
+    char segment_file[FILENAME_LENGTH_EXT]="";
+    char line_buffer[LINE_LENGTH_SHORT]="";
+    char run_id[32]="";
+    int segment=1,segment_temp;
+    int_64bit start,end,epoch;
+    FILE* file_p=NULL;
+    *first_epoch=0;
+    snprintf(index_file,FILENAME_LENGTH-1,"%s.idx",logarchive);
+    file_p=fopen(index_file,"r");
+    if(file_p!=NULL){
+        while(fngetline(file_p,line_buffer,LINE_LENGTH_SHORT)!=1){
+            if(sscanf(line_buffer,"%31s %d %lld %lld %lld",run_id,&segment_temp,&start,&end,&epoch)!=5){
+                continue;
+            }
+            if(segment_temp!=segment||*first_epoch==0){
+                segment=segment_temp;
+                *first_epoch=epoch;
+            }
+        }
+        fclose(file_p);
+    }
+    while(get_log_segment_file(logarchive,segment,segment_file,FILENAME_LENGTH_EXT)!=-1){
+        segment++;
+        *first_epoch=0;
+    }
+    return segment;
+}
+
+/*
+ * Rotate the log archive if it is larger than LOG_ARCHIVE_SIZE_MAX or its first run
+ * is older than LOG_ARCHIVE_AGE_DAYS. Only LOG_ARCHIVE_SEGMENTS_MAX segments are kept,
+ * and the index entries of purged segments are dropped.
+ * return -1: the archive doesn't exist or failed to rename
+ * return 1: no need to rotate
+ * return 0: rotated
+ */
+int rotate_log_archive(char* logarchive){
+    char segment_file[FILENAME_LENGTH_EXT]="";
+    char index_file[FILENAME_LENGTH]="";
+    char index_temp[FILENAME_LENGTH_EXT]="";
+    char log_dir[FILENAME_LENGTH]="";
+    char* log_base=NULL;
+    char line_buffer[LINE_LENGTH_SHORT]="";
+    char run_id[32]="";
+    char cmdline[CMDLINE_LENGTH]="";
+    int segment,segment_temp;
+    int_64bit archive_size,first_epoch,start,end,epoch;
+    time_t current_time_long;
+    FILE* file_p=fopen(logarchive,"rb");
+    FILE* file_p_2=NULL;
+    if(file_p==NULL){
+        return -1;
+    }
+    archive_size=get_filesize_byte(file_p);
+    fclose(file_p);
+    segment=get_log_archive_segment(logarchive,&first_epoch);
+    time(&current_time_long);
+    if(archive_size<LOG_ARCHIVE_SIZE_MAX&&(first_epoch==0||(int_64bit)current_time_long-first_epoch<(int_64bit)LOG_ARCHIVE_AGE_DAYS*86400)){
+        return 1;
+    }
+    snprintf(segment_file,FILENAME_LENGTH_EXT-1,"%s.%d",logarchive,segment);
+    if(rename(logarchive,segment_file)!=0){
+        return -1;
+    }
+    if(LOG_ARCHIVE_COMPRESS==1){
+        strncpy(log_dir,logarchive,FILENAME_LENGTH-1);
+        log_base=strrchr(log_dir,PATH_SLASH[0]);
+        if(log_base!=NULL){
+            *log_base='\0';
+            log_base++;
+            snprintf(cmdline,CMDLINE_LENGTH-1,"tar -czf %s.tar.gz -C %s %s.%d %s",segment_file,log_dir,log_base,segment,SYSTEM_CMD_REDIRECT);
+            if(system(cmdline)==0){
+                rm_file_or_dir(segment_file);
+            }
+        }
+    }
+    if(segment>LOG_ARCHIVE_SEGMENTS_MAX&&get_log_segment_file(logarchive,segment-LOG_ARCHIVE_SEGMENTS_MAX,segment_file,FILENAME_LENGTH_EXT)!=-1){
+        rm_file_or_dir(segment_file);
+    }
+    snprintf(index_file,FILENAME_LENGTH-1,"%s.idx",logarchive);
+    snprintf(index_temp,FILENAME_LENGTH_EXT-1,"%s.tmp",index_file);
+    file_p=fopen(index_file,"r");
+    if(file_p==NULL){
+        return 0;
+    }
+    file_p_2=fopen(index_temp,"w+");
+    if(file_p_2==NULL){
+        fclose(file_p);
+        return 0;
+    }
+    while(fngetline(file_p,line_buffer,LINE_LENGTH_SHORT)!=1){
+        if(sscanf(line_buffer,"%31s %d %lld %lld %lld",run_id,&segment_temp,&start,&end,&epoch)!=5){
+            continue;
+        }
+        if(segment_temp>segment-LOG_ARCHIVE_SEGMENTS_MAX){
+            fprintf(file_p_2,"%s\n",line_buffer);
+        }
+    }
+    fclose(file_p);
+    fclose(file_p_2);
+    rm_file_or_dir(index_file);
+    rename(index_temp,index_file);
+    return 0;
+}
+
+/*
+ * Append the logfile to the archive as one run, and record the byte range of
+ * the run in the index ARCHIVE.idx, so that a run can be read without scanning
+ * the whole archive. The archive is rotated before appending if needed.
+ */
 int archive_log(char* logarchive, char* logfile){
-    char line_buffer[LINE_LENGTH_SMALL]="";
+    char index_file[FILENAME_LENGTH]="";
+    char run_id[64]="";
+    char copy_buffer[LOG_COPY_BUFFER];
+    size_t read_bytes;
+    int segment;
+    int_64bit first_epoch,start_offset,end_offset;
     time_t current_time_long;
     struct tm* time_p=NULL;
-    time(&current_time_long);
-    time_p=localtime(&current_time_long);
     if(file_exist_or_not(logfile)!=0){
         return -1;
     }
-    FILE* file_p=fopen(logarchive,"a+");
+    rotate_log_archive(logarchive);
+    segment=get_log_archive_segment(logarchive,&first_epoch);
+    time(&current_time_long);
+    time_p=localtime(&current_time_long);
+    snprintf(run_id,63,"%d%02d%02d-%02d%02d%02d",time_p->tm_year+1900,time_p->tm_mon+1,time_p->tm_mday,time_p->tm_hour,time_p->tm_min,time_p->tm_sec);
+    FILE* file_p=fopen(logarchive,"ab");
     if(file_p==NULL){
         return -1;
     }
-    FILE* file_p_2=fopen(logfile,"r");
-    fprintf(file_p,"\n\n# TIMESTAMP OF THIS ARCHIVE: %d-%d-%d %d:%d:%d\n",time_p->tm_year+1900,time_p->tm_mon+1,time_p->tm_mday,time_p->tm_hour,time_p->tm_min,time_p->tm_sec);
-    while(fngetline(file_p_2,line_buffer,LINE_LENGTH_SMALL)!=1){
-        fprintf(file_p,"%s\n",line_buffer);
+    FILE* file_p_2=fopen(logfile,"rb");
+    if(file_p_2==NULL){
+        fclose(file_p);
+        return -1;
+    }
+    start_offset=get_filesize_byte(file_p);
+    fprintf(file_p,"\n\n# TIMESTAMP OF THIS ARCHIVE: %d-%d-%d %d:%d:%d RUN_ID: %s\n",time_p->tm_year+1900,time_p->tm_mon+1,time_p->tm_mday,time_p->tm_hour,time_p->tm_min,time_p->tm_sec,run_id);
+    while((read_bytes=fread(copy_buffer,1,LOG_COPY_BUFFER,file_p_2))>0){
+        fwrite(copy_buffer,1,read_bytes,file_p);
     }
+    fflush(file_p);
+    end_offset=get_filesize_byte(file_p);
     fclose(file_p_2);
     fclose(file_p);
     file_p_2=fopen(logfile,"w+");
-    fclose(file_p_2);
+    if(file_p_2!=NULL){
+        fclose(file_p_2);
+    }
+    snprintf(index_file,FILENAME_LENGTH-1,"%s.idx",logarchive);
+    file_p=fopen(index_file,"a+");
+    if(file_p==NULL){
+        return 1;
+    }
+    fprintf(file_p,"%s %d %lld %lld %lld\n",run_id,segment,start_offset,end_offset,(int_64bit)current_time_long);
+    fclose(file_p);
+    return 0;
+}
+
+/*
+ * List the runs in the index (run_id "list"), or extract the run(s) with the
+ * run_id ("latest" for the last indexed run) to the output file. Only the byte ranges in
+ * the index are read. Compressed segments are extracted to NOW_TMP_DIR first.
+ * return -1: the index doesn't exist
+ * return 1: run not found or its segment has been purged
+ * return 0: normal exit
+ */
+int extract_log_run(char* logarchive, char* run_id, char* output_file){
+    char index_file[FILENAME_LENGTH]="";
+    char segment_file[FILENAME_LENGTH_EXT]="";
+    char source_file[FILENAME_LENGTH_EXT]="";
+    char* log_base=NULL;
+    char line_buffer[LINE_LENGTH_SHORT]="";
+    char run_id_temp[32]="";
+    char segment_status[16]="";
+    char cmdline[CMDLINE_LENGTH]="";
+    char copy_buffer[LOG_COPY_BUFFER];
+    int segment,live_segment,segment_flag,run_count=0;
+    int line_num=0,last_line=0;
+    int_64bit start,end,epoch,first_epoch,remain;
+    size_t read_bytes;
+    FILE* file_p=NULL;
+    FILE* file_p_2=NULL;
+    FILE* file_p_3=NULL;
+    snprintf(index_file,FILENAME_LENGTH-1,"%s.idx",logarchive);
+    file_p=fopen(index_file,"r");
+    if(file_p==NULL){
+        return -1;
+    }
+    live_segment=get_log_archive_segment(logarchive,&first_epoch);
+    if(strcmp(run_id,"list")==0){
+        printf(GENERAL_BOLD "| RUN_ID             SEGMENT     BYTES" RESET_DISPLAY "\n");
+    }
+    else if(strcmp(run_id,"latest")==0){
+        while(fngetline(file_p,line_buffer,LINE_LENGTH_SHORT)!=1){
+            last_line++;
+        }
+        fseek(file_p,0,SEEK_SET);
+    }
+    log_base=strrchr(logarchive,PATH_SLASH[0]);
+    log_base=(log_base==NULL)?logarchive:log_base+1;
+    while(fngetline(file_p,line_buffer,LINE_LENGTH_SHORT)!=1){
+        line_num++;
+        if(sscanf(line_buffer,"%31s %d %lld %lld %lld",run_id_temp,&segment,&start,&end,&epoch)!=5){
+            continue;
+        }
+        if(segment==live_segment){
+            segment_flag=(file_exist_or_not(logarchive)==0)?2:-1;
+        }
+        else{
+            segment_flag=get_log_segment_file(logarchive,segment,segment_file,FILENAME_LENGTH_EXT);
+        }
+        if(strcmp(run_id,"list")==0){
+            if(segment_flag==2){
+                strcpy(segment_status,"live");
+            }
+            else if(segment_flag==0){
+                strcpy(segment_status,"rotated");
+            }
+            else if(segment_flag==1){
+                strcpy(segment_status,"compressed");
+            }
+            else{
+                strcpy(segment_status,"purged");
+            }
+            printf("| %-18s %-11s %lld\n",run_id_temp,segment_status,end-start);
+            run_count++;
+            continue;
+        }
+        if(strcmp(run_id_temp,run_id)!=0&&line_num!=last_line){
+            continue;
+        }
+        if(segment_flag==-1){
+            continue;
+        }
+        if(segment_flag==2){
+            strcpy(source_file,logarchive);
+        }
+        else if(segment_flag==0){
+            strcpy(source_file,segment_file);
+        }
+        else{
+            snprintf(cmdline,CMDLINE_LENGTH-1,"tar -xzf %s -C %s %s",segment_file,NOW_TMP_DIR,SYSTEM_CMD_REDIRECT);
+            if(system(cmdline)!=0){
+                continue;
+            }
+            snprintf(source_file,FILENAME_LENGTH_EXT-1,"%s%s.%d",NOW_TMP_DIR,log_base,segment);
+        }
+        file_p_2=fopen(source_file,"rb");
+        if(file_p_2==NULL){
+            continue;
+        }
+        if(file_p_3==NULL){
+            file_p_3=fopen(output_file,"wb");
+            if(file_p_3==NULL){
+                fclose(file_p_2);
+                break;
+            }
+        }
+        fseek_byte(file_p_2,start);
+        remain=end-start;
+        while(remain>0&&(read_bytes=fread(copy_buffer,1,(remain>LOG_COPY_BUFFER)?LOG_COPY_BUFFER:(size_t)remain,file_p_2))>0){
+            fwrite(copy_buffer,1,read_bytes,file_p_3);
+            remain-=read_bytes;
+        }
+        fclose(file_p_2);
+        if(segment_flag==1){
+            rm_file_or_dir(source_file);
+        }
+        run_count++;
+    }
+    fclose(file_p);
+    if(file_p_3!=NULL){
+        fclose(file_p_3);
+    }
+    if(run_count==0){
+        return 1;
+    }
     return 0;
 }
 
@@ -1915,6 +3603,9 @@ int update_compute_template(char* stackdir, char* cloud_flag){
     char prev_template[FILENAME_LENGTH]="";
     char new_template[FILENAME_LENGTH]="";
     snprintf(prev_template,FILENAME_LENGTH-1,"%s%scompute_template",stackdir,PATH_SLASH);
+    if(compute_pool_or_not(stackdir)==0){
+        return 0;
+    }
     snprintf(new_template,FILENAME_LENGTH-1,"%s%shpc_stack_compute1.tf",stackdir,PATH_SLASH);
     if(cp_file(new_template,prev_template,0)!=0){
         return 1;
@@ -1988,7 +3679,6 @@ int graph(char* workdir, char* crypto_keyfile, int graph_level){
     char cluster_role[16]="";
     char cluster_role_ext[16]="";
     char shared_volume[16]="";
-    char string_temp[32]="";
     char compute_address[32]="";
     char compute_status[16]="";
     char compute_config[16]="";
@@ -2009,6 +3699,8 @@ int graph(char* workdir, char* crypto_keyfile, int graph_level){
     int i,j,state_flag=0;
     int decrypt_flag=0;
     char decrypt_prompt[32]="";
+    char line_buffer[LINE_LENGTH_SHORT]="";
+    FILE* file_p=NULL;
     if(create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH)!=0||get_cluster_nname(cluster_name,32,workdir)!=0){
         return -3;
     }
@@ -2055,18 +3747,30 @@ int graph(char* workdir, char* crypto_keyfile, int graph_level){
         printf(GREY_LIGHT "[  ****  ] " RESET_DISPLAY GENERAL_BOLD "+-Payment method: " HIGH_CYAN_BOLD "%s, %s" RESET_DISPLAY GENERAL_BOLD " +-Cloud: " HIGH_CYAN_BOLD "%s" RESET_DISPLAY"\n",payment_method,payment_method_long,cloud_flag);
         printf(GREY_LIGHT "[  ****  ] +-" RESET_DISPLAY "+-master(%s,%s,%s)" RESET_DISPLAY "\n",master_address,master_status,master_config);
         printf(GREY_LIGHT "[  ****  ] +-+-" RESET_DISPLAY "+-db(%s)\n",db_status);
-        for(i=0;i<node_num;i++){
-            snprintf(string_temp,31,"compute%d_private_ip:",i+1);
-            get_key_nvalue(statefile,LINE_LENGTH_SHORT,string_temp,' ',compute_address,32);
-            snprintf(string_temp,31,"compute%d_status:",i+1);
-            get_key_nvalue(statefile,LINE_LENGTH_SHORT,string_temp,' ',compute_status,16);
+        /* Scan the statefile once, the ip line is always followed by the status line */
+        file_p=fopen(statefile,"r");
+        while(file_p!=NULL&&fngetline(file_p,line_buffer,LINE_LENGTH_SHORT)!=1){
+            if(sscanf(line_buffer,"compute%d_",&i)!=1){
+                continue;
+            }
+            if(strstr(line_buffer,"_private_ip:")!=NULL){
+                get_seq_nstring(line_buffer,' ',2,compute_address,32);
+                continue;
+            }
+            if(strstr(line_buffer,"_status:")==NULL){
+                continue;
+            }
+            get_seq_nstring(line_buffer,' ',2,compute_status,16);
             if(strlen(ht_status_ext)!=0){
-                printf(GREY_LIGHT "[  ****  ] +-+-+-" RESET_DISPLAY "+-compute%d(%s,%s,%s,%s)\n",i+1,compute_address,compute_status,compute_config,ht_status_ext);
+                printf(GREY_LIGHT "[  ****  ] +-+-+-" RESET_DISPLAY "+-compute%d(%s,%s,%s,%s)\n",i,compute_address,compute_status,compute_config,ht_status_ext);
             }
             else{
-                printf(GREY_LIGHT "[  ****  ] +-+-+-" RESET_DISPLAY "+-compute%d(%s,%s,%s)\n",i+1,compute_address,compute_status,compute_config);
+                printf(GREY_LIGHT "[  ****  ] +-+-+-" RESET_DISPLAY "+-compute%d(%s,%s,%s)\n",i,compute_address,compute_status,compute_config);
             }
         }
+        if(file_p!=NULL){
+            fclose(file_p);
+        }
         if(strcmp(cloud_flag,"CLOUD_D")==0||strcmp(cloud_flag,"CLOUD_F")==0){
             printf(GREY_LIGHT "[  ****  ] +-" RESET_DISPLAY "+-shared_storage(%s GB)\n",shared_volume);
         }
@@ -2260,19 +3964,184 @@ int cluster_full_running_or_not(char* workdir, char* crypto_keyfile){
     if(strcmp(down_compute_nodes,"0")==0){
         return 0;
     }
-    return 1;
+    return 1;
+}
+
+int tf_exec_config_validation(tf_exec_config* tf_run){
+    if(strcmp(tf_run->tf_runner,TERRAFORM_EXEC)!=0&&strcmp(tf_run->tf_runner,TOFU_EXEC)!=0){
+        return 1;
+    }
+    if(strcmp(tf_run->dbg_level,"trace")!=0&&strcmp(tf_run->dbg_level,"debug")!=0&&strcmp(tf_run->dbg_level,"info")!=0&&strcmp(tf_run->dbg_level,"warn")!=0&&strcmp(tf_run->dbg_level,"error")!=0&&strcmp(tf_run->dbg_level,"off")!=0&&strcmp(tf_run->dbg_level,"TRACE")!=0&&strcmp(tf_run->dbg_level,"DEBUG")!=0&&strcmp(tf_run->dbg_level,"INFO")!=0&&strcmp(tf_run->dbg_level,"WARN")!=0&&strcmp(tf_run->dbg_level,"ERROR")!=0&&strcmp(tf_run->dbg_level,"OFF")!=0){
+        return 1;
+    }
+    if(tf_run->max_wait_time<MAXIMUM_WAIT_TIME||tf_run->max_wait_time>MAXIMUM_WAIT_TIME_EXT){
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * CLOUD_B (qcloud) and CLOUD_D (hwcloud) throttle the API calls per account
+ * tightly, so they start with a lower parallelism.
+ */
+void tf_parallelism_defaults(tf_exec_config* tf_run){
+    int i;
+    strcpy(tf_run->parallel_mode,"fixed");
+    for(i=0;i<TF_CLOUD_NUM;i++){
+        if(i==1||i==3){
+            tf_run->parallelism[i][0]=TF_PARALLELISM_LIMITED;
+            tf_run->parallelism[i][1]=TF_PARALLELISM_LIMITED;
+        }
+        else{
+            tf_run->parallelism[i][0]=TF_PARALLELISM_DEFAULT;
+            tf_run->parallelism[i][1]=TF_PARALLELISM_DEFAULT;
+        }
+    }
+}
+
+/*
+ * return -1: invalid cloud flag
+ * return 0 ~ TF_CLOUD_NUM-1: the index of CLOUD_A ~ CLOUD_G
+ */
+int tf_cloud_index(char* cloud_flag){
+    if(strlen(cloud_flag)!=7||strncmp(cloud_flag,"CLOUD_",6)!=0){
+        return -1;
+    }
+    if(cloud_flag[6]<'A'||cloud_flag[6]>'A'+TF_CLOUD_NUM-1){
+        return -1;
+    }
+    return cloud_flag[6]-'A';
+}
+
+/*
+ * return -1: not a parallel operation (e.g. init)
+ * return 0: apply
+ * return 1: destroy
+ */
+int tf_operation_index(char* execution_name){
+    if(strcmp(execution_name,"apply")==0){
+        return 0;
+    }
+    else if(strcmp(execution_name,"destroy")==0){
+        return 1;
+    }
+    return -1;
+}
+
+/*
+ * Get the adaptive parallelism of an operation from the cluster's state file
+ * return -1: not found or invalid
+ */
+int get_tf_parallelism_state(char* workdir, char* execution_name){
+    char state_file[FILENAME_LENGTH]="";
+    char value[16]="";
+    int parallelism;
+    snprintf(state_file,FILENAME_LENGTH-1,"%s%sconf%stf_parallelism.state",workdir,PATH_SLASH,PATH_SLASH);
+    if(find_and_nget(state_file,LINE_LENGTH_SHORT,execution_name,"","",1,execution_name,"","",' ',2,value,16)!=0){
+        return -1;
+    }
+    parallelism=string_to_positive_num(value);
+    if(parallelism<TF_PARALLELISM_MIN||parallelism>TF_PARALLELISM_DEFAULT){
+        return -1;
+    }
+    return parallelism;
+}
+
+/*
+ * In the fixed mode, return the profile value of the cloud and operation.
+ * In the adaptive mode, return the last tuned value, capped by the profile.
+ */
+int get_tf_parallelism(tf_exec_config* tf_run, char* workdir, char* cloud_flag, char* execution_name){
+    int cloud_index=tf_cloud_index(cloud_flag);
+    int op_index=tf_operation_index(execution_name);
+    int profile,state;
+    if(cloud_index<0||op_index<0){
+        return TF_PARALLELISM_DEFAULT;
+    }
+    profile=tf_run->parallelism[cloud_index][op_index];
+    if(profile<TF_PARALLELISM_MIN||profile>TF_PARALLELISM_DEFAULT){
+        profile=TF_PARALLELISM_DEFAULT;
+    }
+    if(strcmp(tf_run->parallel_mode,"adaptive")!=0){
+        return profile;
+    }
+    state=get_tf_parallelism_state(workdir,execution_name);
+    if(state<0||state>profile){
+        return profile;
+    }
+    return state;
+}
+
+/*
+ * Count the lines with API throttling diagnostics of the clouds, starting from
+ * the byte offset of the file. Only the HTTP 429 responses and the throttling
+ * error codes count. Words like RateLimit also appear in the X-RateLimit-*
+ * headers that TF_LOG prints for the successful calls.
+ */
+int count_throttle_diagnostics(char* filename, int_64bit start_offset){
+    char* throttle_keys[]={"Throttling","RequestLimitExceeded","APIGW.0308","429 Too Many Requests","StatusCode: 429","status code: 429","HTTP/1.1 429","HTTP/2.0 429"};
+    char line_buffer[LINE_LENGTH_SMALL]="";
+    int key_num=sizeof(throttle_keys)/sizeof(char*);
+    int i,count=0;
+    FILE* file_p=fopen(filename,"rb");
+    if(file_p==NULL){
+        return 0;
+    }
+    if(start_offset>0&&start_offset<get_filesize_byte(file_p)){
+        fseek_byte(file_p,start_offset);
+    }
+    while(fngetline(file_p,line_buffer,LINE_LENGTH_SMALL)!=1){
+        for(i=0;i<key_num;i++){
+            if(strstr(line_buffer,throttle_keys[i])!=NULL){
+                count++;
+                break;
+            }
+        }
+    }
+    fclose(file_p);
+    return count;
 }
 
-int tf_exec_config_validation(tf_exec_config* tf_run){
-    if(strcmp(tf_run->tf_runner,TERRAFORM_EXEC)!=0&&strcmp(tf_run->tf_runner,TOFU_EXEC)!=0){
+/*
+ * Adaptive mode only: halve the parallelism if the run hit throttling, raise it
+ * by a quarter (up to the profile value) if the run succeeded cleanly.
+ * return 1: not in the adaptive mode or not a parallel operation
+ * return 0: normal exit
+ */
+int tune_tf_parallelism(tf_exec_config* tf_run, char* workdir, char* cloud_flag, char* execution_name, int current, int throttle_count, int run_flag){
+    char state_file[FILENAME_LENGTH]="";
+    int cloud_index=tf_cloud_index(cloud_flag);
+    int op_index=tf_operation_index(execution_name);
+    int profile,new_value,other_value;
+    FILE* file_p=NULL;
+    if(strcmp(tf_run->parallel_mode,"adaptive")!=0||cloud_index<0||op_index<0){
         return 1;
     }
-    if(strcmp(tf_run->dbg_level,"trace")!=0&&strcmp(tf_run->dbg_level,"debug")!=0&&strcmp(tf_run->dbg_level,"info")!=0&&strcmp(tf_run->dbg_level,"warn")!=0&&strcmp(tf_run->dbg_level,"error")!=0&&strcmp(tf_run->dbg_level,"off")!=0&&strcmp(tf_run->dbg_level,"TRACE")!=0&&strcmp(tf_run->dbg_level,"DEBUG")!=0&&strcmp(tf_run->dbg_level,"INFO")!=0&&strcmp(tf_run->dbg_level,"WARN")!=0&&strcmp(tf_run->dbg_level,"ERROR")!=0&&strcmp(tf_run->dbg_level,"OFF")!=0){
-        return 1;
+    profile=tf_run->parallelism[cloud_index][op_index];
+    if(throttle_count>0){
+        new_value=(current/2<TF_PARALLELISM_MIN)?TF_PARALLELISM_MIN:current/2;
+        printf(WARN_YELLO_BOLD "[ -WARN- ] Detected %d API throttling diagnostic(s). Lowering the parallelism of %s: %d -> %d." RESET_DISPLAY "\n",throttle_count,execution_name,current,new_value);
     }
-    if(tf_run->max_wait_time<MAXIMUM_WAIT_TIME||tf_run->max_wait_time>MAXIMUM_WAIT_TIME_EXT){
-        return 1;
+    else if(run_flag==0){
+        new_value=current+((current/4<1)?1:current/4);
+        if(new_value>profile){
+            new_value=profile;
+        }
+    }
+    else{
+        new_value=current;
+    }
+    other_value=get_tf_parallelism_state(workdir,(op_index==0)?"destroy":"apply");
+    snprintf(state_file,FILENAME_LENGTH-1,"%s%sconf%stf_parallelism.state",workdir,PATH_SLASH,PATH_SLASH);
+    file_p=fopen(state_file,"w+");
+    if(file_p==NULL){
+        return -1;
     }
+    fprintf(file_p,"%s %d\n",execution_name,new_value);
+    if(other_value>0){
+        fprintf(file_p,"%s %d\n",(op_index==0)?"destroy":"apply",other_value);
+    }
+    fclose(file_p);
     return 0;
 }
 
@@ -2290,10 +4159,18 @@ int tf_execution(tf_exec_config* tf_run, char* execution_name, char* workdir, ch
     char tf_dbg_log[FILENAME_LENGTH]="";
     char tf_dbg_log_archive[FILENAME_LENGTH]="";
     char cloud_flag[16]="";
+    char phase_name[32]="";
+    int parallelism,throttle_count;
+    int_64bit err_archive_offset=0;
+    FILE* file_p=NULL;
+    trace_span span;
 
     if(create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH)!=0||get_cloud_flag(workdir,crypto_keyfile,cloud_flag,16)!=0){
         return -3;
     }
+    parallelism=get_tf_parallelism(tf_run,workdir,cloud_flag,execution_name);
+    snprintf(phase_name,31,"tf_%s",execution_name);
+    trace_span_start(&span,phase_name);
     if(strcmp(cloud_flag,"CLOUD_G")==0){
         gcp_credential_convert(workdir,"decrypt",0);
     }
@@ -2306,16 +4183,23 @@ int tf_execution(tf_exec_config* tf_run, char* execution_name, char* workdir, ch
     archive_log(tf_realtime_log_archive,tf_realtime_log);
     archive_log(tf_error_log_archive,tf_error_log);
     archive_log(tf_dbg_log_archive,tf_dbg_log);
+    /* Warnings are archived while waiting, so remember where this run starts in the archive. */
+    file_p=fopen(tf_error_log_archive,"rb");
+    if(file_p!=NULL){
+        err_archive_offset=get_filesize_byte(file_p);
+        fclose(file_p);
+    }
 
     if(strcmp(execution_name,"init")==0){
         snprintf(cmdline,CMDLINE_LENGTH-1,"cd %s%s && %s TF_LOG=%s&&%s TF_LOG_PATH=%s%slog%stf_dbg.log && echo yes | %s %s %s -upgrade -lock=false > %s 2>%s &",stackdir,PATH_SLASH,SET_ENV_CMD,tf_run->dbg_level,SET_ENV_CMD,workdir,PATH_SLASH,PATH_SLASH,START_BG_JOB,tf_run->tf_runner,execution_name,tf_realtime_log,tf_error_log);
     }
     else{
-        snprintf(cmdline,CMDLINE_LENGTH-1,"cd %s%s && %s TF_LOG=%s&&%s TF_LOG_PATH=%s%slog%stf_dbg.log && echo yes | %s %s %s -lock=false -parallelism=1000 > %s 2>%s &",stackdir,PATH_SLASH,SET_ENV_CMD,tf_run->dbg_level,SET_ENV_CMD,workdir,PATH_SLASH,PATH_SLASH,START_BG_JOB,tf_run->tf_runner,execution_name,tf_realtime_log,tf_error_log);
+        snprintf(cmdline,CMDLINE_LENGTH-1,"cd %s%s && %s TF_LOG=%s&&%s TF_LOG_PATH=%s%slog%stf_dbg.log && echo yes | %s %s %s -lock=false -parallelism=%d > %s 2>%s &",stackdir,PATH_SLASH,SET_ENV_CMD,tf_run->dbg_level,SET_ENV_CMD,workdir,PATH_SLASH,PATH_SLASH,START_BG_JOB,tf_run->tf_runner,execution_name,parallelism,tf_realtime_log,tf_error_log);
     }
     /*signal(SIGINT,SIG_IGN);*/
     if(system(cmdline)!=0){
         /*signal(SIGINT,SIG_DFL);*/
+        trace_span_end(&span,-7);
         return -7;
     }
     if(silent_flag!=0){
@@ -2324,23 +4208,42 @@ int tf_execution(tf_exec_config* tf_run, char* execution_name, char* workdir, ch
     }
     if(wait_for_complete(tf_realtime_log,execution_name,tf_run->max_wait_time,tf_error_log,tf_error_log_archive,1)!=0){
         printf(FATAL_RED_BOLD "[ FATAL: ] Failed to operate the cluster. Operation command: %s.\n" RESET_DISPLAY,execution_name);
+        if(strcmp(tf_run->parallel_mode,"adaptive")==0){
+            throttle_count=count_throttle_diagnostics(tf_error_log,0)+count_throttle_diagnostics(tf_error_log_archive,err_archive_offset)+count_throttle_diagnostics(tf_dbg_log,0);
+            tune_tf_parallelism(tf_run,workdir,cloud_flag,execution_name,parallelism,throttle_count,-1);
+        }
         archive_log(tf_error_log_archive,tf_error_log);
         archive_log(tf_dbg_log_archive,tf_dbg_log);
         if(strcmp(cloud_flag,"CLOUD_G")==0){
             gcp_credential_convert(workdir,"delete",0);
         }
         /*signal(SIGINT,SIG_DFL);*/
+        trace_span_end(&span,-1);
         return -1;
     }
     if(strcmp(cloud_flag,"CLOUD_G")==0){
         gcp_credential_convert(workdir,"delete",0);
     }
+    if(strcmp(tf_run->parallel_mode,"adaptive")==0){
+        throttle_count=count_throttle_diagnostics(tf_error_log,0)+count_throttle_diagnostics(tf_error_log_archive,err_archive_offset)+count_throttle_diagnostics(tf_dbg_log,0);
+        tune_tf_parallelism(tf_run,workdir,cloud_flag,execution_name,parallelism,throttle_count,0);
+    }
     archive_log(tf_dbg_log_archive,tf_dbg_log);
     /*signal(SIGINT,SIG_DFL);*/
+    trace_span_end(&span,0);
     return 0;
 }
 
 int update_usage_summary(char* workdir, char* crypto_keyfile, char* node_name, char* option){
+    trace_span span;
+    int run_flag;
+    trace_span_start(&span,"usage_summary");
+    run_flag=update_node_usage(workdir,crypto_keyfile,node_name,option);
+    trace_span_end(&span,run_flag);
+    return run_flag;
+}
+
+int update_node_usage(char* workdir, char* crypto_keyfile, char* node_name, char* option){
     char* usage_file=USAGE_LOG_FILE;
     char ucid_short[16]="";
     char filename_temp[FILENAME_LENGTH]="";
@@ -2702,134 +4605,683 @@ int prompt_to_input(const char* prompt_string, char reply_string[], unsigned int
             reply_string[i]='\0';
         }
     }
-    return 0;
+    return 0;
+}
+
+/* 
+ * CAUTION !
+ * When using this function, please make sure the pointer input_string has enough length!
+ * Otherwise stack overflow may occur! 
+ * force_input=0: force input. force_input=1: optional
+ * return 2 : cmd_keyword found
+ * return 1 : skipped due to batch mode
+ * return 0 : user input
+ */
+int prompt_to_input_required_args(const char* prompt_string, char reply_string[], unsigned int reply_len_max, int batch_flag_local,int argc, char** argv, char* cmd_keyword){
+    if(cmd_keyword_ncheck(argc,argv,cmd_keyword,reply_string,reply_len_max)==0){
+        return 2;
+    }
+    return prompt_to_input(prompt_string,reply_string,reply_len_max,batch_flag_local);
+}
+
+int prompt_to_input_optional_args(const char* prompt_confirm, const char* confirm_string, const char* prompt_string, char reply_string[], unsigned int reply_len_max, int batch_flag_local,int argc, char** argv, char* cmd_keyword){
+    if(cmd_keyword_ncheck(argc,argv,cmd_keyword,reply_string,reply_len_max)==0){
+        return 2;
+    }
+    if(batch_flag_local==0){
+        strcpy(reply_string,"");
+        return 4;
+    }
+    if(prompt_to_confirm(prompt_confirm,confirm_string,batch_flag_local)==1){
+        strcpy(reply_string,"");
+        return 6;
+    }
+    return prompt_to_input(prompt_string,reply_string,reply_len_max,batch_flag_local);
+}
+
+int check_down_nodes(char* workdir, char* crypto_keyfile){
+    char stackdir[DIR_LENGTH];
+    if(create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH)!=0){
+        return -1;
+    }
+    return get_compute_node_num(stackdir,crypto_keyfile,"down");
+}
+
+int cluster_ssh(char* workdir, char* crypto_keyfile, char* username, char* role_flag, char* sshkey_dir){
+    char master_address[64]="";
+    char cmdline[CMDLINE_LENGTH]="";
+    char mux_options[LINE_LENGTH_SHORT]="";
+    char identity_option[LINE_LENGTH_SHORT]="";
+    char privkey_base[FILENAME_LENGTH]="";
+    char privkey_decrypted[FILENAME_LENGTH_EXT]="";
+    char cluster_name[CLUSTER_ID_LENGTH_MAX_PLUS]="";
+    int run_flag;
+    get_state_nvalue(workdir,crypto_keyfile,"master_public_ip:",master_address,64);
+    get_ssh_mux_options(mux_options,LINE_LENGTH_SHORT);
+    if(get_cluster_nname(cluster_name,CLUSTER_ID_LENGTH_MAX_PLUS,workdir)!=0){
+        return -7;
+    }
+    if(strcmp(role_flag,"opr")==0){
+        snprintf(privkey_base,FILENAME_LENGTH-1,"%s%snow-cluster-login",sshkey_dir,PATH_SLASH);
+    }
+    else{
+        snprintf(privkey_base,FILENAME_LENGTH-1,"%s%s.%s%s%s.key",sshkey_dir,PATH_SLASH,cluster_name,PATH_SLASH,username);
+    }
+    if(get_ssh_identity(privkey_base,identity_option,LINE_LENGTH_SHORT,privkey_decrypted,FILENAME_LENGTH_EXT)<0){
+        return -5;
+    }
+    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh %s %s -o StrictHostKeyChecking=no %s@%s",mux_options,identity_option,username,master_address);
+    run_flag=system(cmdline);
+    release_ssh_identity(privkey_decrypted);
+    if(run_flag!=0){
+        return 1;
+    }
+    return 0;
+}
+
+int node_file_to_running(char* stackdir, char* node_name, char* cloud_flag){
+    char filename_temp[FILENAME_LENGTH]="";
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_%s.tf",stackdir,PATH_SLASH,node_name);
+    if(strcmp(cloud_flag,"CLOUD_A")==0){
+        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"Stopped","Running");
+    }
+    else if(strcmp(cloud_flag,"CLOUD_B")==0){
+        find_and_nreplace(filename_temp,LINE_LENGTH_SMALL,"running_flag","","","","","false","true");
+    }
+    else if(strcmp(cloud_flag,"CLOUD_C")==0){
+        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"stopped","running");
+    }
+    else if(strcmp(cloud_flag,"CLOUD_D")==0){
+        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"\"OFF\"","\"ON\"");
+    }
+    else if(strcmp(cloud_flag,"CLOUD_E")==0){
+        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"\"stop\"","\"start\"");
+    }
+    else if(strcmp(cloud_flag,"CLOUD_G")==0){
+        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"\"TERMINATED\"","\"RUNNING\"");
+    }
+    else{
+        return 1;
+    }
+    return 0;
+}
+
+int node_file_to_stop(char* stackdir, char* node_name, char* cloud_flag){
+    char filename_temp[FILENAME_LENGTH]="";
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_%s.tf",stackdir,PATH_SLASH,node_name);
+    if(strcmp(cloud_flag,"CLOUD_A")==0){
+        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"Running","Stopped");
+    }
+    else if(strcmp(cloud_flag,"CLOUD_B")==0){
+        find_and_nreplace(filename_temp,LINE_LENGTH_SMALL,"running_flag","","","","","true","false");
+    }
+    else if(strcmp(cloud_flag,"CLOUD_C")==0){
+        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"running","stopped");
+    }
+    else if(strcmp(cloud_flag,"CLOUD_D")==0){
+        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"\"ON\"","\"OFF\"");
+    }
+    else if(strcmp(cloud_flag,"CLOUD_E")==0){
+        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"\"start\"","\"stop\"");
+    }
+    else if(strcmp(cloud_flag,"CLOUD_G")==0){
+        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"\"RUNNING\"","\"TERMINATED\"");
+    }
+    else{
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * The compute pool layout models ALL the compute nodes with for_each resource(s)
+ * rendered from the compute_template, keyed by a node map (COMPUTE_POOL_NODES).
+ * Adding/deleting/stopping/starting nodes are edits of the node map.
+ * return 0: the stack is in the compute pool layout
+ * return 1: the stack is in the per-node file layout
+ */
+int compute_pool_or_not(char* stackdir){
+    char filename_temp[FILENAME_LENGTH]="";
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_NODES);
+    if(file_exist_or_not(filename_temp)==0){
+        return 0;
+    }
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s.tmp",stackdir,PATH_SLASH,COMPUTE_POOL_NODES);
+    if(file_exist_or_not(filename_temp)==0){
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Get the node status attribute and its value for the option "on" or "off".
+ * return -1: invalid cloud_flag or option
+ * return  1: the cloud doesn't support stopping nodes (Azure), the key is empty
+ * return  0: normal exit
+ */
+int compute_pool_status_literal(char* cloud_flag, char* option, char* status_key, unsigned int keylen_max, char* literal, unsigned int literal_len_max){
+    char* status_keys[7]={"status","running_flag","state","power_action","action","","desired_status"};
+    char* on_literals[7]={"\"Running\"","\"true\"","\"running\"","\"ON\"","\"start\"","\"Running\"","\"RUNNING\""};
+    char* off_literals[7]={"\"Stopped\"","\"false\"","\"stopped\"","\"OFF\"","\"stop\"","\"Running\"","\"TERMINATED\""};
+    int cloud_index;
+    if(strlen(cloud_flag)!=7||strncmp(cloud_flag,"CLOUD_",6)!=0||keylen_max<1||literal_len_max<1){
+        return -1;
+    }
+    cloud_index=*(cloud_flag+6)-'A';
+    if(cloud_index<0||cloud_index>6){
+        return -1;
+    }
+    if(strcmp(option,"on")==0){
+        snprintf(literal,literal_len_max,"%s",on_literals[cloud_index]);
+    }
+    else if(strcmp(option,"off")==0){
+        snprintf(literal,literal_len_max,"%s",off_literals[cloud_index]);
+    }
+    else{
+        return -1;
+    }
+    snprintf(status_key,keylen_max,"%s",status_keys[cloud_index]);
+    if(strlen(status_key)==0){
+        return 1;
+    }
+    return 0;
+}
+
+void pool_line_replace(char* line, unsigned int linelen_max, char* orig_string, char* new_string){
+    char* new_line=line_nreplace(line,contain_or_nnot(line,orig_string),orig_string,new_string);
+    if(new_line==NULL){
+        return;
+    }
+    strncpy(line,new_line,linelen_max-1);
+    *(line+linelen_max-1)='\0';
+    free(new_line);
+}
+
+/*
+ * Render the for_each resource(s) COMPUTE_POOL_STACK from the compute_template.
+ * The compute_template is the ONLY source of the node configuration, therefore
+ * it needs to be rendered again after every modification of the template.
+ * return -1: failed to open the template
+ * return -3: failed to write the pool stack
+ * return  0: normal exit
+ */
+int compute_pool_render(char* stackdir, char* cloud_flag){
+    char compute_template[FILENAME_LENGTH]="";
+    char pool_stack[FILENAME_LENGTH]="";
+    char status_key[32]="";
+    char status_line[64]="";
+    char literal[16]="";
+    char line_buffer[LINE_LENGTH]="";
+    FILE* file_p=NULL;
+    FILE* file_p_2=NULL;
+    snprintf(compute_template,FILENAME_LENGTH-1,"%s%scompute_template",stackdir,PATH_SLASH);
+    snprintf(pool_stack,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_STACK);
+    if(compute_pool_status_literal(cloud_flag,"on",status_key,32,literal,16)==0){
+        snprintf(status_line,63,"  %s = ",status_key);
+    }
+    file_p=fopen(compute_template,"r");
+    if(file_p==NULL){
+        return -1;
+    }
+    file_p_2=fopen(pool_stack,"w+");
+    if(file_p_2==NULL){
+        fclose(file_p);
+        return -3;
+    }
+    while(fngetline(file_p,line_buffer,LINE_LENGTH_SMALL)!=1){
+        if(strncmp(line_buffer,"resource \"",10)==0){
+            pool_line_replace(line_buffer,LINE_LENGTH,"\"compute1","\"compute");
+            pool_line_replace(line_buffer,LINE_LENGTH,"\"comp1_","\"comp_");
+            fprintf(file_p_2,"%s\n  for_each = local.compute_nodes\n",line_buffer);
+            continue;
+        }
+        if(strlen(status_line)>0&&strncmp(line_buffer,status_line,strlen(status_line))==0){
+            fprintf(file_p_2,"%seach.value.status\n",status_line);
+            continue;
+        }
+        pool_line_replace(line_buffer,LINE_LENGTH,".compute1.",".compute[each.key].");
+        pool_line_replace(line_buffer,LINE_LENGTH,".compute1_nic.",".compute_nic[each.key].");
+        pool_line_replace(line_buffer,LINE_LENGTH,"compute1","${each.key}");
+        fprintf(file_p_2,"%s\n",line_buffer);
+    }
+    fclose(file_p);
+    fclose(file_p_2);
+    return 0;
+}
+
+/* The node_status is 1-based, empty strings are skipped */
+int write_compute_pool_nodes(char* nodes_file, char (*node_status)[16], int max_index){
+    FILE* file_p=fopen(nodes_file,"w+");
+    int i;
+    if(file_p==NULL){
+        return -3;
+    }
+    fprintf(file_p,"# %s\nlocals {\n  compute_nodes = {\n",INTERNAL_FILE_HEADER);
+    for(i=1;i<max_index+1;i++){
+        if(strlen(node_status[i])>0){
+            fprintf(file_p,"    \"compute%d\" = { status = %s }\n",i,node_status[i]);
+        }
+    }
+    fprintf(file_p,"  }\n}\n");
+    fclose(file_p);
+    return 0;
+}
+
+/*
+ * Edit the node map of the compute pool in one pass.
+ * option: "add" | "delete" | "on" | "off", applied to compute[start_num, end_num]
+ * return -1: invalid option or range
+ * return -3: failed to read/write the node map
+ * return -5: failed to allocate memory
+ * return  0: normal exit
+ */
+int compute_pool_nodes_edit(char* stackdir, char* cloud_flag, int start_num, int end_num, char* option){
+    char nodes_file[FILENAME_LENGTH]="";
+    char status_key[32]="";
+    char literal[16]="";
+    char status_temp[16]="";
+    char line_buffer[LINE_LENGTH_SHORT]="";
+    char (*node_status)[16]=NULL;
+    int node_index=0;
+    int max_index=0;
+    int run_flag;
+    int i;
+    FILE* file_p=NULL;
+    if(start_num<1||end_num<start_num){
+        return -1;
+    }
+    if(strcmp(option,"add")==0||strcmp(option,"on")==0){
+        compute_pool_status_literal(cloud_flag,"on",status_key,32,literal,16);
+    }
+    else if(strcmp(option,"delete")==0||strcmp(option,"off")==0){
+        compute_pool_status_literal(cloud_flag,"off",status_key,32,literal,16);
+    }
+    else{
+        return -1;
+    }
+    if(strlen(literal)==0){
+        return -1;
+    }
+    snprintf(nodes_file,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_NODES);
+    file_p=fopen(nodes_file,"r");
+    if(file_p==NULL){
+        return -3;
+    }
+    while(fngetline(file_p,line_buffer,LINE_LENGTH_SHORT)!=1){
+        if(sscanf(line_buffer," \"compute%d\"",&node_index)==1&&node_index>max_index){
+            max_index=node_index;
+        }
+    }
+    if(end_num>max_index){
+        max_index=end_num;
+    }
+    node_status=calloc(max_index+1,sizeof(*node_status));
+    if(node_status==NULL){
+        fclose(file_p);
+        return -5;
+    }
+    rewind(file_p);
+    while(fngetline(file_p,line_buffer,LINE_LENGTH_SHORT)!=1){
+        if(sscanf(line_buffer," \"compute%d\" = { status = %15s",&node_index,status_temp)==2&&node_index>0&&node_index<max_index+1){
+            strcpy(node_status[node_index],status_temp);
+        }
+    }
+    fclose(file_p);
+    for(i=start_num;i<end_num+1;i++){
+        if(strcmp(option,"delete")==0){
+            *(node_status[i])='\0';
+        }
+        else if(strcmp(option,"add")==0||strlen(node_status[i])>0){
+            strcpy(node_status[i],literal);
+        }
+    }
+    run_flag=write_compute_pool_nodes(nodes_file,node_status,max_index);
+    free(node_status);
+    return run_flag;
 }
 
-/* 
- * CAUTION !
- * When using this function, please make sure the pointer input_string has enough length!
- * Otherwise stack overflow may occur! 
- * force_input=0: force input. force_input=1: optional
- * return 2 : cmd_keyword found
- * return 1 : skipped due to batch mode
- * return 0 : user input
+/*
+ * Convert the per-node file layout to the compute pool layout. The per-node files
+ * are moved to the backup_dir for rolling back. The generated COMPUTE_POOL_MOVED
+ * lets terraform re-address the existing nodes instead of recreating them, it
+ * should be removed after a successful apply.
+ * return  1: already in the compute pool layout
+ * return -1: failed to read the compute_template
+ * return -3: failed to write the pool files
+ * return -5: failed to allocate memory
+ * return  0: normal exit
  */
-int prompt_to_input_required_args(const char* prompt_string, char reply_string[], unsigned int reply_len_max, int batch_flag_local,int argc, char** argv, char* cmd_keyword){
-    if(cmd_keyword_ncheck(argc,argv,cmd_keyword,reply_string,reply_len_max)==0){
-        return 2;
+int convert_to_compute_pool(char* stackdir, char* cloud_flag, int compute_node_num, char* backup_dir){
+    char compute_template[FILENAME_LENGTH]="";
+    char filename_temp[FILENAME_LENGTH]="";
+    char status_key[32]="";
+    char status_line[64]="";
+    char on_literal[16]="";
+    char off_literal[16]="";
+    char line_buffer[LINE_LENGTH_SHORT]="";
+    char resource_type[8][64];
+    char resource_name[8][64];
+    char string_temp[64]="";
+    char (*node_status)[16]=NULL;
+    int resource_num=0;
+    int prefix_length=0;
+    int i,j;
+    FILE* file_p=NULL;
+    if(compute_pool_or_not(stackdir)==0){
+        return 1;
     }
-    return prompt_to_input(prompt_string,reply_string,reply_len_max,batch_flag_local);
-}
-
-int prompt_to_input_optional_args(const char* prompt_confirm, const char* confirm_string, const char* prompt_string, char reply_string[], unsigned int reply_len_max, int batch_flag_local,int argc, char** argv, char* cmd_keyword){
-    if(cmd_keyword_ncheck(argc,argv,cmd_keyword,reply_string,reply_len_max)==0){
-        return 2;
+    if(compute_node_num<0){
+        compute_node_num=0;
     }
-    if(batch_flag_local==0){
-        strcpy(reply_string,"");
-        return 4;
+    snprintf(compute_template,FILENAME_LENGTH-1,"%s%scompute_template",stackdir,PATH_SLASH);
+    file_p=fopen(compute_template,"r");
+    if(file_p==NULL){
+        return -1;
     }
-    if(prompt_to_confirm(prompt_confirm,confirm_string,batch_flag_local)==1){
-        strcpy(reply_string,"");
-        return 6;
+    while(fngetline(file_p,line_buffer,LINE_LENGTH_SHORT)!=1&&resource_num<8){
+        if(sscanf(line_buffer,"resource \"%63[^\"]\" \"%63[^\"]\"",resource_type[resource_num],resource_name[resource_num])==2){
+            resource_num++;
+        }
     }
-    return prompt_to_input(prompt_string,reply_string,reply_len_max,batch_flag_local);
-}
-
-int check_down_nodes(char* workdir, char* crypto_keyfile){
-    char stackdir[DIR_LENGTH];
-    if(create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH)!=0){
-        return -1;
+    fclose(file_p);
+    compute_pool_status_literal(cloud_flag,"on",status_key,32,on_literal,16);
+    if(compute_pool_status_literal(cloud_flag,"off",status_key,32,off_literal,16)==0){
+        snprintf(status_line,63,"%s = %s",status_key,off_literal);
     }
-    return get_compute_node_num(stackdir,crypto_keyfile,"down");
-}
-
-int cluster_ssh(char* workdir, char* crypto_keyfile, char* username, char* role_flag, char* sshkey_dir){
-    char master_address[64]="";
-    char cmdline[CMDLINE_LENGTH]="";
-    char privkey_base[FILENAME_LENGTH]="";
-    char privkey_decrypted[FILENAME_LENGTH_EXT]="";
-    char cluster_name[CLUSTER_ID_LENGTH_MAX_PLUS]="";
-    char randstr[7]="";
-    int run_flag;
-    get_state_nvalue(workdir,crypto_keyfile,"master_public_ip:",master_address,64);
-    if(get_cluster_nname(cluster_name,CLUSTER_ID_LENGTH_MAX_PLUS,workdir)!=0){
-        return -7;
+    node_status=calloc(compute_node_num+1,sizeof(*node_status));
+    if(node_status==NULL){
+        return -5;
     }
-    if(strcmp(role_flag,"opr")==0){
-        snprintf(privkey_base,FILENAME_LENGTH-1,"%s%snow-cluster-login",sshkey_dir,PATH_SLASH);
+    for(i=1;i<compute_node_num+1;i++){
+        snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf",stackdir,PATH_SLASH,i);
+        if(strlen(status_line)>0&&find_multi_nkeys(filename_temp,LINE_LENGTH_SMALL,status_line,"","","","")>0){
+            strcpy(node_status[i],off_literal);
+        }
+        else{
+            strcpy(node_status[i],on_literal);
+        }
     }
-    else{
-        snprintf(privkey_base,FILENAME_LENGTH-1,"%s%s.%s%s%s.key",sshkey_dir,PATH_SLASH,cluster_name,PATH_SLASH,username);
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_NODES);
+    if(write_compute_pool_nodes(filename_temp,node_status,compute_node_num)!=0){
+        free(node_status);
+        return -3;
     }
-    generate_random_nstring(randstr,7,1);
-    if(file_convert(privkey_base,randstr,"decrypt")!=0){
-        return -5;
+    free(node_status);
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_MOVED);
+    file_p=fopen(filename_temp,"w+");
+    if(file_p==NULL){
+        return -3;
+    }
+    for(i=1;i<compute_node_num+1;i++){
+        for(j=0;j<resource_num;j++){
+            prefix_length=strcspn(resource_name[j],"0123456789");
+            if(*(resource_name[j]+prefix_length)=='\0'){
+                continue;
+            }
+            fprintf(file_p,"moved {\n  from = %s.%.*s%d%s\n",resource_type[j],prefix_length,resource_name[j],i,resource_name[j]+prefix_length+1);
+            fprintf(file_p,"  to = %s.%.*s%s[\"compute%d\"]\n}\n",resource_type[j],prefix_length,resource_name[j],resource_name[j]+prefix_length+1,i);
+        }
     }
-    snprintf(privkey_decrypted,FILENAME_LENGTH_EXT-1,"%s.%s",privkey_base,randstr);
-    if(chmod_ssh_privkey(privkey_decrypted)!=0){
-        rm_file_or_dir(privkey_decrypted);
+    fclose(file_p);
+    if(compute_pool_render(stackdir,cloud_flag)!=0){
         return -3;
     }
-    snprintf(cmdline,CMDLINE_LENGTH-1,"ssh -i %s -o StrictHostKeyChecking=no %s@%s",privkey_decrypted,username,master_address);
-    run_flag=system(cmdline);
-    rm_file_or_dir(privkey_decrypted);
-    if(run_flag!=0){
-        return 1;
+    for(i=1;i<compute_node_num+1;i++){
+        snprintf(string_temp,63,"hpc_stack_compute%d.tf*",i);
+        batch_file_operation(stackdir,string_temp,backup_dir,"mv",0);
     }
     return 0;
 }
 
-int node_file_to_running(char* stackdir, char* node_name, char* cloud_flag){
+/* Roll back a failed conversion to the per-node file layout */
+int revert_compute_pool(char* stackdir, int compute_node_num, char* backup_dir){
     char filename_temp[FILENAME_LENGTH]="";
-    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_%s.tf",stackdir,PATH_SLASH,node_name);
-    if(strcmp(cloud_flag,"CLOUD_A")==0){
-        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"Stopped","Running");
-    }
-    else if(strcmp(cloud_flag,"CLOUD_B")==0){
-        find_and_nreplace(filename_temp,LINE_LENGTH_SMALL,"running_flag","","","","","false","true");
+    char string_temp[64]="";
+    int i;
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_STACK);
+    rm_file_or_dir(filename_temp);
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_NODES);
+    rm_file_or_dir(filename_temp);
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_MOVED);
+    rm_file_or_dir(filename_temp);
+    for(i=1;i<compute_node_num+1;i++){
+        snprintf(string_temp,63,"hpc_stack_compute%d.tf*",i);
+        batch_file_operation(backup_dir,string_temp,stackdir,"mv",0);
     }
-    else if(strcmp(cloud_flag,"CLOUD_C")==0){
-        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"stopped","running");
+    return 0;
+}
+
+/*
+ * Derive the compute node states from the tfstate in ONE pass. Only valid for
+ * the compute pool layout, in which the instances are keyed by "computeN".
+ * return -1: failed to open the tfstate
+ * return -5: failed to allocate memory
+ * return the number of compute nodes
+ */
+int get_compute_pool_state(char* tfstate, char* cloud_flag, FILE* file_p_statefile, FILE* file_p_hostfile, int* node_num_on){
+    char ip_key[32]="";
+    char status_key[32]="";
+    char status_resource[16]="compute";
+    char resource_name[64]="";
+    char line_buffer[LINE_LENGTH_SHORT]="";
+    char* key_position=NULL;
+    char (*node_ips)[32]=NULL;
+    char (*node_status)[16]=NULL;
+    void* realloc_temp=NULL;
+    int node_capacity=0;
+    int node_num=0;
+    int node_index=0;
+    int new_capacity=0;
+    int i;
+    FILE* file_p=NULL;
+    if(strcmp(cloud_flag,"CLOUD_A")==0||strcmp(cloud_flag,"CLOUD_B")==0||strcmp(cloud_flag,"CLOUD_C")==0){
+        strcpy(ip_key,"\"private_ip\":");
+        if(strcmp(cloud_flag,"CLOUD_A")==0){
+            strcpy(status_key,"\"status\":");
+        }
+        else if(strcmp(cloud_flag,"CLOUD_B")==0){
+            strcpy(status_key,"\"instance_status\":");
+        }
+        else{
+            strcpy(status_key,"\"state\":");
+            strcpy(status_resource,"comp_state");
+        }
     }
     else if(strcmp(cloud_flag,"CLOUD_D")==0){
-        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"\"OFF\"","\"ON\"");
+        strcpy(ip_key,"\"access_ip_v4\":");
+        strcpy(status_key,"\"power_action\":");
     }
     else if(strcmp(cloud_flag,"CLOUD_E")==0){
-        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"\"stop\"","\"start\"");
+        strcpy(ip_key,"\"internal_ip\":");
+        strcpy(status_key,"\"status\":");
     }
-    else if(strcmp(cloud_flag,"CLOUD_G")==0){
-        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"\"TERMINATED\"","\"RUNNING\"");
+    else if(strcmp(cloud_flag,"CLOUD_F")==0){
+        strcpy(ip_key,"\"private_ip_address\":");
     }
     else{
-        return 1;
+        strcpy(ip_key,"\"network_ip\":");
+        strcpy(status_key,"\"current_status\":");
+    }
+    file_p=fopen(tfstate,"r");
+    if(file_p==NULL){
+        return -1;
+    }
+    while(fngetline(file_p,line_buffer,LINE_LENGTH_SHORT)!=1){
+        /* Resource-level keys are indented by 6 spaces in the tfstate */
+        if(strncmp(line_buffer,"      \"name\": \"",15)==0){
+            get_seq_nstring(line_buffer,'\"',4,resource_name,64);
+            node_index=0;
+            continue;
+        }
+        if(strcmp(resource_name,"compute")!=0&&strcmp(resource_name,status_resource)!=0){
+            continue;
+        }
+        key_position=strstr(line_buffer,"\"index_key\": \"compute");
+        if(key_position!=NULL){
+            node_index=0;
+            sscanf(key_position+strlen("\"index_key\": \"compute"),"%d",&node_index);
+            if(node_index<1){
+                continue;
+            }
+            if(node_index>node_capacity){
+                new_capacity=node_index+64;
+                realloc_temp=realloc(node_ips,(new_capacity+1)*sizeof(*node_ips));
+                if(realloc_temp!=NULL){
+                    node_ips=realloc_temp;
+                    realloc_temp=realloc(node_status,(new_capacity+1)*sizeof(*node_status));
+                }
+                if(realloc_temp==NULL){
+                    fclose(file_p);
+                    free(node_ips);
+                    free(node_status);
+                    return -5;
+                }
+                node_status=realloc_temp;
+                memset(node_ips+node_capacity+1,'\0',(new_capacity-node_capacity)*sizeof(*node_ips));
+                memset(node_status+node_capacity+1,'\0',(new_capacity-node_capacity)*sizeof(*node_status));
+                if(node_capacity==0){
+                    memset(node_ips,'\0',sizeof(*node_ips));
+                    memset(node_status,'\0',sizeof(*node_status));
+                }
+                node_capacity=new_capacity;
+            }
+            if(node_index>node_num){
+                node_num=node_index;
+            }
+            continue;
+        }
+        if(node_index<1||node_index>node_capacity){
+            continue;
+        }
+        if(strcmp(resource_name,"compute")==0&&strlen(node_ips[node_index])==0&&strstr(line_buffer,ip_key)!=NULL){
+            get_seq_nstring(line_buffer,'\"',4,node_ips[node_index],32);
+        }
+        else if(strlen(status_key)>0&&strcmp(resource_name,status_resource)==0&&strlen(node_status[node_index])==0&&strstr(line_buffer,status_key)!=NULL){
+            get_seq_nstring(line_buffer,'\"',4,node_status[node_index],16);
+        }
+    }
+    fclose(file_p);
+    for(i=1;i<node_num+1;i++){
+        if(strcmp(cloud_flag,"CLOUD_D")==0){
+            strcpy(node_status[i],(strcmp(node_status[i],"ON")==0)?"Running":"Stopped");
+        }
+        else if(strcmp(cloud_flag,"CLOUD_F")==0){
+            strcpy(node_status[i],"Running");
+        }
+        else if(strcmp(cloud_flag,"CLOUD_G")==0){
+            strcpy(node_status[i],(strcmp(node_status[i],"TERMINATED")==0)?"STOPPED":"RUNNING");
+        }
+        fprintf(file_p_statefile,"compute%d_private_ip: %s\n",i,node_ips[i]);
+        fprintf(file_p_hostfile,"%s\tcompute%d\n",node_ips[i],i);
+        fprintf(file_p_statefile,"compute%d_status: %s\n",i,node_status[i]);
+        if(strcmp(node_status[i],"RUNNING")==0||strcmp(node_status[i],"running")==0||strcmp(node_status[i],"Running")==0){
+            (*node_num_on)++;
+        }
+    }
+    free(node_ips);
+    free(node_status);
+    return node_num;
+}
+
+/* In the compute pool layout, the compute_template is the ONLY stack file of compute nodes */
+void get_compute_stack_file(char* stackdir, int node_index, char* filename, unsigned int filename_len_max){
+    if(compute_pool_or_not(stackdir)==0){
+        snprintf(filename,filename_len_max-1,"%s%scompute_template",stackdir,PATH_SLASH);
+    }
+    else{
+        snprintf(filename,filename_len_max-1,"%s%shpc_stack_compute%d.tf",stackdir,PATH_SLASH,node_index);
+    }
+}
+
+/*
+ * The following compute_nodes_* functions work on both layouts. In the compute
+ * pool layout, a range of nodes is handled by ONE edit of the node map.
+ */
+int compute_nodes_add(char* stackdir, char* cloud_flag, int start_num, int end_num){
+    char compute_template[FILENAME_LENGTH]="";
+    char filename_temp[FILENAME_LENGTH]="";
+    char string_temp[32]="";
+    int i;
+    if(compute_pool_or_not(stackdir)==0){
+        return compute_pool_nodes_edit(stackdir,cloud_flag,start_num,end_num,"add");
+    }
+    snprintf(compute_template,FILENAME_LENGTH-1,"%s%scompute_template",stackdir,PATH_SLASH);
+    for(i=start_num;i<end_num+1;i++){
+        snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf",stackdir,PATH_SLASH,i);
+        cp_file(compute_template,filename_temp,0);
+        snprintf(string_temp,31,"compute%d",i);
+        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"compute1",string_temp);
+        snprintf(string_temp,31,"comp%d",i);
+        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"comp1",string_temp);
     }
     return 0;
 }
 
-int node_file_to_stop(char* stackdir, char* node_name, char* cloud_flag){
+/* If the backup_dir is empty, the nodes would be removed without backup */
+int compute_nodes_remove(char* stackdir, char* cloud_flag, int start_num, int end_num, char* backup_dir){
     char filename_temp[FILENAME_LENGTH]="";
-    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_%s.tf",stackdir,PATH_SLASH,node_name);
-    if(strcmp(cloud_flag,"CLOUD_A")==0){
-        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"Running","Stopped");
+    char filename_temp2[FILENAME_LENGTH]="";
+    char string_temp[32]="";
+    int i;
+    if(compute_pool_or_not(stackdir)==0){
+        if(strlen(backup_dir)>0){
+            snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_NODES);
+            snprintf(filename_temp2,FILENAME_LENGTH-1,"%s%s%s",backup_dir,PATH_SLASH,COMPUTE_POOL_NODES);
+            cp_file(filename_temp,filename_temp2,0);
+        }
+        return compute_pool_nodes_edit(stackdir,cloud_flag,start_num,end_num,"delete");
     }
-    else if(strcmp(cloud_flag,"CLOUD_B")==0){
-        find_and_nreplace(filename_temp,LINE_LENGTH_SMALL,"running_flag","","","","","true","false");
+    for(i=start_num;i<end_num+1;i++){
+        if(strlen(backup_dir)>0){
+            snprintf(string_temp,31,"hpc_stack_compute%d.tf*",i);
+            batch_file_operation(stackdir,string_temp,backup_dir,"mv",0);
+        }
+        else{
+            snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf",stackdir,PATH_SLASH,i);
+            rm_file_or_dir(filename_temp);
+        }
     }
-    else if(strcmp(cloud_flag,"CLOUD_C")==0){
-        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"running","stopped");
+    return 0;
+}
+
+int compute_nodes_restore(char* stackdir, int start_num, int end_num, char* backup_dir){
+    char filename_temp[FILENAME_LENGTH]="";
+    char filename_temp2[FILENAME_LENGTH]="";
+    char string_temp[32]="";
+    int i;
+    if(compute_pool_or_not(stackdir)==0){
+        snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s",backup_dir,PATH_SLASH,COMPUTE_POOL_NODES);
+        snprintf(filename_temp2,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_NODES);
+        return cp_file(filename_temp,filename_temp2,0);
     }
-    else if(strcmp(cloud_flag,"CLOUD_D")==0){
-        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"\"ON\"","\"OFF\"");
+    for(i=start_num;i<end_num+1;i++){
+        snprintf(string_temp,31,"hpc_stack_compute%d.tf*",i);
+        batch_file_operation(backup_dir,string_temp,stackdir,"mv",0);
     }
-    else if(strcmp(cloud_flag,"CLOUD_E")==0){
-        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"\"start\"","\"stop\"");
+    return 0;
+}
+
+/* option: "on" | "off" */
+int compute_nodes_to_state(char* stackdir, char* cloud_flag, int start_num, int end_num, char* option){
+    char node_name[32]="";
+    int i;
+    if(strcmp(option,"on")!=0&&strcmp(option,"off")!=0){
+        return -1;
     }
-    else if(strcmp(cloud_flag,"CLOUD_G")==0){
-        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"\"RUNNING\"","\"TERMINATED\"");
+    if(start_num>end_num){
+        return 0;
     }
-    else{
-        return 1;
+    if(compute_pool_or_not(stackdir)==0){
+        return compute_pool_nodes_edit(stackdir,cloud_flag,start_num,end_num,option);
+    }
+    for(i=start_num;i<end_num+1;i++){
+        snprintf(node_name,31,"compute%d",i);
+        if(strcmp(option,"on")==0){
+            node_file_to_running(stackdir,node_name,cloud_flag);
+        }
+        else{
+            node_file_to_stop(stackdir,node_name,cloud_flag);
+        }
     }
     return 0;
 }
@@ -3115,6 +5567,150 @@ int sync_statefile(char* workdir, char* crypto_keyfile, char* sshkey_dir){
     return remote_copy(workdir,crypto_keyfile,sshkey_dir,filename_temp,"/usr/hpc-now/currentstate","root","put","",0);
 }
 
+/*
+ * The steps after a successful apply form a small dependency graph:
+ *   getstate -> graph -> usage records (local)
+ *   getstate -> push hostfile & currentstate -> schedule hpcmgr (remote)
+ * The remote branch is sent in one scp and one ssh session as a background job,
+ * and the local branch runs while it is in flight. If the background job fails
+ * or times out, the remote steps are retried in sequence. A timed-out job is
+ * killed first (not on Windows), so that it doesn't lose its key or schedule
+ * hpcmgr a second time.
+ * return -1: failed to get the stackdir
+ * return 1: the background job failed, fell back to sequential remote steps
+ * return 0: normal exit
+ */
+int post_apply_pipeline(char* workdir, char* crypto_keyfile, char* sshkey_dir, post_apply_config* pipeline){
+    char stackdir[DIR_LENGTH]="";
+    char statefile[FILENAME_LENGTH]="";
+    char hostfile[FILENAME_LENGTH]="";
+    char opr_privkey_base[FILENAME_LENGTH]="";
+    char opr_privkey_decrypted[FILENAME_LENGTH_EXT]="";
+    char remote_script[FILENAME_LENGTH]="";
+    char done_file[FILENAME_LENGTH]="";
+#ifndef _WIN32
+    char launch_script[FILENAME_LENGTH]="";
+    char pid_file[FILENAME_LENGTH]="";
+#endif
+    char remote_address[32]="";
+    char at_job[256]="";
+    char bg_cmdline[CMDLINE_LENGTH_EXT]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    char mux_options[LINE_LENGTH_SHORT]="";
+    char identity_option[LINE_LENGTH_SHORT]="";
+    char done_flag[8]="";
+    char node_name[32]="";
+    char randstr[7]="";
+    int bg_flag=-1;
+    int i;
+    FILE* file_p=NULL;
+    trace_span span;
+    if(create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH)!=0){
+        return -1;
+    }
+    trace_span_start(&span,"post_apply_pipeline");
+    get_ssh_mux_options(mux_options,LINE_LENGTH_SHORT);
+    getstate(workdir,crypto_keyfile);
+    snprintf(statefile,FILENAME_LENGTH-1,"%s%scurrentstate",stackdir,PATH_SLASH);
+    snprintf(hostfile,FILENAME_LENGTH-1,"%s%shostfile_latest",stackdir,PATH_SLASH);
+    if(get_state_nvalue(workdir,crypto_keyfile,"master_public_ip:",remote_address,32)==0){
+        generate_random_nstring(randstr,7,1);
+        snprintf(opr_privkey_base,FILENAME_LENGTH-1,"%s%snow-cluster-login",sshkey_dir,PATH_SLASH);
+        snprintf(remote_script,FILENAME_LENGTH-1,"%spost_apply_%s.sh",NOW_TMP_DIR,randstr);
+        snprintf(done_file,FILENAME_LENGTH-1,"%spost_apply_%s.done",NOW_TMP_DIR,randstr);
+#ifndef _WIN32
+        snprintf(launch_script,FILENAME_LENGTH-1,"%spost_apply_%s.run",NOW_TMP_DIR,randstr);
+        snprintf(pid_file,FILENAME_LENGTH-1,"%spost_apply_%s.pid",NOW_TMP_DIR,randstr);
+#endif
+        /* The remote steps are shipped as a script, so the ssh command line needs no nested quotes. */
+        file_p=fopen(remote_script,"wb");
+        if(file_p!=NULL){
+            if(pipeline->push_hostfile==1){
+                fprintf(file_p,"mv -f /usr/hpc-now/hostfile_latest /root/hostfile\n");
+            }
+            if(strlen(pipeline->hpcmgr_exec)>0&&hpcmgr_at_job(pipeline->hpcmgr_exec,0,at_job,256)==0){
+                fprintf(file_p,"%s\n",at_job);
+            }
+            fprintf(file_p,"rm -f /usr/hpc-now/post_apply_%s.sh\n",randstr);
+            fclose(file_p);
+            if(get_ssh_identity(opr_privkey_base,identity_option,LINE_LENGTH_SHORT,opr_privkey_decrypted,FILENAME_LENGTH_EXT)>-1){
+                /* ConnectionAttempts polls the master until it accepts the connection, instead of a fixed wait. */
+                snprintf(bg_cmdline,CMDLINE_LENGTH_EXT-1,"scp %s -o StrictHostKeyChecking=no -o ConnectTimeout=10 -o ConnectionAttempts=6 %s %s %s %s root@%s:/usr/hpc-now/ %s && ssh -n %s -o StrictHostKeyChecking=no -o ConnectTimeout=10 %s root@%s bash /usr/hpc-now/post_apply_%s.sh %s && echo 0 > %s || echo 1 > %s",mux_options,identity_option,statefile,(pipeline->push_hostfile==1)?hostfile:"",remote_script,remote_address,SYSTEM_CMD_REDIRECT,mux_options,identity_option,remote_address,randstr,SYSTEM_CMD_REDIRECT,done_file,done_file);
+#ifdef _WIN32
+                snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s%s%s",START_BG_SHELL,bg_cmdline,END_BG_SHELL);
+                bg_flag=system(cmdline);
+#else
+                /* Run as a script that records its pid, like the fanout_run tasks, so that it can be killed on timeout. */
+                file_p=fopen(launch_script,"w+");
+                if(file_p!=NULL){
+                    fprintf(file_p,"echo $$ > %s\n%s\n",pid_file,bg_cmdline);
+                    fclose(file_p);
+                    snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s/bin/sh %s%s",START_BG_SHELL,launch_script,END_BG_SHELL);
+                    bg_flag=system(cmdline);
+                }
+#endif
+            }
+        }
+        if(bg_flag!=0){
+            release_ssh_identity(opr_privkey_decrypted);
+            rm_file_or_dir(remote_script);
+#ifndef _WIN32
+            rm_file_or_dir(launch_script);
+#endif
+        }
+    }
+    graph(workdir,crypto_keyfile,0);
+    printf("|\n");
+    if(strlen(pipeline->usage_option)>0){
+        if(pipeline->usage_base_flag==1){
+            update_usage_summary(workdir,crypto_keyfile,"master",pipeline->usage_option);
+            update_usage_summary(workdir,crypto_keyfile,"database",pipeline->usage_option);
+            update_usage_summary(workdir,crypto_keyfile,"natgw",pipeline->usage_option);
+        }
+        for(i=pipeline->usage_node_start;i>0&&i<pipeline->usage_node_end+1;i++){
+            snprintf(node_name,31,"compute%d",i);
+            update_usage_summary(workdir,crypto_keyfile,node_name,pipeline->usage_option);
+        }
+    }
+    if(bg_flag==0){
+        for(i=0;file_exist_or_not(done_file)!=0&&i<POST_APPLY_WAIT_MAX;i++){
+            sleep_func(1);
+        }
+#ifndef _WIN32
+        if(file_exist_or_not(done_file)!=0){
+            fanout_kill(pid_file);
+        }
+        rm_file_or_dir(launch_script);
+        rm_file_or_dir(pid_file);
+#endif
+        release_ssh_identity(opr_privkey_decrypted);
+        rm_file_or_dir(remote_script);
+        file_p=fopen(done_file,"r");
+        if(file_p!=NULL){
+            fngetline(file_p,done_flag,8);
+            fclose(file_p);
+        }
+        rm_file_or_dir(done_file);
+        if(done_flag[0]!='0'){
+            bg_flag=1;
+        }
+    }
+    if(bg_flag==0){
+        trace_span_end(&span,0);
+        return 0;
+    }
+    printf(WARN_YELLO_BOLD "[ -WARN- ] Failed to push the cluster state in the background. Retrying ..." RESET_DISPLAY "\n");
+    if(pipeline->push_hostfile==1){
+        remote_copy(workdir,crypto_keyfile,sshkey_dir,hostfile,"/root/hostfile","root","put","",0);
+    }
+    sync_statefile(workdir,crypto_keyfile,sshkey_dir);
+    if(strlen(pipeline->hpcmgr_exec)>0){
+        remote_exec(workdir,crypto_keyfile,sshkey_dir,pipeline->hpcmgr_exec,0);
+    }
+    trace_span_end(&span,1);
+    return 1;
+}
+
 int user_password_complexity_check(char* password, char* special_chars){
     if(strlen(password)==0){
         printf(FATAL_RED_BOLD "[ FATAL: ] Empty password. Length must be in the range %d - %d." RESET_DISPLAY "\n",USER_PASSWORD_LENGTH_MIN,USER_PASSWORD_LENGTH_MAX);
@@ -3963,6 +6559,9 @@ int modify_payment_lines(char* stackdir, char* crypto_keyfile, char* cloud_flag,
     modify_payment_single_line(filename_temp,modify_flag,line_buffer2);
     modify_payment_single_line(filename_temp,modify_flag,line_buffer3);
     modify_payment_single_line(filename_temp,modify_flag,line_buffer4);
+    if(compute_pool_or_not(stackdir)==0){
+        return compute_pool_render(stackdir,cloud_flag);
+    }
     for(i=0;i<compute_nodes;i++){
         snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf",stackdir,PATH_SLASH,i+1);
         modify_payment_single_line(filename_temp,modify_flag,line_buffer1);
@@ -22,6 +22,41 @@ typedef struct{
     char md5sum[64];
 } global_conf;
 
+typedef struct{
+    int push_hostfile;      /* 1: push the hostfile_latest to the master node */
+    char hpcmgr_exec[16];   /* The hpcmgr job to schedule after the push, "" to skip */
+    char usage_option[8];   /* "start" or "stop", "" to skip the usage records */
+    int usage_base_flag;    /* 1: also record the master, database and natgw nodes */
+    int usage_node_start;   /* The compute node range of the usage records */
+    int usage_node_end;
+} post_apply_config;
+
+typedef struct{
+    char step_type[8];      /* "put": upload a local file, "secret": upload a string as a 0600 file, "exec": run the commands */
+    char local_path[FILENAME_LENGTH];
+    char remote_path[FILENAME_LENGTH];
+    char commands[CMDLINE_LENGTH];
+    int exit_code;          /* -1: the step was not executed */
+    char output[REMOTE_BATCH_OUTPUT_LENGTH];
+} remote_batch_step;
+
+typedef struct{
+    int step_num;
+    int stop_on_error;      /* 1: skip the remaining steps after a failed step */
+    int stream_last;        /* 1: print the output of the last step as it runs, instead of keeping it */
+    remote_batch_step steps[REMOTE_BATCH_STEPS_MAX];
+} remote_batch;
+
+typedef struct{
+    char target[64];        /* The label of the target, e.g. the cluster name */
+    char cmdline[CMDLINE_LENGTH];
+    char privkey_temp[FILENAME_LENGTH_EXT]; /* The decrypted key to release after the run, if any */
+    int state;              /* 0: pending, 1: running, 2: finished or timed out */
+    long long start_time;
+    int elapsed_sec;
+    int exit_code;          /* -1: not finished before the timeout */
+} fanout_task;
+
 int cluster_role_detect(char* workdir, char cluster_role[], char cluster_role_ext[], unsigned int maxlen);
 int add_to_cluster_registry(char* new_cluster_name, char* import_flag);
 int create_and_get_subdir(char* workdir, char* subdir_name, char subdir_path[], unsigned int dir_maxlen);
@@ -29,6 +64,15 @@ int create_and_get_stackdir(char* workdir, char* stackdir);
 
 int decrypt_bucket_info(char* workdir, char* crypto_keyfile, char* bucket_info);
 int get_cloud_flag(char* workdir, char* crypto_keyfile, char cloud_flag[], unsigned int maxlen);
+int get_ssh_mux_options(char* mux_options, unsigned int maxlen);
+int close_ssh_mux(char* workdir, char* crypto_keyfile, char* username);
+int key_broker_status(int* agent_pid);
+int key_broker_start(void);
+int get_ssh_identity(char* privkey_base, char* identity_option, unsigned int maxlen, char* privkey_temp, unsigned int temp_len);
+int release_ssh_identity(char* privkey_temp);
+int key_broker_remove(char* privkey_base);
+int get_ssh_target(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* username, char* remote_address, unsigned int addr_len, char* identity_option, unsigned int id_len, char* privkey_temp, unsigned int temp_len);
+int remote_copy_cmdline(char* workdir, char* crypto_keyfile ,char* sshkey_dir, char* local_path, char* remote_path, char* username, char* option, char* recursive_flag, char* cmdline, unsigned int maxlen, char* privkey_temp, unsigned int temp_len);
 int remote_copy(char* workdir, char* crypto_keyfile ,char* sshkey_dir, char* local_path, char* remote_path, char* username, char* option, char* recursive_flag, int silent_flag);
 
 int chmod_ssh_privkey(char* ssh_privkey);
@@ -51,7 +95,24 @@ int generate_encrypt_opr_sshkey(char* sshkey_folder, char* crypto_keyfile);
 int get_opr_pubkey(char* sshkey_folder, char* pubkey, unsigned int length);
 
 int create_and_get_vaultdir(char* workdir, char* vaultdir);
+int hpcmgr_at_job(char* exec_type, int delay_minutes, char* at_job, unsigned int maxlen);
 int remote_exec(char* workdir, char* crypto_keyfile, char* sshkey_folder, char* exec_type, int delay_minutes);
+int remote_sync(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* local_path, char* remote_path, char* username, char* option, int recursive, int silent_flag);
+int get_transfer_conf(int* streams, int* chunk_mb, int* threshold_mb);
+int xfer_journal_init(char* workdir, char* cmd_type, char* source_path, char* target_path, int resume_flag, char* journal_file, unsigned int maxlen);
+int xfer_journal_check(char* journal_file, char* item, int_64bit size, long long mtime, char* recorded_hash, unsigned int hash_len);
+int xfer_journal_record(char* journal_file, char* item, int_64bit size, long long mtime, char* hash);
+int get_file_range_sha256(char* filename, int skip_mb, int count_mb, char* sha256_string, unsigned int len);
+int parallel_put(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* local_path, char* remote_path, char* username, char* journal_file);
+int get_transfer_compress_mode(void);
+int local_entropy_estimate(char* local_path);
+int remote_copy_compressed(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* local_path, char* remote_path, char* username, char* option, int recursive);
+int remote_batch_init(remote_batch* batch, int stop_on_error, int stream_last);
+int remote_batch_add(remote_batch* batch, char* step_type, char* param1, char* param2);
+void remote_batch_output(remote_batch* batch, int step_index, int stream_flag, char* line);
+int remote_batch_run(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* username, remote_batch* batch);
+void fanout_kill(char* pid_file);
+int fanout_run(fanout_task* tasks, int task_num, int concurrency, int timeout_sec);
 int remote_exec_general(char* workdir, char* crypto_keyfile, char* sshkey_folder, char* username, char* commands, char* extra_options, int delay_minutes, int silent_flag, char* std_redirect, char* err_redirect);
 int get_ak_sk(char* secret_file, char* crypto_key_file, char* ak, char* sk, char* cloud_flag);
 int display_cloud_info(char* workdir, char* crypto_keyfile);
@@ -75,7 +136,11 @@ int getstate(char* workdir, char* crypto_keyfile);
 int get_state_value(char* workdir, char* key, char* value);
 int get_state_nvalue(char* workdir, char* crypto_keyfile, char* key, char* value, unsigned int valen_max); /* Newer function */
 
+int get_log_segment_file(char* logarchive, int segment, char* segment_file, unsigned int maxlen);
+int get_log_archive_segment(char* logarchive, int_64bit* first_epoch);
+int rotate_log_archive(char* logarchive);
 int archive_log(char* logarchive, char* logfile);
+int extract_log_run(char* logarchive, char* run_id, char* output_file);
 int update_compute_template(char* stackdir, char* cloud_flag);
 int wait_for_complete(char* tf_realtime_log, char* option, int max_time, char* errorlog, char* errlog_archive, int silent_flag);
 int graph(char* workdir, char* crypto_keyfile, int graph_level);
@@ -85,8 +150,16 @@ int cluster_asleep_or_not(char* workdir, char* crypto_keyfile);
 
 int cluster_full_running_or_not(char* workdir, char* crypto_keyfile);
 int tf_exec_config_validation(tf_exec_config* tf_run);
+void tf_parallelism_defaults(tf_exec_config* tf_run);
+int tf_cloud_index(char* cloud_flag);
+int tf_operation_index(char* execution_name);
+int get_tf_parallelism_state(char* workdir, char* execution_name);
+int get_tf_parallelism(tf_exec_config* tf_run, char* workdir, char* cloud_flag, char* execution_name);
+int count_throttle_diagnostics(char* filename, int_64bit start_offset);
+int tune_tf_parallelism(tf_exec_config* tf_run, char* workdir, char* cloud_flag, char* execution_name, int current, int throttle_count, int run_flag);
 int tf_execution(tf_exec_config* tf_run, char* execution_name, char* workdir, char* crypto_keyfile, int silent_flag);
 int update_usage_summary(char* workdir, char* crypto_keyfile, char* node_name, char* option);
+int update_node_usage(char* workdir, char* crypto_keyfile, char* node_name, char* option);
 int get_vault_info(char* workdir, char* crypto_keyfile, char* username, char* bucket_flag, char* root_flag);
 int check_pslock(char* workdir, int decrypt_flag);
 int check_pslock_all(void);
@@ -110,6 +183,20 @@ int cluster_ssh(char* workdir, char* crypto_keyfile, char* username, char* clust
 int node_file_to_running(char* stackdir, char* node_name, char* cloud_flag);
 void single_file_to_running(char* filename, char* cloud_flag);
 int node_file_to_stop(char* stackdir, char* node_name, char* cloud_flag);
+int compute_pool_or_not(char* stackdir);
+int compute_pool_status_literal(char* cloud_flag, char* option, char* status_key, unsigned int keylen_max, char* literal, unsigned int literal_len_max);
+void pool_line_replace(char* line, unsigned int linelen_max, char* orig_string, char* new_string);
+int compute_pool_render(char* stackdir, char* cloud_flag);
+int write_compute_pool_nodes(char* nodes_file, char (*node_status)[16], int max_index);
+int compute_pool_nodes_edit(char* stackdir, char* cloud_flag, int start_num, int end_num, char* option);
+int convert_to_compute_pool(char* stackdir, char* cloud_flag, int compute_node_num, char* backup_dir);
+int revert_compute_pool(char* stackdir, int compute_node_num, char* backup_dir);
+void get_compute_stack_file(char* stackdir, int node_index, char* filename, unsigned int filename_len_max);
+int get_compute_pool_state(char* tfstate, char* cloud_flag, FILE* file_p_statefile, FILE* file_p_hostfile, int* node_num_on);
+int compute_nodes_add(char* stackdir, char* cloud_flag, int start_num, int end_num);
+int compute_nodes_remove(char* stackdir, char* cloud_flag, int start_num, int end_num, char* backup_dir);
+int compute_nodes_restore(char* stackdir, int start_num, int end_num, char* backup_dir);
+int compute_nodes_to_state(char* stackdir, char* cloud_flag, int start_num, int end_num, char* option);
 
 int get_bucket_info(char* workdir, char* crypto_keyfile, char* bucket_address, char* region_id, char* bucket_ak, char* bucket_sk);
 int get_bucket_ninfo(char* workdir, char* crypto_keyfile, unsigned int linelen_max, bucket_info* bucketinfo); /* Newer function */
@@ -124,6 +211,7 @@ int delete_decrypted_user_passwords(char* workdir);
 int encrypt_and_delete_user_passwords(char* workdir, char* crypto_keyfile);
 int sync_user_passwords(char* workdir, char* crypto_keyfile, char* sshkey_dir);
 int sync_statefile(char* workdir, char* crypto_keyfile, char* sshkey_dir);
+int post_apply_pipeline(char* workdir, char* crypto_keyfile, char* sshkey_dir, post_apply_config* pipeline);
 
 int user_password_complexity_check(char* password, char* special_chars);
 int input_user_passwd(char* password_string, int batch_flag_local);
@@ -23,6 +23,8 @@
 #include "general_print_info.h"
 #include "cluster_operations.h"
 #include "prereq_check.h"
+#include "mon_store.h"
+#include "jobman.h"
 
 extern char url_code_root_var[LOCATION_LENGTH];
 extern int code_loc_flag_var;
@@ -351,6 +353,8 @@ int rename_cluster(char* cluster_prev_name, char* cluster_new_name, char* crypto
         snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf",new_stackdir,PATH_SLASH,i);
         global_nreplace(filename_temp,LINE_LENGTH_SMALL,unique_cluster_id_prev,unique_cluster_id_new);
     }
+    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s",new_stackdir,PATH_SLASH,COMPUTE_POOL_STACK);
+    global_nreplace(filename_temp,LINE_LENGTH_SMALL,unique_cluster_id_prev,unique_cluster_id_new);
     if(tf_execution(tf_run,"apply",new_workdir,crypto_keyfile,1)!=0){
         printf(FATAL_RED_BOLD "[ FATAL: ] Failed to refresh the cluster's cloud resources." RESET_DISPLAY "\n");
         batch_file_operation(new_stackdir,"*.tf","","rm",0);
@@ -375,6 +379,15 @@ update_summary:
     snprintf(filename_temp,FILENAME_LENGTH-1,"%s%smon_data%smon_data_%s.csv",HPC_NOW_ROOT_DIR,PATH_SLASH,PATH_SLASH,cluster_prev_name);
     snprintf(filename_temp2,FILENAME_LENGTH-1,"%s%smon_data%smon_data_%s.csv",HPC_NOW_ROOT_DIR,PATH_SLASH,PATH_SLASH,cluster_new_name);
     rename(filename_temp,filename_temp2);
+    strncat(filename_temp,".sync",FILENAME_LENGTH-strlen(filename_temp)-1);
+    strncat(filename_temp2,".sync",FILENAME_LENGTH-strlen(filename_temp2)-1);
+    rename(filename_temp,filename_temp2);
+    mon_store_dir(cluster_prev_name,filename_temp,FILENAME_LENGTH);
+    mon_store_dir(cluster_new_name,filename_temp2,FILENAME_LENGTH);
+    rename(filename_temp,filename_temp2);
+    job_acct_dir(cluster_prev_name,filename_temp,FILENAME_LENGTH);
+    job_acct_dir(cluster_new_name,filename_temp2,FILENAME_LENGTH);
+    rename(filename_temp,filename_temp2);
     global_nreplace(USAGE_LOG_FILE,LINE_LENGTH_SMALL,unique_cluster_id_prev,unique_cluster_id_new);
 print_finished:
     file_convert(ALL_CLUSTER_REGISTRY,randstr,"delete_decrypted_backup");
@@ -1021,6 +1034,7 @@ int cluster_destroy(char* workdir, char* crypto_keyfile, char* force_flag, int b
     create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH);
     create_and_get_subdir(workdir,"conf",confdir,DIR_LENGTH);
     decrypt_files(workdir,crypto_keyfile);
+    close_ssh_mux(workdir,crypto_keyfile,"root");
     snprintf(dot_terraform,FILENAME_LENGTH-1,"%s%s.terraform",stackdir,PATH_SLASH);
     if(folder_exist_or_not(dot_terraform)==0){
         if(tf_execution(tf_run,"destroy",workdir,crypto_keyfile,1)!=0){
@@ -1084,8 +1098,9 @@ int delete_compute_node(char* workdir, char* crypto_keyfile, char* param, int ba
     int i,run_flag;
     int del_num=0;
     char filename_temp[FILENAME_LENGTH]="";
+    char cloud_flag[16]="";
     int compute_node_num=0;
-    if(get_nucid(workdir,crypto_keyfile,unique_cluster_id,16)!=0){
+    if(get_nucid(workdir,crypto_keyfile,unique_cluster_id,16)!=0||get_cloud_flag(workdir,crypto_keyfile,cloud_flag,16)!=0){
         return -1;
     }
     generate_random_nstring(randstr,8,1);
@@ -1118,17 +1133,11 @@ int delete_compute_node(char* workdir, char* crypto_keyfile, char* param, int ba
             snprintf(string_temp,127,GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " You specified to delete %d from %d compute node(s).",del_num,compute_node_num);
             printf("%s\n",string_temp);
             decrypt_files(workdir,crypto_keyfile);
-            for(i=compute_node_num-del_num+1;i<compute_node_num+1;i++){
-                snprintf(string_temp,127,"hpc_stack_compute%d.tf*",i);
-                batch_file_operation(stackdir,string_temp,destroyed_dir,"mv",0);
-            }
+            compute_nodes_remove(stackdir,cloud_flag,compute_node_num-del_num+1,compute_node_num,destroyed_dir);
             if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){ 
                 printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Rolling back now ... \n");
-                for(i=compute_node_num-del_num+1;i<compute_node_num+1;i++){
-                    snprintf(string_temp,127,"hpc_stack_compute%d.tf*",i);
-                    batch_file_operation(destroyed_dir,string_temp,stackdir,"mv",0);
-                    rm_pdir(destroyed_dir);
-                }
+                compute_nodes_restore(stackdir,compute_node_num-del_num+1,compute_node_num,destroyed_dir);
+                rm_pdir(destroyed_dir);
                 if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
                     delete_decrypted_files(workdir,crypto_keyfile);
                     printf(FATAL_RED_BOLD "[ FATAL: ] Failed to roll back. The cluster may be corrupted!" RESET_DISPLAY "\n");
@@ -1160,17 +1169,11 @@ int delete_compute_node(char* workdir, char* crypto_keyfile, char* param, int ba
     snprintf(string_temp,127,GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " You specified to delete *ALL* the %d compute node(s).",compute_node_num);
     printf("%s\n",string_temp);
     decrypt_files(workdir,crypto_keyfile);
-    for(i=1;i<compute_node_num+1;i++){
-        snprintf(string_temp,127,"hpc_stack_compute%d.tf*",i);
-        batch_file_operation(stackdir,string_temp,destroyed_dir,"mv",0);
-    }
+    compute_nodes_remove(stackdir,cloud_flag,1,compute_node_num,destroyed_dir);
     if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
         printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Rolling back now ... \n");
-        for(i=1;i<compute_node_num+1;i++){
-            snprintf(string_temp,127,"hpc_stack_compute%d.tf*",i);
-            batch_file_operation(destroyed_dir,string_temp,stackdir,"mv",0);
-            rm_pdir(destroyed_dir);
-        }
+        compute_nodes_restore(stackdir,1,compute_node_num,destroyed_dir);
+        rm_pdir(destroyed_dir);
         if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
             delete_decrypted_files(workdir,crypto_keyfile);
             printf(FATAL_RED_BOLD "[ FATAL: ] Failed to roll back. The cluster may be corrupted!" RESET_DISPLAY "\n");
@@ -1199,44 +1202,66 @@ int delete_compute_node(char* workdir, char* crypto_keyfile, char* param, int ba
     return 0;
 }
 
-int add_compute_node(char* workdir, char* crypto_keyfile, char* add_number_string, tf_exec_config* tf_run){
+/*
+ * pool_flag=0: convert the current compute nodes to the compute pool layout first
+ */
+int add_compute_node(char* workdir, char* crypto_keyfile, char* add_number_string, int pool_flag, tf_exec_config* tf_run){
     char string_temp[128]="";
     char filename_temp[FILENAME_LENGTH]="";
-    char compute_template[FILENAME_LENGTH]="";
     char stackdir[DIR_LENGTH]="";
-    int i;
+    char cloud_flag[16]="";
+    char unique_cluster_id[16]="";
+    char randstr[8]="";
+    char backup_dir[DIR_LENGTH]="";
     int add_number=0;
+    int add_number_max=MAXIMUM_ADD_NODE_NUMBER;
     int current_node_num=0;
+    int convert_flag=0;
     char* sshkey_dir=SSHKEY_DIR;
-    if(strlen(add_number_string)>2||strlen(add_number_string)<1){
-        printf(FATAL_RED_BOLD "[ FATAL: ] The number of nodes to be added is invalid. A number (1-%d) is needed." RESET_DISPLAY "\n",MAXIMUM_ADD_NODE_NUMBER);
+    post_apply_config pipeline;
+    if(get_nucid(workdir,crypto_keyfile,unique_cluster_id,16)!=0||get_cloud_flag(workdir,crypto_keyfile,cloud_flag,16)!=0){
+        return -1;
+    }
+    create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH);
+    if(pool_flag==0||compute_pool_or_not(stackdir)==0){
+        add_number_max=MAXIMUM_ADD_NODE_NUMBER_POOL;
+    }
+    if(strlen(add_number_string)>4||strlen(add_number_string)<1){
+        printf(FATAL_RED_BOLD "[ FATAL: ] The number of nodes to be added is invalid. A number (1-%d) is needed." RESET_DISPLAY "\n",add_number_max);
         return -1;
     }
     add_number=string_to_positive_num(add_number_string);
-    if(add_number<MINIMUM_ADD_NODE_NUMBER||add_number>MAXIMUM_ADD_NODE_NUMBER){
-        printf(FATAL_RED_BOLD "[ FATAL: ] The number of nodes to be added is out of range (1-%d).\n" RESET_DISPLAY,MAXIMUM_ADD_NODE_NUMBER);
+    if(add_number<MINIMUM_ADD_NODE_NUMBER||add_number>add_number_max){
+        printf(FATAL_RED_BOLD "[ FATAL: ] The number of nodes to be added is out of range (1-%d).\n" RESET_DISPLAY,add_number_max);
         return -1;
     }
     snprintf(string_temp,127,GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " You specified to add %d compute node(s).",add_number);
     printf("%s\n",string_temp);
     decrypt_files(workdir,crypto_keyfile);
     printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " The cluster operation is in progress ...\n");
-    create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH);
     current_node_num=get_compute_node_num(stackdir,crypto_keyfile,"all");
-    for(i=0;i<add_number;i++){
-        snprintf(compute_template,FILENAME_LENGTH-1,"%s%scompute_template",stackdir,PATH_SLASH);
-        snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf",stackdir,PATH_SLASH,i+1+current_node_num);
-        cp_file(compute_template,filename_temp,0);
-        snprintf(string_temp,127,"compute%d",i+1+current_node_num);
-        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"compute1",string_temp);
-        snprintf(string_temp,127,"comp%d",i+1+current_node_num);
-        global_nreplace(filename_temp,LINE_LENGTH_SMALL,"comp1",string_temp);
+    if(pool_flag==0&&compute_pool_or_not(stackdir)!=0){
+        generate_random_nstring(randstr,8,1);
+        snprintf(backup_dir,DIR_LENGTH-1,"%s%s%s_%s",NOW_TMP_DIR,PATH_SLASH,unique_cluster_id,randstr);
+        if(mk_pdir(backup_dir)!=0||convert_to_compute_pool(stackdir,cloud_flag,current_node_num,backup_dir)!=0){
+            printf(FATAL_RED_BOLD "[ FATAL: ] Failed to convert the compute nodes to the pool layout." RESET_DISPLAY "\n");
+            revert_compute_pool(stackdir,current_node_num,backup_dir);
+            rm_pdir(backup_dir);
+            delete_decrypted_files(workdir,crypto_keyfile);
+            return -3;
+        }
+        printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Converted %d compute node(s) to the pool layout.\n",current_node_num);
+        convert_flag=1;
     }
+    compute_nodes_add(stackdir,cloud_flag,current_node_num+1,current_node_num+add_number);
     if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
         printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Rolling back now ... \n");
-        for(i=0;i<add_number;i++){
-            snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf",stackdir,PATH_SLASH,i+1+current_node_num);
-            rm_file_or_dir(filename_temp);
+        if(convert_flag==1){
+            revert_compute_pool(stackdir,current_node_num,backup_dir);
+            rm_pdir(backup_dir);
+        }
+        else{
+            compute_nodes_remove(stackdir,cloud_flag,current_node_num+1,current_node_num+add_number,"");
         }
         if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
             delete_decrypted_files(workdir,crypto_keyfile);
@@ -1247,19 +1272,19 @@ int add_compute_node(char* workdir, char* crypto_keyfile, char* add_number_strin
         printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " The cluster has been successfully rolled back.\n");
         return -1;
     }
-    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " After the cluster operation:\n|\n");
-    getstate(workdir,crypto_keyfile);
-    graph(workdir,crypto_keyfile,0);
-    printf("|\n");
-    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shostfile_latest",stackdir,PATH_SLASH);
-    remote_copy(workdir,crypto_keyfile,sshkey_dir,filename_temp,"/root/hostfile","root","put","",0);
-    sync_statefile(workdir,crypto_keyfile,sshkey_dir);
-    remote_exec(workdir,crypto_keyfile,sshkey_dir,"connect",7);
-    remote_exec(workdir,crypto_keyfile,sshkey_dir,"all",8);
-    for(i=0;i<add_number;i++){
-        snprintf(string_temp,127,"compute%d",current_node_num+i+1);
-        update_usage_summary(workdir,crypto_keyfile,string_temp,"start");
+    if(convert_flag==1){
+        snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s%s",stackdir,PATH_SLASH,COMPUTE_POOL_MOVED);
+        rm_file_or_dir(filename_temp);
+        rm_pdir(backup_dir);
     }
+    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " After the cluster operation:\n|\n");
+    pipeline.push_hostfile=1;
+    strcpy(pipeline.hpcmgr_exec,"ready");
+    strcpy(pipeline.usage_option,"start");
+    pipeline.usage_base_flag=0;
+    pipeline.usage_node_start=current_node_num+1;
+    pipeline.usage_node_end=current_node_num+add_number;
+    post_apply_pipeline(workdir,crypto_keyfile,sshkey_dir,&pipeline);
     printf(GENERAL_BOLD "[ -DONE- ]" RESET_DISPLAY " Congrats! The specified compute nodes have been added.\n");
     delete_decrypted_files(workdir,crypto_keyfile);
     return 0;
@@ -1272,7 +1297,6 @@ int shutdown_compute_nodes(char* workdir, char* crypto_keyfile, char* param, int
     char cloud_flag[16]="";
     int i;
     int down_num=0;
-    char node_name[32]="";
     int compute_node_num=0;
 
     if(get_nucid(workdir,crypto_keyfile,unique_cluster_id,16)!=0){
@@ -1319,16 +1343,10 @@ int shutdown_compute_nodes(char* workdir, char* crypto_keyfile, char* param, int
             snprintf(string_temp,127,GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " You planned to shutdown %d from %d compute node(s).",down_num,compute_node_num);
             printf("%s\n",string_temp);
             decrypt_files(workdir,crypto_keyfile);
-            for(i=compute_node_num-down_num+1;i<compute_node_num+1;i++){
-                snprintf(node_name,31,"compute%d",i);
-                node_file_to_stop(stackdir,node_name,cloud_flag);
-            }
+            compute_nodes_to_state(stackdir,cloud_flag,compute_node_num-down_num+1,compute_node_num,"off");
             if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
                 printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Rolling back now ... \n");
-                for(i=compute_node_num-down_num+1;i<compute_node_num+1;i++){
-                    snprintf(node_name,31,"compute%d",i);
-                    node_file_to_running(stackdir,node_name,cloud_flag);
-                }
+                compute_nodes_to_state(stackdir,cloud_flag,compute_node_num-down_num+1,compute_node_num,"on");
                 if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
                     delete_decrypted_files(workdir,crypto_keyfile);
                     printf(FATAL_RED_BOLD "[ FATAL: ] Failed to roll back. The cluster may be corrupted!" RESET_DISPLAY "\n");
@@ -1355,16 +1373,10 @@ int shutdown_compute_nodes(char* workdir, char* crypto_keyfile, char* param, int
     snprintf(string_temp,127,GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " You planned to shutdown *ALL* the %d compute node(s).",compute_node_num);
     printf("%s\n",string_temp);
     decrypt_files(workdir,crypto_keyfile);
-    for(i=1;i<compute_node_num+1;i++){
-        snprintf(node_name,31,"compute%d",i);
-        node_file_to_stop(stackdir,node_name,cloud_flag);
-    }
+    compute_nodes_to_state(stackdir,cloud_flag,1,compute_node_num,"off");
     if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
         printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Rolling back now ... \n");
-        for(i=1;i<compute_node_num+1;i++){
-            snprintf(node_name,31,"compute%d",i);
-            node_file_to_running(stackdir,node_name,cloud_flag);
-        }
+        compute_nodes_to_state(stackdir,cloud_flag,1,compute_node_num,"on");
         if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
             delete_decrypted_files(workdir,crypto_keyfile);
             printf(FATAL_RED_BOLD "[ FATAL: ] Failed to roll back. The cluster may be corrupted!" RESET_DISPLAY "\n");
@@ -1392,7 +1404,6 @@ int turn_on_compute_nodes(char* workdir, char* crypto_keyfile, char* param, int
     char string_temp[128]="";
     char unique_cluster_id[16]="";
     char stackdir[DIR_LENGTH]="";
-    char node_name[32]="";
     char cloud_flag[16]="";
     char* sshkey_dir=SSHKEY_DIR;
     int i;
@@ -1450,16 +1461,10 @@ int turn_on_compute_nodes(char* workdir, char* crypto_keyfile, char* param, int
             snprintf(string_temp,127,GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " You planned to turn on *ALL* the %d compute node(s).",compute_node_num);
             printf("%s\n",string_temp);
             decrypt_files(workdir,crypto_keyfile);
-            for(i=compute_node_num_on+1;i<compute_node_num_on+on_num+1;i++){
-                snprintf(node_name,31,"compute%d",i);
-                node_file_to_running(stackdir,node_name,cloud_flag);
-            }
+            compute_nodes_to_state(stackdir,cloud_flag,compute_node_num_on+1,compute_node_num_on+on_num,"on");
             if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
                 printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Rolling back now ... \n");
-                for(i=compute_node_num_on+1;i<compute_node_num_on+on_num+1;i++){
-                    snprintf(node_name,31,"compute%d",i);
-                    node_file_to_stop(stackdir,node_name,cloud_flag);
-                }
+                compute_nodes_to_state(stackdir,cloud_flag,compute_node_num_on+1,compute_node_num_on+on_num,"off");
                 if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
                     delete_decrypted_files(workdir,crypto_keyfile);
                     printf(FATAL_RED_BOLD "[ FATAL: ] Failed to roll back. The cluster may be corrupted!" RESET_DISPLAY "\n");
@@ -1487,16 +1492,10 @@ int turn_on_compute_nodes(char* workdir, char* crypto_keyfile, char* param, int
     snprintf(string_temp,127,GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " You planned to turn on *ALL* the %d compute node(s).",compute_node_num);
     printf("%s\n",string_temp);
     decrypt_files(workdir,crypto_keyfile);
-    for(i=compute_node_num_on+1;i<compute_node_num+1;i++){
-        snprintf(node_name,31,"compute%d",i);
-        node_file_to_running(stackdir,node_name,cloud_flag);
-    }
+    compute_nodes_to_state(stackdir,cloud_flag,compute_node_num_on+1,compute_node_num,"on");
     if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
         printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Rolling back now ...\n");
-        for(i=compute_node_num_on+1;i<compute_node_num+1;i++){
-            snprintf(node_name,31,"compute%d",i);
-            node_file_to_stop(stackdir,node_name,cloud_flag);
-        }
+        compute_nodes_to_state(stackdir,cloud_flag,compute_node_num_on+1,compute_node_num,"off");
         if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
             delete_decrypted_files(workdir,crypto_keyfile);
             printf(FATAL_RED_BOLD "[ FATAL: ] Failed to roll back. The cluster may be corrupted!" RESET_DISPLAY "\n");
@@ -1539,12 +1538,14 @@ int reconfigure_compute_node(char* workdir, char* crypto_keyfile, char* new_conf
     char node_name_temp[32]="";
     int cpu_core_num=0;
     int reinit_flag=0;
+    int stack_file_num=0;
     if(get_cloud_flag(workdir,crypto_keyfile,cloud_flag,16)!=0){
         return -5;
     }
     create_and_get_subdir(workdir,"stack",stackdir,DIR_LENGTH);
     create_and_get_subdir(workdir,"vault",vaultdir,DIR_LENGTH);
     compute_node_num=get_compute_node_num(stackdir,crypto_keyfile,"all");
+    stack_file_num=(compute_pool_or_not(stackdir)==0)?1:compute_node_num;
     compute_node_down_num=get_compute_node_num(stackdir,crypto_keyfile,"down");
     if(compute_node_num==0){
         printf(WARN_YELLO_BOLD "[ -WARN- ] Currently there is no compute nodes in your cluster." RESET_DISPLAY "\n");
@@ -1584,9 +1585,9 @@ int reconfigure_compute_node(char* workdir, char* crypto_keyfile, char* new_conf
             delete_decrypted_files(workdir,crypto_keyfile);
             return 1;
         }
-        for(i=1;i<compute_node_num+1;i++){
-            snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf",stackdir,PATH_SLASH,i);
-            snprintf(filename_temp2,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf.bak",stackdir,PATH_SLASH,i);
+        for(i=1;i<stack_file_num+1;i++){
+            get_compute_stack_file(stackdir,i,filename_temp,FILENAME_LENGTH);
+            snprintf(filename_temp2,FILENAME_LENGTH-1,"%.*s.bak",FILENAME_LENGTH-8,filename_temp);
             cp_file(filename_temp,filename_temp2,0);
             global_nreplace(filename_temp,LINE_LENGTH_SMALL,prev_config,new_config);
         }
@@ -1604,9 +1605,9 @@ int reconfigure_compute_node(char* workdir, char* crypto_keyfile, char* new_conf
             delete_decrypted_files(workdir,crypto_keyfile);
             return 1;
         }
-        for(i=1;i<compute_node_num+1;i++){
-            snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf",stackdir,PATH_SLASH,i);
-            snprintf(filename_temp2,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf.bak",stackdir,PATH_SLASH,i);
+        for(i=1;i<stack_file_num+1;i++){
+            get_compute_stack_file(stackdir,i,filename_temp,FILENAME_LENGTH);
+            snprintf(filename_temp2,FILENAME_LENGTH-1,"%.*s.bak",FILENAME_LENGTH-8,filename_temp);
             cp_file(filename_temp,filename_temp2,0);
             if(config_diff_flag!=0){
                 global_replace(filename_temp,prev_config,new_config);
@@ -1637,13 +1638,19 @@ int reconfigure_compute_node(char* workdir, char* crypto_keyfile, char* new_conf
             }
         }
     }
+    if(compute_pool_or_not(stackdir)==0){
+        compute_pool_render(stackdir,cloud_flag);
+    }
     if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
         printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Rolling back now ... \n");
-        for(i=1;i<compute_node_num+1;i++){
-            snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf",stackdir,PATH_SLASH,i);
-            snprintf(filename_temp2,FILENAME_LENGTH-1,"%s%shpc_stack_compute%d.tf.bak",stackdir,PATH_SLASH,i);
+        for(i=1;i<stack_file_num+1;i++){
+            get_compute_stack_file(stackdir,i,filename_temp,FILENAME_LENGTH);
+            snprintf(filename_temp2,FILENAME_LENGTH-1,"%.*s.bak",FILENAME_LENGTH-8,filename_temp);
             rename(filename_temp2,filename_temp);
         }
+        if(compute_pool_or_not(stackdir)==0){
+            compute_pool_render(stackdir,cloud_flag);
+        }
         if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
             delete_decrypted_files(workdir,crypto_keyfile);
             printf(FATAL_RED_BOLD "[ FATAL: ] Failed to roll back. The cluster may be corrupted!" RESET_DISPLAY "\n");
@@ -1851,7 +1858,6 @@ int cluster_sleep(char* workdir, char* crypto_keyfile, tf_exec_config* tf_run){
     char stackdir[DIR_LENGTH]="";
     char cloud_flag[16]="";
     int i;
-    char node_name[32]="";
     int compute_node_num=0;
     if(get_nucid(workdir,crypto_keyfile,unique_cluster_id,16)!=0){
         return -1;
@@ -1875,19 +1881,13 @@ int cluster_sleep(char* workdir, char* crypto_keyfile, tf_exec_config* tf_run){
     node_file_to_stop(stackdir,"master",cloud_flag);
     node_file_to_stop(stackdir,"database",cloud_flag);
     node_file_to_stop(stackdir,"natgw",cloud_flag);
-    for(i=1;i<compute_node_num+1;i++){
-        snprintf(node_name,31,"compute%d",i);
-        node_file_to_stop(stackdir,node_name,cloud_flag);
-    }
+    compute_nodes_to_state(stackdir,cloud_flag,1,compute_node_num,"off");
     if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
         printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Rolling back now ...\n");
         node_file_to_running(stackdir,"master",cloud_flag);
         node_file_to_running(stackdir,"database",cloud_flag);
         node_file_to_running(stackdir,"natgw",cloud_flag);
-        for(i=1;i<compute_node_num+1;i++){
-            snprintf(node_name,31,"compute%d",i);
-            node_file_to_running(stackdir,node_name,cloud_flag);
-        }
+        compute_nodes_to_state(stackdir,cloud_flag,1,compute_node_num,"on");
         if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
             delete_decrypted_files(workdir,crypto_keyfile);
             printf(FATAL_RED_BOLD "[ FATAL: ] Failed to roll back. The cluster may be corrupted!" RESET_DISPLAY "\n");
@@ -1918,13 +1918,12 @@ int cluster_wakeup(char* workdir, char* crypto_keyfile, char* option, tf_exec_co
         printf(FATAL_RED_BOLD "[ FATAL: ] Please specify either 'minimal' or 'all' as the second parameter." RESET_DISPLAY "\n");
         return -1;
     }
-    char string_temp[128]="";
     char unique_cluster_id[16]="";
     char stackdir[DIR_LENGTH]="";
     char cloud_flag[16]="";
     int i;
     char* sshkeydir=SSHKEY_DIR;
-    char node_name[32]="";
+    post_apply_config pipeline;
     int compute_node_num=0;
     if(get_nucid(workdir,crypto_keyfile,unique_cluster_id,16)!=0){
         return -1;
@@ -1952,10 +1951,7 @@ int cluster_wakeup(char* workdir, char* crypto_keyfile, char* option, tf_exec_co
     node_file_to_running(stackdir,"database",cloud_flag);
     node_file_to_running(stackdir,"natgw",cloud_flag);
     if(strcmp(option,"all")==0){
-        for(i=1;i<compute_node_num+1;i++){
-            snprintf(node_name,31,"compute%d",i);
-            node_file_to_running(stackdir,node_name,cloud_flag);
-        }
+        compute_nodes_to_state(stackdir,cloud_flag,1,compute_node_num,"on");
     }
     if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
         printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Rolling back now ...\n");
@@ -1963,10 +1959,7 @@ int cluster_wakeup(char* workdir, char* crypto_keyfile, char* option, tf_exec_co
         node_file_to_stop(stackdir,"database",cloud_flag);
         node_file_to_stop(stackdir,"natgw",cloud_flag);
         if(strcmp(option,"all")==0){
-            for(i=1;i<compute_node_num+1;i++){
-                snprintf(node_name,31,"compute%d",i);
-                node_file_to_stop(stackdir,node_name,cloud_flag);
-            }
+            compute_nodes_to_state(stackdir,cloud_flag,1,compute_node_num,"off");
         }
         if(tf_execution(tf_run,"apply",workdir,crypto_keyfile,1)!=0){
             delete_decrypted_files(workdir,crypto_keyfile);
@@ -1990,26 +1983,13 @@ int cluster_wakeup(char* workdir, char* crypto_keyfile, char* option, tf_exec_co
         }
     }
     printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " After the cluster operation:\n|\n");
-    getstate(workdir,crypto_keyfile);
-    graph(workdir,crypto_keyfile,0);
-    printf("|\n");
-    update_usage_summary(workdir,crypto_keyfile,"master","start");
-    update_usage_summary(workdir,crypto_keyfile,"database","start");
-    update_usage_summary(workdir,crypto_keyfile,"natgw","start");
-    if(strcmp(option,"all")==0){
-        for(i=1;i<compute_node_num+1;i++){
-            snprintf(string_temp,127,"compute%d",i);
-            update_usage_summary(workdir,crypto_keyfile,string_temp,"start");
-        }
-    }
-    for(i=0;i<10;i++){
-        printf("[ -WAIT- ] Still need to wait for %d sec(s) ...\r",10-i);
-        fflush(stdout);
-        sleep_func(1);
-    }
-    printf("\n");
-    sync_statefile(workdir,crypto_keyfile,sshkeydir);
-    remote_exec(workdir,crypto_keyfile,sshkeydir,"quick",1);
+    pipeline.push_hostfile=0;
+    strcpy(pipeline.hpcmgr_exec,"ready_quick");
+    strcpy(pipeline.usage_option,"start");
+    pipeline.usage_base_flag=1;
+    pipeline.usage_node_start=(strcmp(option,"all")==0)?1:0;
+    pipeline.usage_node_end=compute_node_num;
+    post_apply_pipeline(workdir,crypto_keyfile,sshkeydir,&pipeline);
     if(strcmp(option,"all")==0){
         printf(GENERAL_BOLD "[ -DONE- ]" RESET_DISPLAY " Congrats! The cluster is in the state of " HIGH_CYAN_BOLD "full" RESET_DISPLAY " running.\n");
     }
@@ -2252,13 +2232,12 @@ int rebuild_nodes(char* workdir, char* crypto_keyfile, char* option, int batch_f
     }
     char stackdir[DIR_LENGTH]="";
     char vaultdir[DIR_LENGTH]="";
-    char filename_temp[FILENAME_LENGTH]="";
     char dirname_temp[DIR_LENGTH_EXT]="";
     char base_tf[FILENAME_LENGTH]="";
     char master_tf[FILENAME_LENGTH]="";
     char user_passwords[FILENAME_LENGTH]="";
     char* sshkey_folder=SSHKEY_DIR;
-    char node_name[32]="";
+    post_apply_config pipeline;
     char cluster_name[CLUSTER_ID_LENGTH_MAX_PLUS]="";
     char username_temp[64]="";
     char user_status_temp[32]="";
@@ -2317,10 +2296,7 @@ int rebuild_nodes(char* workdir, char* crypto_keyfile, char* option, int batch_f
     node_file_to_running(stackdir,"natgw",cloud_flag);
     node_file_to_running(stackdir,"database",cloud_flag);
     compute_node_num=get_compute_node_num(stackdir,crypto_keyfile,"all");
-    for(i=1;i<compute_node_num+1;i++){
-        snprintf(node_name,31,"compute%d",i);
-        node_file_to_running(stackdir,node_name,cloud_flag);
-    }
+    compute_nodes_to_state(stackdir,cloud_flag,1,compute_node_num,"on");
 
     create_and_get_subdir(workdir,"vault",vaultdir,DIR_LENGTH);
     decrypt_user_passwords(workdir,crypto_keyfile);
@@ -2380,12 +2356,13 @@ int rebuild_nodes(char* workdir, char* crypto_keyfile, char* option, int batch_f
     }
     printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Remote execution commands   sent.\n");
     printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " After the cluster operation:\n|\n");
-    getstate(workdir,crypto_keyfile);
-    graph(workdir,crypto_keyfile,0);
-    printf("|\n");
-    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%shostfile_latest",stackdir,PATH_SLASH);
-    remote_copy(workdir,crypto_keyfile,sshkey_folder,filename_temp,"/root/hostfile","root","put","",0);
-    sync_statefile(workdir,crypto_keyfile,sshkey_folder);
+    pipeline.push_hostfile=1;
+    strcpy(pipeline.hpcmgr_exec,"");
+    strcpy(pipeline.usage_option,"");
+    pipeline.usage_base_flag=0;
+    pipeline.usage_node_start=0;
+    pipeline.usage_node_end=0;
+    post_apply_pipeline(workdir,crypto_keyfile,sshkey_folder,&pipeline);
     remote_exec_general(workdir,crypto_keyfile,sshkey_folder,"root","/usr/hpc-now/profile_bkup_rstr.sh restore","-n",0,0,"","");
     printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Rebuilding the cluster users now ...\n");
     file_p=fopen(user_passwords,"r");
@@ -2401,8 +2378,7 @@ int rebuild_nodes(char* workdir, char* crypto_keyfile, char* option, int batch_f
     }
     fclose(file_p);
     delete_decrypted_user_passwords(workdir);
-    remote_exec(workdir,crypto_keyfile,sshkey_folder,"connect",7);
-    remote_exec(workdir,crypto_keyfile,sshkey_folder,"all",8);
+    remote_exec(workdir,crypto_keyfile,sshkey_folder,"ready",0);
     printf(WARN_YELLO_BOLD "[ -INFO- ] The rebuild process may need 7 minutes. Please do not operate\n");
     printf("[  ****  ] this cluster during the period." RESET_DISPLAY "\n");
     delete_decrypted_files(workdir,crypto_keyfile);
@@ -2470,11 +2446,14 @@ int switch_cluster_payment(char* cluster_name, char* new_payment_method, char* c
     return 0;
 }
 
-int view_run_log(char* workdir, char* stream, char* run_option, char* view_option, char* export_dest){
+int view_run_log(char* workdir, char* stream, char* run_option, char* run_id, char* view_option, char* export_dest){
     char logfile[FILENAME_LENGTH]="";
+    char run_logfile[FILENAME_LENGTH]="";
     char cmdline[CMDLINE_LENGTH]="";
     char real_export_dest[FILENAME_LENGTH]="";
     char real_stream[16]="";
+    char randstr[8]="";
+    int run_flag;
     if(strcmp(stream,"err")!=0&&strcmp(stream,"dbg")!=0){
         strcpy(real_stream,"std");
     }
@@ -2514,6 +2493,24 @@ int view_run_log(char* workdir, char* stream, char* run_option, char* view_optio
             snprintf(logfile,FILENAME_LENGTH-1,"%s%slog%stf_dbg.log.archive",workdir,PATH_SLASH,PATH_SLASH);
         }
     }
+    if(strlen(run_id)>0&&strcmp(run_option,"archive")==0){
+        if(strcmp(run_id,"list")==0){
+            run_flag=extract_log_run(logfile,"list","");
+            return (run_flag==-1)?-1:0;
+        }
+        generate_random_nstring(randstr,7,1);
+        snprintf(run_logfile,FILENAME_LENGTH-1,"%srun_%s_%s.log",NOW_TMP_DIR,run_id,randstr);
+        run_flag=extract_log_run(logfile,run_id,run_logfile);
+        if(run_flag==-1){
+            return -1;
+        }
+        else if(run_flag==1){
+            printf(FATAL_RED_BOLD "[ FATAL: ] The run %s is not found or has been purged." RESET_DISPLAY "\n",run_id);
+            return -5;
+        }
+        strcpy(logfile,run_logfile);
+        view_option="print";
+    }
     if(file_exist_or_not(logfile)!=0){
         return -1;
     }
@@ -2536,6 +2533,7 @@ int view_run_log(char* workdir, char* stream, char* run_option, char* view_optio
         if(folder_exist_or_not(real_export_dest)==0){
             if(cp_file(logfile,real_export_dest,0)!=0){
                 printf(WARN_YELLO_BOLD "[ -WARN- ] Failed to export the logfile to %s.\n",real_export_dest);
+                rm_file_or_dir(run_logfile);
                 return 1;
             }
             printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Exported the logfile to the specified folder " HIGH_CYAN_BOLD "%s" RESET_DISPLAY ".\n",real_export_dest);
@@ -2543,6 +2541,7 @@ int view_run_log(char* workdir, char* stream, char* run_option, char* view_optio
         else if(file_creation_test(real_export_dest)==0){
             if(cp_file(logfile,real_export_dest,0)!=0){
                 printf(WARN_YELLO_BOLD "[ -WARN- ] Failed to export the logfile to %s.\n",real_export_dest);
+                rm_file_or_dir(run_logfile);
                 return 1;
             }
             printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Exported the logfile to the specified file " HIGH_CYAN_BOLD "%s" RESET_DISPLAY ".\n",real_export_dest);
@@ -2551,5 +2550,6 @@ int view_run_log(char* workdir, char* stream, char* run_option, char* view_optio
             printf(WARN_YELLO_BOLD "[ -WARN- ] The specified dest path %s doesn't work.\n" RESET_DISPLAY,real_export_dest);
         }
     }
+    rm_file_or_dir(run_logfile);
     return 0;
 }
\ No newline at end of file
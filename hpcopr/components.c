@@ -521,10 +521,43 @@ int reset_tf_running(void){
     fprintf(file_p,"tf_execution:  %s\n",TERRAFORM_EXEC);
     fprintf(file_p,"tf_dbg_level:  warn\n");
     fprintf(file_p,"max_wait_sec:  %d\n",MAXIMUM_WAIT_TIME);
+    fprintf(file_p,"parallel_mode:  fixed\n");
+    fprintf(file_p,"parallelism:  CLOUD_B all %d\n",TF_PARALLELISM_LIMITED);
+    fprintf(file_p,"parallelism:  CLOUD_D all %d\n",TF_PARALLELISM_LIMITED);
     fclose(file_p);
     return 0;
 }
 
+/*
+ * Apply a parallelism profile line: CLOUD_X|all apply|destroy|all VALUE
+ * return -1: invalid profile
+ * return 0: applied
+ */
+int set_tf_parallelism_profile(tf_exec_config* tf_config, char* cloud, char* operation, int value){
+    int cloud_index,i,j;
+    if(value<TF_PARALLELISM_MIN||value>TF_PARALLELISM_DEFAULT){
+        return -1;
+    }
+    if(strcmp(operation,"apply")!=0&&strcmp(operation,"destroy")!=0&&strcmp(operation,"all")!=0){
+        return -1;
+    }
+    cloud_index=tf_cloud_index(cloud);
+    if(cloud_index<0&&strcmp(cloud,"all")!=0){
+        return -1;
+    }
+    for(i=0;i<TF_CLOUD_NUM;i++){
+        if(cloud_index>-1&&i!=cloud_index){
+            continue;
+        }
+        for(j=0;j<2;j++){
+            if(strcmp(operation,"all")==0||j==tf_operation_index(operation)){
+                tf_config->parallelism[i][j]=value;
+            }
+        }
+    }
+    return 0;
+}
+
 /*
  * return -1: file_not_exist
  * return 0: file exist and format correct
@@ -538,7 +571,10 @@ int get_tf_running(tf_exec_config* tf_config, char* tf_config_file){
     char conf_line[LINE_LENGTH_SHORT]="";
     char header[256]="";
     char tail[512]="";
+    char operation[16]="";
+    char value[16]="";
     int time,get_flag=0;
+    tf_parallelism_defaults(tf_config);
     if(file_p==NULL){
         strcpy(tf_config->tf_runner_type,"terraform");
         strcpy(tf_config->tf_runner,TERRAFORM_EXEC);
@@ -579,6 +615,19 @@ int get_tf_running(tf_exec_config* tf_config, char* tf_config_file){
                 tf_config->max_wait_time=time;
             }
         }
+        else if(strcmp(header,"parallel_mode:")==0){
+            if(strcmp(tail,"adaptive")==0){
+                strcpy(tf_config->parallel_mode,"adaptive");
+            }
+            else{
+                strcpy(tf_config->parallel_mode,"fixed");
+            }
+        }
+        else if(strcmp(header,"parallelism:")==0){
+            get_seq_nstring(conf_line,' ',3,operation,16);
+            get_seq_nstring(conf_line,' ',4,value,16);
+            set_tf_parallelism_profile(tf_config,tail,operation,string_to_positive_num(value));
+        }
         else{
             continue;
         }
@@ -614,9 +663,12 @@ int show_tf_running_config(void){
         }
         get_seq_nstring(conf_line,' ',1,header,LINE_LENGTH_TINY);
         get_seq_nstring(conf_line,' ',2,tail,LINE_LENGTH_SHORT);
-        if(strcmp(header,"tf_execution:")==0||strcmp(header,"tf_dbg_level:")==0||strcmp(header,"max_wait_sec:")==0){
+        if(strcmp(header,"tf_execution:")==0||strcmp(header,"tf_dbg_level:")==0||strcmp(header,"max_wait_sec:")==0||strcmp(header,"parallel_mode:")==0){
             printf("|   " GENERAL_BOLD "%s" RESET_DISPLAY "  %s\n",header,tail);
         }
+        else if(strcmp(header,"parallelism:")==0){
+            printf("|   " GENERAL_BOLD "%s" RESET_DISPLAY "  %s\n",header,conf_line+strlen(header)+2);
+        }
         else{
             continue;
         }
@@ -625,10 +677,16 @@ int show_tf_running_config(void){
     return 0;
 }
 
-int update_tf_running(char* new_tf_runner, char* new_dbg_level, int new_max_time){
+int update_tf_running(char* new_tf_runner, char* new_dbg_level, int new_max_time, char* new_parallel_mode, char* new_parallel_profile){
     if(file_empty_or_not(TF_RUNNING_CONFIG)<1){
         return -1;
     }
+    tf_exec_config tf_config_temp;
+    char profile_cloud[16]="";
+    char profile_op[16]="";
+    char profile_value[16]="";
+    char profile_line[64]="";
+    FILE* file_p=NULL;
     char prev_config[128]="";
     char new_max_time_string[8]="";
     char new_tf_runner_path[256]="";
@@ -667,6 +725,43 @@ int update_tf_running(char* new_tf_runner, char* new_dbg_level, int new_max_time
             printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Updated max wait time from " GENERAL_BOLD "%s" RESET_DISPLAY " to " GENERAL_BOLD "%s" RESET_DISPLAY ".\n",prev_config,new_max_time_string);
         }
     }
+    if(strcmp(new_parallel_mode,"fixed")==0||strcmp(new_parallel_mode,"adaptive")==0){
+        find_and_nget(TF_RUNNING_CONFIG,LINE_LENGTH_SHORT,"parallel_mode:","","",1,"parallel_mode:","","",' ',2,prev_config,128);
+        if(strcmp(prev_config,new_parallel_mode)!=0){
+            if(strlen(prev_config)==0){
+                file_p=fopen(TF_RUNNING_CONFIG,"a");
+                if(file_p!=NULL){
+                    fprintf(file_p,"parallel_mode:  %s\n",new_parallel_mode);
+                    fclose(file_p);
+                }
+            }
+            else{
+                find_and_nreplace(TF_RUNNING_CONFIG,LINE_LENGTH_SHORT,"parallel_mode:","","","","",prev_config,new_parallel_mode);
+            }
+            i++;
+            printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Updated parallel mode to " GENERAL_BOLD "%s" RESET_DISPLAY ".\n",new_parallel_mode);
+        }
+    }
+    if(strlen(new_parallel_profile)>0){
+        /* Profile format: CLOUD_X:OPERATION:VALUE, e.g. CLOUD_B:apply:20 or all:all:1000 */
+        get_seq_nstring(new_parallel_profile,':',1,profile_cloud,16);
+        get_seq_nstring(new_parallel_profile,':',2,profile_op,16);
+        get_seq_nstring(new_parallel_profile,':',3,profile_value,16);
+        if(set_tf_parallelism_profile(&tf_config_temp,profile_cloud,profile_op,string_to_positive_num(profile_value))!=0){
+            printf(WARN_YELLO_BOLD "[ -WARN- ] Invalid parallelism profile %s. Format: CLOUD_X:apply|destroy|all:%d~%d." RESET_DISPLAY "\n",new_parallel_profile,TF_PARALLELISM_MIN,TF_PARALLELISM_DEFAULT);
+        }
+        else{
+            snprintf(profile_line,63,"parallelism:  %s %s ",profile_cloud,profile_op);
+            delete_nlines_by_kwd(TF_RUNNING_CONFIG,LINE_LENGTH_SHORT,profile_line,1);
+            file_p=fopen(TF_RUNNING_CONFIG,"a");
+            if(file_p!=NULL){
+                fprintf(file_p,"%s%d\n",profile_line,string_to_positive_num(profile_value));
+                fclose(file_p);
+            }
+            i++;
+            printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Updated parallelism of " GENERAL_BOLD "%s %s" RESET_DISPLAY " to " GENERAL_BOLD "%s" RESET_DISPLAY ".\n",profile_cloud,profile_op,profile_value);
+        }
+    }
     if(i==0){
         printf(GENERAL_BOLD "\n[ -INFO- ]" RESET_DISPLAY " Same configurations specified. Nothing updated.\n");
     }
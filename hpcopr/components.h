@@ -16,7 +16,8 @@ int configure_locations(int batch_flag_local);
 int reset_tf_running(void);
 int get_tf_running(tf_exec_config* tf_config, char* tf_config_file);
 int show_tf_running_config(void);
-int update_tf_running(char* new_tf_runner, char* new_dbg_level, int new_max_time);
+int set_tf_parallelism_profile(tf_exec_config* tf_config, char* cloud, char* operation, int value);
+int update_tf_running(char* new_tf_runner, char* new_dbg_level, int new_max_time, char* new_parallel_mode, char* new_parallel_profile);
 
 int valid_ver_or_not(char* version_code);
 int valid_sha_or_not(char* sha_input);
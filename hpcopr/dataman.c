@@ -16,10 +16,13 @@
 #endif
 
 #include "now_macros.h"
+#include "now_sha256.h"
 #include "general_funcs.h"
 #include "time_process.h"
 #include "cluster_general_funcs.h"
 #include "general_print_info.h"
+#include "s3_engine.h"
+#include "bucket_index.h"
 #include "dataman.h"
 
 void unset_bucket_envs(char* cloud_flag){
@@ -83,7 +86,11 @@ void rf_flag_parser(const char* rflag, const char* fflag, char* real_rflag, char
     }
 }
 
-int bucket_cp(char* workdir, char* crypto_keyfile, char* hpc_user, char* source_path, char* target_path, char* rflag, char* fflag, char* cloud_flag, char* cmd_type){
+/*
+ * resume_flag "resume": upload file by file with the transfer journal, and skip
+ * the files done in the previous runs. Only for put.
+ */
+int bucket_cp(char* workdir, char* crypto_keyfile, char* hpc_user, char* source_path, char* target_path, char* rflag, char* fflag, char* cloud_flag, char* resume_flag, char* cmd_type){
     if(strcmp(cloud_flag,"CLOUD_A")!=0&&strcmp(cloud_flag,"CLOUD_B")!=0&&strcmp(cloud_flag,"CLOUD_C")!=0&&strcmp(cloud_flag,"CLOUD_D")!=0&&strcmp(cloud_flag,"CLOUD_E")!=0&&strcmp(cloud_flag,"CLOUD_F")!=0&&strcmp(cloud_flag,"CLOUD_G")!=0){
         return -3;
     }
@@ -103,6 +110,29 @@ int bucket_cp(char* workdir, char* crypto_keyfile, char* hpc_user, char* source_
     char real_target_path[DIR_LENGTH]="";
     char vaultdir[DIR_LENGTH]="";
     char cmdline[CMDLINE_LENGTH]="";
+    char journal_file[FILENAME_LENGTH]="";
+    char index_base[FILENAME_LENGTH]="";
+    int run_flag;
+    if(strcmp(resume_flag,"resume")==0){
+        if(strcmp(cmd_type,"put")==0){
+            local_path_nparser(source_path,real_source_path,DIR_LENGTH);
+            run_flag=xfer_journal_init(workdir,"bucket_put",real_source_path,target_path,1,journal_file,FILENAME_LENGTH);
+            if(run_flag<0){
+                return -1;
+            }
+            else if(run_flag==1){
+                printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " No journal of this transfer found. Starting a new one.\n");
+            }
+            run_flag=bucket_put_resume(workdir,crypto_keyfile,hpc_user,real_source_path,target_path,fflag,cloud_flag,journal_file);
+            if(run_flag==0){
+                rm_file_or_dir(journal_file);
+                return 0;
+            }
+            printf(WARN_YELLO_BOLD "[ -WARN- ] The transfer is not complete. Run the same command again with --resume." RESET_DISPLAY "\n");
+            return 1;
+        }
+        printf(WARN_YELLO_BOLD "[ -WARN- ] --resume only applies to put. Transferring the whole object(s)." RESET_DISPLAY "\n");
+    }
     if(get_bucket_ninfo(workdir,crypto_keyfile,LINE_LENGTH_SHORT,&bucketinfo)!=0){
         return -1;
     }
@@ -140,6 +170,17 @@ int bucket_cp(char* workdir, char* crypto_keyfile, char* hpc_user, char* source_
         bucket_path_check(source_path,hpc_user,real_source_path,DIR_LENGTH);
         bucket_path_check(target_path,hpc_user,real_target_path,DIR_LENGTH);
     }
+    run_flag=bucket_cp_native(workdir,&bucketinfo,cloud_flag,real_source_path,real_target_path,rflag,cmd_type);
+    if(run_flag==0){
+        return 0;
+    }
+    else if(run_flag!=-9){
+        printf(WARN_YELLO_BOLD "[ -WARN- ] The native transfer engine failed. Falling back to the CLI." RESET_DISPLAY "\n");
+    }
+    /* The CLI changes are not recorded, the next ls lists them from the bucket. */
+    if(strcmp(cmd_type,"get")!=0&&bucket_index_base(workdir,index_base,FILENAME_LENGTH)==0){
+        bucket_index_invalidate(index_base,real_target_path+1);
+    }
     if(strcmp(cloud_flag,"CLOUD_A")==0){
         if(strcmp(cmd_type,"copy")==0){
             snprintf(cmdline,CMDLINE_LENGTH-1,"%s -e oss-%s.aliyuncs.com -i %s -k %s cp %s%s %s%s %s %s",OSSUTIL_EXEC,bucketinfo.region_id,bucketinfo.bucket_ak,bucketinfo.bucket_sk,bucketinfo.bucket_address,real_source_path,bucketinfo.bucket_address,real_target_path,real_rflag,real_fflag);
@@ -270,6 +311,8 @@ int bucket_rm_ls(char* workdir, char* crypto_keyfile, char* hpc_user, char* remo
     char real_remote_path[DIR_LENGTH]="";
     char vaultdir[DIR_LENGTH]="";
     char cmdline[CMDLINE_LENGTH]="";
+    char index_base[FILENAME_LENGTH]="";
+    int run_flag;
     if(get_bucket_ninfo(workdir,crypto_keyfile,LINE_LENGTH_SHORT,&binfo)!=0){
         return -1;
     }
@@ -296,6 +339,16 @@ int bucket_rm_ls(char* workdir, char* crypto_keyfile, char* hpc_user, char* remo
         }
     }
     bucket_path_check(remote_path,hpc_user,real_remote_path,DIR_LENGTH);
+    run_flag=bucket_rm_ls_native(workdir,&binfo,cloud_flag,real_remote_path,rflag,fflag,cmd_type);
+    if(run_flag==0){
+        return 0;
+    }
+    else if(run_flag!=-9){
+        printf(WARN_YELLO_BOLD "[ -WARN- ] The native bucket engine failed. Falling back to the CLI." RESET_DISPLAY "\n");
+    }
+    if(strcmp(cmd_type,"delete")==0&&bucket_index_base(workdir,index_base,FILENAME_LENGTH)==0){
+        bucket_index_invalidate(index_base,real_remote_path+1);
+    }
     if(strcmp(cloud_flag,"CLOUD_A")==0){
         if(strcmp(cmd_type,"delete")==0){
             snprintf(cmdline,CMDLINE_LENGTH-1,"%s -e oss-%s.aliyuncs.com -i %s -k %s rm %s%s %s %s",OSSUTIL_EXEC,binfo.region_id,binfo.bucket_ak,binfo.bucket_sk,binfo.bucket_address,real_remote_path,real_rflag,real_fflag);
@@ -386,7 +439,678 @@ int bucket_rm_ls(char* workdir, char* crypto_keyfile, char* hpc_user, char* remo
     }
 }
 
-int direct_cp_mv(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* source_path, char* target_path, char* recursive_flag, char* force_flag, char* cmd_type){
+/*
+ * Run a bucket_cp with the native S3-compatible engine (s3_engine.c). The
+ * paths are the real paths parsed by bucket_cp. Like the vendor CLIs, a folder
+ * needs the rflag "recursive", and its contents go under the target path.
+ * The new objects are recorded to the local listing index (bucket_index.c). If
+ * the index of the target is fresh, the files of a folder put with the same
+ * sizes and ETags as the objects are skipped.
+ * return -9: not applicable, use the vendor CLIs
+ * return -1: failed to list the source
+ * return 1: some objects failed
+ * return 0: normal exit
+ */
+int bucket_cp_native(char* workdir, bucket_info* binfo, char* cloud_flag, char* source_path, char* target_path, char* rflag, char* cmd_type){
+    s3_target target;
+    s3_item* items=NULL;
+    bucket_index_entry* index_entries=NULL;
+    bucket_index_entry* index_found=NULL;
+    char list_file[FILENAME_LENGTH]="";
+    char index_list[FILENAME_LENGTH]="";
+    char index_base[FILENAME_LENGTH]="";
+    char line_buffer[FILENAME_LENGTH_EXT]="";
+    char source_key[FILENAME_LENGTH]="";
+    char target_key[FILENAME_LENGTH]="";
+    char object_key[FILENAME_LENGTH]="";
+    char prefix[FILENAME_LENGTH_EXT]="";
+    char key_buffer[CMDLINE_LENGTH]="";
+    char etag[80]="";
+    char last_modified[64]="";
+    char randstr[7]="";
+    char* base_name=NULL;
+    char* rel_path=NULL;
+    char* index_buffer=NULL;
+    int_64bit object_size,local_size;
+    long long local_mtime;
+    int item_num=0,done_num=0,skip_num=0,fail_num=0,single_flag=1,index_flag=0,index_num=0,index_max=0,run_flag,i;
+    unsigned int source_len=0;
+    FILE* file_p=NULL;
+    if(s3_target_init(binfo,cloud_flag,&target)!=0){
+        return -9;
+    }
+    if(target.index_ttl>0&&bucket_index_base(workdir,index_base,FILENAME_LENGTH)==0){
+        index_flag=1;
+    }
+    if(strcmp(cmd_type,"put")!=0){
+        strncpy(source_key,source_path+1,FILENAME_LENGTH-1);
+    }
+    if(strcmp(cmd_type,"get")!=0){
+        strncpy(target_key,target_path+1,FILENAME_LENGTH-1);
+    }
+    if(strcmp(cmd_type,"put")==0&&folder_exist_or_not(source_path)==0){
+        if(strcmp(rflag,"recursive")!=0){
+            s3_target_clear(&target);
+            return -9;
+        }
+        single_flag=0;
+    }
+    else if(strcmp(cmd_type,"put")!=0&&strcmp(rflag,"recursive")==0){
+        single_flag=0;
+    }
+    generate_random_nstring(randstr,7,1);
+    snprintf(list_file,FILENAME_LENGTH-1,"%ss3_%s.lst",NOW_TMP_DIR,randstr);
+    if(single_flag==0){
+        if(strcmp(cmd_type,"put")==0){
+            run_flag=local_file_list(source_path,list_file);
+            source_len=strlen(source_path);
+        }
+        else{
+            snprintf(prefix,FILENAME_LENGTH_EXT-1,"%s%s",source_key,(strlen(source_key)==0||source_key[strlen(source_key)-1]=='/')?"":"/");
+            run_flag=s3_list_objects(&target,prefix,0,list_file);
+            source_len=strlen(prefix);
+            /* Nothing under the path, take it as an object. */
+            if(run_flag==0&&file_empty_or_not(list_file)<1){
+                single_flag=1;
+            }
+        }
+        if(run_flag!=0){
+            rm_file_or_dir(list_file);
+            s3_target_clear(&target);
+            return -1;
+        }
+    }
+    if(single_flag==1){
+        rm_file_or_dir(list_file);
+        base_name=strrchr((strcmp(cmd_type,"put")==0)?source_path:source_key,'/');
+        base_name=(base_name==NULL)?((strcmp(cmd_type,"put")==0)?source_path:source_key):base_name+1;
+        if(strcmp(cmd_type,"get")==0){
+            if(folder_exist_or_not(target_path)==0||target_path[strlen(target_path)-1]=='/'){
+                snprintf(line_buffer,FILENAME_LENGTH_EXT-1,"%s%s%s",target_path,(target_path[strlen(target_path)-1]=='/')?"":"/",base_name);
+            }
+            else{
+                strncpy(line_buffer,target_path,FILENAME_LENGTH_EXT-1);
+            }
+            run_flag=s3_get_object(&target,source_key,line_buffer);
+        }
+        else{
+            if((strlen(target_key)==0||target_key[strlen(target_key)-1]=='/')&&strlen(target_key)+strlen(base_name)<FILENAME_LENGTH){
+                strcat(target_key,base_name);
+            }
+            if(strcmp(cmd_type,"put")==0){
+                run_flag=s3_put_object(&target,source_path,target_key);
+            }
+            else{
+                run_flag=s3_copy_object(&target,source_key,target_key);
+            }
+            if(run_flag==0&&index_flag==1){
+                bucket_index_record_object(&target,index_base,target_key,0,"");
+            }
+        }
+        s3_target_clear(&target);
+        return (run_flag==0)?0:1;
+    }
+    while(strlen(target_key)>0&&target_key[strlen(target_key)-1]=='/'){
+        target_key[strlen(target_key)-1]='\0';
+    }
+    /* Plan the folder put with the index: only the changed files go. */
+    if(strcmp(cmd_type,"put")==0&&index_flag==1){
+        snprintf(prefix,FILENAME_LENGTH_EXT-1,"%s%s",target_key,(strlen(target_key)==0)?"":"/");
+        snprintf(index_list,FILENAME_LENGTH-1,"%ss3_%s.idx",NOW_TMP_DIR,randstr);
+        if(bucket_index_fresh(index_base,prefix,target.index_ttl)==0&&bucket_index_scan(index_base,prefix,0,index_list)==0&&bucket_index_load(index_list,0,NULL,&index_entries,&index_num,&index_max,&index_buffer)==0&&index_num>0){
+            qsort(index_entries,index_num,sizeof(bucket_index_entry),bucket_index_entry_cmp);
+            index_num=bucket_index_compact(index_entries,index_num,0);
+        }
+        rm_file_or_dir(index_list);
+    }
+    items=(s3_item*)malloc(S3_BATCH_ITEMS*sizeof(s3_item));
+    file_p=fopen(list_file,"r");
+    if(items==NULL||file_p==NULL){
+        if(file_p!=NULL){
+            fclose(file_p);
+        }
+        free(items);
+        free(index_entries);
+        free(index_buffer);
+        rm_file_or_dir(list_file);
+        s3_target_clear(&target);
+        return -1;
+    }
+    do{
+        run_flag=fngetline(file_p,line_buffer,FILENAME_LENGTH_EXT);
+        if(run_flag!=1&&strlen(line_buffer)>0){
+            if(strcmp(cmd_type,"put")==0){
+                object_size=0;
+                strncpy(items[item_num].path,line_buffer,FILENAME_LENGTH-1);
+                items[item_num].path[FILENAME_LENGTH-1]='\0';
+                rel_path=line_buffer+source_len;
+                while(*rel_path=='/'){
+                    rel_path++;
+                }
+            }
+            else{
+                /* The empty objects ending with '/' are the folder markers. */
+                if(s3_list_line_parse(line_buffer,&object_size,etag,last_modified,object_key,FILENAME_LENGTH)!=0||object_key[strlen(object_key)-1]=='/'){
+                    continue;
+                }
+                rel_path=object_key+source_len;
+                if(strcmp(cmd_type,"get")==0){
+                    snprintf(items[item_num].path,FILENAME_LENGTH-1,"%s/%s",target_path,rel_path);
+                }
+                else{
+                    strcpy(items[item_num].path,object_key);
+                }
+                strcpy(items[item_num].etag,etag);
+            }
+            if(strcmp(cmd_type,"get")==0){
+                strcpy(items[item_num].key,object_key);
+            }
+            else{
+                snprintf(key_buffer,CMDLINE_LENGTH-1,"%s%s%s",target_key,(strlen(target_key)==0)?"":"/",rel_path);
+                strncpy(items[item_num].key,key_buffer,FILENAME_LENGTH-1);
+                items[item_num].key[FILENAME_LENGTH-1]='\0';
+            }
+            if(index_num>0){
+                index_found=bucket_index_find(index_entries,index_num,items[item_num].key);
+                if(index_found!=NULL&&s3_list_line_parse(index_found->line,&object_size,etag,last_modified,object_key,FILENAME_LENGTH)==0&&get_file_size_mtime(items[item_num].path,&local_size,&local_mtime)==0&&local_size==object_size&&s3_etag_check(items[item_num].path,local_size,etag,target.part_mb)==0){
+                    skip_num++;
+                    continue;
+                }
+                object_size=0;
+            }
+            items[item_num].size=object_size;
+            item_num++;
+        }
+        if(item_num==S3_BATCH_ITEMS||(run_flag==1&&item_num>0)){
+            i=s3_batch_run(&target,items,item_num,cmd_type);
+            fail_num+=(i<0)?item_num:i;
+            done_num+=(i<0)?0:item_num-i;
+            for(i=0;i<item_num&&index_flag==1&&strcmp(cmd_type,"get")!=0;i++){
+                if(items[i].done==1){
+                    bucket_index_record_object(&target,index_base,items[i].key,items[i].size,items[i].etag);
+                }
+            }
+            item_num=0;
+        }
+    }while(run_flag!=1);
+    fclose(file_p);
+    free(items);
+    free(index_entries);
+    free(index_buffer);
+    rm_file_or_dir(list_file);
+    if(skip_num>0){
+        printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " %d object(s) transferred, %d unchanged, %d failed.\n",done_num,skip_num,fail_num);
+    }
+    else{
+        printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " %d object(s) transferred, %d failed.\n",done_num,fail_num);
+    }
+    s3_target_clear(&target);
+    return (fail_num>0)?1:0;
+}
+
+/*
+ * Run a bucket_rm_ls with the native S3-compatible engine (s3_engine.c). A
+ * path is listed as a folder first, and as an object if nothing is under it.
+ * The listing comes from the local index (bucket_index.c), which lists the
+ * path from the bucket only if not refreshed within the index_ttl. The deleted
+ * objects are recorded to the index.
+ * The recursive delete without the fflag "force" is left to the vendor CLIs,
+ * which ask for the confirmation.
+ * return -9: not applicable, use the vendor CLIs
+ * return -1: failed to list
+ * return 1: some objects failed to delete
+ * return 0: normal exit
+ */
+int bucket_rm_ls_native(char* workdir, bucket_info* binfo, char* cloud_flag, char* remote_path, char* rflag, char* fflag, char* cmd_type){
+    s3_target target;
+    s3_item* items=NULL;
+    char list_file[FILENAME_LENGTH]="";
+    char index_base[FILENAME_LENGTH]="";
+    char line_buffer[FILENAME_LENGTH_EXT]="";
+    char prefix[FILENAME_LENGTH_EXT]="";
+    char object_key[FILENAME_LENGTH]="";
+    char etag[80]="";
+    char last_modified[64]="";
+    char randstr[7]="";
+    int_64bit object_size,total_size=0;
+    int object_num=0,folder_num=0,item_num=0,fail_num=0,index_flag=0,cache_flag=0,delimiter_flag,run_flag,i;
+    FILE* file_p=NULL;
+    if(strcmp(cmd_type,"delete")==0&&strcmp(rflag,"recursive")==0&&strcmp(fflag,"force")!=0){
+        return -9;
+    }
+    if(s3_target_init(binfo,cloud_flag,&target)!=0){
+        return -9;
+    }
+    if(target.index_ttl>0&&bucket_index_base(workdir,index_base,FILENAME_LENGTH)==0){
+        index_flag=1;
+    }
+    strncpy(object_key,remote_path+1,FILENAME_LENGTH-1);
+    if(strcmp(cmd_type,"delete")==0&&strcmp(rflag,"recursive")!=0){
+        run_flag=s3_delete_object(&target,object_key);
+        if(run_flag==0&&index_flag==1){
+            bucket_index_record(index_base,"delete",object_key);
+        }
+        s3_target_clear(&target);
+        return (run_flag==0)?0:1;
+    }
+    delimiter_flag=(strcmp(rflag,"recursive")==0)?0:1;
+    generate_random_nstring(randstr,7,1);
+    snprintf(list_file,FILENAME_LENGTH-1,"%ss3_%s.lst",NOW_TMP_DIR,randstr);
+    snprintf(prefix,FILENAME_LENGTH_EXT-1,"%s%s",object_key,(strlen(object_key)==0||object_key[strlen(object_key)-1]=='/')?"":"/");
+    if(index_flag==1){
+        /* The object_key covers both the folder and the object. */
+        if(bucket_index_fresh(index_base,object_key,target.index_ttl)==0){
+            cache_flag=1;
+        }
+        else if(bucket_index_refresh(&target,index_base,object_key)==0){
+            cache_flag=2;
+        }
+    }
+    if(cache_flag>0){
+        run_flag=bucket_index_scan(index_base,prefix,delimiter_flag,list_file);
+        if(run_flag==0&&file_empty_or_not(list_file)<1&&strcmp(prefix,object_key)!=0){
+            run_flag=bucket_index_scan(index_base,object_key,delimiter_flag,list_file);
+        }
+    }
+    else{
+        run_flag=s3_list_objects(&target,prefix,delimiter_flag,list_file);
+        if(run_flag==0&&file_empty_or_not(list_file)<1&&strcmp(prefix,object_key)!=0){
+            run_flag=s3_list_objects(&target,object_key,delimiter_flag,list_file);
+        }
+    }
+    items=(s3_item*)malloc(S3_BATCH_ITEMS*sizeof(s3_item));
+    file_p=fopen(list_file,"r");
+    if(run_flag!=0||items==NULL||file_p==NULL){
+        if(file_p!=NULL){
+            fclose(file_p);
+        }
+        free(items);
+        rm_file_or_dir(list_file);
+        s3_target_clear(&target);
+        return -1;
+    }
+    do{
+        run_flag=fngetline(file_p,line_buffer,FILENAME_LENGTH_EXT);
+        if(run_flag!=1&&strlen(line_buffer)>0){
+            i=s3_list_line_parse(line_buffer,&object_size,etag,last_modified,object_key,FILENAME_LENGTH);
+            if(i<0){
+                continue;
+            }
+            if(strcmp(cmd_type,"list")==0){
+                if(i==1){
+                    printf("%16s  %-24s  %s/%s\n","DIR","",binfo->bucket_address,object_key);
+                    folder_num++;
+                }
+                else{
+                    printf("%16lld  %-24s  %s/%s\n",(long long)object_size,last_modified,binfo->bucket_address,object_key);
+                    object_num++;
+                    total_size+=object_size;
+                }
+                continue;
+            }
+            strcpy(items[item_num].key,object_key);
+            item_num++;
+        }
+        if(item_num==S3_BATCH_ITEMS||(run_flag==1&&item_num>0)){
+            i=s3_batch_run(&target,items,item_num,"delete");
+            fail_num+=(i<0)?item_num:i;
+            object_num+=(i<0)?0:item_num-i;
+            for(i=0;i<item_num&&index_flag==1;i++){
+                if(items[i].done==1){
+                    bucket_index_record(index_base,"delete",items[i].key);
+                }
+            }
+            item_num=0;
+        }
+    }while(run_flag!=1);
+    fclose(file_p);
+    free(items);
+    rm_file_or_dir(list_file);
+    if(strcmp(cmd_type,"list")==0){
+        printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " %d object(s), %d folder(s), %lld byte(s) in total.\n",object_num,folder_num,(long long)total_size);
+        if(cache_flag==1){
+            printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Listed from the local index. Use --refresh to list from the bucket.\n");
+        }
+        s3_target_clear(&target);
+        return 0;
+    }
+    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " %d object(s) deleted, %d failed.\n",object_num,fail_num);
+    s3_target_clear(&target);
+    return (fail_num>0)?1:0;
+}
+
+/*
+ * List the regular files of a local file or folder (recursively) to the
+ * list_file, one path per line.
+ */
+int local_file_list(char* source_path, char* list_file){
+    char cmdline[CMDLINE_LENGTH]="";
+    FILE* file_p=NULL;
+    if(file_exist_or_not(source_path)==0){
+        file_p=fopen(list_file,"w+");
+        if(file_p==NULL){
+            return -1;
+        }
+        fprintf(file_p,"%s\n",source_path);
+        fclose(file_p);
+        return 0;
+    }
+    if(folder_exist_or_not(source_path)!=0){
+        return -1;
+    }
+#ifdef _WIN32
+    snprintf(cmdline,CMDLINE_LENGTH-1,"dir /s /b /a-d %s > %s 2>nul",source_path,list_file);
+#else
+    snprintf(cmdline,CMDLINE_LENGTH-1,"find %s -type f > %s 2>>%s",source_path,list_file,SYSTEM_CMD_ERROR_LOG);
+#endif
+    if(system(cmdline)!=0){
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Upload a local file or folder file by file with the transfer journal. The
+ * files recorded with the same size and mtime are skipped, and so are the ones
+ * with only the mtime changed but the same sha256. Large files go through
+ * parallel_put, so an interrupted one continues from its recorded chunks.
+ * Like scp -r, a folder goes into the target if the target folder exists.
+ * return -1: failed to list the local files
+ * return 1: some files failed
+ * return 0: normal exit
+ */
+int direct_put_resume(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* source_path, char* target_path, char* journal_file){
+    char list_file[FILENAME_LENGTH]="";
+    char local_file[FILENAME_LENGTH]="";
+    char remote_base[DIR_LENGTH]="";
+    char remote_file[FILENAME_LENGTH_EXT]="";
+    char remote_dir[FILENAME_LENGTH_EXT]="";
+    char last_remote_dir[FILENAME_LENGTH_EXT]="";
+    char remote_commands[CMDLINE_LENGTH]="";
+    char recorded_hash[80]="";
+    char current_hash[80]="";
+    char randstr[7]="";
+    char* rel_path=NULL;
+    char* slash_p=NULL;
+    int streams,chunk_mb,threshold_mb;
+    int check_flag,run_flag,folder_flag,skip_num=0,done_num=0,fail_num=0;
+    unsigned int i,source_len;
+    int_64bit file_size;
+    long long file_mtime;
+    FILE* file_p=NULL;
+    get_transfer_conf(&streams,&chunk_mb,&threshold_mb);
+    generate_random_nstring(randstr,7,1);
+    snprintf(list_file,FILENAME_LENGTH-1,"%sresume_%s.lst",NOW_TMP_DIR,randstr);
+    if(local_file_list(source_path,list_file)!=0){
+        rm_file_or_dir(list_file);
+        return -1;
+    }
+    folder_flag=folder_exist_or_not(source_path);
+    source_len=strlen(source_path);
+    while(source_len>1&&(source_path[source_len-1]=='/'||source_path[source_len-1]=='\\')){
+        source_len--;
+    }
+    if(folder_flag==0){
+        snprintf(remote_commands,CMDLINE_LENGTH-1,"test -d %s",target_path);
+        if(remote_exec_general(workdir,crypto_keyfile,sshkey_dir,hpc_user,remote_commands,"-n",0,2,"","")==0){
+            for(i=source_len;i>0&&source_path[i-1]!='/'&&source_path[i-1]!='\\';i--);
+            snprintf(remote_base,DIR_LENGTH-1,"%s/%.*s",target_path,source_len-i,source_path+i);
+        }
+        else{
+            strncpy(remote_base,target_path,DIR_LENGTH-1);
+        }
+    }
+    file_p=fopen(list_file,"r");
+    if(file_p==NULL){
+        rm_file_or_dir(list_file);
+        return -1;
+    }
+    while(fngetline(file_p,local_file,FILENAME_LENGTH)!=1){
+        if(strlen(local_file)==0){
+            continue;
+        }
+        if(get_file_size_mtime(local_file,&file_size,&file_mtime)!=0){
+            fail_num++;
+            continue;
+        }
+        if(folder_flag==0){
+            rel_path=local_file+source_len;
+            while(*rel_path=='/'||*rel_path=='\\'){
+                rel_path++;
+            }
+            snprintf(remote_file,FILENAME_LENGTH_EXT-1,"%s/%s",remote_base,rel_path);
+            for(i=0;i<strlen(remote_file);i++){
+                if(remote_file[i]=='\\'){
+                    remote_file[i]='/';
+                }
+            }
+            strcpy(remote_dir,remote_file);
+            slash_p=strrchr(remote_dir,'/');
+            if(slash_p!=NULL){
+                *slash_p='\0';
+            }
+            if(strcmp(remote_dir,last_remote_dir)!=0){
+                snprintf(remote_commands,CMDLINE_LENGTH-1,"mkdir -p %s",remote_dir);
+                remote_exec_general(workdir,crypto_keyfile,sshkey_dir,hpc_user,remote_commands,"-n",0,2,"","");
+                strcpy(last_remote_dir,remote_dir);
+            }
+        }
+        else{
+            strncpy(remote_file,target_path,FILENAME_LENGTH_EXT-1);
+        }
+        strcpy(current_hash,"");
+        check_flag=xfer_journal_check(journal_file,local_file,file_size,file_mtime,recorded_hash,80);
+        if(check_flag==2&&strcmp(recorded_hash,"-")!=0&&now_sha256_for_file(local_file,current_hash,80)==0&&strcmp(current_hash,recorded_hash)==0){
+            check_flag=0;
+        }
+        if(check_flag==0){
+            skip_num++;
+            continue;
+        }
+        run_flag=-9;
+        if(file_size>=(int_64bit)threshold_mb*1048576){
+            run_flag=parallel_put(workdir,crypto_keyfile,sshkey_dir,local_file,remote_file,hpc_user,journal_file);
+            /* The chunks carry the hashes, no need to read the large file again. */
+            strcpy(current_hash,"-");
+        }
+        if(run_flag==-9){
+            run_flag=remote_copy(workdir,crypto_keyfile,sshkey_dir,local_file,remote_file,hpc_user,"put","",1);
+            if(strlen(current_hash)==0&&now_sha256_for_file(local_file,current_hash,80)!=0){
+                strcpy(current_hash,"-");
+            }
+        }
+        if(run_flag==0){
+            xfer_journal_record(journal_file,local_file,file_size,file_mtime,current_hash);
+            done_num++;
+        }
+        else{
+            fail_num++;
+        }
+    }
+    fclose(file_p);
+    rm_file_or_dir(list_file);
+    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " %d file(s) transferred, %d already done, %d failed.\n",done_num,skip_num,fail_num);
+    if(fail_num>0){
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Upload a local file or folder to the bucket file by file with the transfer
+ * journal, with the same skip rules as direct_put_resume. The files of a folder
+ * go into the target path with their relative paths.
+ * return -1: failed to list the local files
+ * return 1: some files failed
+ * return 0: normal exit
+ */
+int bucket_put_resume(char* workdir, char* crypto_keyfile, char* hpc_user, char* source_path, char* target_path, char* fflag, char* cloud_flag, char* journal_file){
+    char list_file[FILENAME_LENGTH]="";
+    char local_file[FILENAME_LENGTH]="";
+    char object_path[FILENAME_LENGTH_EXT]="";
+    char recorded_hash[80]="";
+    char current_hash[80]="";
+    char randstr[7]="";
+    char* rel_path=NULL;
+    int check_flag,folder_flag,skip_num=0,done_num=0,fail_num=0;
+    unsigned int i,source_len,target_len;
+    int_64bit file_size;
+    long long file_mtime;
+    FILE* file_p=NULL;
+    generate_random_nstring(randstr,7,1);
+    snprintf(list_file,FILENAME_LENGTH-1,"%sresume_%s.lst",NOW_TMP_DIR,randstr);
+    if(local_file_list(source_path,list_file)!=0){
+        rm_file_or_dir(list_file);
+        return -1;
+    }
+    folder_flag=folder_exist_or_not(source_path);
+    source_len=strlen(source_path);
+    target_len=strlen(target_path);
+    while(target_len>1&&target_path[target_len-1]=='/'){
+        target_len--;
+    }
+    file_p=fopen(list_file,"r");
+    if(file_p==NULL){
+        rm_file_or_dir(list_file);
+        return -1;
+    }
+    while(fngetline(file_p,local_file,FILENAME_LENGTH)!=1){
+        if(strlen(local_file)==0){
+            continue;
+        }
+        if(get_file_size_mtime(local_file,&file_size,&file_mtime)!=0){
+            fail_num++;
+            continue;
+        }
+        if(folder_flag==0){
+            rel_path=local_file+source_len;
+            while(*rel_path=='/'||*rel_path=='\\'){
+                rel_path++;
+            }
+            snprintf(object_path,FILENAME_LENGTH_EXT-1,"%.*s/%s",target_len,target_path,rel_path);
+            for(i=0;i<strlen(object_path);i++){
+                if(object_path[i]=='\\'){
+                    object_path[i]='/';
+                }
+            }
+        }
+        else{
+            strncpy(object_path,target_path,FILENAME_LENGTH_EXT-1);
+        }
+        strcpy(current_hash,"");
+        check_flag=xfer_journal_check(journal_file,local_file,file_size,file_mtime,recorded_hash,80);
+        if(check_flag==2&&strcmp(recorded_hash,"-")!=0&&now_sha256_for_file(local_file,current_hash,80)==0&&strcmp(current_hash,recorded_hash)==0){
+            check_flag=0;
+        }
+        if(check_flag==0){
+            skip_num++;
+            continue;
+        }
+        if(bucket_cp(workdir,crypto_keyfile,hpc_user,local_file,object_path,"",fflag,cloud_flag,"","put")==0){
+            if(strlen(current_hash)==0&&now_sha256_for_file(local_file,current_hash,80)!=0){
+                strcpy(current_hash,"-");
+            }
+            xfer_journal_record(journal_file,local_file,file_size,file_mtime,current_hash);
+            done_num++;
+        }
+        else{
+            fail_num++;
+        }
+    }
+    fclose(file_p);
+    rm_file_or_dir(list_file);
+    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " %d file(s) transferred, %d already done, %d failed.\n",done_num,skip_num,fail_num);
+    if(fail_num>0){
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Upload a file or folder in the cluster to the bucket file by file with the
+ * transfer journal. The sizes and mtimes are listed on the cluster in one call,
+ * and the files recorded with the same size and mtime are skipped. The hashes
+ * are not recorded, so a file with only the mtime changed is sent again.
+ * return -1: failed to list the remote files
+ * return 1: some files failed
+ * return 0: normal exit
+ */
+int remote_bucket_put_resume(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* source_path, char* dest_path, char* fflag, char* cloud_flag, char* journal_file){
+    char list_file[FILENAME_LENGTH]="";
+    char line_buffer[FILENAME_LENGTH_EXT]="";
+    char remote_commands[CMDLINE_LENGTH]="";
+    char object_path[FILENAME_LENGTH_EXT]="";
+    char recorded_hash[80]="";
+    char randstr[7]="";
+    char* remote_file=NULL;
+    char* rel_path=NULL;
+    long long file_size,file_mtime;
+    int path_start,skip_num=0,done_num=0,fail_num=0;
+    unsigned int source_len,dest_len;
+    FILE* file_p=NULL;
+    generate_random_nstring(randstr,7,1);
+    snprintf(list_file,FILENAME_LENGTH-1,"%sresume_%s.lst",NOW_TMP_DIR,randstr);
+    snprintf(remote_commands,CMDLINE_LENGTH-1,"find %s -type f -printf '%%s %%Ts %%p\\n'",source_path);
+    if(remote_exec_general(workdir,crypto_keyfile,sshkey_dir,hpc_user,remote_commands,"-n",0,3,list_file,NULL_STREAM)!=0){
+        rm_file_or_dir(list_file);
+        return -1;
+    }
+    source_len=strlen(source_path);
+    dest_len=strlen(dest_path);
+    while(dest_len>1&&dest_path[dest_len-1]=='/'){
+        dest_len--;
+    }
+    file_p=fopen(list_file,"r");
+    if(file_p==NULL){
+        rm_file_or_dir(list_file);
+        return -1;
+    }
+    while(fngetline(file_p,line_buffer,FILENAME_LENGTH_EXT)!=1){
+        path_start=0;
+        if(sscanf(line_buffer,"%lld %lld %n",&file_size,&file_mtime,&path_start)<2||path_start==0){
+            continue;
+        }
+        remote_file=line_buffer+path_start;
+        rel_path=remote_file+source_len;
+        while(*rel_path=='/'){
+            rel_path++;
+        }
+        if(strlen(rel_path)==0){
+            strncpy(object_path,dest_path,FILENAME_LENGTH_EXT-1);
+        }
+        else{
+            snprintf(object_path,FILENAME_LENGTH_EXT-1,"%.*s/%s",dest_len,dest_path,rel_path);
+        }
+        if(xfer_journal_check(journal_file,remote_file,file_size,file_mtime,recorded_hash,80)==0){
+            skip_num++;
+            continue;
+        }
+        if(remote_bucket_cp(workdir,crypto_keyfile,hpc_user,sshkey_dir,remote_file,object_path,"",fflag,cloud_flag,"","rput")==0){
+            xfer_journal_record(journal_file,remote_file,file_size,file_mtime,"-");
+            done_num++;
+        }
+        else{
+            fail_num++;
+        }
+    }
+    fclose(file_p);
+    rm_file_or_dir(list_file);
+    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " %d file(s) transferred, %d already done, %d failed.\n",done_num,skip_num,fail_num);
+    if(fail_num>0){
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * sync_flag "sync": transfer with rsync, only the changed blocks are sent.
+ * Falls back to scp if rsync is not available locally or on the cluster.
+ * resume_flag "resume": continue the previous transfer. Uploads go file by file
+ * with the transfer journal, and downloads go with rsync --partial.
+ * Otherwise, compressible data goes as a zstd stream (compress: in TRANSFER_CONF),
+ * and large files are uploaded in parallel chunks.
+ */
+int direct_cp_mv(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* source_path, char* target_path, char* recursive_flag, char* force_flag, char* sync_flag, char* resume_flag, char* cmd_type){
     if(strcmp(cmd_type,"mv")!=0&&strcmp(cmd_type,"cp")!=0){
         return -1;
     }
@@ -396,6 +1120,10 @@ int direct_cp_mv(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshk
     char real_target_path[DIR_LENGTH]="";
     char real_rf_flag[4]="";
     char remote_commands[CMDLINE_LENGTH]="";
+    char journal_file[FILENAME_LENGTH]="";
+    int streams,chunk_mb,threshold_mb;
+    int_64bit file_size=0;
+    FILE* file_p=NULL;
 
     if(strcmp(cmd_type,"mv")==0){
         if(strcmp(force_flag,"force")==0){
@@ -450,7 +1178,16 @@ int direct_cp_mv(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshk
     }
     else{
         if(path_flag1==path_flag2){
-            if(strcmp(hpc_user,"user1")==0||strcmp(hpc_user,"root")==0){
+            if(strcmp(sync_flag,"sync")==0){
+                /* Like cp, the folders are only copied with -r. */
+                if(strcmp(hpc_user,"user1")==0||strcmp(hpc_user,"root")==0){
+                    snprintf(remote_commands,CMDLINE_LENGTH-1,"sudo rsync -a %s%s %s &",(strcmp(recursive_flag,"recursive")==0)?"":"--no-r ",real_source_path,real_target_path);
+                }
+                else{
+                    snprintf(remote_commands,CMDLINE_LENGTH-1,"rsync -a %s%s %s &",(strcmp(recursive_flag,"recursive")==0)?"":"--no-r ",real_source_path,real_target_path);
+                }
+            }
+            else if(strcmp(hpc_user,"user1")==0||strcmp(hpc_user,"root")==0){
                 snprintf(remote_commands,CMDLINE_LENGTH-1,"sudo /bin/cp %s %s %s &",real_source_path,real_target_path,real_rf_flag);
             }
             else{
@@ -458,11 +1195,89 @@ int direct_cp_mv(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshk
             }
             run_flag=remote_exec_general(workdir,crypto_keyfile,sshkey_dir,hpc_user,remote_commands,"-n",0,1,"","");
         }
-        else if(path_flag1==1&&path_flag2==0){
-            run_flag=remote_copy(workdir,crypto_keyfile,sshkey_dir,real_source_path,real_target_path,hpc_user,"put",real_rf_flag,1);
-        }
         else{
-            run_flag=remote_copy(workdir,crypto_keyfile,sshkey_dir,real_target_path,real_source_path,hpc_user,"get",real_rf_flag,1);
+            if(strcmp(sync_flag,"sync")==0){
+                if(path_flag1==1&&path_flag2==0){
+                    run_flag=remote_sync(workdir,crypto_keyfile,sshkey_dir,real_source_path,real_target_path,hpc_user,"put",(strcmp(recursive_flag,"recursive")==0)?1:0,1);
+                }
+                else{
+                    run_flag=remote_sync(workdir,crypto_keyfile,sshkey_dir,real_target_path,real_source_path,hpc_user,"get",(strcmp(recursive_flag,"recursive")==0)?1:0,1);
+                }
+                if(run_flag!=-9){
+                    return (run_flag==0)?0:1;
+                }
+                printf(WARN_YELLO_BOLD "[ -WARN- ] rsync is not available locally or on the cluster. Copying the whole files with scp." RESET_DISPLAY "\n");
+            }
+            else if(strcmp(resume_flag,"resume")==0){
+                if(path_flag1==1&&path_flag2==0){
+                    run_flag=xfer_journal_init(workdir,"put",real_source_path,real_target_path,1,journal_file,FILENAME_LENGTH);
+                    if(run_flag<0){
+                        return 1;
+                    }
+                    else if(run_flag==1){
+                        printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " No journal of this transfer found. Starting a new one.\n");
+                    }
+                    run_flag=direct_put_resume(workdir,crypto_keyfile,hpc_user,sshkey_dir,real_source_path,real_target_path,journal_file);
+                    if(run_flag==0){
+                        rm_file_or_dir(journal_file);
+                        return 0;
+                    }
+                    printf(WARN_YELLO_BOLD "[ -WARN- ] The transfer is not complete. Run the same command again with --resume." RESET_DISPLAY "\n");
+                    return 1;
+                }
+                /* rsync skips the complete files by size and mtime, and continues the partial ones. */
+                run_flag=remote_sync(workdir,crypto_keyfile,sshkey_dir,real_target_path,real_source_path,hpc_user,"get",(strcmp(recursive_flag,"recursive")==0)?1:0,1);
+                if(run_flag!=-9){
+                    return (run_flag==0)?0:1;
+                }
+                printf(WARN_YELLO_BOLD "[ -WARN- ] rsync is not available locally or on the cluster. Copying the whole files with scp." RESET_DISPLAY "\n");
+            }
+            if(path_flag1==1&&path_flag2==0&&strcmp(sync_flag,"sync")!=0&&folder_exist_or_not(real_source_path)!=0){
+                get_transfer_conf(&streams,&chunk_mb,&threshold_mb);
+                file_p=fopen(real_source_path,"rb");
+                if(file_p!=NULL){
+                    file_size=get_filesize_byte(file_p);
+                    fclose(file_p);
+                }
+            }
+            if(strcmp(sync_flag,"sync")!=0){
+                if(path_flag1==1&&path_flag2==0){
+                    /* Only the files below the chunking threshold are compressed, the large ones go to the parallel streams. */
+                    run_flag=-9;
+                    if(folder_exist_or_not(real_source_path)==0||file_size<(int_64bit)threshold_mb*1048576){
+                        run_flag=remote_copy_compressed(workdir,crypto_keyfile,sshkey_dir,real_source_path,real_target_path,hpc_user,"put",(strcmp(recursive_flag,"recursive")==0)?1:0);
+                    }
+                }
+                else{
+                    run_flag=remote_copy_compressed(workdir,crypto_keyfile,sshkey_dir,real_target_path,real_source_path,hpc_user,"get",(strcmp(recursive_flag,"recursive")==0)?1:0);
+                }
+                if(run_flag!=-9){
+                    return (run_flag==0)?0:1;
+                }
+            }
+            if(path_flag1==1&&path_flag2==0&&strcmp(sync_flag,"sync")!=0&&folder_exist_or_not(real_source_path)!=0){
+                if(file_size>=(int_64bit)threshold_mb*1048576){
+                    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Uploading in %d MiB chunks over %d streams.\n",chunk_mb,streams);
+                    /* Journal the chunks, so that an interrupted upload can be continued with --resume. */
+                    xfer_journal_init(workdir,"put",real_source_path,real_target_path,0,journal_file,FILENAME_LENGTH);
+                    run_flag=parallel_put(workdir,crypto_keyfile,sshkey_dir,real_source_path,real_target_path,hpc_user,journal_file);
+                    if(run_flag==0){
+                        rm_file_or_dir(journal_file);
+                        return 0;
+                    }
+                    else if(run_flag!=-9){
+                        printf(WARN_YELLO_BOLD "[ -WARN- ] The upload is not complete. Run the same command again with --resume." RESET_DISPLAY "\n");
+                        return 1;
+                    }
+                    printf(WARN_YELLO_BOLD "[ -WARN- ] Chunked upload is not available. Copying the whole file with scp." RESET_DISPLAY "\n");
+                }
+            }
+            if(path_flag1==1&&path_flag2==0){
+                run_flag=remote_copy(workdir,crypto_keyfile,sshkey_dir,real_source_path,real_target_path,hpc_user,"put",real_rf_flag,1);
+            }
+            else{
+                run_flag=remote_copy(workdir,crypto_keyfile,sshkey_dir,real_target_path,real_source_path,hpc_user,"get",real_rf_flag,1);
+            }
         }
     }
     if(run_flag!=0){
@@ -565,7 +1380,11 @@ int direct_file_operations(char* workdir, char* crypto_keyfile, char* hpc_user,
     }
 }
 
-int remote_bucket_cp(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* source_path, char* dest_path, char* rflag, char* fflag, char* cloud_flag, char* cmd_type){
+/*
+ * resume_flag "resume": upload file by file with the transfer journal, and skip
+ * the files done in the previous runs. Only for rput.
+ */
+int remote_bucket_cp(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* source_path, char* dest_path, char* rflag, char* fflag, char* cloud_flag, char* resume_flag, char* cmd_type){
     if(strcmp(cloud_flag,"CLOUD_A")!=0&&strcmp(cloud_flag,"CLOUD_B")!=0&&strcmp(cloud_flag,"CLOUD_C")!=0&&strcmp(cloud_flag,"CLOUD_D")!=0&&strcmp(cloud_flag,"CLOUD_E")!=0&&strcmp(cloud_flag,"CLOUD_F")!=0&&strcmp(cloud_flag,"CLOUD_G")!=0){
         return -3;
     }
@@ -585,6 +1404,28 @@ int remote_bucket_cp(char* workdir, char* crypto_keyfile, char* hpc_user, char*
     bucket_info binfo;
     char az_subscription_id[128]="";
     char az_tenant_id[128]="";
+    char journal_file[FILENAME_LENGTH]="";
+    char index_base[FILENAME_LENGTH]="";
+    if(strcmp(resume_flag,"resume")==0){
+        if(strcmp(cmd_type,"rput")==0){
+            direct_path_ncheck(source_path,hpc_user,real_source_path,DIR_LENGTH);
+            run_flag=xfer_journal_init(workdir,"rput",real_source_path,dest_path,1,journal_file,FILENAME_LENGTH);
+            if(run_flag<0){
+                return -1;
+            }
+            else if(run_flag==1){
+                printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " No journal of this transfer found. Starting a new one.\n");
+            }
+            run_flag=remote_bucket_put_resume(workdir,crypto_keyfile,hpc_user,sshkey_dir,real_source_path,dest_path,fflag,cloud_flag,journal_file);
+            if(run_flag==0){
+                rm_file_or_dir(journal_file);
+                return 0;
+            }
+            printf(WARN_YELLO_BOLD "[ -WARN- ] The transfer is not complete. Run the same command again with --resume." RESET_DISPLAY "\n");
+            return 1;
+        }
+        printf(WARN_YELLO_BOLD "[ -WARN- ] --resume only applies to rput. Transferring the whole object(s)." RESET_DISPLAY "\n");
+    }
     if(get_bucket_ninfo(workdir,crypto_keyfile,LINE_LENGTH_SHORT,&binfo)!=0){
         return -1;
     }
@@ -678,6 +1519,9 @@ int remote_bucket_cp(char* workdir, char* crypto_keyfile, char* hpc_user, char*
             snprintf(remote_commands,CMDLINE_LENGTH-1,"gcloud storage cp %s %s%s %s",real_source_path,binfo.bucket_address,real_dest_path,real_rflag);
         }
     }
+    if(strcmp(cmd_type,"rput")==0&&bucket_index_base(workdir,index_base,FILENAME_LENGTH)==0){
+        bucket_index_invalidate(index_base,real_dest_path+1);
+    }
     run_flag=remote_exec_general(workdir,crypto_keyfile,sshkey_dir,hpc_user,remote_commands,"-n",0,1,"","");
     if(run_flag!=0){
         return 1;
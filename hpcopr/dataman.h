@@ -12,13 +12,19 @@ void unset_bucket_envs(char* cloud_flag);
 void bucket_path_check(char* path_string, char* hpc_user, char* real_path, unsigned int real_path_length);
 void rf_flag_parser(const char* rflag, const char* fflag, char* real_rflag, char* real_fflag);
 
-int bucket_cp(char* workdir, char* crypto_keyfile, char* hpc_user, char* source_path, char* target_path, char* rflag, char* fflag, char* cloud_flag, char* cmd_type);
+int bucket_cp(char* workdir, char* crypto_keyfile, char* hpc_user, char* source_path, char* target_path, char* rflag, char* fflag, char* cloud_flag, char* resume_flag, char* cmd_type);
 int bucket_rm_ls(char* workdir, char* crypto_keyfile, char* hpc_user, char* remote_path, char* rflag, char* fflag, char* cloud_flag, char* cmd_type);
+int bucket_cp_native(char* workdir, bucket_info* binfo, char* cloud_flag, char* source_path, char* target_path, char* rflag, char* cmd_type);
+int bucket_rm_ls_native(char* workdir, bucket_info* binfo, char* cloud_flag, char* remote_path, char* rflag, char* fflag, char* cmd_type);
 
-int direct_cp_mv(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* source_path, char* target_path, char* recursive_flag, char* force_flag, char* cmd_type);
+int local_file_list(char* source_path, char* list_file);
+int direct_put_resume(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* source_path, char* target_path, char* journal_file);
+int bucket_put_resume(char* workdir, char* crypto_keyfile, char* hpc_user, char* source_path, char* target_path, char* fflag, char* cloud_flag, char* journal_file);
+int remote_bucket_put_resume(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* source_path, char* dest_path, char* fflag, char* cloud_flag, char* journal_file);
+int direct_cp_mv(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* source_path, char* target_path, char* recursive_flag, char* force_flag, char* sync_flag, char* resume_flag, char* cmd_type);
 int direct_rm_ls_mkdir(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* remote_path, char* force_flag, char* recursive_flag, char* cmd_type);
 int direct_file_operations(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* remote_path, char* cmd_type);
 
-int remote_bucket_cp(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* source_path, char* dest_path, char* rflag, char* fflag, char* cloud_flag, char* cmd_type);
+int remote_bucket_cp(char* workdir, char* crypto_keyfile, char* hpc_user, char* sshkey_dir, char* source_path, char* dest_path, char* rflag, char* fflag, char* cloud_flag, char* resume_flag, char* cmd_type);
 
 #endif
\ No newline at end of file
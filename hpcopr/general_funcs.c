@@ -81,7 +81,14 @@ char command_flags[CMD_FLAG_NUM][16]={
     "--month",
     "--gcp",
     "--rdp",
-    "--copypass"
+    "--copypass",
+    "--pool", /* compute pool layout */
+    "--sync", /* dataman delta-sync */
+    "--resume", /* dataman resumable transfer */
+    "--refresh", /* dataman bucket listing from the bucket, not the local index */
+    "--stat", /* monman avg/max/p95 per time bucket */
+    "--loop", /* autoscale rounds until killed */
+    "--dry-run" /* autoscale without operating the cluster */
 };
 
 char command_keywords[CMD_KWDS_NUM][32]={
@@ -132,7 +139,14 @@ char command_keywords[CMD_KWDS_NUM][32]={
     "--dbg-level",
     "--max-time",
     "--tf-run",
-    "--pass"
+    "--pass",
+    "--cloud",
+    "--run", /* run id of the log archive */
+    "--para-mode", /* tf parallel mode */
+    "--para", /* tf parallelism profile */
+    "--top", /* jobman acct top jobs */
+    "--queue", /* autoscale simulated queue file */
+    "--interval" /* autoscale loop interval */
 };
 
 void sleep_func(unsigned int time){
@@ -2054,6 +2068,144 @@ int_64bit get_filesize_byte(FILE* file_p){
     return length;
 }
 
+int fseek_byte(FILE* file_p, int_64bit offset){
+    if(file_p==NULL){
+        return NULL_PTR_ARG;
+    }
+#ifdef _WIN32
+    return _fseeki64(file_p,offset,SEEK_SET);
+#elif __linux__
+    return fseeko64(file_p,offset,SEEK_SET);
+#else
+    return fseeko(file_p,offset,SEEK_SET);
+#endif
+}
+
+/*
+ * Get the size and the mtime (epoch seconds) of a regular file.
+ * return -1: not found or not a regular file
+ * return 0: normal exit
+ */
+int get_file_size_mtime(char* filename, int_64bit* size, long long* mtime){
+    if(filename==NULL||size==NULL||mtime==NULL){
+        return NULL_PTR_ARG;
+    }
+#ifdef _WIN32
+    struct _stat64 file_stat;
+    if(_stat64(filename,&file_stat)!=0||!(file_stat.st_mode&_S_IFREG)){
+        return -1;
+    }
+#else
+    struct stat file_stat;
+    if(stat(filename,&file_stat)!=0||!S_ISREG(file_stat.st_mode)){
+        return -1;
+    }
+#endif
+    *size=(int_64bit)file_stat.st_size;
+    *mtime=(long long)file_stat.st_mtime;
+    return 0;
+}
+
+/*
+ * log2 of x (x>0) without libm: shift x into [1,2), then the series of
+ * ln((1+t)/(1-t)). The error is below 1e-5, enough for estimations.
+ */
+double log2_approx(double x){
+    double t,t2,ln_m;
+    int k=0;
+    if(x<=0){
+        return 0;
+    }
+    while(x>=2){
+        x/=2;
+        k++;
+    }
+    while(x<1){
+        x*=2;
+        k--;
+    }
+    t=(x-1)/(x+1);
+    t2=t*t;
+    ln_m=2*t*(1+t2/3+t2*t2/5+t2*t2*t2/7+t2*t2*t2*t2/9);
+    return k+ln_m*1.4426950408889634;
+}
+
+/*
+ * Estimate the byte entropy of a file with sample_num blocks of sample_size
+ * bytes, spread evenly over the file. Compressed or encrypted data is close to
+ * 8 bits per byte, and text is usually below 5.
+ * return -1: failed to read the file
+ * return N>=0: the entropy in milli-bits per byte, 0 ~ 8000
+ */
+int file_entropy_sample(char* filename, int sample_num, int sample_size){
+    unsigned long long counts[256]={0};
+    unsigned long long total=0;
+    unsigned char* buffer=NULL;
+    int_64bit file_size,offset;
+    size_t read_size;
+    double entropy;
+    int i;
+    FILE* file_p=NULL;
+    if(filename==NULL||sample_num<1||sample_size<1){
+        return -1;
+    }
+    file_p=fopen(filename,"rb");
+    if(file_p==NULL){
+        return -1;
+    }
+    buffer=(unsigned char*)malloc(sample_size);
+    if(buffer==NULL){
+        fclose(file_p);
+        return -1;
+    }
+    file_size=get_filesize_byte(file_p);
+    if(file_size<=(int_64bit)sample_size*sample_num){
+        sample_num=1;
+        sample_size=(file_size<sample_size)?(int)file_size:sample_size;
+    }
+    for(i=0;i<sample_num;i++){
+        offset=(sample_num==1)?0:(file_size-sample_size)/(sample_num-1)*i;
+        if(fseek_byte(file_p,offset)!=0){
+            break;
+        }
+        read_size=fread(buffer,1,sample_size,file_p);
+        total+=read_size;
+        while(read_size>0){
+            read_size--;
+            counts[buffer[read_size]]++;
+        }
+    }
+    free(buffer);
+    fclose(file_p);
+    if(total==0){
+        return 0;
+    }
+    /* H = log2(N) - sum(c*log2(c))/N */
+    entropy=log2_approx((double)total);
+    for(i=0;i<256;i++){
+        if(counts[i]>0){
+            entropy-=(double)counts[i]*log2_approx((double)counts[i])/(double)total;
+        }
+    }
+    return (entropy<0)?0:(int)(entropy*1000);
+}
+
+/*
+ * A 64-bit FNV-1a hash of a string, for short stable ids, *NOT* for security.
+ */
+unsigned long long string_hash64(char* string){
+    unsigned long long hash=14695981039346656037ULL;
+    if(string==NULL){
+        return 0;
+    }
+    while(*string!='\0'){
+        hash^=(unsigned char)(*string);
+        hash*=1099511628211ULL;
+        string++;
+    }
+    return hash;
+}
+
 /* 
  * This function is to replace the delete_file_or_dir function 
  */
@@ -74,6 +74,11 @@ int folder_check_general(char* foldername, int rw_flag);
 int folder_empty_or_not(char* foldername);
 int delete_file_or_dir(char* file_or_dir);
 int_64bit get_filesize_byte(FILE* file_p);
+int fseek_byte(FILE* file_p, int_64bit offset);
+int get_file_size_mtime(char* filename, int_64bit* size, long long* mtime);
+double log2_approx(double x);
+int file_entropy_sample(char* filename, int sample_num, int sample_size);
+unsigned long long string_hash64(char* string);
 
 int rm_file_or_dir(char* file_or_dir);
 int mk_pdir(char* pathname);
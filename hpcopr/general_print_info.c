@@ -153,6 +153,8 @@ void print_help(char* cmd_name){
         printf("|                            ~ " WARN_YELLO_BOLD "*MUST* use a "HIGH_CYAN_BOLD "@" RESET_DISPLAY " to split the date and time!" RESET_DISPLAY "\n");
         printf("|    -e     END_TIMESTAMP    ~ Specify a " HIGH_CYAN_BOLD "strictly-formatted" RESET_DISPLAY " end timestamp. e.g. " HIGH_CYAN_BOLD "2023-1-1@12:10" RESET_DISPLAY "\n");
         printf("|   --level INTERVAL_MINUTES ~ Time interval by minutes.\n");
+        printf("|   --stat                   ~ Show avg/max/p95 of cpu_util, mem_util and idle_cores per node and cluster.\n");
+        printf("|                            ~ Grouped by the --level buckets (Default: 60 minutes).\n");
         printf("|    -d     DEST_PATH        ~ Export the data to a destination folder or file.\n");
     }
     if(strcmp(cmd_name,"history")==0||strcmp(cmd_name,"all")==0){
@@ -167,6 +169,12 @@ void print_help(char* cmd_name){
         printf("|   --print(Default)      ~ Print out the usage data.\n");
         printf("|    -d      DEST_PATH    ~ Export the usage data to a destination file.\n");
     }
+    if(strcmp(cmd_name,"profile")==0||strcmp(cmd_name,"all")==0){
+        printf("|  " HIGH_GREEN_BOLD "profile" RESET_DISPLAY "     :~ Show p50/p95 durations of the operation phases per cloud.\n");
+        printf("|   --cmd    CMD_NAME     ~ Only count the records of a command, e.g. " HIGH_CYAN_BOLD "wakeup" RESET_DISPLAY "\n");
+        printf("|   --cloud  CLOUD_FLAG   ~ Only count the records of a cloud, e.g. " HIGH_CYAN_BOLD "CLOUD_C" RESET_DISPLAY "\n");
+        printf("|    -d      DEST_PATH    ~ Export the profile to a destination file (CSV).\n");
+    }
     if(strcmp(cmd_name,"ssh")==0||strcmp(cmd_name,"all")==0){
         printf("|  " HIGH_GREEN_BOLD "ssh" RESET_DISPLAY "         :~ SSH to the master node of a cluster.\n");
         printf("|   -u       USER_NAME    ~ SSH to the cluster as a valid user.\n");
@@ -187,6 +195,8 @@ void print_help(char* cmd_name){
         printf("|   --tf-run    EXECUTION_NAME  ~ terraform or tofu\n");
         printf("|   --dbg-level DEBUG_LOG_LEVEL ~ debug log output level, default: warn\n");
         printf("|   --max-time  MAX_WAIT_TIME   ~ maximum waiting time (600~1200), default 600\n");
+        printf("|   --para-mode PARALLEL_MODE   ~ fixed or adaptive (tuned by API throttling), default fixed\n");
+        printf("|   --para      CLOUD:OP:NUM    ~ parallelism profile, e.g. CLOUD_B:apply:20 or all:all:1000\n");
     }
     if(strcmp(cmd_name,"configloc")==0||strcmp(cmd_name,"all")==0){
         printf("|  " HIGH_GREEN_BOLD "configloc" RESET_DISPLAY "   :~ Configure the locations for the terraform binaries, providers\n");
@@ -293,6 +303,7 @@ void print_help(char* cmd_name){
         printf("|  " HIGH_GREEN_BOLD "viewlog" RESET_DISPLAY "     :~ View the operation log of the current cluster.\n");
         printf("|   --log STREAM_TYPE  ~ Choose standard output (std), standart error (err), or TF debug stream (dbg).\n");
         printf("|   --this | --hist    ~ Choose the log of this run or historical runs.\n");
+        printf("|   --run RUN_ID       ~ Read one historical run by its ID, 'latest', or 'list' the runs.\n");
         printf("|   --print            ~ Print out (not stream out) the contents.\n");
         printf("|    -d   EXPORT_DEST  ~ Export the log to a specified folder or file.\n");
     }
@@ -308,6 +319,8 @@ void print_help(char* cmd_name){
         printf("|  " HIGH_GREEN_BOLD "addc" RESET_DISPLAY "        :~ Add compute nodes to current cluster. You must specify how many\n");
         printf("|              :~ to be added.\n");
         printf("|   --nn NODE_NUM ~ Add NUM new compute nodes.\n");
+        printf("|   --pool        ~ (Optional) Convert to the compute pool layout (for_each based)\n");
+        printf("|                 ~ before adding. Up to %d nodes can be added at once.\n",MAXIMUM_ADD_NODE_NUMBER_POOL);
     }
     if(strcmp(cmd_name,"shutdownc")==0||strcmp(cmd_name,"all")==0){
         printf("|  " HIGH_GREEN_BOLD "shutdownc" RESET_DISPLAY "   :~ Shutdown specified compute nodes. Similar to 'delc',\n");
@@ -321,6 +334,14 @@ void print_help(char* cmd_name){
         printf("|              :~ the param --nn NODE_NUM.\n");
         printf("|   --nn NODE_NUM ~ Nodes to be turned on, '--nn all' means all nodes.\n");
     }
+    if(strcmp(cmd_name,"autoscale")==0||strcmp(cmd_name,"all")==0){
+        printf("|  " HIGH_GREEN_BOLD "autoscale" RESET_DISPLAY "   :~ Turn on, shut down or add compute nodes by the Slurm queue\n");
+        printf("|              :~ and the idle cores. The policy is in the cluster conf autoscale.conf.\n");
+        printf("|   --loop          ~ (Optional) Run a round every interval until killed.\n");
+        printf("|   --interval SEC  ~ (Optional) The loop interval, default %d, at least %d.\n",AUTOSCALE_INTERVAL,AUTOSCALE_INTERVAL_MIN);
+        printf("|   --dry-run       ~ (Optional) Decide and print the actions without running them.\n");
+        printf("|   --queue FILE    ~ (Optional) Simulate the queue by a file of squeue -o '%%T|%%C|%%N' lines.\n");
+    }
     if(strcmp(cmd_name,"reconfc")==0||strcmp(cmd_name,"all")==0){
         printf("|  " HIGH_GREEN_BOLD "reconfc" RESET_DISPLAY "     :~ Reconfigure all the compute nodes.\n");
         printf("|   --list             ~ List out all the available configurations\n");
@@ -483,15 +504,19 @@ void print_datamgr_info(void){
     printf("|    -t TARGET_PATH  ~ Target path of unary operations. e.g. ls\n");
     printf("| Bucket Operations:~ Transfer and manage data with the bucket.\n");
     printf("|   --dcmd put       ~ Upload a local file or folder to the bucket path.\n");
+    printf("|     --resume       ~ Continue the previous upload, skipping the files done.\n");
     printf("|   --dcmd get       ~ Download a bucket object(file or folder) to the local path.\n");
     printf("|   --dcmd copy      ~ Copy a bucket object to another folder/path.\n");
     printf("|   --dcmd list      ~ Show the object list of a specified folder/path.\n");
+    printf("|     --refresh      ~ List from the bucket instead of the local index.\n");
     printf("|   --dcmd delete    ~ Delete an object (file or folder) of the bucket.\n");
     printf("|   --dcmd move      ~ Move an existed object (file or folder) in the bucket.\n");
     printf("|    Example: hpcopr dataman --dcmd put -s ./foo -d /foo -u user1\n");
     printf("| Direct Operations:~ Transfer and manage data in the cluster storage.\n");
     printf("| * The cluster must be in running state (minimal or all). *\n");
     printf("|   --dcmd cp        ~ Remote copy between local and the cluster storage.\n");
+    printf("|     --sync         ~ Only transfer the changes with rsync, keeping the mtimes.\n");
+    printf("|     --resume       ~ Continue the previous transfer, skipping the files done.\n");
     printf("|   --dcmd mv        ~ Move the remote files/folders in the cluster storage.\n");
     printf("|   --dcmd ls        ~ List the files/folders in the cluster storage.\n");
     printf("|   --dcmd rm        ~ Remove the files/folders in the cluster storage.\n");
@@ -501,6 +526,7 @@ void print_datamgr_info(void){
     printf("|   --dcmd less      ~ Read a remote file.\n");
     printf("|   --dcmd tail      ~ Streaming out a remote file dynamically.\n");
     printf("|   --dcmd rput      ~ Upload a *remote* file or folder to the bucket path.\n");
+    printf("|     --resume       ~ Continue the previous upload, skipping the files done.\n");
     printf("|   --dcmd rget      ~ Download a bucket object(file or folder) to the *remote* path.\n");
     printf("|     @h/ to specify the $HOME prefix of the cluster.\n");
     printf("|     @d/ to specify the /hpc_data/user_data prefix.\n");
@@ -550,6 +576,11 @@ void print_jobmgr_info(void){
     printf("|   --jcmd list    ~ List out all the jobs.\n");
     printf("|   --jcmd cancel  ~ Cancel a job with specified ID\n");
     printf("|     --jid   JOB_ID           ~ A valid job ID.\n");
+    printf("|   --jcmd acct    ~ Join the finished jobs with the monitor data and report the waste.\n");
+    printf("|     -s      START_TIMESTAMP  ~ Jobs ended after it. e.g. " HIGH_CYAN_BOLD "2023-1-1@12:10" RESET_DISPLAY "\n");
+    printf("|     -e      END_TIMESTAMP    ~ Jobs ended before it. e.g. " HIGH_CYAN_BOLD "2023-1-1@12:10" RESET_DISPLAY "\n");
+    printf("|     --top   JOB_NUM          ~ The jobs with the most idle core hours (Default: 20).\n");
+    printf("|     -d      DEST_PATH        ~ Export the report to a destination folder or file.\n");
 }
 
 void list_all_commands(void){
@@ -559,7 +590,7 @@ void list_all_commands(void){
     printf("     switch  glance  rename  refresh \n");
     printf("     export  import  remove  exit-current " RESET_DISPLAY "\n");
     printf(GENERAL_BOLD " 2.  Global Management: " RESET_DISPLAY "\n");
-    printf(HIGH_GREEN_BOLD "     help  usage  monman  history  syserr \n");
+    printf(HIGH_GREEN_BOLD "     help  usage  monman  history  syserr  profile \n");
     printf("     ssh  rdp \n");
     printf("     set-tf configloc  showloc  showhash  resetloc \n");
     printf("     encrypt decrypt " RESET_DISPLAY "\n");
@@ -572,7 +603,7 @@ void list_all_commands(void){
     printf(HIGH_GREEN_BOLD "     delc     addc     shutdownc  turnonc \n");
     printf("     reconfc  reconfm  nfsup \n");
     printf("     sleep    wakeup   destroy\n");
-    printf("     payment" RESET_DISPLAY "\n");
+    printf("     payment  autoscale" RESET_DISPLAY "\n");
     printf(GENERAL_BOLD " 6.  User Mgmt: " RESET_DISPLAY HIGH_GREEN_BOLD "userman" RESET_DISPLAY "\n");
     printf(GENERAL_BOLD " 7.  Data Mgmt: " RESET_DISPLAY HIGH_GREEN_BOLD "dataman" RESET_DISPLAY "\n");
     printf(GENERAL_BOLD " 8.  App Mgmt : " RESET_DISPLAY HIGH_GREEN_BOLD "appman" RESET_DISPLAY "\n");
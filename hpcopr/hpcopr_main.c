@@ -29,6 +29,8 @@
 #include "prereq_check.h"
 #include "time_process.h"
 #include "usage_and_logs.h"
+#include "s3_engine.h"
+#include "bucket_index.h"
 #include "dataman.h"
 #include "transfer.h"
 #include "monman.h"
@@ -38,6 +40,7 @@
 #include "appman.h"
 #include "jobman.h"
 #include "userman.h"
+#include "autoscale.h"
 
 char url_code_root_var[LOCATION_LENGTH]="";
 char url_tf_root_var[LOCATION_LENGTH]="";
@@ -115,6 +118,7 @@ char commands[COMMAND_NUM][COMMAND_STRING_LENGTH_MAX]={
     "usage,gen,NULL",
     "history,gen,NULL",
     "syserr,gen,NULL",
+    "profile,gen,NULL",
     "ssh,gen,UNAME",
     "rdp,gen,UNAME",
     "set-tf,gen,NULL",
@@ -137,6 +141,7 @@ char commands[COMMAND_NUM][COMMAND_STRING_LENGTH_MAX]={
     "addc,opr,CNAME",
     "shutdownc,opr,CNAME",
     "turnonc,opr,CNAME",
+    "autoscale,opr,CNAME",
     "reconfc,opr,CNAME",
     "reconfm,opr,CNAME",
     "nfsup,opr,CNAME",
@@ -186,10 +191,11 @@ char appman_commands[8][SUBCMD_STRING_LENGTH_MAX]={
     "check-conf"
 };
 
-char jobman_commands[3][SUBCMD_STRING_LENGTH_MAX]={
+char jobman_commands[4][SUBCMD_STRING_LENGTH_MAX]={
     "list",
     "submit",
-    "cancel"
+    "cancel",
+    "acct"
 };
 
 /*
@@ -279,6 +285,9 @@ int main(int argc, char* argv[]){
     char cloud_sk[AKSK_LENGTH]="";
     char stream_name[8]="";
     char log_type[128]="";
+    char run_id[32]="";
+    char para_mode[16]="";
+    char para_profile[64]="";
     char user_name[32]="";
     char pass_word[128]="";
     char user_name_list[1024]="";
@@ -297,6 +306,8 @@ int main(int argc, char* argv[]){
     char target_path[FILENAME_LENGTH]="";
     char recursive_flag[16]="";
     char force_flag_string[16]="";
+    char resume_flag_string[16]="";
+    char index_base[FILENAME_LENGTH]="";
     char node_num_string[8]="";
     char app_name[32]="";
     char inst_loc[DIR_LENGTH]="";
@@ -306,6 +317,7 @@ int main(int argc, char* argv[]){
     char string_temp2[256]="";
     char string_temp3[256]="";
     char string_temp4[8]="";
+    char string_temp5[8]="";
     char cluster_role[16]="";
     int cluster_state_flag=0;
     int decrypt_flag=0;
@@ -404,6 +416,7 @@ int main(int argc, char* argv[]){
         check_and_cleanup(workdir);
         return 5;
     }
+    set_trace_context(final_command,cluster_name,"");
     if(strcmp(final_command,"help")==0){
         if(cmd_flag_check(argc,argv,"--all")==0){
             print_help("all");
@@ -521,7 +534,9 @@ int main(int argc, char* argv[]){
         prompt_to_input_required_args("Select a new tf execution:  terraform  tofu",string_temp,256,batch_flag,argc,argv,"--tf-run");
         prompt_to_input_required_args("Select a new debug log level: trace  debug  info  warn  error  off",string_temp2,256,batch_flag,argc,argv,"--dbg-level");
         prompt_to_input_required_args("Specify a new max wait time (600 - 1200) secs",string_temp3,256,batch_flag,argc,argv,"--max-time");
-        run_flag=update_tf_running(string_temp,string_temp2,string_to_positive_num(string_temp3));
+        cmd_keyword_ncheck(argc,argv,"--para-mode",para_mode,16);
+        cmd_keyword_ncheck(argc,argv,"--para",para_profile,64);
+        run_flag=update_tf_running(string_temp,string_temp2,string_to_positive_num(string_temp3),para_mode,para_profile);
         if(run_flag==-1){
             write_operation_log("NULL",operation_log,argc,argv,"FILE_I/O_ERROR",127);
             check_and_cleanup("");
@@ -899,6 +914,26 @@ int main(int argc, char* argv[]){
         return 0;
     }
 
+    if(strcmp(final_command,"profile")==0){
+        cmd_keyword_ncheck(argc,argv,"--cmd",string_temp,256);
+        cmd_keyword_ncheck(argc,argv,"--cloud",string_temp2,256);
+        cmd_keyword_ncheck(argc,argv,"-d",export_dest,FILENAME_LENGTH);
+        run_flag=show_trace_profile(OPERATION_TRACE_LOG,string_temp,string_temp2,export_dest);
+        if(run_flag==-1||run_flag==-5){
+            write_operation_log("NULL",operation_log,argc,argv,"FILE_I/O_ERROR",127);
+            check_and_cleanup("");
+            return 127;
+        }
+        else if(run_flag==-3){
+            write_operation_log("NULL",operation_log,argc,argv,"FATAL_INTERNAL_ERROR",125);
+            check_and_cleanup("");
+            return 125;
+        }
+        write_operation_log("NULL",operation_log,argc,argv,"SUCCEEDED",0);
+        check_and_cleanup("");
+        return 0;
+    }
+
     if(strcmp(final_command,"import")==0){
         cmd_keyword_ncheck(argc,argv,"-s",import_source,512);
         cmd_keyword_ncheck(argc,argv,"-p",pass_word,128);
@@ -921,12 +956,15 @@ int main(int argc, char* argv[]){
         prompt_to_input_optional_args("Specify end date & time? (Default: The last timestamp)",CONFIRM_STRING_QUICK,"Specify a strictly-formatted start timestamp. i.e. 2023-1-1@12:10",string_temp3,256,batch_flag,argc,argv,"-e");
         prompt_to_input_optional_args("Specify a time interval? (Default: 5 minutes)",CONFIRM_STRING_QUICK,"Specify a positive number.",string_temp4,8,batch_flag,argc,argv,"--level");
         prompt_to_input_optional_args("Export to a local path?",CONFIRM_STRING_QUICK,"Specify a local path (directory or file).",destination_path,FILENAME_LENGTH,batch_flag,argc,argv,"-d");
+        if(cmd_flag_check(argc,argv,"--stat")==0){
+            strcpy(string_temp5,"stat");
+        }
         run_flag=prompt_to_confirm_args("Read the monitor data? (Default: Print)",CONFIRM_STRING_QUICK,batch_flag,argc,argv,"--read");
         if(run_flag==2||run_flag==0){
-            run_flag=show_cluster_mon_data(cluster_name,crypto_keyfile,SSHKEY_DIR,string_temp,string_temp2,string_temp3,string_temp4,"read",destination_path);
+            run_flag=show_cluster_mon_data(cluster_name,crypto_keyfile,SSHKEY_DIR,string_temp,string_temp2,string_temp3,string_temp4,string_temp5,"read",destination_path);
         }
         else{
-            run_flag=show_cluster_mon_data(cluster_name,crypto_keyfile,SSHKEY_DIR,string_temp,string_temp2,string_temp3,string_temp4,"print",destination_path);
+            run_flag=show_cluster_mon_data(cluster_name,crypto_keyfile,SSHKEY_DIR,string_temp,string_temp2,string_temp3,string_temp4,string_temp5,"print",destination_path);
         }
         if(run_flag!=0){
             write_operation_log(cluster_name,operation_log,argc,argv,"MONITOR_MANAGER_FAILED",40);
@@ -1022,7 +1060,13 @@ int main(int argc, char* argv[]){
     if(strcmp(final_command,"viewlog")==0){
         prompt_to_input_optional_args("Export to a local path?",CONFIRM_STRING_QUICK,"Specify a local path (directory or file).",string_temp,256,batch_flag,argc,argv,"-d");
         prompt_to_input_optional_args("Specify a log stream? (Default: std output stream)",CONFIRM_STRING_QUICK,"Select a log stream: std(default)   err   dbg",stream_name,8,batch_flag,argc,argv,"--log");
-        run_flag=prompt_to_confirm_args("View historical run log? (Default: realtime run log)",CONFIRM_STRING_QUICK,batch_flag,argc,argv,"--hist");
+        cmd_keyword_ncheck(argc,argv,"--run",run_id,32);
+        if(strlen(run_id)>0){
+            run_flag=0;
+        }
+        else{
+            run_flag=prompt_to_confirm_args("View historical run log? (Default: realtime run log)",CONFIRM_STRING_QUICK,batch_flag,argc,argv,"--hist");
+        }
         if(run_flag==2||run_flag==0){
             strcpy(log_type,"archive");
         }
@@ -1031,10 +1075,15 @@ int main(int argc, char* argv[]){
         }
         run_flag=prompt_to_confirm_args("Print out the log? (Default: stream out the log)",CONFIRM_STRING_QUICK,batch_flag,argc,argv,"--print");
         if(run_flag==2||run_flag==0){
-            run_flag=view_run_log(workdir,stream_name,log_type,"print",string_temp);
+            run_flag=view_run_log(workdir,stream_name,log_type,run_id,"print",string_temp);
         }
         else{
-            run_flag=view_run_log(workdir,stream_name,log_type,"",string_temp);
+            run_flag=view_run_log(workdir,stream_name,log_type,run_id,"",string_temp);
+        }
+        if(run_flag==-5){
+            write_operation_log(cluster_name,operation_log,argc,argv,"RUN_NOT_FOUND",127);
+            check_and_cleanup(workdir);
+            return 127;
         }
         if(run_flag==-1){
             printf(FATAL_RED_BOLD "[ FATAL: ] Failed to open the log. Have you specified or switched to a cluster?\n" RESET_DISPLAY );
@@ -1265,6 +1314,7 @@ int main(int argc, char* argv[]){
         check_and_cleanup(workdir);
         return 7;
     }
+    set_trace_context(final_command,cluster_name,cloud_flag);
 
     if(strcmp(final_command,"export")==0){
         if(cluster_empty_or_not(workdir,crypto_keyfile)==0){
@@ -1423,9 +1473,15 @@ int main(int argc, char* argv[]){
                 strcpy(recursive_flag,"recursive");
             }
         }
+        if(cmd_flag_check(argc,argv,"--resume")==0){
+            strcpy(resume_flag_string,"resume");
+        }
+        if(cmd_flag_check(argc,argv,"--refresh")==0&&bucket_index_base(workdir,index_base,FILENAME_LENGTH)==0){
+            bucket_index_invalidate(index_base,"");
+        }
         printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Data operation started ...\n\n");
         if(strcmp(data_cmd,"put")==0||strcmp(data_cmd,"get")==0||strcmp(data_cmd,"copy")==0||strcmp(data_cmd,"move")==0){
-            run_flag=bucket_cp(workdir,crypto_keyfile,user_name,source_path,destination_path,recursive_flag,force_flag_string,cloud_flag,data_cmd);
+            run_flag=bucket_cp(workdir,crypto_keyfile,user_name,source_path,destination_path,recursive_flag,force_flag_string,cloud_flag,resume_flag_string,data_cmd);
             if(strcmp(data_cmd,"move")==0&&run_flag==0){
                 run_flag=bucket_rm_ls(workdir,crypto_keyfile,user_name,source_path,"recursive","",cloud_flag,"delete");
             }
@@ -1437,10 +1493,15 @@ int main(int argc, char* argv[]){
             run_flag=direct_rm_ls_mkdir(workdir,crypto_keyfile,user_name,SSHKEY_DIR,target_path,force_flag_string,recursive_flag,data_cmd);
         }
         else if(strcmp(data_cmd,"cp")==0||strcmp(data_cmd,"mv")==0){
-            run_flag=direct_cp_mv(workdir,crypto_keyfile,user_name,SSHKEY_DIR,source_path,destination_path,recursive_flag,force_flag_string,data_cmd);
+            if(cmd_flag_check(argc,argv,"--sync")==0){
+                run_flag=direct_cp_mv(workdir,crypto_keyfile,user_name,SSHKEY_DIR,source_path,destination_path,recursive_flag,force_flag_string,"sync",resume_flag_string,data_cmd);
+            }
+            else{
+                run_flag=direct_cp_mv(workdir,crypto_keyfile,user_name,SSHKEY_DIR,source_path,destination_path,recursive_flag,force_flag_string,"",resume_flag_string,data_cmd);
+            }
         }
         else if(strcmp(data_cmd,"rput")==0||strcmp(data_cmd,"rget")==0){
-            run_flag=remote_bucket_cp(workdir,crypto_keyfile,user_name,SSHKEY_DIR,source_path,destination_path,recursive_flag,force_flag_string,cloud_flag,data_cmd);
+            run_flag=remote_bucket_cp(workdir,crypto_keyfile,user_name,SSHKEY_DIR,source_path,destination_path,recursive_flag,force_flag_string,cloud_flag,resume_flag_string,data_cmd);
         }
         else{
             run_flag=direct_file_operations(workdir,crypto_keyfile,user_name,SSHKEY_DIR,target_path,data_cmd);
@@ -2091,7 +2152,7 @@ int main(int argc, char* argv[]){
                 check_and_cleanup(workdir);
                 return 5;
             }
-            printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Input a valid command: submit, list, cancel\n");
+            printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Input a valid command: submit, list, cancel, acct\n");
             printf(GENERAL_BOLD "[ INPUT: ] " RESET_DISPLAY);
             scanf("%31s",job_cmd);
             fflush_stdin();
@@ -2099,13 +2160,13 @@ int main(int argc, char* argv[]){
         int i=0;
         while(strcmp(job_cmd,jobman_commands[i])!=0){
             i++;
-            if(i==3){
+            if(i==4){
                 break;
             }
         }
-        if(i==3){
+        if(i==4){
             printf(FATAL_RED_BOLD "[ FATAL: ] The command " WARN_YELLO_BOLD "%s" FATAL_RED_BOLD " is incorrect. Please read the help for details." RESET_DISPLAY "\n",job_cmd);
-            printf(GENERAL_BOLD "[  ****  ] " RESET_DISPLAY " submit, list, cancel\n");
+            printf(GENERAL_BOLD "[  ****  ] " RESET_DISPLAY " submit, list, cancel, acct\n");
             write_operation_log(cluster_name,operation_log,argc,argv,"INVALID_PARAMS",9);
             check_and_cleanup(workdir);
             return 9;
@@ -2122,6 +2183,13 @@ int main(int argc, char* argv[]){
         else if(strcmp(job_cmd,"list")==0){
             run_flag=job_list(workdir,crypto_keyfile,user_name,SSHKEY_DIR);
         }
+        else if(strcmp(job_cmd,"acct")==0){
+            cmd_keyword_ncheck(argc,argv,"-s",string_temp2,256);
+            cmd_keyword_ncheck(argc,argv,"-e",string_temp3,256);
+            cmd_keyword_ncheck(argc,argv,"--top",string_temp4,8);
+            cmd_keyword_ncheck(argc,argv,"-d",destination_path,FILENAME_LENGTH);
+            run_flag=job_acct(workdir,crypto_keyfile,SSHKEY_DIR,string_temp2,string_temp3,string_temp4,destination_path);
+        }
         else{
             if(cmd_keyword_ncheck(argc,argv,"--jid",job_id,32)!=0){
                 job_list(workdir,crypto_keyfile,user_name,SSHKEY_DIR);
@@ -2184,7 +2252,7 @@ int main(int argc, char* argv[]){
             check_and_cleanup(workdir);
             return 3;
         }
-        run_flag=add_compute_node(workdir,crypto_keyfile,node_num_string,&tf_this_run);
+        run_flag=add_compute_node(workdir,crypto_keyfile,node_num_string,cmd_flag_check(argc,argv,"--pool"),&tf_this_run);
         write_operation_log(cluster_name,operation_log,argc,argv,"",run_flag);
         check_and_cleanup(workdir);
         return run_flag;
@@ -2236,6 +2304,32 @@ int main(int argc, char* argv[]){
         return run_flag;
     }
 
+    if(strcmp(final_command,"autoscale")==0){
+        if(strcmp(cloud_flag,"CLOUD_F")==0){
+            printf(FATAL_RED_BOLD "[ FATAL: ] Currently Azure (HPC-NOW Code: CLOUD_F) doesn't support this operation." RESET_DISPLAY "\n");
+            write_operation_log(cluster_name,operation_log,argc,argv,"CLOUD_FUNCTION_UNSUPPORTED",6);
+            check_and_cleanup("");
+            return 6;
+        }
+        cmd_keyword_ncheck(argc,argv,"--queue",string_temp2,256);
+        cmd_keyword_ncheck(argc,argv,"--interval",string_temp4,8);
+        if(strlen(string_temp2)>0&&file_exist_or_not(string_temp2)!=0){
+            printf(FATAL_RED_BOLD "[ FATAL: ] The queue file %s doesn't exist." RESET_DISPLAY "\n",string_temp2);
+            write_operation_log(cluster_name,operation_log,argc,argv,"INVALID_PARAMS",9);
+            check_and_cleanup(workdir);
+            return 9;
+        }
+        if(cmd_flag_check(argc,argv,"--dry-run")!=0&&confirm_to_operate_cluster(cluster_name,batch_flag)!=0){
+            write_operation_log(cluster_name,operation_log,argc,argv,"USER_DENIED",3);
+            check_and_cleanup(workdir);
+            return 3;
+        }
+        run_flag=autoscale(workdir,crypto_keyfile,SSHKEY_DIR,string_temp2,cmd_flag_check(argc,argv,"--dry-run"),cmd_flag_check(argc,argv,"--loop"),string_temp4,&tf_this_run);
+        write_operation_log(cluster_name,operation_log,argc,argv,"",run_flag);
+        check_and_cleanup(workdir);
+        return run_flag;
+    }
+
     if(strcmp(final_command,"reconfc")==0||strcmp(final_command,"reconfm")==0){
         if(check_reconfigure_list(workdir,1)!=0){
             printf(FATAL_RED_BOLD "[ FATAL: ] Failed to get the list. Have you initiated this cluster?" RESET_DISPLAY "\n");
@@ -22,6 +22,8 @@
 #include "general_print_info.h"
 #include "appman.h"
 #include "userman.h"
+#include "monman.h"
+#include "mon_store.h"
 #include "jobman.h"
 
 int get_job_info(int argc, char** argv, char* workdir, char* user_name, char* sshkey_dir, char* crypto_keyfile, jobinfo* job_info, int batch_flag_local){
@@ -31,7 +33,7 @@ int get_job_info(int argc, char** argv, char* workdir, char* user_name, char* ss
     char duration_hours_string[128]="";
     char cluster_node_num_string[8]="";
     char cluster_node_cores_string[8]="";
-    char filename_temp[FILENAME_LENGTH]="";
+    char remote_commands[CMDLINE_LENGTH]="";
     char app_name[128]="";
     char exec_name[128]="";
     char job_data[256]="";
@@ -42,17 +44,14 @@ int get_job_info(int argc, char** argv, char* workdir, char* user_name, char* ss
     int specified_node_num=0;
     int specified_node_cores=0;
     int duration_hours=0;
-    int run_flag;
     int num_temp=0;
     int i;
+    remote_batch batch;
     get_state_nvalue(workdir,crypto_keyfile,"total_compute_nodes:",cluster_node_num_string,8);
     get_state_nvalue(workdir,crypto_keyfile,"compute_node_cores:",cluster_node_cores_string,8);
     cluster_node_num=string_to_positive_num(cluster_node_num_string);
     cluster_node_cores=string_to_positive_num(cluster_node_cores_string);
 
-    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Current cluster cores status:\n");
-    remote_exec_general(workdir,crypto_keyfile,sshkey_dir,user_name,"tail -n 1 /hpc_data/cluster_data/mon_cores.dat","",0,2,"","");
-
     if(strcmp(user_name,"root")==0){
         printf(FATAL_RED_BOLD "[ FATAL: ] The root user cannot submit jobs, please specify another user." RESET_DISPLAY "\n");
         hpc_user_list(workdir,crypto_keyfile,0,1);
@@ -69,10 +68,17 @@ int get_job_info(int argc, char** argv, char* workdir, char* user_name, char* ss
         scanf("%127s",app_name);
         fflush_stdin();
     }
-    snprintf(filename_temp,FILENAME_LENGTH-1,"%s%s.tmp%sapp_check.tmp",HPC_NOW_ROOT_DIR,PATH_SLASH,PATH_SLASH);
-    app_list(workdir,crypto_keyfile,"check",user_name,app_name,sshkey_dir,filename_temp,"");
-    run_flag=find_multi_nkeys(filename_temp,LINE_LENGTH_SHORT,"not available","","","","");
-    if(run_flag>0){
+    /* The cores status and the app check in one round-trip. */
+    remote_batch_init(&batch,0,0);
+    remote_batch_add(&batch,"exec","tail -n 1 /hpc_data/cluster_data/mon_cores.dat","");
+    snprintf(remote_commands,CMDLINE_LENGTH-1,"hpcmgr applist check --app=%s",app_name);
+    remote_batch_add(&batch,"exec",remote_commands,"");
+    if(remote_batch_run(workdir,crypto_keyfile,sshkey_dir,user_name,&batch)==3){
+        printf(FATAL_RED_BOLD "[ FATAL: ] Failed to connect to the cluster. Please check the cluster status." RESET_DISPLAY "\n");
+        return 3;
+    }
+    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Current cluster cores status:\n%s",batch.steps[0].output);
+    if(batch.steps[1].exit_code!=0||strstr(batch.steps[1].output,"not available")!=NULL){
         printf(FATAL_RED_BOLD "[ FATAL: ] The specified app " WARN_YELLO_BOLD "%s" FATAL_RED_BOLD " is invalid." RESET_DISPLAY "\n",app_name);
         return -5;
     }
@@ -232,6 +238,7 @@ int job_submit(char* workdir, char* crypto_keyfile, char* user_name, char* sshke
     char filename_temp[FILENAME_LENGTH]="";
     char remote_filename_temp[FILENAME_LENGTH]="";
     int i,run_flag=0;
+    remote_batch batch;
     snprintf(dirname_temp,DIR_LENGTH-1,"%s%s.tmp",HPC_NOW_ROOT_DIR,PATH_SLASH);
     if(mk_pdir(dirname_temp)<0){
         return -1;
@@ -251,13 +258,16 @@ int job_submit(char* workdir, char* crypto_keyfile, char* user_name, char* sshke
     fprintf(file_p,"Data Directory ::%s",job_info->job_data);
     fclose(file_p);
     snprintf(remote_filename_temp,FILENAME_LENGTH-1,"/tmp/job_submit_info_%s.tmp",user_name);
-    remote_copy(workdir,crypto_keyfile,sshkey_dir,filename_temp,remote_filename_temp,user_name,"put","",0);
+    /* The output of hpcmgr submit is streamed to the console in full, as it runs. */
+    remote_batch_init(&batch,1,1);
+    remote_batch_add(&batch,"put",filename_temp,remote_filename_temp);
     snprintf(remote_commands,CMDLINE_LENGTH-1,"hpcmgr submit %s",remote_filename_temp);
-    run_flag=remote_exec_general(workdir,crypto_keyfile,sshkey_dir,user_name,remote_commands,"",0,2,"","");
+    remote_batch_add(&batch,"exec",remote_commands,"");
+    run_flag=remote_batch_run(workdir,crypto_keyfile,sshkey_dir,user_name,&batch);
+    rm_file_or_dir(filename_temp);
     if(run_flag!=0){
         return 1;
     }
-    rm_file_or_dir(filename_temp);
     if(strcmp(job_info->echo_flag,"true")==0){
         printf("\n");
         printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " You can press " WARN_YELLO_BOLD "Ctrl C" RESET_DISPLAY " to stop displaying the job output.\n");
@@ -325,4 +335,631 @@ int job_cancel(char* workdir, char* crypto_keyfile, char* user_name, char* sshke
         snprintf(remote_commands,CMDLINE_LENGTH-1,"scancel --verbose %s",job_id);
     }
     return remote_exec_general(workdir,crypto_keyfile,sshkey_dir,user_name,remote_commands,"",0,3,"","");
-}
\ No newline at end of file
+}
+int job_acct_dir(char* cluster_name, char* acct_dir, unsigned int maxlen){
+    if(cluster_name==NULL||acct_dir==NULL||strlen(cluster_name)==0){
+        return -1;
+    }
+    snprintf(acct_dir,maxlen-1,"%s%sjob_acct_%s",NOW_MON_DIR,PATH_SLASH,cluster_name);
+    return 0;
+}
+
+/*
+ * Expand a Slurm node list, e.g. compute[1-3,05],master
+ * return N>=0: the number of node names
+ */
+int job_nodelist_expand(char* nodelist, char (*node_names)[32], int max_num){
+    char prefix[32]="";
+    char node_temp[96]="";
+    char* ptr=nodelist;
+    char* num_end=NULL;
+    int prefix_len=0;
+    int node_num=0;
+    int first,last,width,i;
+    while(*ptr!='\0'&&node_num<max_num){
+        if(*ptr==','){
+            if(prefix_len>0){
+                strcpy(node_names[node_num],prefix);
+                node_num++;
+            }
+            prefix_len=0;
+            prefix[0]='\0';
+            ptr++;
+            continue;
+        }
+        if(*ptr!='['){
+            if(prefix_len<31){
+                prefix[prefix_len]=*ptr;
+                prefix_len++;
+                prefix[prefix_len]='\0';
+            }
+            ptr++;
+            continue;
+        }
+        ptr++;
+        while(*ptr!='\0'&&*ptr!=']'){
+            first=(int)strtol(ptr,&num_end,10);
+            if(num_end==ptr){
+                return node_num;
+            }
+            width=(num_end-ptr>16)?16:(int)(num_end-ptr);
+            ptr=num_end;
+            last=first;
+            if(*ptr=='-'){
+                ptr++;
+                last=(int)strtol(ptr,&num_end,10);
+                if(num_end==ptr){
+                    return node_num;
+                }
+                ptr=num_end;
+            }
+            for(i=first;i<=last&&node_num<max_num;i++){
+                snprintf(node_temp,95,"%s%0*d",prefix,width,i);
+                strncpy(node_names[node_num],node_temp,31);
+                node_names[node_num][31]='\0';
+                node_num++;
+            }
+            if(*ptr==','){
+                ptr++;
+            }
+        }
+        if(*ptr==']'){
+            ptr++;
+        }
+        prefix_len=0;
+        prefix[0]='\0';
+    }
+    if(prefix_len>0&&node_num<max_num){
+        strcpy(node_names[node_num],prefix);
+        node_num++;
+    }
+    return node_num;
+}
+
+/*
+ * Parse a line of sacct -P -o JobID,User,State,Start,End,NNodes,NCPUS,NodeList,JobName
+ * return 1: not a finished job allocation, skip it
+ * return 0: normal exit
+ */
+int job_acct_line_parse(char* line, job_acct_record* record, char* nodelist, unsigned int nodelist_len){
+    char* fields[9];
+    char* ptr=line;
+    int field_num=1;
+    int datetime[6]={0};
+    int i;
+    struct tm time_tm;
+    int_64bit times[2];
+    fields[0]=line;
+    while(*ptr!='\0'&&*ptr!='\r'&&*ptr!='\n'){
+        if(*ptr=='|'&&field_num<9){
+            *ptr='\0';
+            fields[field_num]=ptr+1;
+            field_num++;
+        }
+        ptr++;
+    }
+    *ptr='\0';
+    if(field_num<9||strlen(fields[0])==0||strchr(fields[0],'.')!=NULL){
+        return 1;
+    }
+    memset(record,0,sizeof(job_acct_record));
+    for(i=0;i<2;i++){
+        if(sscanf(fields[3+i],"%d-%d-%dT%d:%d:%d",&datetime[0],&datetime[1],&datetime[2],&datetime[3],&datetime[4],&datetime[5])!=6){
+            return 1;
+        }
+        memset(&time_tm,0,sizeof(struct tm));
+        time_tm.tm_year=datetime[0]-1900;
+        time_tm.tm_mon=datetime[1]-1;
+        time_tm.tm_mday=datetime[2];
+        time_tm.tm_hour=datetime[3];
+        time_tm.tm_min=datetime[4];
+        time_tm.tm_sec=datetime[5];
+        time_tm.tm_isdst=-1;
+        times[i]=(int_64bit)mktime(&time_tm);
+    }
+    if(times[1]<=times[0]){
+        return 1;
+    }
+    strncpy(record->job_id,fields[0],31);
+    strncpy(record->user_name,fields[1],31);
+    strncpy(record->job_name,fields[8],63);
+    /* The report is a csv */
+    for(i=0;i<strlen(record->job_name);i++){
+        if(record->job_name[i]==','){
+            record->job_name[i]='_';
+        }
+    }
+    sscanf(fields[2],"%15s",record->state);
+    record->start_time=times[0];
+    record->end_time=times[1];
+    record->node_num=atoi(fields[5]);
+    record->cpu_num=atoi(fields[6]);
+    strncpy(nodelist,fields[7],nodelist_len-1);
+    return 0;
+}
+
+/*
+ * Join a job with the monitoring store: the cpu_util, cpu_cores and idle_cores
+ * rows of the job nodes between the job start and end. The utilization is per
+ * node, so a node shared by several jobs is counted for each of them.
+ * The idle cores of the job on a node are its allocated cores minus the busy
+ * cores of the node (cpu_cores - idle_cores), at least 0. sacct only gives the
+ * total NCPUS, so they are split evenly over the job nodes.
+ * return -3: failed to allocate memory
+ * return 0: normal exit
+ */
+int job_acct_join(char* store_dir, char (*store_nodes)[32], int store_node_num, char* nodelist, job_acct_record* record){
+    char (*job_nodes)[32]=NULL;
+    int_64bit* ts_block=NULL;
+    double* util_block=NULL;
+    double* cores_block=NULL;
+    double* idle_block=NULL;
+    int_64bit row;
+    int_64bit row_total;
+    int_64bit read_num;
+    int_64bit j;
+    int job_node_num;
+    int node_id;
+    int node_samples;
+    int i;
+    double util_sum=0;
+    double idle_sum=0;
+    double node_idle;
+    double node_alloc;
+    double job_idle;
+    double hours=(record->end_time-record->start_time)/3600.0;
+    job_nodes=(char (*)[32])malloc(sizeof(char)*32*JOB_ACCT_NODES_MAX);
+    ts_block=(int_64bit*)malloc(sizeof(int_64bit)*MON_STORE_STRIDE);
+    util_block=(double*)malloc(sizeof(double)*MON_STORE_STRIDE);
+    cores_block=(double*)malloc(sizeof(double)*MON_STORE_STRIDE);
+    idle_block=(double*)malloc(sizeof(double)*MON_STORE_STRIDE);
+    if(job_nodes==NULL||ts_block==NULL||util_block==NULL||cores_block==NULL||idle_block==NULL){
+        free(job_nodes);
+        free(ts_block);
+        free(util_block);
+        free(cores_block);
+        free(idle_block);
+        return -3;
+    }
+    job_node_num=job_nodelist_expand(nodelist,job_nodes,JOB_ACCT_NODES_MAX);
+    for(i=0;i<job_node_num;i++){
+        node_id=mon_store_node_id(store_nodes,store_node_num,job_nodes[i]);
+        if(node_id<0){
+            continue;
+        }
+        node_alloc=record->cpu_num/job_node_num+((i<record->cpu_num%job_node_num)?1:0);
+        row=mon_store_seek(store_dir,node_id,record->start_time);
+        row_total=mon_store_rows(store_dir,node_id);
+        node_samples=0;
+        node_idle=0;
+        while(row<row_total){
+            read_num=mon_store_read(store_dir,node_id,"ts",row,MON_STORE_STRIDE,ts_block);
+            if(read_num<1||mon_store_read(store_dir,node_id,"cpu_util",row,read_num,util_block)!=read_num||mon_store_read(store_dir,node_id,"cpu_cores",row,read_num,cores_block)!=read_num||mon_store_read(store_dir,node_id,"idle_cores",row,read_num,idle_block)!=read_num){
+                break;
+            }
+            for(j=0;j<read_num&&ts_block[j]<=record->end_time;j++){
+                util_sum+=util_block[j];
+                job_idle=node_alloc-(cores_block[j]-idle_block[j]);
+                node_idle+=(job_idle>0)?job_idle:0;
+                node_samples++;
+            }
+            row+=j;
+            if(j<read_num){
+                break;
+            }
+        }
+        if(node_samples>0){
+            idle_sum+=node_idle/node_samples;
+            record->samples+=node_samples;
+        }
+    }
+    record->cpu_hours=record->cpu_num*hours;
+    record->avg_util=(record->samples>0)?util_sum/record->samples:0;
+    record->idle_core_hours=idle_sum*hours;
+    free(job_nodes);
+    free(ts_block);
+    free(util_block);
+    free(cores_block);
+    free(idle_block);
+    return 0;
+}
+
+int_64bit job_acct_num(char* acct_dir){
+    char acct_file[FILENAME_LENGTH]="";
+    int_64bit file_size;
+    FILE* file_p=NULL;
+    snprintf(acct_file,FILENAME_LENGTH-1,"%s%sjobs.dat",acct_dir,PATH_SLASH);
+    file_p=fopen(acct_file,"rb");
+    if(file_p==NULL){
+        return 0;
+    }
+    file_size=get_filesize_byte(file_p);
+    fclose(file_p);
+    return file_size/(int_64bit)sizeof(job_acct_record);
+}
+
+int_64bit job_acct_read(char* acct_dir, int_64bit start, int_64bit num, job_acct_record* records){
+    char acct_file[FILENAME_LENGTH]="";
+    int_64bit read_num;
+    FILE* file_p=NULL;
+    snprintf(acct_file,FILENAME_LENGTH-1,"%s%sjobs.dat",acct_dir,PATH_SLASH);
+    file_p=fopen(acct_file,"rb");
+    if(file_p==NULL){
+        return 0;
+    }
+    if(fseek_byte(file_p,start*(int_64bit)sizeof(job_acct_record))!=0){
+        fclose(file_p);
+        return 0;
+    }
+    read_num=(int_64bit)fread(records,sizeof(job_acct_record),(size_t)num,file_p);
+    fclose(file_p);
+    return read_num;
+}
+
+/* The first record ending at or after end_time, the records are sorted by the end time */
+int_64bit job_acct_seek(char* acct_dir, int_64bit end_time){
+    job_acct_record record;
+    int_64bit low=0;
+    int_64bit high=job_acct_num(acct_dir);
+    int_64bit middle;
+    while(low<high){
+        middle=low+(high-low)/2;
+        if(job_acct_read(acct_dir,middle,1,&record)!=1){
+            break;
+        }
+        if(record.end_time<end_time){
+            low=middle+1;
+        }
+        else{
+            high=middle;
+        }
+    }
+    return low;
+}
+
+int job_acct_cmp(const void* record_a, const void* record_b){
+    const job_acct_record* job_a=(const job_acct_record*)record_a;
+    const job_acct_record* job_b=(const job_acct_record*)record_b;
+    if(job_a->end_time!=job_b->end_time){
+        return (job_a->end_time<job_b->end_time)?-1:1;
+    }
+    return strcmp(job_a->job_id,job_b->job_id);
+}
+
+/*
+ * Join the new jobs in the sacct output and merge them into the sorted records.
+ * Only the records within JOB_ACCT_MARGIN of the last end are read back, for the
+ * duplicates and the late jobs, the older records are never rewritten. The ones
+ * read back without samples are joined again, the monitor data of their nodes
+ * may have been synced after the last run.
+ * return -1: failed to open or write the files
+ * return -3: failed to allocate memory
+ * return N>=0: the number of new jobs
+ */
+int job_acct_merge(char* acct_dir, char* sacct_file, char* store_dir){
+    char acct_file[FILENAME_LENGTH]="";
+    char sacct_line[LINE_LENGTH]="";
+    char nodelist[LINE_LENGTH_SHORT]="";
+    char (*store_nodes)[32]=NULL;
+    job_acct_record* records=NULL;
+    job_acct_record* records_new=NULL;
+    job_acct_record record;
+    int_64bit total=job_acct_num(acct_dir);
+    int_64bit tail_start=0;
+    int_64bit tail_num=0;
+    int_64bit record_num;
+    int_64bit record_max;
+    int_64bit keep_from=0;
+    int_64bit i;
+    int store_node_num;
+    int new_num=0;
+    int rejoin_num=0;
+    FILE* file_p=NULL;
+    if(total>0&&job_acct_read(acct_dir,total-1,1,&record)==1){
+        keep_from=record.end_time-JOB_ACCT_MARGIN;
+        tail_start=job_acct_seek(acct_dir,keep_from);
+        tail_num=total-tail_start;
+    }
+    record_max=tail_num+1024;
+    records=(job_acct_record*)malloc(sizeof(job_acct_record)*record_max);
+    store_nodes=(char (*)[32])malloc(sizeof(char)*32*MON_STORE_NODES_MAX);
+    if(records==NULL||store_nodes==NULL){
+        free(records);
+        free(store_nodes);
+        return -3;
+    }
+    record_num=job_acct_read(acct_dir,tail_start,tail_num,records);
+    store_node_num=mon_store_node_load(store_dir,store_nodes,MON_STORE_NODES_MAX);
+    if(store_node_num<0){
+        store_node_num=0;
+    }
+    file_p=fopen(sacct_file,"r");
+    if(file_p==NULL){
+        free(records);
+        free(store_nodes);
+        return -1;
+    }
+    while(fgets(sacct_line,LINE_LENGTH-1,file_p)!=NULL){
+        if(job_acct_line_parse(sacct_line,&record,nodelist,LINE_LENGTH_SHORT)!=0||record.end_time<keep_from){
+            continue;
+        }
+        for(i=0;i<tail_num;i++){
+            if(strcmp(records[i].job_id,record.job_id)==0){
+                break;
+            }
+        }
+        if(i<tail_num){
+            if(records[i].samples>0){
+                continue;
+            }
+            if(job_acct_join(store_dir,store_nodes,store_node_num,nodelist,&record)!=0){
+                fclose(file_p);
+                free(records);
+                free(store_nodes);
+                return -3;
+            }
+            if(record.samples>0){
+                records[i]=record;
+                rejoin_num++;
+            }
+            continue;
+        }
+        if(record_num==record_max){
+            record_max*=2;
+            records_new=(job_acct_record*)realloc(records,sizeof(job_acct_record)*record_max);
+            if(records_new==NULL){
+                fclose(file_p);
+                free(records);
+                free(store_nodes);
+                return -3;
+            }
+            records=records_new;
+        }
+        if(job_acct_join(store_dir,store_nodes,store_node_num,nodelist,&record)!=0){
+            fclose(file_p);
+            free(records);
+            free(store_nodes);
+            return -3;
+        }
+        records[record_num]=record;
+        record_num++;
+        new_num++;
+    }
+    fclose(file_p);
+    free(store_nodes);
+    if(new_num==0&&rejoin_num==0){
+        free(records);
+        return 0;
+    }
+    qsort(records,record_num,sizeof(job_acct_record),job_acct_cmp);
+    /* The merged tail is not shorter than the old one, so overwriting in place is enough */
+    snprintf(acct_file,FILENAME_LENGTH-1,"%s%sjobs.dat",acct_dir,PATH_SLASH);
+    file_p=fopen(acct_file,(total>0)?"r+b":"wb");
+    if(file_p==NULL||fseek_byte(file_p,tail_start*(int_64bit)sizeof(job_acct_record))!=0||fwrite(records,sizeof(job_acct_record),(size_t)record_num,file_p)!=(size_t)record_num){
+        if(file_p!=NULL){
+            fclose(file_p);
+        }
+        free(records);
+        return -1;
+    }
+    fclose(file_p);
+    free(records);
+    return new_num;
+}
+
+/*
+ * Report the jobs ended between time_start and time_end from the records: the
+ * totals and the top_num jobs wasting the most idle core hours.
+ * return -1: no job records
+ * return -3: failed to allocate memory
+ * return N>=0: the number of jobs in the range
+ */
+int job_acct_report(char* acct_dir, int_64bit time_start, int_64bit time_end, int top_num, FILE* out_p){
+    job_acct_record* block=NULL;
+    job_acct_record* top_jobs=NULL;
+    int_64bit total=job_acct_num(acct_dir);
+    int_64bit position;
+    int_64bit read_num;
+    int_64bit j;
+    int top_used=0;
+    int job_num=0;
+    int nodata_num=0;
+    int i,k;
+    double cpu_hours_sum=0;
+    double idle_hours_sum=0;
+    double util_weighted=0;
+    double cpu_hours_joined=0;
+    char time_strings[2][48];
+    time_t time_temp;
+    struct tm* time_p=NULL;
+    if(total<1){
+        return -1;
+    }
+    block=(job_acct_record*)malloc(sizeof(job_acct_record)*1024);
+    top_jobs=(job_acct_record*)malloc(sizeof(job_acct_record)*(top_num+1));
+    if(block==NULL||top_jobs==NULL){
+        free(block);
+        free(top_jobs);
+        return -3;
+    }
+    position=job_acct_seek(acct_dir,time_start);
+    while(position<total){
+        read_num=job_acct_read(acct_dir,position,1024,block);
+        if(read_num<1){
+            break;
+        }
+        for(j=0;j<read_num&&block[j].end_time<=time_end;j++){
+            job_num++;
+            cpu_hours_sum+=block[j].cpu_hours;
+            if(block[j].samples==0){
+                nodata_num++;
+                continue;
+            }
+            idle_hours_sum+=block[j].idle_core_hours;
+            util_weighted+=block[j].avg_util*block[j].cpu_hours;
+            cpu_hours_joined+=block[j].cpu_hours;
+            /* Keep the top jobs sorted by the idle core hours, descending */
+            for(i=top_used;i>0&&top_jobs[i-1].idle_core_hours<block[j].idle_core_hours;i--){
+                if(i<top_num){
+                    top_jobs[i]=top_jobs[i-1];
+                }
+            }
+            if(i<top_num){
+                top_jobs[i]=block[j];
+                if(top_used<top_num){
+                    top_used++;
+                }
+            }
+        }
+        position+=j;
+        if(j<read_num){
+            break;
+        }
+    }
+    fprintf(out_p,"job_id,user,job_name,state,start,end,nodes,cpus,cpu_hours,avg_util,idle_core_hours,idle_%%\n");
+    for(i=0;i<top_used;i++){
+        for(k=0;k<2;k++){
+            time_temp=(time_t)((k==0)?top_jobs[i].start_time:top_jobs[i].end_time);
+            time_p=localtime(&time_temp);
+            snprintf(time_strings[k],47,"%d-%02d-%02d %02d:%02d",time_p->tm_year+1900,time_p->tm_mon+1,time_p->tm_mday,time_p->tm_hour,time_p->tm_min);
+        }
+        fprintf(out_p,"%s,%s,%s,%s,%s,%s,%d,%d,%.2f,%.1f,%.2f,%.1f\n",top_jobs[i].job_id,top_jobs[i].user_name,top_jobs[i].job_name,top_jobs[i].state,time_strings[0],time_strings[1],top_jobs[i].node_num,top_jobs[i].cpu_num,top_jobs[i].cpu_hours,top_jobs[i].avg_util,top_jobs[i].idle_core_hours,(top_jobs[i].cpu_hours>0)?top_jobs[i].idle_core_hours*100/top_jobs[i].cpu_hours:0);
+    }
+    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Jobs: " HIGH_CYAN_BOLD "%d" RESET_DISPLAY " (%d without monitoring data). CPU hours: " HIGH_CYAN_BOLD "%.2f" RESET_DISPLAY " .\n",job_num,nodata_num,cpu_hours_sum);
+    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Average utilization: " HIGH_CYAN_BOLD "%.1f%%" RESET_DISPLAY " . Idle core hours: " HIGH_CYAN_BOLD "%.2f" RESET_DISPLAY " (%.1f%%).\n",(cpu_hours_joined>0)?util_weighted/cpu_hours_joined:0,idle_hours_sum,(cpu_hours_joined>0)?idle_hours_sum*100/cpu_hours_joined:0);
+    free(block);
+    free(top_jobs);
+    return job_num;
+}
+
+/*
+ * Fetch the jobs ended since the last run from Slurm, join them with the
+ * monitoring store and report the jobs ended in the specified range.
+ * return -1: failed to get the cluster name
+ * return -3: failed to create the files
+ * return -5: no job records
+ * return 0: normal exit
+ */
+int job_acct(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* start_datetime, char* end_datetime, char* top_string, char* export_dest){
+    char cluster_name[CLUSTER_ID_LENGTH_MAX_PLUS]="";
+    char mon_data_file[FILENAME_LENGTH]="";
+    char store_dir[FILENAME_LENGTH]="";
+    char acct_dir[FILENAME_LENGTH]="";
+    char sacct_file[FILENAME_LENGTH]="";
+    char report_file[FILENAME_LENGTH]="";
+    char dirname_temp[DIR_LENGTH]="";
+    char remote_commands[CMDLINE_LENGTH]="";
+    char cmdline[CMDLINE_LENGTH]="";
+    char date_string[32]="";
+    char time_string[32]="";
+    char since_string[32]="";
+    char real_export_dest[DIR_LENGTH_EXT]="";
+    char export_file[FILENAME_LENGTH]="";
+    char randstr[8]="";
+    job_acct_record record;
+    int_64bit total;
+    int_64bit since;
+    time_t time1;
+    time_t time2;
+    struct tm time_tm;
+    struct tm* time_p=NULL;
+    int top_num;
+    int run_flag;
+    FILE* file_p=NULL;
+    if(get_cluster_nname(cluster_name,CLUSTER_ID_LENGTH_MAX_PLUS,workdir)!=0){
+        return -1;
+    }
+    run_flag=get_cluster_mon_data(cluster_name,crypto_keyfile,sshkey_dir,mon_data_file);
+    if(run_flag!=0&&run_flag!=-3){
+        printf(WARN_YELLO_BOLD "[ -WARN- ] Failed to get the monitor data. The utilization of new jobs may be empty." RESET_DISPLAY "\n");
+        snprintf(mon_data_file,FILENAME_LENGTH-1,"%s%smon_data_%s.csv",NOW_MON_DIR,PATH_SLASH,cluster_name);
+    }
+    mon_store_dir(cluster_name,store_dir,FILENAME_LENGTH);
+    mon_store_update(mon_data_file,store_dir);
+    job_acct_dir(cluster_name,acct_dir,FILENAME_LENGTH);
+    if(mk_pdir(acct_dir)<0){
+        return -3;
+    }
+    total=job_acct_num(acct_dir);
+    if(total>0&&job_acct_read(acct_dir,total-1,1,&record)==1){
+        since=record.end_time-JOB_ACCT_MARGIN;
+    }
+    else{
+        since=(int_64bit)time(NULL)-JOB_ACCT_DAYS_DEFAULT*86400;
+    }
+    if(cluster_asleep_or_not(workdir,crypto_keyfile)==0){
+        printf(WARN_YELLO_BOLD "[ -WARN- ] The cluster %s is not running. The jobs are not updated." RESET_DISPLAY "\n",cluster_name);
+    }
+    else{
+        snprintf(dirname_temp,DIR_LENGTH-1,"%s%s.tmp",HPC_NOW_ROOT_DIR,PATH_SLASH);
+        if(mk_pdir(dirname_temp)<0){
+            return -3;
+        }
+        snprintf(sacct_file,FILENAME_LENGTH-1,"%s%sjob_acct_%s.txt",dirname_temp,PATH_SLASH,cluster_name);
+        time1=(time_t)since;
+        time_p=localtime(&time1);
+        strftime(since_string,31,"%Y-%m-%dT%H:%M:%S",time_p);
+        snprintf(remote_commands,CMDLINE_LENGTH-1,"sacct -a -X -n -P -S %s -E now --state=CD,F,TO,CA,NF,OOM,PR -o JobID,User,State,Start,End,NNodes,NCPUS,NodeList,JobName",since_string);
+        /* A partial output would move the last end on and lose the jobs before it */
+        if(remote_exec_general(workdir,crypto_keyfile,sshkey_dir,"root",remote_commands,"",0,3,sacct_file,NULL_STREAM)!=0){
+            printf(WARN_YELLO_BOLD "[ -WARN- ] Failed to get the jobs from Slurm. The jobs are not updated." RESET_DISPLAY "\n");
+        }
+        else{
+            run_flag=(file_exist_or_not(sacct_file)==0)?job_acct_merge(acct_dir,sacct_file,store_dir):-1;
+            if(run_flag<0){
+                printf(WARN_YELLO_BOLD "[ -WARN- ] Failed to update the jobs from Slurm." RESET_DISPLAY "\n");
+            }
+            else{
+                printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Joined " HIGH_CYAN_BOLD "%d" RESET_DISPLAY " new job(s) with the monitor data.\n",run_flag);
+            }
+        }
+        rm_file_or_dir(sacct_file);
+    }
+    valid_time_format_or_not(start_datetime,0,date_string,time_string);
+    datetime_to_num(date_string,time_string,&time_tm);
+    time1=mktime(&time_tm);
+    valid_time_format_or_not(end_datetime,1,date_string,time_string);
+    datetime_to_num(date_string,time_string,&time_tm);
+    time2=mktime(&time_tm);
+    top_num=string_to_positive_num(top_string);
+    if(top_num<1){
+        top_num=JOB_ACCT_TOP_DEFAULT;
+    }
+    else if(top_num>JOB_ACCT_TOP_MAX){
+        top_num=JOB_ACCT_TOP_MAX;
+    }
+    generate_random_nstring(randstr,8,1);
+    snprintf(report_file,FILENAME_LENGTH-1,"%s%sjob_acct_temp.%s.csv",NOW_MON_DIR,PATH_SLASH,randstr);
+    file_p=fopen(report_file,"w+");
+    if(file_p==NULL){
+        return -3;
+    }
+    run_flag=job_acct_report(acct_dir,(int_64bit)time1,(int_64bit)time2,top_num,file_p);
+    fclose(file_p);
+    if(run_flag<0){
+        printf(WARN_YELLO_BOLD "[ -WARN- ] No job records of the cluster %s." RESET_DISPLAY "\n",cluster_name);
+        rm_file_or_dir(report_file);
+        return -5;
+    }
+    printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " The top %d job(s) by the idle core hours:\n\n",top_num);
+    snprintf(cmdline,CMDLINE_LENGTH-1,"%s %s",CAT_FILE_CMD,report_file);
+    system(cmdline);
+    printf("\n");
+    if(strlen(export_dest)!=0){
+        local_path_nparser(export_dest,real_export_dest,DIR_LENGTH_EXT);
+        if(folder_exist_or_not(real_export_dest)==0){
+            snprintf(export_file,FILENAME_LENGTH-1,"%s%sjob_acct_%s.csv",real_export_dest,PATH_SLASH,cluster_name);
+        }
+        else{
+            strncpy(export_file,real_export_dest,FILENAME_LENGTH-1);
+        }
+        if(cp_file(report_file,export_file,0)!=0){
+            printf(WARN_YELLO_BOLD "[ -WARN- ] Failed to export to " HIGH_CYAN_BOLD "%s" RESET_DISPLAY " .\n",export_file);
+        }
+        else{
+            printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Exported to " HIGH_CYAN_BOLD "%s" RESET_DISPLAY " .\n",export_file);
+        }
+    }
+    rm_file_or_dir(report_file);
+    return 0;
+}
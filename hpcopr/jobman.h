@@ -20,9 +20,35 @@ typedef struct
     char echo_flag[8];
 } jobinfo;
 
+typedef struct{
+    char job_id[32];
+    char user_name[32];
+    char job_name[64];
+    char state[16];
+    int_64bit start_time;
+    int_64bit end_time;
+    int node_num;
+    int cpu_num;
+    int samples;                        /* The mon_data rows joined, 0 means no monitoring data */
+    double cpu_hours;                   /* Allocated cores x elapsed hours */
+    double avg_util;                    /* The mean cpu_util of the job nodes */
+    double idle_core_hours;             /* The allocated cores left idle on the job nodes x hours */
+} job_acct_record;
+
 int get_job_info(int argc, char** argv, char* workdir, char* user_name, char* sshkey_dir, char* crypto_keyfile, jobinfo* job_info, int interactive_flag_local);
 int job_submit(char* workdir, char* crypto_keyfile, char* user_name, char* sshkey_dir, jobinfo* job_info);
 int job_cancel(char* workdir, char* crypto_keyfile, char* user_name, char* sshkey_dir, char* job_id, int batch_flag_local);
 int job_list(char* workdir, char* crypto_keyfile, char* user_name, char* sshkey_dir);
+int job_acct_dir(char* cluster_name, char* acct_dir, unsigned int maxlen);
+int job_nodelist_expand(char* nodelist, char (*node_names)[32], int max_num);
+int job_acct_line_parse(char* line, job_acct_record* record, char* nodelist, unsigned int nodelist_len);
+int job_acct_join(char* store_dir, char (*store_nodes)[32], int store_node_num, char* nodelist, job_acct_record* record);
+int_64bit job_acct_num(char* acct_dir);
+int_64bit job_acct_read(char* acct_dir, int_64bit start, int_64bit num, job_acct_record* records);
+int_64bit job_acct_seek(char* acct_dir, int_64bit end_time);
+int job_acct_cmp(const void* record_a, const void* record_b);
+int job_acct_merge(char* acct_dir, char* sacct_file, char* store_dir);
+int job_acct_report(char* acct_dir, int_64bit time_start, int_64bit time_end, int top_num, FILE* out_p);
+int job_acct(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* start_datetime, char* end_datetime, char* top_string, char* export_dest);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,1467 @@
+/*
+ * Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+ * This code is distributed under the license: MIT License
+ * Originally written by Zhenrong WANG
+ * mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "now_macros.h"
+#include "general_funcs.h"
+#include "time_process.h"
+#include "monman.h"
+#include "mon_store.h"
+
+/*
+ * The columnar store of a cluster's mon_data, under NOW_MON_DIR/mon_store_CLUSTER:
+ *   meta         OFFSET WINDOW TAIL_MD5 of the csv ingested so far, and MON_STORE_VERSION
+ *   nodes        The node dictionary, the line number (from 0) is the node id
+ *   nID.ts       int64 epoch seconds of each row of the node
+ *   nID.off      int64 byte offset of the row's line in the csv
+ *   nID.COLUMN   double values of each column in mon_store_columns
+ *   nID.tsi      The sparse time index, the ts of every MON_STORE_STRIDE-th row
+ *   nID.r5m/r1h/r1d  mon_store_rollup records (min/max/sum per column) per bucket,
+ *                the 1d buckets start at the local midnights
+ * The csv stays the raw data and the export format, the store is rebuilt from
+ * it whenever it was rotated. The raw rows index the csv lines, so they are
+ * kept as long as the csv keeps the lines, only the rollups have a retention.
+ */
+char mon_store_columns[MON_STORE_COLUMNS][16]={
+    "cpu_cores",
+    "mem_tot_gb",
+    "mem_used_gb",
+    "mem_util",
+    "stor_app_gb",
+    "stor_data_gb",
+    "cpu_util",
+    "idle_cores",
+    "low_cores",
+    "mid_low_cores",
+    "mid_high_cores",
+    "high_cores",
+    "full_cores"
+};
+
+/* The rollup tiers, see mon_store_rollup_tier for what each is rolled up from */
+int mon_store_rollup_secs[MON_STORE_ROLLUPS]={300,3600,86400};
+char mon_store_rollup_names[MON_STORE_ROLLUPS][8]={"5m","1h","1d"};
+
+int mon_store_dir(char* cluster_name, char* store_dir, unsigned int maxlen){
+    if(cluster_name==NULL||store_dir==NULL||strlen(cluster_name)==0){
+        return -1;
+    }
+    snprintf(store_dir,maxlen-1,"%s%smon_store_%s",NOW_MON_DIR,PATH_SLASH,cluster_name);
+    return 0;
+}
+
+void mon_store_file(char* store_dir, int node_id, char* column, char* filename, unsigned int maxlen){
+    if(node_id<0){
+        snprintf(filename,maxlen-1,"%s%s%s",store_dir,PATH_SLASH,column);
+    }
+    else{
+        snprintf(filename,maxlen-1,"%s%sn%d.%s",store_dir,PATH_SLASH,node_id,column);
+    }
+}
+
+/*
+ * return -1: not a column of the store
+ * return N>=0: the index in mon_store_columns
+ */
+int mon_store_column_id(char* column_name){
+    int i;
+    for(i=0;i<MON_STORE_COLUMNS;i++){
+        if(strcmp(column_name,mon_store_columns[i])==0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* The df -TH sizes, e.g. 12G or 512M, in GB (powers of 1000). */
+double mon_store_size_gb(char* size_string){
+    char* unit=NULL;
+    double size=strtod(size_string,&unit);
+    if(unit==NULL){
+        return size;
+    }
+    switch(*unit){
+        case 'k':
+        case 'K':
+            return size/1000000;
+        case 'M':
+            return size/1000;
+        case 'T':
+            return size*1000;
+        case 'P':
+            return size*1000000;
+        default:
+            return size;
+    }
+}
+
+/*
+ * return -1: no dictionary yet
+ * return N>=0: the number of nodes loaded
+ */
+int mon_store_node_load(char* store_dir, char (*node_names)[32], int max_num){
+    char dict_file[FILENAME_LENGTH]="";
+    int node_num=0;
+    FILE* file_p=NULL;
+    mon_store_file(store_dir,-1,"nodes",dict_file,FILENAME_LENGTH);
+    file_p=fopen(dict_file,"r");
+    if(file_p==NULL){
+        return -1;
+    }
+    while(node_num<max_num&&fngetline(file_p,node_names[node_num],32)!=1){
+        node_num++;
+    }
+    fclose(file_p);
+    return node_num;
+}
+
+int mon_store_node_id(char (*node_names)[32], int node_num, char* node_name){
+    int i;
+    for(i=0;i<node_num;i++){
+        if(strcmp(node_names[i],node_name)==0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* FNV-1a */
+unsigned int mon_node_hash(char* node_name){
+    unsigned int hash=2166136261u;
+    char* ptr=NULL;
+    for(ptr=node_name;*ptr!='\0';ptr++){
+        hash^=(unsigned char)(*ptr);
+        hash*=16777619u;
+    }
+    return hash;
+}
+
+void mon_node_hset_reset(mon_node_hset* hset){
+    memset(hset->ids,-1,sizeof(int)*MON_NODE_HASH_SLOTS);
+}
+
+/*
+ * Open addressing with linear probing, a node added again keeps its first id.
+ * return -1: the name is too long or the set is full
+ * return 0: normal exit
+ */
+int mon_node_hset_add(mon_node_hset* hset, char* node_name, int id){
+    unsigned int slot;
+    int i;
+    if(strlen(node_name)>31){
+        return -1;
+    }
+    slot=mon_node_hash(node_name)&(MON_NODE_HASH_SLOTS-1);
+    for(i=0;i<MON_NODE_HASH_SLOTS;i++){
+        if(hset->ids[slot]<0){
+            strcpy(hset->names[slot],node_name);
+            hset->ids[slot]=id;
+            return 0;
+        }
+        if(strcmp(hset->names[slot],node_name)==0){
+            return 0;
+        }
+        slot=(slot+1)&(MON_NODE_HASH_SLOTS-1);
+    }
+    return -1;
+}
+
+/*
+ * return -1: not in the set
+ * return N>=0: the id of the node
+ */
+int mon_node_hset_get(mon_node_hset* hset, char* node_name){
+    unsigned int slot=mon_node_hash(node_name)&(MON_NODE_HASH_SLOTS-1);
+    int i;
+    for(i=0;i<MON_NODE_HASH_SLOTS&&hset->ids[slot]>-1;i++){
+        if(strcmp(hset->names[slot],node_name)==0){
+            return hset->ids[slot];
+        }
+        slot=(slot+1)&(MON_NODE_HASH_SLOTS-1);
+    }
+    return -1;
+}
+
+/*
+ * Parse a mon_data line (modified in place) to a row, adding the node to the
+ * dictionary (and the hash set of it) if it is new. The offset of the row is
+ * left to the caller.
+ * return -1: the dictionary is full
+ * return 1: not a data line (the comment, the header or a broken line)
+ * return 0: normal exit
+ */
+int mon_store_line_parse(char* line, char (*node_names)[32], int* node_num, mon_node_hset* node_hset, date_epoch_cache* date_cache, mon_store_row* row){
+    char* fields[MON_STORE_COLUMNS+4];
+    char* ptr=line;
+    int field_num=1;
+    int i;
+    if(*line=='#'){
+        return 1;
+    }
+    fields[0]=line;
+    while(*ptr!='\0'&&*ptr!='\r'&&*ptr!='\n'){
+        if(*ptr==','){
+            *ptr='\0';
+            if(field_num<MON_STORE_COLUMNS+4){
+                fields[field_num]=ptr+1;
+            }
+            field_num++;
+        }
+        ptr++;
+    }
+    *ptr='\0';
+    if(field_num<MON_STORE_COLUMNS+4||strlen(fields[3])==0||strlen(fields[3])>31){
+        return 1;
+    }
+    row->timestamp=datetime_fast_epoch(fields[0],fields[2],date_cache);
+    if(row->timestamp<0){
+        return 1;
+    }
+    row->node_id=mon_node_hset_get(node_hset,fields[3]);
+    if(row->node_id<0){
+        if(*node_num>=MON_STORE_NODES_MAX){
+            return -1;
+        }
+        strcpy(node_names[*node_num],fields[3]);
+        mon_node_hset_add(node_hset,fields[3],*node_num);
+        row->node_id=*node_num;
+        (*node_num)++;
+    }
+    for(i=0;i<MON_STORE_COLUMNS;i++){
+        if(i==4||i==5){
+            row->values[i]=mon_store_size_gb(fields[i+4]);
+        }
+        else{
+            row->values[i]=atof(fields[i+4]);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Append a batch of rows to the column files, node by node.
+ * return -1: failed to open a column file
+ * return 0: normal exit
+ */
+int mon_store_flush(char* store_dir, mon_store_row* rows, int row_num, int node_num, int_64bit* node_rows){
+    char filename[FILENAME_LENGTH]="";
+    char extra_columns[3][4]={"ts","off","tsi"};
+    FILE* file_p[MON_STORE_COLUMNS+3];
+    int open_flag;
+    int i,j,k;
+    for(i=0;i<node_num;i++){
+        for(j=0;j<row_num;j++){
+            if(rows[j].node_id==i){
+                break;
+            }
+        }
+        if(j==row_num){
+            continue;
+        }
+        open_flag=0;
+        for(k=0;k<MON_STORE_COLUMNS+3;k++){
+            if(k<MON_STORE_COLUMNS){
+                mon_store_file(store_dir,i,mon_store_columns[k],filename,FILENAME_LENGTH);
+            }
+            else{
+                mon_store_file(store_dir,i,extra_columns[k-MON_STORE_COLUMNS],filename,FILENAME_LENGTH);
+            }
+            file_p[k]=fopen(filename,"ab");
+            if(file_p[k]==NULL){
+                open_flag=1;
+            }
+        }
+        if(open_flag==0){
+            for(;j<row_num;j++){
+                if(rows[j].node_id!=i){
+                    continue;
+                }
+                if(node_rows[i]%MON_STORE_STRIDE==0){
+                    fwrite(&rows[j].timestamp,sizeof(int_64bit),1,file_p[MON_STORE_COLUMNS+2]);
+                }
+                fwrite(&rows[j].timestamp,sizeof(int_64bit),1,file_p[MON_STORE_COLUMNS]);
+                fwrite(&rows[j].offset,sizeof(int_64bit),1,file_p[MON_STORE_COLUMNS+1]);
+                for(k=0;k<MON_STORE_COLUMNS;k++){
+                    fwrite(&rows[j].values[k],sizeof(double),1,file_p[k]);
+                }
+                node_rows[i]++;
+            }
+        }
+        for(k=0;k<MON_STORE_COLUMNS+3;k++){
+            if(file_p[k]!=NULL){
+                fclose(file_p[k]);
+            }
+        }
+        if(open_flag!=0){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Ingest the lines appended to the mon_data csv since the last update. The
+ * store is rebuilt if the csv shrank or the tail before the ingested offset
+ * changed, i.e. the csv was rotated. An incomplete last line is left to the
+ * next update.
+ * return -1: failed to open the csv
+ * return -3: failed to allocate memory
+ * return -5: failed to write the store (removed)
+ * return 0: normal exit
+ */
+int mon_store_update(char* csv_file, char* store_dir){
+    char meta_file[FILENAME_LENGTH]="";
+    char dict_file[FILENAME_LENGTH]="";
+    char meta_line[LINE_LENGTH_SHORT]="";
+    char line[LINE_LENGTH_SHORT]="";
+    char tail_md5[36]="";
+    char tail_md5_prev[36]="";
+    char (*node_names)[32]=NULL;
+    mon_store_row* rows=NULL;
+    mon_node_hset* node_hset=NULL;
+    date_epoch_cache date_cache;
+    int_64bit* node_rows=NULL;
+    int_64bit csv_size=0;
+    int_64bit offset=-1;
+    long long mtime=0;
+    int window=0;
+    int version=0;
+    int node_num;
+    int node_num_prev;
+    int row_num=0;
+    int ch;
+    int i;
+    size_t line_len;
+    FILE* file_p=NULL;
+    if(get_file_size_mtime(csv_file,&csv_size,&mtime)!=0){
+        return -1;
+    }
+    mon_store_file(store_dir,-1,"meta",meta_file,FILENAME_LENGTH);
+    mon_store_file(store_dir,-1,"nodes",dict_file,FILENAME_LENGTH);
+    file_p=fopen(meta_file,"r");
+    if(file_p!=NULL){
+        fngetline(file_p,meta_line,LINE_LENGTH_SHORT);
+        fclose(file_p);
+        if(sscanf(meta_line,"%lld %d %35s %d",&offset,&window,tail_md5_prev,&version)!=4||version!=MON_STORE_VERSION){
+            offset=-1;
+        }
+    }
+    if(offset<0||offset>csv_size||(window>0&&(mon_tail_md5(csv_file,offset,window,tail_md5,36)!=0||strcmp(tail_md5,tail_md5_prev)!=0))){
+        if(folder_exist_or_not(store_dir)==0){
+            rm_file_or_dir(store_dir);
+        }
+        offset=0;
+    }
+    else if(offset==csv_size){
+        return 0;
+    }
+    mk_pdir(store_dir);
+    node_names=(char (*)[32])malloc(sizeof(char)*32*MON_STORE_NODES_MAX);
+    node_rows=(int_64bit*)malloc(sizeof(int_64bit)*MON_STORE_NODES_MAX);
+    rows=(mon_store_row*)malloc(sizeof(mon_store_row)*MON_STORE_BATCH);
+    node_hset=(mon_node_hset*)malloc(sizeof(mon_node_hset));
+    if(node_names==NULL||node_rows==NULL||rows==NULL||node_hset==NULL){
+        free(node_names);
+        free(node_rows);
+        free(rows);
+        free(node_hset);
+        return -3;
+    }
+    node_num=mon_store_node_load(store_dir,node_names,MON_STORE_NODES_MAX);
+    if(node_num<0){
+        node_num=0;
+    }
+    node_num_prev=node_num;
+    memset(node_rows,0,sizeof(int_64bit)*MON_STORE_NODES_MAX);
+    mon_node_hset_reset(node_hset);
+    date_epoch_cache_reset(&date_cache);
+    for(i=0;i<node_num;i++){
+        node_rows[i]=mon_store_rows(store_dir,i);
+        mon_node_hset_add(node_hset,node_names[i],i);
+    }
+    file_p=fopen(csv_file,"rb");
+    if(file_p==NULL||fseek_byte(file_p,offset)!=0){
+        if(file_p!=NULL){
+            fclose(file_p);
+        }
+        free(node_names);
+        free(node_rows);
+        free(rows);
+        free(node_hset);
+        return -1;
+    }
+    while(fgets(line,LINE_LENGTH_SHORT,file_p)!=NULL){
+        line_len=strlen(line);
+        if(line_len==0){
+            break;
+        }
+        if(line[line_len-1]!='\n'){
+            if(line_len<LINE_LENGTH_SHORT-1){
+                break;
+            }
+            /* Not a mon_data line, skip the rest of it */
+            while((ch=fgetc(file_p))!=EOF&&ch!='\n'){
+                line_len++;
+            }
+            if(ch==EOF){
+                break;
+            }
+            offset+=line_len+1;
+            continue;
+        }
+        rows[row_num].offset=offset;
+        offset+=line_len;
+        if(mon_store_line_parse(line,node_names,&node_num,node_hset,&date_cache,&rows[row_num])!=0){
+            continue;
+        }
+        row_num++;
+        if(row_num==MON_STORE_BATCH){
+            if(mon_store_flush(store_dir,rows,row_num,node_num,node_rows)!=0){
+                fclose(file_p);
+                goto write_failed;
+            }
+            row_num=0;
+        }
+    }
+    fclose(file_p);
+    if(row_num>0&&mon_store_flush(store_dir,rows,row_num,node_num,node_rows)!=0){
+        goto write_failed;
+    }
+    if(node_num>node_num_prev){
+        file_p=fopen(dict_file,"w");
+        if(file_p==NULL){
+            goto write_failed;
+        }
+        for(i=0;i<node_num;i++){
+            fprintf(file_p,"%s\n",node_names[i]);
+        }
+        fclose(file_p);
+    }
+    window=(offset<MON_SYNC_TAIL_BYTES)?(int)offset:MON_SYNC_TAIL_BYTES;
+    if(window<1||mon_tail_md5(csv_file,offset,window,tail_md5,36)!=0){
+        window=0;
+        strcpy(tail_md5,"-");
+    }
+    file_p=fopen(meta_file,"w");
+    if(file_p==NULL){
+        goto write_failed;
+    }
+    fprintf(file_p,"%lld %d %s %d\n",offset,window,tail_md5,MON_STORE_VERSION);
+    fclose(file_p);
+    free(node_names);
+    free(node_rows);
+    free(rows);
+    free(node_hset);
+    mon_store_maintain(store_dir);
+    return 0;
+
+write_failed:
+    free(node_names);
+    free(node_rows);
+    free(rows);
+    free(node_hset);
+    rm_file_or_dir(store_dir);
+    return -5;
+}
+
+int_64bit mon_store_rows(char* store_dir, int node_id){
+    char ts_file[FILENAME_LENGTH]="";
+    int_64bit size=0;
+    long long mtime=0;
+    mon_store_file(store_dir,node_id,"ts",ts_file,FILENAME_LENGTH);
+    if(get_file_size_mtime(ts_file,&size,&mtime)!=0){
+        return 0;
+    }
+    return size/(int_64bit)sizeof(int_64bit);
+}
+
+/*
+ * Read row_num 8-byte values of a column (ts, off, tsi or one in mon_store_columns)
+ * starting from row_start to the buffer.
+ * return N>=0: the number of values read
+ */
+int_64bit mon_store_read(char* store_dir, int node_id, char* column, int_64bit row_start, int_64bit row_num, void* buffer){
+    char filename[FILENAME_LENGTH]="";
+    size_t read_num;
+    FILE* file_p=NULL;
+    mon_store_file(store_dir,node_id,column,filename,FILENAME_LENGTH);
+    file_p=fopen(filename,"rb");
+    if(file_p==NULL){
+        return 0;
+    }
+    if(fseek_byte(file_p,row_start*8)!=0){
+        fclose(file_p);
+        return 0;
+    }
+    read_num=fread(buffer,8,(size_t)row_num,file_p);
+    fclose(file_p);
+    return (int_64bit)read_num;
+}
+
+/*
+ * Binary search the sparse time index, then the block it points to.
+ * return N>=0: the first row of the node at or after the timestamp
+ */
+int_64bit mon_store_seek(char* store_dir, int node_id, int_64bit timestamp){
+    char index_file[FILENAME_LENGTH]="";
+    int_64bit* index=NULL;
+    int_64bit* block=NULL;
+    int_64bit index_size=0;
+    int_64bit index_num;
+    int_64bit low=0;
+    int_64bit high;
+    int_64bit mid;
+    int_64bit block_start;
+    int_64bit read_num;
+    int_64bit i;
+    long long mtime=0;
+    mon_store_file(store_dir,node_id,"tsi",index_file,FILENAME_LENGTH);
+    if(get_file_size_mtime(index_file,&index_size,&mtime)!=0||index_size<8){
+        return 0;
+    }
+    index_num=index_size/8;
+    index=(int_64bit*)malloc(sizeof(int_64bit)*index_num);
+    block=(int_64bit*)malloc(sizeof(int_64bit)*MON_STORE_STRIDE);
+    if(index==NULL||block==NULL){
+        free(index);
+        free(block);
+        return 0;
+    }
+    index_num=mon_store_read(store_dir,node_id,"tsi",0,index_num,index);
+    high=index_num;
+    while(low<high){
+        mid=low+(high-low)/2;
+        if(index[mid]<timestamp){
+            low=mid+1;
+        }
+        else{
+            high=mid;
+        }
+    }
+    free(index);
+    if(low==0){
+        free(block);
+        return 0;
+    }
+    block_start=(low-1)*MON_STORE_STRIDE;
+    read_num=mon_store_read(store_dir,node_id,"ts",block_start,MON_STORE_STRIDE,block);
+    for(i=0;i<read_num;i++){
+        if(block[i]>=timestamp){
+            break;
+        }
+    }
+    free(block);
+    return block_start+i;
+}
+
+int mon_store_offset_cmp(const void* offset_a, const void* offset_b){
+    int_64bit a=*(const int_64bit*)offset_a;
+    int_64bit b=*(const int_64bit*)offset_b;
+    return (a>b)-(a<b);
+}
+
+/*
+ * Write the csv lines of the nodes in the filter (filter_num<1 for all) whose
+ * minute is in [time_start,time_end] and on the interval from time_start, in
+ * the csv order. The first row of a node in each minute is taken, the agents in
+ * the push mode write one every few seconds. Only the ts and off columns are
+ * read, the lines are copied from the csv as they are.
+ * return -1: failed to open the csv
+ * return -3: failed to allocate memory
+ * return N>=0: the number of lines written
+ */
+int_64bit mon_store_export(char* store_dir, char* csv_file, char (*node_filter)[16], int filter_num, int_64bit time_start, int_64bit time_end, int interval_sec, FILE* out_p){
+    char line[LINE_LENGTH_SHORT]="";
+    char (*node_names)[32]=NULL;
+    int_64bit* ts_block=NULL;
+    int_64bit* off_block=NULL;
+    int_64bit* offsets=NULL;
+    int_64bit* offsets_new=NULL;
+    int_64bit offset_num=0;
+    int_64bit offset_max=0;
+    int_64bit exported=0;
+    int_64bit row;
+    int_64bit row_total;
+    int_64bit read_num;
+    int_64bit minute;
+    int_64bit last_minute;
+    int_64bit j;
+    int node_num;
+    int end_flag;
+    int i,k;
+    FILE* file_p=NULL;
+    if(interval_sec<1){
+        interval_sec=60;
+    }
+    node_names=(char (*)[32])malloc(sizeof(char)*32*MON_STORE_NODES_MAX);
+    ts_block=(int_64bit*)malloc(sizeof(int_64bit)*MON_STORE_STRIDE);
+    off_block=(int_64bit*)malloc(sizeof(int_64bit)*MON_STORE_STRIDE);
+    if(node_names==NULL||ts_block==NULL||off_block==NULL){
+        goto alloc_failed;
+    }
+    node_num=mon_store_node_load(store_dir,node_names,MON_STORE_NODES_MAX);
+    for(i=0;i<node_num;i++){
+        if(filter_num>0){
+            for(k=0;k<filter_num;k++){
+                if(strcmp(node_names[i],node_filter[k])==0){
+                    break;
+                }
+            }
+            if(k==filter_num){
+                continue;
+            }
+        }
+        row=mon_store_seek(store_dir,i,time_start);
+        row_total=mon_store_rows(store_dir,i);
+        last_minute=-1;
+        end_flag=0;
+        while(row<row_total&&end_flag==0){
+            read_num=mon_store_read(store_dir,i,"ts",row,MON_STORE_STRIDE,ts_block);
+            if(read_num<1||mon_store_read(store_dir,i,"off",row,read_num,off_block)!=read_num){
+                break;
+            }
+            for(j=0;j<read_num;j++){
+                minute=ts_block[j]-ts_block[j]%60;
+                if(minute<time_start){
+                    continue;
+                }
+                if(minute>time_end){
+                    end_flag=1;
+                    break;
+                }
+                if((minute-time_start)%interval_sec!=0||minute==last_minute){
+                    continue;
+                }
+                last_minute=minute;
+                if(offset_num==offset_max){
+                    offset_max=(offset_max==0)?MON_STORE_STRIDE:offset_max*2;
+                    offsets_new=(int_64bit*)realloc(offsets,sizeof(int_64bit)*offset_max);
+                    if(offsets_new==NULL){
+                        goto alloc_failed;
+                    }
+                    offsets=offsets_new;
+                }
+                offsets[offset_num]=off_block[j];
+                offset_num++;
+            }
+            row+=read_num;
+        }
+    }
+    free(node_names);
+    free(ts_block);
+    free(off_block);
+    if(offset_num==0){
+        return 0;
+    }
+    qsort(offsets,(size_t)offset_num,sizeof(int_64bit),mon_store_offset_cmp);
+    file_p=fopen(csv_file,"rb");
+    if(file_p==NULL){
+        free(offsets);
+        return -1;
+    }
+    for(j=0;j<offset_num;j++){
+        /* A row flushed twice by an interrupted update */
+        if(j>0&&offsets[j]==offsets[j-1]){
+            continue;
+        }
+        if(fseek_byte(file_p,offsets[j])!=0||fngetline(file_p,line,LINE_LENGTH_SHORT)==1){
+            break;
+        }
+        fprintf(out_p,"%s\n",line);
+        exported++;
+    }
+    fclose(file_p);
+    free(offsets);
+    return exported;
+
+alloc_failed:
+    free(node_names);
+    free(ts_block);
+    free(off_block);
+    free(offsets);
+    return -3;
+}
+
+/*
+ * The retention days of the rollup tiers from MON_STORE_CONF, written with the
+ * defaults if absent. 0 keeps a tier forever. The raw rows follow the csv, the
+ * raw_days: line of the older files is ignored.
+ * return 0: normal exit
+ */
+int mon_store_conf(int* retention_days){
+    char conf_keys[MON_STORE_ROLLUPS][16]={"5m_days:","1h_days:","1d_days:"};
+    char value_string[LINE_LENGTH_SHORT]="";
+    int value;
+    int i;
+    FILE* file_p=NULL;
+    retention_days[0]=MON_5M_DAYS_DEFAULT;
+    retention_days[1]=MON_1H_DAYS_DEFAULT;
+    retention_days[2]=MON_1D_DAYS_DEFAULT;
+    if(file_exist_or_not(MON_STORE_CONF)!=0){
+        file_p=fopen(MON_STORE_CONF,"w+");
+        if(file_p!=NULL){
+            for(i=0;i<MON_STORE_ROLLUPS;i++){
+                fprintf(file_p,"%s  %d\n",conf_keys[i],retention_days[i]);
+            }
+            fclose(file_p);
+        }
+        return 0;
+    }
+    for(i=0;i<MON_STORE_ROLLUPS;i++){
+        if(find_and_nget(MON_STORE_CONF,LINE_LENGTH_SHORT,conf_keys[i],"","",1,conf_keys[i],"","",' ',2,value_string,LINE_LENGTH_SHORT)==0){
+            value=string_to_positive_num(value_string);
+            if(value>=0){
+                retention_days[i]=value;
+            }
+        }
+    }
+    return 0;
+}
+
+void mon_store_rollup_file(char* store_dir, int node_id, int tier, char* filename, unsigned int maxlen){
+    char column[16]="";
+    snprintf(column,15,"r%s",mon_store_rollup_names[tier]);
+    mon_store_file(store_dir,node_id,column,filename,maxlen);
+}
+
+int_64bit mon_store_rollup_num(char* store_dir, int node_id, int tier){
+    char filename[FILENAME_LENGTH]="";
+    int_64bit size=0;
+    long long mtime=0;
+    mon_store_rollup_file(store_dir,node_id,tier,filename,FILENAME_LENGTH);
+    if(get_file_size_mtime(filename,&size,&mtime)!=0){
+        return 0;
+    }
+    return size/(int_64bit)sizeof(mon_store_rollup);
+}
+
+/*
+ * return N>=0: the number of records read
+ */
+int_64bit mon_store_rollup_read(char* store_dir, int node_id, int tier, int_64bit start, int_64bit num, mon_store_rollup* records){
+    char filename[FILENAME_LENGTH]="";
+    size_t read_num;
+    FILE* file_p=NULL;
+    mon_store_rollup_file(store_dir,node_id,tier,filename,FILENAME_LENGTH);
+    file_p=fopen(filename,"rb");
+    if(file_p==NULL){
+        return 0;
+    }
+    if(fseek_byte(file_p,start*(int_64bit)sizeof(mon_store_rollup))!=0){
+        fclose(file_p);
+        return 0;
+    }
+    read_num=fread(records,sizeof(mon_store_rollup),(size_t)num,file_p);
+    fclose(file_p);
+    return (int_64bit)read_num;
+}
+
+/*
+ * return N>=0: the first record of the tier at or after the bucket
+ */
+int_64bit mon_store_rollup_seek(char* store_dir, int node_id, int tier, int_64bit bucket){
+    mon_store_rollup record;
+    int_64bit low=0;
+    int_64bit high=mon_store_rollup_num(store_dir,node_id,tier);
+    int_64bit mid;
+    while(low<high){
+        mid=low+(high-low)/2;
+        if(mon_store_rollup_read(store_dir,node_id,tier,mid,1,&record)!=1){
+            return low;
+        }
+        if(record.bucket<bucket){
+            low=mid+1;
+        }
+        else{
+            high=mid;
+        }
+    }
+    return low;
+}
+
+/* Fold a record (or a raw row as a 1-count record) into the current bucket */
+void mon_store_rollup_add(mon_store_rollup* target, mon_store_rollup* source){
+    int i;
+    if(target->count==0){
+        memcpy(target->min,source->min,sizeof(double)*MON_STORE_COLUMNS);
+        memcpy(target->max,source->max,sizeof(double)*MON_STORE_COLUMNS);
+        memcpy(target->sum,source->sum,sizeof(double)*MON_STORE_COLUMNS);
+        target->count=source->count;
+        return;
+    }
+    for(i=0;i<MON_STORE_COLUMNS;i++){
+        if(source->min[i]<target->min[i]){
+            target->min[i]=source->min[i];
+        }
+        if(source->max[i]>target->max[i]){
+            target->max[i]=source->max[i];
+        }
+        target->sum[i]+=source->sum[i];
+    }
+    target->count+=source->count;
+}
+
+/*
+ * The start of the tier bucket of a timestamp. The 5m and 1h buckets start at
+ * the multiples of the tier seconds, the 1d ones at the local midnight, so that
+ * the days in the views start where the user's days start.
+ */
+int_64bit mon_store_bucket(int_64bit timestamp, int tier){
+    time_t bucket_time=(time_t)timestamp;
+    struct tm* time_p=NULL;
+    struct tm midnight;
+    if(mon_store_rollup_secs[tier]<86400){
+        return timestamp-timestamp%mon_store_rollup_secs[tier];
+    }
+    time_p=localtime(&bucket_time);
+    if(time_p==NULL){
+        return timestamp-timestamp%mon_store_rollup_secs[tier];
+    }
+    /* mktime finds the midnight across a DST change of the day */
+    memcpy(&midnight,time_p,sizeof(struct tm));
+    midnight.tm_hour=0;
+    midnight.tm_min=0;
+    midnight.tm_sec=0;
+    midnight.tm_isdst=-1;
+    bucket_time=mktime(&midnight);
+    if(bucket_time==(time_t)-1||(int_64bit)bucket_time>timestamp){
+        return timestamp-timestamp%mon_store_rollup_secs[tier];
+    }
+    return (int_64bit)bucket_time;
+}
+
+/*
+ * Roll the tier below (the raw rows for the 5m tier, the 5m tier for the 1d one)
+ * up to a tier, from the last bucket of the tier on. The last bucket may be
+ * incomplete, so it is rewritten every time.
+ * return -1: failed to open the tier file
+ * return -3: failed to allocate memory
+ * return 0: normal exit
+ */
+int mon_store_rollup_tier(char* store_dir, int node_id, int tier){
+    char filename[FILENAME_LENGTH]="";
+    mon_store_rollup current;
+    mon_store_rollup item;
+    mon_store_rollup* records=NULL;
+    int_64bit* ts_block=NULL;
+    double* value_block=NULL;
+    int_64bit record_num=mon_store_rollup_num(store_dir,node_id,tier);
+    int_64bit start_bucket=-1;
+    int_64bit source_pos;
+    int_64bit source_total;
+    int_64bit read_num;
+    int_64bit bucket;
+    int_64bit j;
+    int source_tier;
+    int i;
+    FILE* file_p=NULL;
+    memset(&current,0,sizeof(mon_store_rollup));
+    memset(&item,0,sizeof(mon_store_rollup));
+    if(record_num>0&&mon_store_rollup_read(store_dir,node_id,tier,record_num-1,1,&current)==1){
+        start_bucket=current.bucket;
+        record_num--;
+    }
+    else{
+        record_num=0;
+    }
+    current.count=0;
+    mon_store_rollup_file(store_dir,node_id,tier,filename,FILENAME_LENGTH);
+    file_p=fopen(filename,(file_exist_or_not(filename)==0)?"r+b":"w+b");
+    if(file_p==NULL){
+        return -1;
+    }
+    if(fseek_byte(file_p,record_num*(int_64bit)sizeof(mon_store_rollup))!=0){
+        fclose(file_p);
+        return -1;
+    }
+    if(tier==0){
+        ts_block=(int_64bit*)malloc(sizeof(int_64bit)*MON_STORE_STRIDE);
+        value_block=(double*)malloc(sizeof(double)*MON_STORE_STRIDE*MON_STORE_COLUMNS);
+        if(ts_block==NULL||value_block==NULL){
+            free(ts_block);
+            free(value_block);
+            fclose(file_p);
+            return -3;
+        }
+        source_pos=(start_bucket<0)?0:mon_store_seek(store_dir,node_id,start_bucket);
+        source_total=mon_store_rows(store_dir,node_id);
+        item.count=1;
+        while(source_pos<source_total){
+            read_num=mon_store_read(store_dir,node_id,"ts",source_pos,MON_STORE_STRIDE,ts_block);
+            if(read_num<1){
+                break;
+            }
+            for(i=0;i<MON_STORE_COLUMNS;i++){
+                if(mon_store_read(store_dir,node_id,mon_store_columns[i],source_pos,read_num,value_block+i*MON_STORE_STRIDE)!=read_num){
+                    read_num=0;
+                }
+            }
+            for(j=0;j<read_num;j++){
+                bucket=mon_store_bucket(ts_block[j],tier);
+                if(current.count>0&&current.bucket!=bucket){
+                    fwrite(&current,sizeof(mon_store_rollup),1,file_p);
+                    current.count=0;
+                }
+                for(i=0;i<MON_STORE_COLUMNS;i++){
+                    item.min[i]=item.max[i]=item.sum[i]=value_block[i*MON_STORE_STRIDE+j];
+                }
+                current.bucket=bucket;
+                mon_store_rollup_add(&current,&item);
+            }
+            if(read_num<1){
+                break;
+            }
+            source_pos+=read_num;
+        }
+        free(ts_block);
+        free(value_block);
+    }
+    else{
+        records=(mon_store_rollup*)malloc(sizeof(mon_store_rollup)*MON_STORE_STRIDE);
+        if(records==NULL){
+            fclose(file_p);
+            return -3;
+        }
+        /* The hour buckets cross the local midnight in the half-hour time zones, the 1d tier takes the 5m one */
+        source_tier=(mon_store_rollup_secs[tier]<86400)?tier-1:0;
+        source_pos=(start_bucket<0)?0:mon_store_rollup_seek(store_dir,node_id,source_tier,start_bucket);
+        while((read_num=mon_store_rollup_read(store_dir,node_id,source_tier,source_pos,MON_STORE_STRIDE,records))>0){
+            for(j=0;j<read_num;j++){
+                bucket=mon_store_bucket(records[j].bucket,tier);
+                if(current.count>0&&current.bucket!=bucket){
+                    fwrite(&current,sizeof(mon_store_rollup),1,file_p);
+                    current.count=0;
+                }
+                current.bucket=bucket;
+                mon_store_rollup_add(&current,&records[j]);
+            }
+            source_pos+=read_num;
+        }
+        free(records);
+    }
+    if(current.count>0){
+        fwrite(&current,sizeof(mon_store_rollup),1,file_p);
+    }
+    fclose(file_p);
+    return 0;
+}
+
+/*
+ * Write a file without its head bytes to filename.tmp, see mon_store_file_swap.
+ * return -1: failed to write
+ * return 0: normal exit
+ */
+int mon_store_file_cut(char* filename, int_64bit head_bytes){
+    char filename_temp[FILENAME_LENGTH_EXT]="";
+    char buffer[8192];
+    size_t read_num;
+    FILE* file_p=NULL;
+    FILE* file_p_tmp=NULL;
+    snprintf(filename_temp,FILENAME_LENGTH_EXT-1,"%s.tmp",filename);
+    file_p=fopen(filename,"rb");
+    if(file_p==NULL){
+        return -1;
+    }
+    file_p_tmp=fopen(filename_temp,"wb");
+    if(file_p_tmp==NULL||fseek_byte(file_p,head_bytes)!=0){
+        fclose(file_p);
+        if(file_p_tmp!=NULL){
+            fclose(file_p_tmp);
+            rm_file_or_dir(filename_temp);
+        }
+        return -1;
+    }
+    while((read_num=fread(buffer,1,8192,file_p))>0){
+        if(fwrite(buffer,1,read_num,file_p_tmp)!=read_num){
+            fclose(file_p);
+            fclose(file_p_tmp);
+            rm_file_or_dir(filename_temp);
+            return -1;
+        }
+    }
+    fclose(file_p);
+    if(fclose(file_p_tmp)!=0){
+        rm_file_or_dir(filename_temp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Replace a file with its filename.tmp written by mon_store_file_cut.
+ * return -1: failed to rename
+ * return 0: normal exit
+ */
+int mon_store_file_swap(char* filename){
+    char filename_temp[FILENAME_LENGTH_EXT]="";
+    snprintf(filename_temp,FILENAME_LENGTH_EXT-1,"%s.tmp",filename);
+#ifdef _WIN32
+    rm_file_or_dir(filename);
+#endif
+    if(rename(filename_temp,filename)!=0){
+        rm_file_or_dir(filename_temp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Drop the records of a rollup tier before keep_from. The file is only
+ * rewritten if at least MON_STORE_STRIDE records or 1/8 of them go.
+ * return -1: failed to rewrite
+ * return 0: normal exit
+ */
+int mon_store_retain(char* store_dir, int node_id, int tier, int_64bit keep_from){
+    char filename[FILENAME_LENGTH]="";
+    int_64bit first=mon_store_rollup_seek(store_dir,node_id,tier,keep_from);
+    int_64bit total=mon_store_rollup_num(store_dir,node_id,tier);
+    if(first<1||(first<MON_STORE_STRIDE&&first*8<total)){
+        return 0;
+    }
+    mon_store_rollup_file(store_dir,node_id,tier,filename,FILENAME_LENGTH);
+    if(mon_store_file_cut(filename,first*(int_64bit)sizeof(mon_store_rollup))!=0){
+        return -1;
+    }
+    return mon_store_file_swap(filename);
+}
+
+/*
+ * Roll up and apply the retention of every node, after the raw rows were
+ * ingested by mon_store_update.
+ * return -1: failed to roll up a node
+ * return 0: normal exit
+ */
+int mon_store_maintain(char* store_dir){
+    char (*node_names)[32]=NULL;
+    int retention_days[MON_STORE_ROLLUPS];
+    int_64bit now=(int_64bit)time(NULL);
+    int node_num;
+    int run_flag=0;
+    int i,k;
+    node_names=(char (*)[32])malloc(sizeof(char)*32*MON_STORE_NODES_MAX);
+    if(node_names==NULL){
+        return -1;
+    }
+    mon_store_conf(retention_days);
+    node_num=mon_store_node_load(store_dir,node_names,MON_STORE_NODES_MAX);
+    free(node_names);
+    for(i=0;i<node_num;i++){
+        for(k=0;k<MON_STORE_ROLLUPS;k++){
+            if(mon_store_rollup_tier(store_dir,i,k)!=0){
+                run_flag=-1;
+            }
+        }
+        /*
+         * The raw rows are not cut: the csv keeps their lines, and trimming the csv
+         * would rebuild the store and lose the rollups kept longer than the csv.
+         */
+        for(k=0;k<MON_STORE_ROLLUPS;k++){
+            if(retention_days[k]>0){
+                mon_store_retain(store_dir,i,k,now-(int_64bit)retention_days[k]*86400);
+            }
+        }
+    }
+    return run_flag;
+}
+
+/*
+ * The coarsest rollup tier whose buckets fit the interval and the start time,
+ * see mon_store_bucket for where the buckets start.
+ * return -1: the raw rows
+ * return N>=0: the rollup tier
+ */
+int mon_store_tier_choose(int_64bit time_start, int interval_sec){
+    int k;
+    for(k=MON_STORE_ROLLUPS-1;k>=0;k--){
+        if(interval_sec%mon_store_rollup_secs[k]==0&&mon_store_bucket(time_start,k)==time_start){
+            return k;
+        }
+    }
+    return -1;
+}
+
+int mon_store_window_cmp(const void* window_a, const void* window_b){
+    const mon_store_window* a=(const mon_store_window*)window_a;
+    const mon_store_window* b=(const mon_store_window*)window_b;
+    if(a->window!=b->window){
+        return (a->window>b->window)-(a->window<b->window);
+    }
+    return a->node_id-b->node_id;
+}
+
+/*
+ * Append the average of a window to the growing array.
+ * return -3: failed to allocate memory
+ * return 0: normal exit
+ */
+int mon_store_window_push(mon_store_window** windows, int_64bit* window_num, int_64bit* window_max, int_64bit window, int node_id, mon_store_rollup* record){
+    mon_store_window* windows_new=NULL;
+    int k;
+    if(*window_num==*window_max){
+        *window_max=(*window_max==0)?MON_STORE_STRIDE:(*window_max)*2;
+        windows_new=(mon_store_window*)realloc(*windows,sizeof(mon_store_window)*(*window_max));
+        if(windows_new==NULL){
+            return -3;
+        }
+        *windows=windows_new;
+    }
+    (*windows)[*window_num].window=window;
+    (*windows)[*window_num].node_id=node_id;
+    for(k=0;k<MON_STORE_COLUMNS;k++){
+        (*windows)[*window_num].values[k]=record->sum[k]/(double)record->count;
+    }
+    (*window_num)++;
+    return 0;
+}
+
+/*
+ * Write the averages of the nodes in the filter (filter_num<1 for all) per
+ * interval window from time_start, out of a rollup tier, in the mon_data
+ * columns. The windows are ordered by time and then by node id.
+ * return -3: failed to allocate memory
+ * return N>=0: the number of lines written
+ */
+int_64bit mon_store_export_rollup(char* store_dir, char (*node_filter)[16], int filter_num, int_64bit time_start, int_64bit time_end, int interval_sec, int tier, FILE* out_p){
+    char (*node_names)[32]=NULL;
+    mon_store_rollup* records=NULL;
+    mon_store_window* windows=NULL;
+    mon_store_rollup current;
+    int_64bit window_num=0;
+    int_64bit window_max=0;
+    int_64bit window_start;
+    int_64bit current_window=-1;
+    int_64bit pos;
+    int_64bit read_num;
+    int_64bit j;
+    int node_num;
+    int end_flag;
+    int i,k;
+    time_t window_time;
+    struct tm* time_p=NULL;
+    node_names=(char (*)[32])malloc(sizeof(char)*32*MON_STORE_NODES_MAX);
+    records=(mon_store_rollup*)malloc(sizeof(mon_store_rollup)*MON_STORE_STRIDE);
+    if(node_names==NULL||records==NULL){
+        free(node_names);
+        free(records);
+        return -3;
+    }
+    node_num=mon_store_node_load(store_dir,node_names,MON_STORE_NODES_MAX);
+    for(i=0;i<node_num;i++){
+        if(filter_num>0){
+            for(k=0;k<filter_num;k++){
+                if(strcmp(node_names[i],node_filter[k])==0){
+                    break;
+                }
+            }
+            if(k==filter_num){
+                continue;
+            }
+        }
+        pos=mon_store_rollup_seek(store_dir,i,tier,time_start);
+        current.count=0;
+        current_window=-1;
+        end_flag=0;
+        while(end_flag==0&&(read_num=mon_store_rollup_read(store_dir,i,tier,pos,MON_STORE_STRIDE,records))>0){
+            for(j=0;j<read_num;j++){
+                if(records[j].bucket>time_end){
+                    end_flag=1;
+                    break;
+                }
+                if(mon_store_rollup_secs[tier]<86400){
+                    window_start=time_start+(records[j].bucket-time_start)/interval_sec*interval_sec;
+                }
+                else{
+                    /* A local day is 23 or 25 hours at a DST change, round to the nearest local midnight */
+                    window_start=time_start+(records[j].bucket-time_start+43200)/interval_sec*interval_sec;
+                    window_start=mon_store_bucket(window_start+43200,tier);
+                }
+                if(current.count>0&&window_start!=current_window){
+                    if(mon_store_window_push(&windows,&window_num,&window_max,current_window,i,&current)!=0){
+                        goto alloc_failed;
+                    }
+                    current.count=0;
+                }
+                current_window=window_start;
+                mon_store_rollup_add(&current,&records[j]);
+            }
+            pos+=read_num;
+        }
+        if(current.count>0&&mon_store_window_push(&windows,&window_num,&window_max,current_window,i,&current)!=0){
+            goto alloc_failed;
+        }
+    }
+    free(records);
+    if(window_num>0){
+        qsort(windows,(size_t)window_num,sizeof(mon_store_window),mon_store_window_cmp);
+    }
+    for(j=0;j<window_num;j++){
+        window_time=(time_t)windows[j].window;
+        time_p=localtime(&window_time);
+        fprintf(out_p,"%d-%02d-%02d,%02d:%02d,%02d:%02d:%02d,%s",time_p->tm_year+1900,time_p->tm_mon+1,time_p->tm_mday,time_p->tm_hour,time_p->tm_min,time_p->tm_hour,time_p->tm_min,time_p->tm_sec,node_names[windows[j].node_id]);
+        for(k=0;k<MON_STORE_COLUMNS;k++){
+            if(k==4||k==5){
+                fprintf(out_p,",%.1fG",windows[j].values[k]);
+            }
+            else if(k==3){
+                fprintf(out_p,",%.4f",windows[j].values[k]);
+            }
+            else{
+                fprintf(out_p,",%.1f",windows[j].values[k]);
+            }
+        }
+        fprintf(out_p,"\n");
+    }
+    free(windows);
+    free(node_names);
+    return window_num;
+
+alloc_failed:
+    free(windows);
+    free(node_names);
+    free(records);
+    return -3;
+}
+
+void mon_stat_reset(mon_stat_acc* acc, double bin_width){
+    memset(acc,0,sizeof(mon_stat_acc));
+    acc->bin_width=bin_width;
+}
+
+void mon_stat_add(mon_stat_acc* acc, double value){
+    int_64bit bin=(value>0)?(int_64bit)(value/acc->bin_width):0;
+    if(bin>=MON_STAT_BINS){
+        bin=MON_STAT_BINS-1;
+    }
+    if(acc->count==0||value>acc->max){
+        acc->max=value;
+    }
+    acc->count++;
+    acc->sum+=value;
+    acc->bins[bin]++;
+}
+
+/* The upper edge of the histogram bin of the percentile, not above the max */
+double mon_stat_percentile(mon_stat_acc* acc, int percent){
+    int_64bit rank=(acc->count*percent+99)/100;
+    int_64bit cumulated=0;
+    double value;
+    int i;
+    for(i=0;i<MON_STAT_BINS;i++){
+        cumulated+=acc->bins[i];
+        if(cumulated>=rank){
+            break;
+        }
+    }
+    value=(i+1)*acc->bin_width;
+    return (value>acc->max)?acc->max:value;
+}
+
+void mon_stat_print(FILE* out_p, mon_stat_acc* acc){
+    if(acc->count==0){
+        fprintf(out_p,",null,null,null");
+        return;
+    }
+    fprintf(out_p,",%.2f,%.2f,%.2f",acc->sum/(double)acc->count,acc->max,mon_stat_percentile(acc,95));
+}
+
+/*
+ * Aggregate cpu_util, mem_util and idle_cores per time bucket from time_start
+ * in one pass over the raw columns: avg/max/p95 per node and for the cluster.
+ * The cluster cpu_util and mem_util pool the samples of all the nodes, the
+ * cluster idle_cores is the sum of the nodes in each minute. The percentiles
+ * come from fixed histograms, so the memory doesn't grow with the rows.
+ * return -3: failed to allocate memory
+ * return N>=0: the number of lines written
+ */
+int_64bit mon_store_stat(char* store_dir, char (*node_filter)[16], int filter_num, int_64bit time_start, int_64bit time_end, int bucket_sec, FILE* out_p){
+    char (*node_names)[32]=NULL;
+    char stat_columns[3][16]={"cpu_util","mem_util","idle_cores"};
+    double bin_widths[3]={0.1,0.1,1};
+    int_64bit* ts_block=NULL;
+    double* value_block=NULL;
+    double* minute_idle=NULL;
+    char* minute_seen=NULL;
+    int_64bit* cursors=NULL;
+    int_64bit* row_totals=NULL;
+    mon_stat_acc* node_acc=NULL;
+    mon_stat_acc* cluster_acc=NULL;
+    int_64bit bucket;
+    int_64bit bucket_end;
+    int_64bit minute;
+    int_64bit next_minute;
+    int_64bit current_minute;
+    int_64bit read_num;
+    int_64bit lines=0;
+    int_64bit j;
+    int minute_num=bucket_sec/60;
+    int node_num;
+    int bucket_flag;
+    int idle_count;
+    double idle_sum;
+    int i,k,m;
+    time_t bucket_time;
+    struct tm* time_p=NULL;
+    if(bucket_sec<60){
+        return -3;
+    }
+    node_names=(char (*)[32])malloc(sizeof(char)*32*MON_STORE_NODES_MAX);
+    ts_block=(int_64bit*)malloc(sizeof(int_64bit)*MON_STORE_STRIDE);
+    value_block=(double*)malloc(sizeof(double)*MON_STORE_STRIDE*3);
+    minute_idle=(double*)malloc(sizeof(double)*minute_num);
+    minute_seen=(char*)malloc(sizeof(char)*minute_num);
+    cursors=(int_64bit*)malloc(sizeof(int_64bit)*MON_STORE_NODES_MAX);
+    row_totals=(int_64bit*)malloc(sizeof(int_64bit)*MON_STORE_NODES_MAX);
+    node_acc=(mon_stat_acc*)malloc(sizeof(mon_stat_acc)*3);
+    cluster_acc=(mon_stat_acc*)malloc(sizeof(mon_stat_acc)*3);
+    if(node_names==NULL||ts_block==NULL||value_block==NULL||minute_idle==NULL||minute_seen==NULL||cursors==NULL||row_totals==NULL||node_acc==NULL||cluster_acc==NULL){
+        lines=-3;
+        goto free_memory;
+    }
+    node_num=mon_store_node_load(store_dir,node_names,MON_STORE_NODES_MAX);
+    for(i=0;i<node_num;i++){
+        cursors[i]=-1;
+        if(filter_num>0){
+            for(k=0;k<filter_num;k++){
+                if(strcmp(node_names[i],node_filter[k])==0){
+                    break;
+                }
+            }
+            if(k==filter_num){
+                continue;
+            }
+        }
+        cursors[i]=mon_store_seek(store_dir,i,time_start);
+        row_totals[i]=mon_store_rows(store_dir,i);
+    }
+    fprintf(out_p,"bucket_start,scope,samples,cpu_util_avg,cpu_util_max,cpu_util_p95,mem_util_avg,mem_util_max,mem_util_p95,idle_cores_avg,idle_cores_max,idle_cores_p95\n");
+    for(bucket=time_start;bucket<=time_end;bucket+=bucket_sec){
+        /* Jump over the empty buckets to the earliest row left */
+        next_minute=-1;
+        for(i=0;i<node_num;i++){
+            if(cursors[i]<0||cursors[i]>=row_totals[i]||mon_store_read(store_dir,i,"ts",cursors[i],1,ts_block)!=1){
+                continue;
+            }
+            minute=ts_block[0]-ts_block[0]%60;
+            if(next_minute<0||minute<next_minute){
+                next_minute=minute;
+            }
+        }
+        if(next_minute<0||next_minute>time_end){
+            break;
+        }
+        if(next_minute>bucket){
+            bucket+=(next_minute-bucket)/bucket_sec*bucket_sec;
+        }
+        bucket_end=bucket+bucket_sec;
+        bucket_time=(time_t)bucket;
+        time_p=localtime(&bucket_time);
+        for(k=0;k<3;k++){
+            mon_stat_reset(&cluster_acc[k],bin_widths[k]);
+        }
+        memset(minute_idle,0,sizeof(double)*minute_num);
+        memset(minute_seen,0,sizeof(char)*minute_num);
+        bucket_flag=0;
+        for(i=0;i<node_num;i++){
+            if(cursors[i]<0){
+                continue;
+            }
+            for(k=0;k<3;k++){
+                mon_stat_reset(&node_acc[k],bin_widths[k]);
+            }
+            current_minute=-1;
+            idle_sum=0;
+            idle_count=0;
+            while(cursors[i]<row_totals[i]){
+                read_num=mon_store_read(store_dir,i,"ts",cursors[i],MON_STORE_STRIDE,ts_block);
+                for(k=0;k<3&&read_num>0;k++){
+                    if(mon_store_read(store_dir,i,stat_columns[k],cursors[i],read_num,value_block+k*MON_STORE_STRIDE)!=read_num){
+                        read_num=0;
+                    }
+                }
+                if(read_num<1){
+                    cursors[i]=row_totals[i];
+                    break;
+                }
+                for(j=0;j<read_num;j++){
+                    minute=ts_block[j]-ts_block[j]%60;
+                    if(minute>=bucket_end||minute>time_end){
+                        break;
+                    }
+                    if(minute<bucket){
+                        continue;
+                    }
+                    for(k=0;k<3;k++){
+                        mon_stat_add(&node_acc[k],value_block[k*MON_STORE_STRIDE+j]);
+                        if(k<2){
+                            mon_stat_add(&cluster_acc[k],value_block[k*MON_STORE_STRIDE+j]);
+                        }
+                    }
+                    /* The mean idle cores of the node in each minute, summed up for the cluster */
+                    if(minute!=current_minute&&idle_count>0){
+                        m=(int)((current_minute-bucket)/60);
+                        minute_idle[m]+=idle_sum/idle_count;
+                        minute_seen[m]=1;
+                        idle_sum=0;
+                        idle_count=0;
+                    }
+                    current_minute=minute;
+                    idle_sum+=value_block[2*MON_STORE_STRIDE+j];
+                    idle_count++;
+                }
+                cursors[i]+=j;
+                if(j<read_num){
+                    break;
+                }
+            }
+            if(idle_count>0){
+                m=(int)((current_minute-bucket)/60);
+                minute_idle[m]+=idle_sum/idle_count;
+                minute_seen[m]=1;
+            }
+            if(node_acc[0].count==0){
+                continue;
+            }
+            fprintf(out_p,"%d-%02d-%02d %02d:%02d,%s,%lld",time_p->tm_year+1900,time_p->tm_mon+1,time_p->tm_mday,time_p->tm_hour,time_p->tm_min,node_names[i],node_acc[0].count);
+            for(k=0;k<3;k++){
+                mon_stat_print(out_p,&node_acc[k]);
+            }
+            fprintf(out_p,"\n");
+            lines++;
+            bucket_flag=1;
+        }
+        if(bucket_flag==0){
+            continue;
+        }
+        for(m=0;m<minute_num;m++){
+            if(minute_seen[m]!=0){
+                mon_stat_add(&cluster_acc[2],minute_idle[m]);
+            }
+        }
+        fprintf(out_p,"%d-%02d-%02d %02d:%02d,cluster,%lld",time_p->tm_year+1900,time_p->tm_mon+1,time_p->tm_mday,time_p->tm_hour,time_p->tm_min,cluster_acc[0].count);
+        for(k=0;k<3;k++){
+            mon_stat_print(out_p,&cluster_acc[k]);
+        }
+        fprintf(out_p,"\n");
+        lines++;
+    }
+
+free_memory:
+    free(node_names);
+    free(ts_block);
+    free(value_block);
+    free(minute_idle);
+    free(minute_seen);
+    free(cursors);
+    free(row_totals);
+    free(node_acc);
+    free(cluster_acc);
+    return lines;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+ * This code is distributed under the license: MIT License
+ * Originally written by Zhenrong WANG
+ * mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+ */
+
+#ifndef MON_STORE_H
+#define MON_STORE_H
+
+typedef struct{
+    int node_id;
+    int_64bit timestamp;                /* Epoch seconds of date+time_s */
+    int_64bit offset;                   /* Byte offset of the line in the mon_data csv */
+    double values[MON_STORE_COLUMNS];
+} mon_store_row;
+
+typedef struct{
+    int_64bit bucket;                   /* Epoch seconds of the bucket start, a multiple of the tier seconds */
+    int_64bit count;                    /* The raw rows rolled up */
+    double min[MON_STORE_COLUMNS];
+    double max[MON_STORE_COLUMNS];
+    double sum[MON_STORE_COLUMNS];
+} mon_store_rollup;
+
+typedef struct{
+    int_64bit window;
+    int node_id;
+    double values[MON_STORE_COLUMNS];   /* The averages in the window */
+} mon_store_window;
+
+typedef struct{
+    char names[MON_NODE_HASH_SLOTS][32];
+    int ids[MON_NODE_HASH_SLOTS];       /* -1 for the empty slots */
+} mon_node_hset;
+
+typedef struct{
+    int_64bit count;
+    double sum;
+    double max;
+    double bin_width;
+    int_64bit bins[MON_STAT_BINS];      /* Fixed histogram for the percentiles, the last bin takes the overflow */
+} mon_stat_acc;
+
+int mon_store_dir(char* cluster_name, char* store_dir, unsigned int maxlen);
+void mon_store_file(char* store_dir, int node_id, char* column, char* filename, unsigned int maxlen);
+int mon_store_column_id(char* column_name);
+double mon_store_size_gb(char* size_string);
+int mon_store_node_load(char* store_dir, char (*node_names)[32], int max_num);
+int mon_store_node_id(char (*node_names)[32], int node_num, char* node_name);
+unsigned int mon_node_hash(char* node_name);
+void mon_node_hset_reset(mon_node_hset* hset);
+int mon_node_hset_add(mon_node_hset* hset, char* node_name, int id);
+int mon_node_hset_get(mon_node_hset* hset, char* node_name);
+int mon_store_line_parse(char* line, char (*node_names)[32], int* node_num, mon_node_hset* node_hset, date_epoch_cache* date_cache, mon_store_row* row);
+int mon_store_flush(char* store_dir, mon_store_row* rows, int row_num, int node_num, int_64bit* node_rows);
+int mon_store_update(char* csv_file, char* store_dir);
+int_64bit mon_store_rows(char* store_dir, int node_id);
+int_64bit mon_store_read(char* store_dir, int node_id, char* column, int_64bit row_start, int_64bit row_num, void* buffer);
+int_64bit mon_store_seek(char* store_dir, int node_id, int_64bit timestamp);
+int mon_store_offset_cmp(const void* offset_a, const void* offset_b);
+int_64bit mon_store_export(char* store_dir, char* csv_file, char (*node_filter)[16], int filter_num, int_64bit time_start, int_64bit time_end, int interval_sec, FILE* out_p);
+int mon_store_conf(int* retention_days);
+void mon_store_rollup_file(char* store_dir, int node_id, int tier, char* filename, unsigned int maxlen);
+int_64bit mon_store_rollup_num(char* store_dir, int node_id, int tier);
+int_64bit mon_store_rollup_read(char* store_dir, int node_id, int tier, int_64bit start, int_64bit num, mon_store_rollup* records);
+int_64bit mon_store_rollup_seek(char* store_dir, int node_id, int tier, int_64bit bucket);
+void mon_store_rollup_add(mon_store_rollup* target, mon_store_rollup* source);
+int_64bit mon_store_bucket(int_64bit timestamp, int tier);
+int mon_store_rollup_tier(char* store_dir, int node_id, int tier);
+int mon_store_file_cut(char* filename, int_64bit head_bytes);
+int mon_store_file_swap(char* filename);
+int mon_store_retain(char* store_dir, int node_id, int tier, int_64bit keep_from);
+int mon_store_maintain(char* store_dir);
+int mon_store_tier_choose(int_64bit time_start, int interval_sec);
+int mon_store_window_cmp(const void* window_a, const void* window_b);
+int mon_store_window_push(mon_store_window** windows, int_64bit* window_num, int_64bit* window_max, int_64bit window, int node_id, mon_store_rollup* record);
+int_64bit mon_store_export_rollup(char* store_dir, char (*node_filter)[16], int filter_num, int_64bit time_start, int_64bit time_end, int interval_sec, int tier, FILE* out_p);
+
+void mon_stat_reset(mon_stat_acc* acc, double bin_width);
+void mon_stat_add(mon_stat_acc* acc, double value);
+double mon_stat_percentile(mon_stat_acc* acc, int percent);
+void mon_stat_print(FILE* out_p, mon_stat_acc* acc);
+int_64bit mon_store_stat(char* store_dir, char (*node_filter)[16], int filter_num, int_64bit time_start, int_64bit time_end, int bucket_sec, FILE* out_p);
+
+#endif
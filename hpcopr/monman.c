@@ -20,7 +20,11 @@
 #include "time_process.h"
 #include "cluster_general_funcs.h"
 #include "general_print_info.h"
+#include "now_md5.h"
 #include "monman.h"
+#include "mon_store.h"
+
+extern char mon_store_rollup_names[MON_STORE_ROLLUPS][8];
 
 /*
  * Return -1: Failed to get the workdir
@@ -47,7 +51,7 @@ int get_cluster_mon_data(char* cluster_name, char* crypto_keyfile, char* sshkey_
             return -3;
         }
     }
-    remote_copy(workdir,crypto_keyfile,sshkey_dir,mon_data_file,"/hpc_data/cluster_data/mon_data.csv","root","get","",0);
+    mon_data_sync(workdir,crypto_keyfile,sshkey_dir,mon_data_file);
     if(file_empty_or_not(mon_data_file)<1){
         strcpy(mon_data_file,"");
         return 1;
@@ -55,30 +59,325 @@ int get_cluster_mon_data(char* cluster_name, char* crypto_keyfile, char* sshkey_
     return 0;
 }
 
+/*
+ * Fetch the mon_data of all the awake clusters in the (decrypted) registry
+ * concurrently with fanout_run, instead of one cluster after another. The
+ * clusters synced before only fetch the appended lines (mon_tail_cmdline), and
+ * fall back to the full copy one by one if the remote file was rotated.
+ * Return -1: Failed to open the registry
+ * Return -3: Failed to allocate memory
+ * Return N>=0: The number of clusters updated
+ */
 int update_all_mon_data(char* cluster_registry, char* crypto_keyfile, char* sshkey_dir){
     char cluster_name_temp[64]="";
+    char workdir[DIR_LENGTH]="";
     char mon_data_file_temp[FILENAME_LENGTH]="";
+    char tail_file[FILENAME_LENGTH]="";
+    char tail_cmdline[CMDLINE_LENGTH]="";
     char registry_line[LINE_LENGTH_SHORT]="";
-    int run_flag;
+    char randstr[7]="";
+    fanout_task* tasks=NULL;
+    int* tail_flags=NULL;
+    int line_num=0;
+    int task_num=0;
     int updated=0;
+    int i;
     FILE* file_p=fopen(cluster_registry,"r");
     if(file_p==NULL){
         return -1;
     }
-    while(!feof(file_p)){
-        fngetline(file_p,registry_line,LINE_LENGTH_SHORT);
+    while(fngetline(file_p,registry_line,LINE_LENGTH_SHORT)!=1){
+        line_num++;
+    }
+    if(line_num<1){
+        fclose(file_p);
+        return 0;
+    }
+    tasks=(fanout_task*)malloc(sizeof(fanout_task)*line_num);
+    tail_flags=(int*)malloc(sizeof(int)*line_num);
+    if(tasks==NULL||tail_flags==NULL){
+        fclose(file_p);
+        free(tasks);
+        free(tail_flags);
+        return -3;
+    }
+    mk_pdir(NOW_MON_DIR);
+    if(folder_check_general(NOW_MON_DIR,6)!=0){
+        fclose(file_p);
+        free(tasks);
+        free(tail_flags);
+        return -1;
+    }
+    generate_random_nstring(randstr,7,1);
+    fseek(file_p,0,SEEK_SET);
+    while(task_num<line_num&&fngetline(file_p,registry_line,LINE_LENGTH_SHORT)!=1){
         if(strlen(registry_line)==0){
             continue;
         }
-        get_seq_nstring(cluster_name_temp,' ',4,cluster_name_temp,64);
-        run_flag=get_cluster_mon_data(cluster_name_temp,crypto_keyfile,sshkey_dir,mon_data_file_temp);
-        if(run_flag==0){
+        get_seq_nstring(registry_line,' ',4,cluster_name_temp,64);
+        if(get_nworkdir(workdir,DIR_LENGTH,cluster_name_temp)!=0||cluster_asleep_or_not(workdir,crypto_keyfile)==0){
+            continue;
+        }
+        snprintf(mon_data_file_temp,FILENAME_LENGTH-1,"%s%smon_data_%s.csv",NOW_MON_DIR,PATH_SLASH,cluster_name_temp);
+        snprintf(tail_file,FILENAME_LENGTH-1,"%smon_tail_%s_%s.out",NOW_TMP_DIR,cluster_name_temp,randstr);
+        tail_flags[task_num]=0;
+#ifndef _WIN32
+        /* The group keeps the output from the redirection added by fanout_run. */
+        if(mon_tail_cmdline(workdir,crypto_keyfile,sshkey_dir,mon_data_file_temp,tail_file,tail_cmdline,CMDLINE_LENGTH-8,tasks[task_num].privkey_temp,FILENAME_LENGTH_EXT)==0){
+            strcpy(tasks[task_num].cmdline,"{ ");
+            strncat(tasks[task_num].cmdline,tail_cmdline,CMDLINE_LENGTH-8);
+            strcat(tasks[task_num].cmdline,"; }");
+            tail_flags[task_num]=1;
+        }
+#endif
+        if(tail_flags[task_num]==0&&remote_copy_cmdline(workdir,crypto_keyfile,sshkey_dir,mon_data_file_temp,"/hpc_data/cluster_data/mon_data.csv","root","get","",tasks[task_num].cmdline,CMDLINE_LENGTH,tasks[task_num].privkey_temp,FILENAME_LENGTH_EXT)!=0){
+            continue;
+        }
+        strncpy(tasks[task_num].target,cluster_name_temp,63);
+        task_num++;
+    }
+    fclose(file_p);
+    if(task_num>0){
+        fanout_run(tasks,task_num,FANOUT_CONCURRENCY_DEFAULT,FANOUT_TIMEOUT_DEFAULT);
+    }
+    for(i=0;i<task_num;i++){
+        release_ssh_identity(tasks[i].privkey_temp);
+        snprintf(mon_data_file_temp,FILENAME_LENGTH-1,"%s%smon_data_%s.csv",NOW_MON_DIR,PATH_SLASH,tasks[i].target);
+        if(tail_flags[i]==1){
+            snprintf(tail_file,FILENAME_LENGTH-1,"%smon_tail_%s_%s.out",NOW_TMP_DIR,tasks[i].target,randstr);
+            if(tasks[i].exit_code!=0||mon_tail_apply(mon_data_file_temp,tail_file)!=0){
+                get_nworkdir(workdir,DIR_LENGTH,tasks[i].target);
+                tasks[i].exit_code=remote_copy(workdir,crypto_keyfile,sshkey_dir,mon_data_file_temp,"/hpc_data/cluster_data/mon_data.csv","root","get","",0);
+                mon_sync_record(mon_data_file_temp);
+            }
+            rm_file_or_dir(tail_file);
+        }
+        else{
+            mon_sync_record(mon_data_file_temp);
+        }
+        if(tasks[i].exit_code==0&&file_empty_or_not(mon_data_file_temp)>0){
             updated++;
         }
     }
+    free(tasks);
+    free(tail_flags);
     return updated;
 }
 
+/*
+ * The md5 of the window bytes of a file before the offset, through a temp file.
+ * return -3: memory error
+ * return -1: failed to read the file
+ * return 0: normal exit
+ */
+int mon_tail_md5(char* filename, int_64bit offset, int window, char* md5_string, unsigned int len){
+    char tmp_file[FILENAME_LENGTH]="";
+    char randstr[7]="";
+    char* buffer=NULL;
+    size_t read_size=0;
+    int run_flag;
+    FILE* file_p=NULL;
+    if(window<1||offset<window){
+        return -1;
+    }
+    buffer=(char*)malloc(window);
+    if(buffer==NULL){
+        return -3;
+    }
+    file_p=fopen(filename,"rb");
+    if(file_p!=NULL){
+        if(fseek_byte(file_p,offset-window)==0){
+            read_size=fread(buffer,1,window,file_p);
+        }
+        fclose(file_p);
+    }
+    generate_random_nstring(randstr,7,1);
+    snprintf(tmp_file,FILENAME_LENGTH-1,"%smon_tail_%s.tmp",NOW_TMP_DIR,randstr);
+    file_p=(read_size==(size_t)window)?fopen(tmp_file,"wb"):NULL;
+    if(file_p==NULL){
+        free(buffer);
+        return -1;
+    }
+    fwrite(buffer,1,window,file_p);
+    fclose(file_p);
+    free(buffer);
+    run_flag=now_md5_for_file(tmp_file,md5_string,len);
+    rm_file_or_dir(tmp_file);
+    return (run_flag==0)?0:-1;
+}
+
+/*
+ * Record the synced size and the md5 of the tail of a local mon_data file to
+ * the state file FILE.sync: OFFSET WINDOW TAIL_MD5. An empty or missing file
+ * removes the state, so that the next sync is a full one.
+ * return 1: no state recorded
+ * return 0: normal exit
+ */
+int mon_sync_record(char* mon_data_file){
+    char sync_file[FILENAME_LENGTH]="";
+    char tail_md5[64]="";
+    int_64bit file_size=0;
+    long long file_mtime;
+    int window;
+    FILE* file_p=NULL;
+    snprintf(sync_file,FILENAME_LENGTH-1,"%s.sync",mon_data_file);
+    if(get_file_size_mtime(mon_data_file,&file_size,&file_mtime)!=0||file_size<1){
+        rm_file_or_dir(sync_file);
+        return 1;
+    }
+    window=(file_size<MON_SYNC_TAIL_BYTES)?(int)file_size:MON_SYNC_TAIL_BYTES;
+    if(mon_tail_md5(mon_data_file,file_size,window,tail_md5,64)!=0){
+        rm_file_or_dir(sync_file);
+        return 1;
+    }
+    file_p=fopen(sync_file,"w+");
+    if(file_p==NULL){
+        return 1;
+    }
+    fprintf(file_p,"%lld %d %s\n",(long long)file_size,window,tail_md5);
+    fclose(file_p);
+    return 0;
+}
+
+/*
+ * Read the state of the last sync of a local mon_data file. The state is valid
+ * only if the local file is still of the recorded size.
+ * return 1: no valid state, a full sync is needed
+ * return 0: normal exit
+ */
+int mon_sync_state(char* mon_data_file, int_64bit* offset, int* window, char* tail_md5, unsigned int md5_len){
+    char sync_file[FILENAME_LENGTH]="";
+    char line_buffer[LINE_LENGTH_SHORT]="";
+    char md5_string[64]="";
+    long long offset_value=0;
+    int_64bit file_size=0;
+    long long file_mtime;
+    FILE* file_p=NULL;
+    snprintf(sync_file,FILENAME_LENGTH-1,"%s.sync",mon_data_file);
+    file_p=fopen(sync_file,"r");
+    if(file_p==NULL){
+        return 1;
+    }
+    fngetline(file_p,line_buffer,LINE_LENGTH_SHORT);
+    fclose(file_p);
+    if(sscanf(line_buffer,"%lld %d %63s",&offset_value,window,md5_string)!=3||offset_value<1||*window<1||*window>offset_value){
+        return 1;
+    }
+    if(get_file_size_mtime(mon_data_file,&file_size,&file_mtime)!=0||file_size!=(int_64bit)offset_value){
+        return 1;
+    }
+    *offset=(int_64bit)offset_value;
+    strncpy(tail_md5,md5_string,md5_len-1);
+    tail_md5[md5_len-1]='\0';
+    return 0;
+}
+
+/*
+ * Build the ssh command line that prints the size of the remote mon_data, the
+ * md5 of the bytes matching the recorded tail, and the bytes appended after
+ * the synced offset, to the out_file. No shell variables are used, so the
+ * quoting works for both sh and cmd.
+ * The caller *MUST* call release_ssh_identity(privkey_temp) after running it.
+ * return 1: no valid sync state, use the full copy
+ * return <0: failed to get the ssh target
+ * return 0: normal exit
+ */
+int mon_tail_cmdline(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* mon_data_file, char* out_file, char* cmdline, unsigned int maxlen, char* privkey_temp, unsigned int temp_len){
+    char remote_address[32]="";
+    char mux_options[LINE_LENGTH_SHORT]="";
+    char identity_option[LINE_LENGTH_SHORT]="";
+    char tail_md5[64]="";
+    int_64bit offset;
+    int window,run_flag;
+    strcpy(privkey_temp,"");
+    if(mon_sync_state(mon_data_file,&offset,&window,tail_md5,64)!=0){
+        return 1;
+    }
+    get_ssh_mux_options(mux_options,LINE_LENGTH_SHORT);
+    run_flag=get_ssh_target(workdir,crypto_keyfile,sshkey_dir,"root",remote_address,32,identity_option,LINE_LENGTH_SHORT,privkey_temp,temp_len);
+    if(run_flag!=0){
+        return run_flag;
+    }
+    snprintf(cmdline,maxlen-1,"ssh %s -n -o StrictHostKeyChecking=no %s root@%s \"wc -c < /hpc_data/cluster_data/mon_data.csv && tail -c +%lld /hpc_data/cluster_data/mon_data.csv | head -c %d | md5sum | cut -c1-32 && tail -c +%lld /hpc_data/cluster_data/mon_data.csv\" > %s 2>>%s",mux_options,identity_option,remote_address,(long long)(offset-window+1),window,(long long)(offset+1),out_file,SYSTEM_CMD_ERROR_LOG);
+    return 0;
+}
+
+/*
+ * Append the new bytes in the out_file of a mon_tail_cmdline run to the local
+ * mon_data file, if the remote file is not shorter than the synced offset and
+ * its bytes at the recorded tail have the same md5, i.e. it was not truncated
+ * or rotated. The sync state is updated.
+ * return 1: not applicable, a full sync is needed
+ * return 0: normal exit
+ */
+int mon_tail_apply(char* mon_data_file, char* out_file){
+    char size_string[32]="";
+    char remote_md5[64]="";
+    char tail_md5[64]="";
+    char buffer[65536];
+    int_64bit offset;
+    int window;
+    size_t read_size;
+    FILE* file_p=NULL;
+    FILE* data_p=NULL;
+    if(mon_sync_state(mon_data_file,&offset,&window,tail_md5,64)!=0){
+        return 1;
+    }
+    file_p=fopen(out_file,"rb");
+    if(file_p==NULL){
+        return 1;
+    }
+    if(fngetline(file_p,size_string,32)!=0||fngetline(file_p,remote_md5,64)!=0||strtoll(size_string,NULL,10)<offset||strcmp(remote_md5,tail_md5)!=0){
+        fclose(file_p);
+        return 1;
+    }
+    data_p=fopen(mon_data_file,"ab");
+    if(data_p==NULL){
+        fclose(file_p);
+        return 1;
+    }
+    while((read_size=fread(buffer,1,65536,file_p))>0){
+        fwrite(buffer,1,read_size,data_p);
+    }
+    fclose(data_p);
+    fclose(file_p);
+    mon_sync_record(mon_data_file);
+    return 0;
+}
+
+/*
+ * Sync the mon_data of a cluster to the local file: only the appended bytes
+ * if synced before, otherwise (or if the remote file was truncated or rotated)
+ * the whole file.
+ * return 1: failed
+ * return 0: normal exit
+ */
+int mon_data_sync(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* mon_data_file){
+    char out_file[FILENAME_LENGTH]="";
+    char cmdline[CMDLINE_LENGTH]="";
+    char privkey_temp[FILENAME_LENGTH_EXT]="";
+    char randstr[7]="";
+    int run_flag=1;
+    trace_span span;
+    trace_span_start(&span,"mon_data_sync");
+    generate_random_nstring(randstr,7,1);
+    snprintf(out_file,FILENAME_LENGTH-1,"%smon_tail_%s.out",NOW_TMP_DIR,randstr);
+    if(mon_tail_cmdline(workdir,crypto_keyfile,sshkey_dir,mon_data_file,out_file,cmdline,CMDLINE_LENGTH,privkey_temp,FILENAME_LENGTH_EXT)==0){
+        run_flag=system(cmdline);
+        release_ssh_identity(privkey_temp);
+        if(run_flag==0){
+            run_flag=mon_tail_apply(mon_data_file,out_file);
+        }
+    }
+    rm_file_or_dir(out_file);
+    if(run_flag!=0){
+        run_flag=remote_copy(workdir,crypto_keyfile,sshkey_dir,mon_data_file,"/hpc_data/cluster_data/mon_data.csv","root","get","",0);
+        mon_sync_record(mon_data_file);
+    }
+    trace_span_end(&span,run_flag);
+    return (run_flag==0)?0:1;
+}
+
 int valid_time_format_or_not(char* datetime_input, int extend_flag, char* date_string, char* time_string){
     char ymd[32]="";
     char year[8]="";
@@ -164,12 +463,13 @@ int valid_time_format_or_not(char* datetime_input, int extend_flag, char* date_s
     return i;
 }
 
-int show_cluster_mon_data(char* cluster_name, char* crypto_keyfile, char* sshkey_dir, char* node_name_list, char* start_datetime, char* end_datetime, char* interval, char* view_option, char* export_dest){
+int show_cluster_mon_data(char* cluster_name, char* crypto_keyfile, char* sshkey_dir, char* node_name_list, char* start_datetime, char* end_datetime, char* interval, char* stat_option, char* view_option, char* export_dest){
     if(cluster_name_check(cluster_name)!=-7){
         return -3;
     }
     char cluster_mon_data_file[FILENAME_LENGTH]="";
     char mon_data_file_temp[FILENAME_LENGTH]="";
+    char store_dir[FILENAME_LENGTH]="";
     char cmdline[CMDLINE_LENGTH]="";
     char mon_data_line[LINE_LENGTH_SHORT]="";
     char randstr[8]="";
@@ -177,22 +477,27 @@ int show_cluster_mon_data(char* cluster_name, char* crypto_keyfile, char* sshkey
     char start_time[32]="";
     char end_date[32]="";
     char end_time[32]="";
-    char temp_date[32]="";
-    char temp_time_final[40]="";
-    char temp_time[30]="";
+    char* fields[4];
     char node_name_list_converted[256][16]={""};
     char real_export_dest[DIR_LENGTH_EXT]="";
     char export_file[FILENAME_LENGTH]="";
     char node_name_temp[32]="";
     int node_filter_flag;
     int interval_num;
+    int interval_flag=0;
+    int tier;
     int i;
     time_t time1;
     time_t time2;
-    time_t time_tmp;
+    int_64bit time_tmp;
     struct tm time_tm1;
     struct tm time_tm2;
-    struct tm time_tm_tmp;
+    date_epoch_cache date_cache;
+    mon_node_hset* filter_hset=NULL;
+    mon_node_hset* minute_hset=NULL;
+    int_64bit* node_minutes=NULL; /* The minute of the last row taken for each node */
+    int node_seen=0;
+    int node_id;
     
     FILE* file_p=NULL;
     FILE* file_p_2=NULL;
@@ -281,50 +586,133 @@ int show_cluster_mon_data(char* cluster_name, char* crypto_keyfile, char* sshkey
     }
 
     interval_num=string_to_positive_num(interval);
-    if(interval_num<1){
+    if(interval_num<1&&strcmp(stat_option,"stat")==0){
+        printf(WARN_YELLO_BOLD "[ -WARN- ] No valid interval specified. Will use the default bucket 60 mins." RESET_DISPLAY "\n");
+        interval_num=60;
+    }
+    else if(interval_num<1){
         printf(WARN_YELLO_BOLD "[ -WARN- ] No valid interval specified. Will use the default interval 5 mins." RESET_DISPLAY "\n");
         interval_num=5;
     }
     else{
         printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Using the specified interval " HIGH_CYAN_BOLD "%d" RESET_DISPLAY " mins.\n",interval_num);
+        interval_flag=1;
     }
 
+    mon_store_dir(cluster_name,store_dir,FILENAME_LENGTH);
+    /* The statistics are only aggregated from the columnar store */
+    if(strcmp(stat_option,"stat")==0){
+        if(mon_store_update(cluster_mon_data_file,store_dir)!=0||mon_store_stat(store_dir,node_name_list_converted,node_filter_flag,time1,time2,interval_num*60,file_p_2)<0){
+            printf(FATAL_RED_BOLD "[ FATAL: ] Failed to aggregate the monitor data of cluster " WARN_YELLO_BOLD "%s" RESET_DISPLAY FATAL_RED_BOLD" ." RESET_DISPLAY "\n", cluster_name);
+            fclose(file_p_2);
+            return -7;
+        }
+        printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Showing the avg/max/p95 per node and for the cluster in each bucket.\n");
+        fclose(file_p_2);
+        goto show_data;
+    }
     file_p=fopen(cluster_mon_data_file,"r");
     fngetline(file_p,mon_data_line,LINE_LENGTH_SHORT);
     fngetline(file_p,mon_data_line,LINE_LENGTH_SHORT);
     fprintf(file_p_2,"%s\n",mon_data_line);
-    while(!feof(file_p)){
-        fngetline(file_p,mon_data_line,LINE_LENGTH_SHORT);
-        get_seq_nstring(mon_data_line,',',1,temp_date,32);
-        get_seq_nstring(mon_data_line,',',2,temp_time,30);
-        snprintf(temp_time_final,39,"%s:0",temp_time);
-        datetime_to_num(temp_date,temp_time_final,&time_tm_tmp);
-        time_tmp=mktime(&time_tm_tmp);
+    /*
+     * Query the columnar store, scan the csv only if the store is not available.
+     * The rollup averages are only shown for a specified interval, the default view
+     * and the export keep the raw rows.
+     */
+    if(mon_store_update(cluster_mon_data_file,store_dir)==0){
+        tier=(interval_flag==1&&strlen(export_dest)==0)?mon_store_tier_choose(time1,interval_num*60):-1;
+        if(tier<0&&mon_store_export(store_dir,cluster_mon_data_file,node_name_list_converted,node_filter_flag,time1,time2,interval_num*60,file_p_2)>-1){
+            fclose(file_p);
+            fclose(file_p_2);
+            goto show_data;
+        }
+        if(tier>-1&&mon_store_export_rollup(store_dir,node_name_list_converted,node_filter_flag,time1,time2,interval_num*60,tier,file_p_2)>-1){
+            printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Showing the averages per interval from the " HIGH_CYAN_BOLD "%s" RESET_DISPLAY " rollups.\n",mon_store_rollup_names[tier]);
+            fclose(file_p);
+            fclose(file_p_2);
+            goto show_data;
+        }
+    }
+    /*
+     * The rows are filtered by integers, the time of the row and the node id in the hash set.
+     * The agents in the push mode write a row every few seconds, the first row of each node
+     * per minute is taken.
+     */
+    minute_hset=(mon_node_hset*)malloc(sizeof(mon_node_hset));
+    node_minutes=(int_64bit*)malloc(sizeof(int_64bit)*MON_STORE_NODES_MAX);
+    if(minute_hset==NULL||node_minutes==NULL){
+        free(minute_hset);
+        free(node_minutes);
+        fclose(file_p);
+        fclose(file_p_2);
+        return -1;
+    }
+    mon_node_hset_reset(minute_hset);
+    if(node_filter_flag>0){
+        filter_hset=(mon_node_hset*)malloc(sizeof(mon_node_hset));
+        if(filter_hset==NULL){
+            free(minute_hset);
+            free(node_minutes);
+            fclose(file_p);
+            fclose(file_p_2);
+            return -1;
+        }
+        mon_node_hset_reset(filter_hset);
+        for(i=0;i<node_filter_flag;i++){
+            mon_node_hset_add(filter_hset,node_name_list_converted[i],i);
+        }
+    }
+    date_epoch_cache_reset(&date_cache);
+    while(fngetline(file_p,mon_data_line,LINE_LENGTH_SHORT)!=1){
+        fields[0]=mon_data_line;
+        for(i=1;i<4;i++){
+            fields[i]=strchr(fields[i-1],',');
+            if(fields[i]==NULL){
+                break;
+            }
+            fields[i]++;
+        }
+        if(i<4){
+            continue;
+        }
+        time_tmp=datetime_fast_epoch(fields[0],fields[1],&date_cache);
         if(time_tmp<time1){
             continue;
         }
-        else if(time_tmp<time2||time_tmp==time2){
-            if((time_tmp-time1)%(interval_num*60)!=0){
+        if(time_tmp>time2){
+            break;
+        }
+        if((time_tmp-time1)%(interval_num*60)!=0){
+            continue;
+        }
+        for(i=0;i<31&&fields[3][i]!=','&&fields[3][i]!='\0';i++){
+            node_name_temp[i]=fields[3][i];
+        }
+        node_name_temp[i]='\0';
+        if(node_filter_flag>0&&mon_node_hset_get(filter_hset,node_name_temp)<0){
+            continue;
+        }
+        node_id=mon_node_hset_get(minute_hset,node_name_temp);
+        if(node_id<0&&node_seen<MON_STORE_NODES_MAX&&mon_node_hset_add(minute_hset,node_name_temp,node_seen)==0){
+            node_id=node_seen;
+            node_minutes[node_id]=-1;
+            node_seen++;
+        }
+        if(node_id>-1){
+            if(node_minutes[node_id]==time_tmp){
                 continue;
             }
-            if(node_filter_flag==-1){
-                fprintf(file_p_2,"%s\n",mon_data_line);
-            }
-            else{
-                get_seq_nstring(mon_data_line,',',4,node_name_temp,32);
-                for(i=0;i<node_filter_flag;i++){
-                    if(strcmp(node_name_temp,node_name_list_converted[i])==0){
-                        fprintf(file_p_2,"%s\n",mon_data_line);
-                    }
-                }
-            }
-        }
-        else{
-            break;
+            node_minutes[node_id]=time_tmp;
         }
+        fprintf(file_p_2,"%s\n",mon_data_line);
     }
+    free(filter_hset);
+    free(minute_hset);
+    free(node_minutes);
     fclose(file_p);
     fclose(file_p_2);
+show_data:
     if(strcmp(view_option,"print")==0){
         snprintf(cmdline,CMDLINE_LENGTH-1,"%s %s",CAT_FILE_CMD,mon_data_file_temp);
     }
@@ -10,7 +10,13 @@
 
 int get_cluster_mon_data(char* cluster_name, char* crypto_keyfile, char* sshkey_dir, char* mon_data_file);
 int update_all_mon_data(char* cluster_registry, char* crypto_keyfile, char* sshkey_dir);
+int mon_tail_md5(char* filename, int_64bit offset, int window, char* md5_string, unsigned int len);
+int mon_sync_record(char* mon_data_file);
+int mon_sync_state(char* mon_data_file, int_64bit* offset, int* window, char* tail_md5, unsigned int md5_len);
+int mon_tail_cmdline(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* mon_data_file, char* out_file, char* cmdline, unsigned int maxlen, char* privkey_temp, unsigned int temp_len);
+int mon_tail_apply(char* mon_data_file, char* out_file);
+int mon_data_sync(char* workdir, char* crypto_keyfile, char* sshkey_dir, char* mon_data_file);
 int valid_time_format_or_not(char* datetime_input, int extend_flag, char* date_string, char* time_string);
-int show_cluster_mon_data(char* cluster_name, char* crypto_keyfile, char* sshkey_dir, char* node_name_list, char* start_datetime, char* end_datetime, char* interval, char* view_option, char* export_dest);
+int show_cluster_mon_data(char* cluster_name, char* crypto_keyfile, char* sshkey_dir, char* node_name_list, char* start_datetime, char* end_datetime, char* interval, char* stat_option, char* view_option, char* export_dest);
 
 #endif
\ No newline at end of file
@@ -23,17 +23,45 @@
 #define RESET_DISPLAY    "\033[0m"
 
 /* Define the tf configuration */
+#define TF_CLOUD_NUM     7 /* CLOUD_A ~ CLOUD_G */
 typedef struct{
     char tf_runner_type[16];
     char tf_runner[256];
     char dbg_level[128];
     int max_wait_time;
+    char parallel_mode[16]; /* fixed or adaptive */
+    int parallelism[TF_CLOUD_NUM][2]; /* Per-cloud profiles, 0: apply, 1: destroy */
 } tf_exec_config;
 
 /* As we know, Windows use long long as 8-byte, *nix use long OR long long as 8-byte.
  * But here we chose long long int, not long */
 typedef signed long long int int_64bit;
 
+/* Define the timing span of a phase, used by the per-phase trace */
+typedef struct{
+    char phase[32];
+    int_64bit start_ms;
+    int_64bit start_epoch;
+} trace_span;
+
+/* The local midnight of the last date parsed, see datetime_fast_epoch() */
+typedef struct{
+    int year;
+    int month;
+    int mday;
+    int_64bit midnight;
+    int_64bit day_seconds; /* 86400, or 82800/90000 on the DST switch days */
+} date_epoch_cache;
+
+/* A record of the operator metrics state, see update_operator_metrics() */
+typedef struct{
+    char kind[16];
+    char name[64];
+    char label[32];
+    int_64bit values[3];
+    int_64bit updated;
+} operator_metric;
+
 #define CONFIRM_STRING               "y-e-s"
 #define CONFIRM_STRING_QUICK         "y"
 #define GFUNC_FILE_SUFFIX            ".gfuncs"
@@ -41,9 +69,14 @@ typedef signed long long int int_64bit;
 #define SPECIAL_PASSWORD_CHARS_SHORT "~@&(){}[]="
 #define TRANSFER_HEADER              "EXPORTED AND TO BE IMPORTED BY HPC-NOW SERVICES"
 #define INTERNAL_FILE_HEADER         "---GENERATED AND MAINTAINED BY HPC-NOW SERVICES INTERNALLY---"
+#define COMPUTE_POOL_STACK           "hpc_stack_compute_pool.tf"
+#define COMPUTE_POOL_NODES           "hpc_stack_compute_nodes.tf"
+#define COMPUTE_POOL_MOVED           "hpc_stack_compute_moved.tf"
 
 /* You can modify the MAXIMUM_ADD_NODE_NUMBER to allow adding more nodes in one command */
 #define MAXIMUM_ADD_NODE_NUMBER  64
+/* In the compute pool layout, nodes are map entries rather than files, so the limit is much larger */
+#define MAXIMUM_ADD_NODE_NUMBER_POOL 1024
 #define MINIMUM_ADD_NODE_NUMBER  1
 #define MAXIMUM_ADD_USER_NUMBER  32
 #define MINIMUM_ADD_USER_NUNMBER 2
@@ -92,9 +125,13 @@ typedef signed long long int int_64bit;
 #define NOW_LOG_DIR                  HPC_NOW_ROOT_DIR"now_logs\\"
 #define NOW_MON_DIR                  HPC_NOW_ROOT_DIR"mon_data\\"
 #define NOW_TMP_DIR                  HPC_NOW_ROOT_DIR".tmp\\"
+#define XFER_JOURNAL_DIR             NOW_TMP_DIR"xfer_journal\\"
 #define USAGE_LOG_FILE               NOW_LOG_DIR"now-cluster-usage.log"
 #define OPERATION_LOG_FILE           NOW_LOG_DIR"now-cluster-operation.log"
 #define SYSTEM_CMD_ERROR_LOG         NOW_LOG_DIR"system_command_error.log"
+#define OPERATION_TRACE_LOG          NOW_LOG_DIR"now-cluster-trace.log"
+#define OPERATOR_METRICS_STATE       NOW_LOG_DIR"now-operator-metrics.dat"
+#define OPERATOR_METRICS_FILE        NOW_LOG_DIR"now-operator-metrics.prom"
 
 #define SYSTEM_CMD_REDIRECT          ">nul 2>>"SYSTEM_CMD_ERROR_LOG
 #define SYSTEM_CMD_REDIRECT_NULL     ">nul 2>&1"
@@ -113,6 +150,10 @@ typedef signed long long int int_64bit;
 #define ALL_CLUSTER_REGISTRY         GENERAL_CONF_DIR"all_clusters.dat"
 #define CURRENT_CLUSTER_INDICATOR    GENERAL_CONF_DIR"current_cluster.dat"
 #define TF_RUNNING_CONFIG            GENERAL_CONF_DIR"tf_running.conf"
+#define SSH_MUX_CONF                 GENERAL_CONF_DIR"ssh_mux.conf"
+#define TRANSFER_CONF                GENERAL_CONF_DIR"transfer.conf"
+#define S3_ENGINE_CONF               GENERAL_CONF_DIR"s3_engine.conf"
+#define MON_STORE_CONF               GENERAL_CONF_DIR"mon_store.conf"
 
 #define NOW_CRYPTO_EXEC              NOW_BINARY_DIR"now-crypto-aes.exe"
 #define TERRAFORM_EXEC               NOW_BINARY_DIR"terraform.exe"
@@ -135,6 +176,8 @@ typedef signed long long int int_64bit;
 #define GREP_CMD                 "findstr"
 #define SET_ENV_CMD              "set"
 #define START_BG_JOB             "start /b"
+#define START_BG_SHELL           "start /b cmd /c \""
+#define END_BG_SHELL             "\""
 #define MKDIR_CMD                "mkdir"
 #define EDITOR_CMD               "notepad"
 #define CLEAR_SCREEN_CMD         "cls"
@@ -170,9 +213,17 @@ typedef signed long long int int_64bit;
 #define NOW_LOG_DIR                  HPC_NOW_ROOT_DIR"now_logs/"
 #define NOW_MON_DIR                  HPC_NOW_ROOT_DIR"mon_data/"
 #define NOW_TMP_DIR                  HPC_NOW_ROOT_DIR".tmp/"
+#define XFER_JOURNAL_DIR             NOW_TMP_DIR"xfer_journal/"
+#define SSH_MUX_DIR                  NOW_TMP_DIR"ssh_mux/"
+#define KEY_BROKER_DIR               NOW_TMP_DIR"key_broker/"
+#define SHA256SUM_CMD                "sha256sum"
+#define MD5SUM_CMD                   "md5sum"
 #define USAGE_LOG_FILE               NOW_LOG_DIR"now-cluster-usage.log"
 #define OPERATION_LOG_FILE           NOW_LOG_DIR"now-cluster-operation.log"
 #define SYSTEM_CMD_ERROR_LOG         NOW_LOG_DIR"system_command_error.log"
+#define OPERATION_TRACE_LOG          NOW_LOG_DIR"now-cluster-trace.log"
+#define OPERATOR_METRICS_STATE       NOW_LOG_DIR"now-operator-metrics.dat"
+#define OPERATOR_METRICS_FILE        NOW_LOG_DIR"now-operator-metrics.prom"
 
 #define SYSTEM_CMD_REDIRECT          ">>/dev/null 2>>"SYSTEM_CMD_ERROR_LOG
 #define SYSTEM_CMD_REDIRECT_NULL     ">>/dev/null 2>&1"
@@ -191,6 +242,10 @@ typedef signed long long int int_64bit;
 #define ALL_CLUSTER_REGISTRY         GENERAL_CONF_DIR".all_clusters.dat"
 #define CURRENT_CLUSTER_INDICATOR    GENERAL_CONF_DIR"current_cluster.dat"
 #define TF_RUNNING_CONFIG            GENERAL_CONF_DIR"tf_running.conf"
+#define SSH_MUX_CONF                 GENERAL_CONF_DIR"ssh_mux.conf"
+#define TRANSFER_CONF                GENERAL_CONF_DIR"transfer.conf"
+#define S3_ENGINE_CONF               GENERAL_CONF_DIR"s3_engine.conf"
+#define MON_STORE_CONF               GENERAL_CONF_DIR"mon_store.conf"
 
 #define NOW_CRYPTO_EXEC              NOW_BINARY_DIR"now-crypto-aes.exe"
 #define TERRAFORM_EXEC               NOW_BINARY_DIR"terraform"
@@ -213,6 +268,8 @@ typedef signed long long int int_64bit;
 #define GREP_CMD                 "grep"
 #define SET_ENV_CMD              "export"
 #define START_BG_JOB             ""
+#define START_BG_SHELL           "("
+#define END_BG_SHELL             ") &"
 #define MKDIR_CMD                "mkdir -p"
 #define EDITOR_CMD               "vi"
 #define CLEAR_SCREEN_CMD         "clear"
@@ -248,9 +305,17 @@ typedef signed long long int int_64bit;
 #define NOW_LOG_DIR                  HPC_NOW_ROOT_DIR"now_logs/"
 #define NOW_MON_DIR                  HPC_NOW_ROOT_DIR"mon_data/"
 #define NOW_TMP_DIR                  HPC_NOW_ROOT_DIR".tmp/"
+#define XFER_JOURNAL_DIR             NOW_TMP_DIR"xfer_journal/"
+#define SSH_MUX_DIR                  NOW_TMP_DIR"ssh_mux/"
+#define KEY_BROKER_DIR               NOW_TMP_DIR"key_broker/"
+#define SHA256SUM_CMD                "shasum -a 256"
+#define MD5SUM_CMD                   "md5 -q"
 #define USAGE_LOG_FILE               NOW_LOG_DIR"now-cluster-usage.log"
 #define OPERATION_LOG_FILE           NOW_LOG_DIR"now-cluster-operation.log"
 #define SYSTEM_CMD_ERROR_LOG         NOW_LOG_DIR"system_command_error.log"
+#define OPERATION_TRACE_LOG          NOW_LOG_DIR"now-cluster-trace.log"
+#define OPERATOR_METRICS_STATE       NOW_LOG_DIR"now-operator-metrics.dat"
+#define OPERATOR_METRICS_FILE        NOW_LOG_DIR"now-operator-metrics.prom"
 
 #define SYSTEM_CMD_REDIRECT          ">>/dev/null 2>>"SYSTEM_CMD_ERROR_LOG
 #define SYSTEM_CMD_REDIRECT_NULL     ">>/dev/null 2>&1"
@@ -269,6 +334,10 @@ typedef signed long long int int_64bit;
 #define ALL_CLUSTER_REGISTRY         GENERAL_CONF_DIR".all_clusters.dat"
 #define CURRENT_CLUSTER_INDICATOR    GENERAL_CONF_DIR"current_cluster.dat"
 #define TF_RUNNING_CONFIG            GENERAL_CONF_DIR"tf_running.conf"
+#define SSH_MUX_CONF                 GENERAL_CONF_DIR"ssh_mux.conf"
+#define TRANSFER_CONF                GENERAL_CONF_DIR"transfer.conf"
+#define S3_ENGINE_CONF               GENERAL_CONF_DIR"s3_engine.conf"
+#define MON_STORE_CONF               GENERAL_CONF_DIR"mon_store.conf"
 
 #define NOW_CRYPTO_EXEC              NOW_BINARY_DIR"now-crypto-aes.exe"
 #define TERRAFORM_EXEC               NOW_BINARY_DIR"terraform"
@@ -291,6 +360,8 @@ typedef signed long long int int_64bit;
 #define GREP_CMD                 "grep"
 #define SET_ENV_CMD              "export"
 #define START_BG_JOB             ""
+#define START_BG_SHELL           "("
+#define END_BG_SHELL             ") &"
 #define MKDIR_CMD                "mkdir -p"
 #define EDITOR_CMD               "vi"
 #define CLEAR_SCREEN_CMD         "clear"
@@ -351,13 +422,15 @@ typedef signed long long int int_64bit;
 
 #define AKSK_LENGTH               256
 #define CONF_STRING_LENTH         64
-#define COMMAND_NUM               54
+#define COMMAND_NUM               56
 #define DATAMAN_COMMAND_NUM       17
+#define TRACE_PROFILE_GROUP_MAX   128
+#define OPERATOR_METRICS_MAX      1024 /* Records of the operator metrics state */
 #define COMMAND_STRING_LENGTH_MAX 64
 #define SUBCMD_STRING_LENGTH_MAX  32
 #define CONF_LINE_NUM             11
-#define CMD_FLAG_NUM              30
-#define CMD_KWDS_NUM              49
+#define CMD_FLAG_NUM              37
+#define CMD_KWDS_NUM              55
 #define VERS_SHA_LINES            11
 
 /* Internal macros - usually you don't need to modify the macros in this section.*/
@@ -372,5 +445,74 @@ typedef signed long long int int_64bit;
 #define ALI_SLEEP_TIME         60
 #define QCLOUD_SLEEP_TIME      60
 #define GENERAL_SLEEP_TIME     30
+#define LOG_ARCHIVE_SIZE_MAX      67108864 /* Rotate a log archive once it exceeds 64 MiB ... */
+#define LOG_ARCHIVE_AGE_DAYS      30       /* ... or its first run is older than 30 days. */
+#define LOG_ARCHIVE_SEGMENTS_MAX  8        /* Rotated segments to keep for each log archive. */
+#define LOG_ARCHIVE_COMPRESS      1        /* 1: compress the rotated segments with tar -z. */
+#define LOG_COPY_BUFFER           16384
+#define TF_PARALLELISM_DEFAULT    1000
+#define TF_PARALLELISM_LIMITED    50   /* For the clouds with tight per-account API rate limits */
+#define TF_PARALLELISM_MIN        5
+#define SSH_MUX_IDLE_DEFAULT      600  /* Idle seconds before a multiplexed ssh master connection exits */
+#define KEY_BROKER_LIFETIME       3600 /* Seconds a decrypted key stays in the key broker agent */
+/* Both can be raised at build time, e.g. -DREMOTE_BATCH_OUTPUT_LENGTH=8192. Longer outputs should be streamed. */
+#ifndef REMOTE_BATCH_STEPS_MAX
+#define REMOTE_BATCH_STEPS_MAX    16
+#endif
+#ifndef REMOTE_BATCH_OUTPUT_LENGTH
+#define REMOTE_BATCH_OUTPUT_LENGTH 1024 /* Captured output kept for each step of a remote batch */
+#endif
+#define FANOUT_CONCURRENCY_DEFAULT 8
+#define FANOUT_TIMEOUT_DEFAULT    50   /* Seconds, fits in a 1-minute collection window */
+#define MON_SYNC_TAIL_BYTES       4096 /* The tail of the local mon_data compared with the remote one before appending */
+#define MON_STORE_COLUMNS         13   /* The numeric columns of a mon_data line after date,time_m,time_s,node_name */
+#define MON_STORE_STRIDE          1024 /* Rows between two entries of the sparse time index */
+#define MON_STORE_BATCH           16384 /* Rows parsed before flushing to the column files */
+#define MON_STORE_NODES_MAX       4096
+#define MON_NODE_HASH_SLOTS       8192 /* A power of 2, twice the nodes to keep the probes short */
+#define MON_STORE_ROLLUPS         3    /* The 5m, 1h and 1d rollup tiers after the raw one */
+#define MON_STORE_VERSION         2    /* In the meta of a store, the stores of other versions are rebuilt */
+#define MON_5M_DAYS_DEFAULT       365  /* Retention of each rollup tier, 0 keeps it forever */
+#define MON_1H_DAYS_DEFAULT       1825
+#define MON_1D_DAYS_DEFAULT       0
+#define MON_STAT_BINS             1024 /* 0.1% for the utilizations, 1 core for the idle cores */
+#define JOB_ACCT_DAYS_DEFAULT     30   /* Days of Slurm jobs fetched by the first accounting run */
+#define JOB_ACCT_MARGIN           3600 /* Seconds re-fetched before the last job end, for the late records */
+#define JOB_ACCT_TOP_DEFAULT      20
+#define JOB_ACCT_TOP_MAX          1000
+#define JOB_ACCT_NODES_MAX        1024 /* Nodes of a single job */
+#define AUTOSCALE_INTERVAL        60   /* Seconds between two rounds of the autoscale loop */
+#define AUTOSCALE_INTERVAL_MIN    30
+#define AUTOSCALE_MON_WINDOW      300  /* Seconds of the latest monitor data for the idle cores */
+#define AUTOSCALE_MAX_NODES       16
+#define AUTOSCALE_MAX_STEP        4
+#define AUTOSCALE_UP_DELAY        120
+#define AUTOSCALE_DOWN_DELAY      900
+#define AUTOSCALE_UP_COOLDOWN     300
+#define AUTOSCALE_DOWN_COOLDOWN   900
+#define PTX_STREAMS_DEFAULT       8    /* Concurrent streams of a chunked parallel transfer */
+#define PTX_STREAMS_MAX           10   /* The streams share one ssh master, sshd MaxSessions defaults to 10 */
+#define PTX_CHUNK_MB_DEFAULT      64
+#define PTX_CHUNK_MB_MAX          1024
+#define PTX_THRESHOLD_MB_DEFAULT  256  /* Files smaller than this go through a single scp stream */
+#define PTX_CHUNK_TIMEOUT         3600
+#define PTX_RETRY_MAX             2    /* Extra rounds for the chunks failed or mismatched */
+#define ZSTD_STREAM_OPTIONS       "-q -T0 --adapt=min=1,max=15" /* zstd tunes the level to the link speed */
+#define COMPRESS_ENTROPY_MAX      7500 /* Milli-bits per byte, above this the data is taken as compressed */
+#define ENTROPY_SAMPLE_NUM        8
+#define ENTROPY_SAMPLE_SIZE       65536
+#define ENTROPY_SAMPLE_FILES      16   /* Files to sample in a folder */
+#define S3_PART_MB_DEFAULT        16   /* Part size of the native multipart bucket transfers */
+#define S3_PART_MB_MIN            5    /* The S3 API minimum for all but the last part */
+#define S3_PART_MB_MAX            1024
+#define S3_PARTS_MAX              10000
+#define S3_CONCURRENCY_DEFAULT    8
+#define S3_CONCURRENCY_MAX        32
+#define S3_REQUEST_TIMEOUT        1800
+#define S3_BATCH_ITEMS            256  /* Objects handed to the engine per batch of a folder operation */
+#define BUCKET_INDEX_TTL_DEFAULT  600  /* Seconds a listed prefix of the local bucket index is served without listing again */
+#define BUCKET_INDEX_STRIDE       256  /* Objects per offset record of the local bucket index */
+#define BUCKET_INDEX_DELTA_MAX    1048576 /* Bytes of recorded changes before merging them into the local bucket index */
+#define POST_APPLY_WAIT_MAX    180 /* Max seconds to wait for the background push of the post-apply pipeline. */
 
 #endif
\ No newline at end of file
@@ -149,11 +149,11 @@ int now_sha256_for_file(char* input_file, char sha256_string[], int sha256_len){
         return -1;
     }
     while(final_flag==0){
-        if(total_length_byte>FILEIO_BUFFER_SIZE_SHA*(buffer_blocks+1)){
+        if(total_length_byte>(int_64bit)FILEIO_BUFFER_SIZE_SHA*(buffer_blocks+1)){
             buffer_block_length=FILEIO_BUFFER_SIZE_SHA;
         }
         else{
-            buffer_block_length=total_length_byte-FILEIO_BUFFER_SIZE_SHA*buffer_blocks;
+            buffer_block_length=total_length_byte-(int_64bit)FILEIO_BUFFER_SIZE_SHA*buffer_blocks;
             final_flag=1;
         }
         buffer_blocks++;
@@ -187,7 +187,7 @@ int now_sha256_for_file(char* input_file, char sha256_string[], int sha256_len){
                 for(i=read_byte+1;i<56;i++){
                     buffer_8bit[i]=0x00;
                 }
-                padding_length_sha256(buffer_8bit+56,(total_length_byte<<3)&0xFFFFFFFF);
+                padding_length_sha256(buffer_8bit+56,(uint_64bit)total_length_byte<<3);
                 now_sha256_core(state,buffer_8bit);
                 break_flag=3; /* Exit without an extra round. */
                 break;
@@ -214,7 +214,7 @@ int now_sha256_for_file(char* input_file, char sha256_string[], int sha256_len){
     fclose(file_p);
     if(break_flag!=3){
         memcpy(buffer_8bit,padding_sha256,64);
-        padding_length_sha256(buffer_8bit+56,(total_length_byte<<3)&0xFFFFFFFF);
+        padding_length_sha256(buffer_8bit+56,(uint_64bit)total_length_byte<<3);
         if(break_flag==5){
             buffer_8bit[0]=0x00;
         }
@@ -0,0 +1,1289 @@
+/*
+ * Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+ * This code is distributed under the license: MIT License
+ * Originally written by Zhenrong WANG
+ * mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+ */
+
+/*
+ * The native object transfer engine for the S3-compatible APIs of the clouds.
+ * The requests are signed by curl (--aws-sigv4), the parts are transferred by
+ * the concurrent fanout_run tasks, and the results are verified with the
+ * ETags. The vendor CLIs in dataman.c are kept as the fallbacks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#include "now_macros.h"
+#include "now_md5.h"
+#include "general_funcs.h"
+#include "time_process.h"
+#include "cluster_general_funcs.h"
+#include "s3_engine.h"
+
+/*
+ * Read the settings of the native engine from S3_ENGINE_CONF:
+ * engine: native (default) or cli, part_mb: MiB per part, concurrency: the
+ * concurrent requests, endpoint: auto (default) or a scheme://host[:port] to
+ * replace the cloud endpoint, e.g. a local MinIO for tests. An endpoint set
+ * here is addressed in the path style. index_ttl: seconds a listed prefix is
+ * served from the local listing index, 0 disables the index.
+ * Created with the defaults if absent. Invalid values fall back to the defaults.
+ * return 0: use the native engine
+ * return 1: use the vendor CLIs
+ */
+int s3_engine_conf(s3_target* target){
+    char value_string[LINE_LENGTH_SHORT]="";
+    int value;
+    FILE* file_p=NULL;
+    target->part_mb=S3_PART_MB_DEFAULT;
+    target->concurrency=S3_CONCURRENCY_DEFAULT;
+    target->index_ttl=BUCKET_INDEX_TTL_DEFAULT;
+    target->path_style=0;
+    strcpy(target->endpoint,"");
+    strcpy(target->config_file,"");
+    if(file_exist_or_not(S3_ENGINE_CONF)!=0){
+        file_p=fopen(S3_ENGINE_CONF,"w+");
+        if(file_p!=NULL){
+            fprintf(file_p,"engine:  native\npart_mb:  %d\nconcurrency:  %d\nendpoint:  auto\nindex_ttl:  %d\n",S3_PART_MB_DEFAULT,S3_CONCURRENCY_DEFAULT,BUCKET_INDEX_TTL_DEFAULT);
+            fclose(file_p);
+        }
+        return 0;
+    }
+    if(find_and_nget(S3_ENGINE_CONF,LINE_LENGTH_SHORT,"engine:","","",1,"engine:","","",' ',2,value_string,LINE_LENGTH_SHORT)==0&&strcmp(value_string,"cli")==0){
+        return 1;
+    }
+    if(find_and_nget(S3_ENGINE_CONF,LINE_LENGTH_SHORT,"part_mb:","","",1,"part_mb:","","",' ',2,value_string,LINE_LENGTH_SHORT)==0){
+        value=string_to_positive_num(value_string);
+        if(value>0){
+            target->part_mb=(value<S3_PART_MB_MIN)?S3_PART_MB_MIN:((value>S3_PART_MB_MAX)?S3_PART_MB_MAX:value);
+        }
+    }
+    if(find_and_nget(S3_ENGINE_CONF,LINE_LENGTH_SHORT,"concurrency:","","",1,"concurrency:","","",' ',2,value_string,LINE_LENGTH_SHORT)==0){
+        value=string_to_positive_num(value_string);
+        if(value>0){
+            target->concurrency=(value>S3_CONCURRENCY_MAX)?S3_CONCURRENCY_MAX:value;
+        }
+    }
+    if(find_and_nget(S3_ENGINE_CONF,LINE_LENGTH_SHORT,"index_ttl:","","",1,"index_ttl:","","",' ',2,value_string,LINE_LENGTH_SHORT)==0){
+        value=string_to_positive_num(value_string);
+        if(value>=0){
+            target->index_ttl=value;
+        }
+    }
+    if(find_and_nget(S3_ENGINE_CONF,LINE_LENGTH_SHORT,"endpoint:","","",1,"endpoint:","","",' ',2,value_string,LINE_LENGTH_SHORT)==0&&strstr(value_string,"://")!=NULL){
+        value=strlen(value_string);
+        while(value>0&&value_string[value-1]=='/'){
+            value_string[--value]='\0';
+        }
+        strncpy(target->endpoint,value_string,LINE_LENGTH_SHORT-1);
+        target->path_style=1;
+    }
+    return 0;
+}
+
+/*
+ * Fill the target with the bucket info and the S3-compatible endpoint of the
+ * cloud. CLOUD_F (Azure Blob) and CLOUD_G (GCS with service accounts) don't
+ * have a usable S3-compatible API and stay with their CLIs.
+ * return -9: not applicable, use the vendor CLIs
+ * return 0: normal exit
+ */
+int s3_target_init(bucket_info* binfo, char* cloud_flag, s3_target* target){
+#ifdef _WIN32
+    return -9;
+#else
+    char* bucket_name=NULL;
+    int length;
+    if(s3_engine_conf(target)!=0){
+        return -9;
+    }
+    if(strcmp(cloud_flag,"CLOUD_F")==0||strcmp(cloud_flag,"CLOUD_G")==0){
+        return -9;
+    }
+    bucket_name=strstr(binfo->bucket_address,"://");
+    bucket_name=(bucket_name==NULL)?binfo->bucket_address:bucket_name+3;
+    strncpy(target->bucket,bucket_name,127);
+    target->bucket[127]='\0';
+    length=strlen(target->bucket);
+    while(length>0&&target->bucket[length-1]=='/'){
+        target->bucket[--length]='\0';
+    }
+    strncpy(target->region,binfo->region_id,31);
+    target->region[31]='\0';
+    strncpy(target->ak,binfo->bucket_ak,127);
+    target->ak[127]='\0';
+    strncpy(target->sk,binfo->bucket_sk,127);
+    target->sk[127]='\0';
+    if(length==0||strlen(target->region)==0||strlen(target->ak)==0||strlen(target->sk)==0){
+        return -9;
+    }
+    if(target->path_style==1){
+        return s3_target_credentials(target);
+    }
+    if(strcmp(cloud_flag,"CLOUD_A")==0){
+        snprintf(target->endpoint,LINE_LENGTH_SHORT-1,"https://oss-%s.aliyuncs.com",target->region);
+    }
+    else if(strcmp(cloud_flag,"CLOUD_B")==0){
+        snprintf(target->endpoint,LINE_LENGTH_SHORT-1,"https://cos.%s.myqcloud.com",target->region);
+    }
+    else if(strcmp(cloud_flag,"CLOUD_C")==0){
+        if(strncmp(target->region,"cn-",3)==0){
+            snprintf(target->endpoint,LINE_LENGTH_SHORT-1,"https://s3.%s.amazonaws.com.cn",target->region);
+        }
+        else{
+            snprintf(target->endpoint,LINE_LENGTH_SHORT-1,"https://s3.%s.amazonaws.com",target->region);
+        }
+    }
+    else if(strcmp(cloud_flag,"CLOUD_D")==0){
+        snprintf(target->endpoint,LINE_LENGTH_SHORT-1,"https://obs.%s.myhuaweicloud.com",target->region);
+    }
+    else if(strcmp(cloud_flag,"CLOUD_E")==0){
+        snprintf(target->endpoint,LINE_LENGTH_SHORT-1,"https://s3.%s.bcebos.com",target->region);
+    }
+    else{
+        return -9;
+    }
+    return s3_target_credentials(target);
+#endif
+}
+
+/*
+ * Write the credentials to a 0600 curl config file referenced by --config, so
+ * that they are in no command line and no fanout task script. The caller
+ * removes it with s3_target_clear once the target is no longer used.
+ * return -9: failed to write the config file
+ * return 0: normal exit
+ */
+int s3_target_credentials(s3_target* target){
+    char randstr[7]="";
+    char* ptr=NULL;
+    FILE* file_p=NULL;
+    strcpy(target->config_file,"");
+    mk_pdir(NOW_TMP_DIR);
+    generate_random_nstring(randstr,7,1);
+    snprintf(target->config_file,FILENAME_LENGTH-1,"%ss3_%s.cred",NOW_TMP_DIR,randstr);
+    file_p=fopen(target->config_file,"w+");
+    if(file_p==NULL){
+        strcpy(target->config_file,"");
+        return -9;
+    }
+#ifndef _WIN32
+    chmod(target->config_file,S_IRUSR|S_IWUSR);
+#endif
+    /* The quotes and backslashes are escaped in a quoted curl config value */
+    fprintf(file_p,"user = \"");
+    for(ptr=target->ak;*ptr!='\0';ptr++){
+        fprintf(file_p,(*ptr=='"'||*ptr=='\\')?"\\%c":"%c",*ptr);
+    }
+    fprintf(file_p,":");
+    for(ptr=target->sk;*ptr!='\0';ptr++){
+        fprintf(file_p,(*ptr=='"'||*ptr=='\\')?"\\%c":"%c",*ptr);
+    }
+    fprintf(file_p,"\"\n");
+    fclose(file_p);
+    return 0;
+}
+
+void s3_target_clear(s3_target* target){
+    if(strlen(target->config_file)>0){
+        rm_file_or_dir(target->config_file);
+        strcpy(target->config_file,"");
+    }
+}
+
+/*
+ * Percent-encode a key or a query value as the SigV4 canonical form requires.
+ * keep_slash 1: leave the '/' as is, for the keys in the URL paths.
+ */
+void s3_uri_encode(char* source, char* dest, unsigned int maxlen, int keep_slash){
+    const char* hex_chars="0123456789ABCDEF";
+    unsigned char ch;
+    unsigned int i,j=0;
+    for(i=0;i<strlen(source)&&j+4<maxlen;i++){
+        ch=(unsigned char)source[i];
+        if((ch>='A'&&ch<='Z')||(ch>='a'&&ch<='z')||(ch>='0'&&ch<='9')||ch=='-'||ch=='_'||ch=='.'||ch=='~'||(ch=='/'&&keep_slash==1)){
+            dest[j++]=ch;
+        }
+        else{
+            dest[j++]='%';
+            dest[j++]=hex_chars[ch>>4];
+            dest[j++]=hex_chars[ch&0x0F];
+        }
+    }
+    dest[j]='\0';
+}
+
+/*
+ * The URL of an object (or of the bucket with an empty key). The query must be
+ * encoded and sorted by the parameter names, because curl signs it as given.
+ */
+void s3_object_url(s3_target* target, char* key, char* query, char* url, unsigned int maxlen){
+    char encoded_key[FILENAME_LENGTH_EXT]="";
+    char* host=NULL;
+    s3_uri_encode(key,encoded_key,FILENAME_LENGTH_EXT,1);
+    if(target->path_style==1){
+        snprintf(url,maxlen-1,"%s/%s/%s%s%s",target->endpoint,target->bucket,encoded_key,(strlen(query)==0)?"":"?",query);
+    }
+    else{
+        host=strstr(target->endpoint,"://");
+        host=(host==NULL)?target->endpoint:host+3;
+        snprintf(url,maxlen-1,"https://%s.%s/%s%s%s",target->bucket,host,encoded_key,(strlen(query)==0)?"":"?",query);
+    }
+}
+
+void s3_curl_prefix(s3_target* target, char* prefix, unsigned int maxlen){
+    snprintf(prefix,maxlen-1,"curl -s -S --fail --connect-timeout 30 --aws-sigv4 \"aws:amz:%s:s3\" --config \"%s\" -H \"x-amz-content-sha256: UNSIGNED-PAYLOAD\"",target->region,target->config_file);
+}
+
+/*
+ * Get a header of the last response in a header file dumped by curl -D. The
+ * name is case-insensitive, and the quotes around the value are removed.
+ * return -1: failed to open the header file
+ * return 1: header not found
+ * return 0: normal exit
+ */
+int s3_header_value(char* header_file, char* header_name, char* value, unsigned int maxlen){
+    char line_buffer[LINE_LENGTH_SHORT]="";
+    char* value_start=NULL;
+    unsigned int i,name_len=strlen(header_name);
+    int found=1;
+    FILE* file_p=fopen(header_file,"r");
+    if(file_p==NULL){
+        return -1;
+    }
+    strcpy(value,"");
+    while(fngetline(file_p,line_buffer,LINE_LENGTH_SHORT)!=1){
+        if(strlen(line_buffer)<=name_len||line_buffer[name_len]!=':'){
+            continue;
+        }
+        for(i=0;i<name_len;i++){
+            if((line_buffer[i]|0x20)!=(header_name[i]|0x20)){
+                break;
+            }
+        }
+        if(i<name_len){
+            continue;
+        }
+        value_start=line_buffer+name_len+1;
+        while(*value_start==' '){
+            value_start++;
+        }
+        if(*value_start=='\"'&&strlen(value_start)>1&&value_start[strlen(value_start)-1]=='\"'){
+            value_start[strlen(value_start)-1]='\0';
+            value_start++;
+        }
+        strncpy(value,value_start,maxlen-1);
+        value[maxlen-1]='\0';
+        found=0;
+    }
+    fclose(file_p);
+    return found;
+}
+
+/*
+ * Get the value of the first <tag> in the XML text, with the entities decoded
+ * and the quotes around it removed.
+ * return NULL: tag not found
+ * return the position after the closing tag
+ */
+char* s3_xml_value(char* text, char* tag, char* value, unsigned int maxlen){
+    char open_tag[64]="";
+    char close_tag[64]="";
+    char* start=NULL;
+    char* end=NULL;
+    unsigned int i=0,j=0,length;
+    snprintf(open_tag,63,"<%s>",tag);
+    snprintf(close_tag,63,"</%s>",tag);
+    strcpy(value,"");
+    start=strstr(text,open_tag);
+    if(start==NULL){
+        return NULL;
+    }
+    start+=strlen(open_tag);
+    end=strstr(start,close_tag);
+    if(end==NULL){
+        return NULL;
+    }
+    length=end-start;
+    while(i<length&&j<maxlen-1){
+        if(strncmp(start+i,"&amp;",5)==0){
+            value[j++]='&';
+            i+=5;
+        }
+        else if(strncmp(start+i,"&lt;",4)==0){
+            value[j++]='<';
+            i+=4;
+        }
+        else if(strncmp(start+i,"&gt;",4)==0){
+            value[j++]='>';
+            i+=4;
+        }
+        else if(strncmp(start+i,"&quot;",6)==0){
+            value[j++]='\"';
+            i+=6;
+        }
+        else if(strncmp(start+i,"&apos;",6)==0){
+            value[j++]='\'';
+            i+=6;
+        }
+        else{
+            value[j++]=start[i++];
+        }
+    }
+    value[j]='\0';
+    if(j>1&&value[0]=='\"'&&value[j-1]=='\"'){
+        value[j-1]='\0';
+        memmove(value,value+1,j-1);
+    }
+    return end+strlen(close_tag);
+}
+
+/*
+ * Read a whole (response) file to a new buffer. The caller frees it.
+ * return NULL: failed
+ */
+char* s3_file_to_buffer(char* filename){
+    char* buffer=NULL;
+    long file_size;
+    size_t read_size;
+    FILE* file_p=fopen(filename,"rb");
+    if(file_p==NULL){
+        return NULL;
+    }
+    fseek(file_p,0,SEEK_END);
+    file_size=ftell(file_p);
+    fseek(file_p,0,SEEK_SET);
+    if(file_size<0){
+        fclose(file_p);
+        return NULL;
+    }
+    buffer=(char*)malloc(file_size+1);
+    if(buffer==NULL){
+        fclose(file_p);
+        return NULL;
+    }
+    read_size=fread(buffer,1,file_size,file_p);
+    buffer[read_size]='\0';
+    fclose(file_p);
+    return buffer;
+}
+
+/*
+ * The md5 of a range of a file, the offset and length in MiB. Not for Windows.
+ * return 1: failed
+ * return 0: normal exit
+ */
+int s3_range_md5(char* filename, int skip_mb, int count_mb, char* md5_string, unsigned int len){
+#ifdef _WIN32
+    return 1;
+#else
+    char randstr[7]="";
+    char md5_file[FILENAME_LENGTH]="";
+    char cmdline[CMDLINE_LENGTH]="";
+    FILE* file_p=NULL;
+    strcpy(md5_string,"");
+    generate_random_nstring(randstr,7,1);
+    snprintf(md5_file,FILENAME_LENGTH-1,"%ss3_range_%s.md5",NOW_TMP_DIR,randstr);
+    snprintf(cmdline,CMDLINE_LENGTH-1,"dd if=\"%s\" bs=1048576 skip=%d count=%d 2>/dev/null | %s | cut -c1-32 > %s",filename,skip_mb,count_mb,MD5SUM_CMD,md5_file);
+    if(system(cmdline)!=0){
+        rm_file_or_dir(md5_file);
+        return 1;
+    }
+    file_p=fopen(md5_file,"r");
+    if(file_p!=NULL){
+        fngetline(file_p,md5_string,len);
+        fclose(file_p);
+    }
+    rm_file_or_dir(md5_file);
+    return (strlen(md5_string)==32)?0:1;
+#endif
+}
+
+/*
+ * The ETag of a multipart object: the md5 of the concatenated binary md5s of
+ * the parts, then '-' and the part number. md5_list holds the hex md5s of the
+ * parts without separators.
+ * return -1: invalid md5 list or failed to write the temp file
+ * return 0: normal exit
+ */
+int s3_composite_etag(char* md5_list, int part_num, char* etag, unsigned int len){
+    char randstr[7]="";
+    char bin_file[FILENAME_LENGTH]="";
+    char md5_string[64]="";
+    unsigned int byte_value;
+    int i;
+    FILE* file_p=NULL;
+    strcpy(etag,"");
+    if(part_num<1||strlen(md5_list)!=(unsigned int)part_num*32){
+        return -1;
+    }
+    generate_random_nstring(randstr,7,1);
+    snprintf(bin_file,FILENAME_LENGTH-1,"%ss3_etag_%s.bin",NOW_TMP_DIR,randstr);
+    file_p=fopen(bin_file,"wb");
+    if(file_p==NULL){
+        return -1;
+    }
+    for(i=0;i<part_num*16;i++){
+        if(sscanf(md5_list+i*2,"%2x",&byte_value)!=1){
+            fclose(file_p);
+            rm_file_or_dir(bin_file);
+            return -1;
+        }
+        fputc((int)byte_value,file_p);
+    }
+    fclose(file_p);
+    i=now_md5_for_file(bin_file,md5_string,64);
+    rm_file_or_dir(bin_file);
+    if(i!=0){
+        return -1;
+    }
+    snprintf(etag,len-1,"%s-%d",md5_string,part_num);
+    return 0;
+}
+
+/*
+ * The Content-MD5 header value of a hex md5: the base64 of the binary md5. The
+ * server rejects the request if the body doesn't match, so the check works
+ * with any ETag, including the non-md5 ones of the encrypted objects.
+ * return -1: invalid md5 or buffer too small
+ * return 0: normal exit
+ */
+int s3_content_md5(char* md5_string, char* content_md5, unsigned int len){
+    const char* base64_table="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned char md5_bin[18];
+    unsigned int byte_value;
+    int i,j=0;
+    strcpy(content_md5,"");
+    if(len<25||strlen(md5_string)!=32){
+        return -1;
+    }
+    for(i=0;i<16;i++){
+        if(sscanf(md5_string+i*2,"%2x",&byte_value)!=1){
+            return -1;
+        }
+        md5_bin[i]=(unsigned char)byte_value;
+    }
+    md5_bin[16]=0;
+    md5_bin[17]=0;
+    for(i=0;i<16;i+=3){
+        content_md5[j++]=base64_table[md5_bin[i]>>2];
+        content_md5[j++]=base64_table[((md5_bin[i]&0x03)<<4)|(md5_bin[i+1]>>4)];
+        content_md5[j++]=base64_table[((md5_bin[i+1]&0x0F)<<2)|(md5_bin[i+2]>>6)];
+        content_md5[j++]=base64_table[md5_bin[i+2]&0x3F];
+    }
+    /* 16 bytes leave 1 byte in the last group, so the last 2 chars are the padding. */
+    content_md5[22]='=';
+    content_md5[23]='=';
+    content_md5[24]='\0';
+    return 0;
+}
+
+/*
+ * Verify a local file with the ETag of its object. A multipart ETag can only be
+ * verified if it has the same part number as the part_mb gives.
+ * return 1: mismatch
+ * return 2: not verifiable (unknown part size, or not an md5 ETag)
+ * return 0: verified
+ */
+int s3_etag_check(char* local_file, int_64bit size, char* etag, int part_mb){
+    char md5_string[64]="";
+    char* md5_list=NULL;
+    char* part_flag=NULL;
+    int_64bit part_bytes=(int_64bit)part_mb*1048576;
+    int i,part_num;
+    part_flag=strchr(etag,'-');
+    if(part_flag==NULL){
+        if(strlen(etag)!=32){
+            return 2;
+        }
+        if(now_md5_for_file(local_file,md5_string,64)!=0){
+            return 1;
+        }
+        return (strcmp(md5_string,etag)==0)?0:1;
+    }
+    part_num=(int)((size+part_bytes-1)/part_bytes);
+    if(part_num<1||atoi(part_flag+1)!=part_num){
+        return 2;
+    }
+    md5_list=(char*)malloc(part_num*32+1);
+    if(md5_list==NULL){
+        return 2;
+    }
+    memset(md5_list,'\0',part_num*32+1);
+    for(i=0;i<part_num;i++){
+        if(s3_range_md5(local_file,i*part_mb,part_mb,md5_string,64)!=0){
+            free(md5_list);
+            return 1;
+        }
+        memcpy(md5_list+i*32,md5_string,32);
+    }
+    i=s3_composite_etag(md5_list,part_num,md5_string,64);
+    free(md5_list);
+    if(i!=0){
+        return 2;
+    }
+    return (strcmp(md5_string,etag)==0)?0:1;
+}
+
+/*
+ * return 1: failed or not found
+ * return 0: normal exit
+ */
+int s3_head_object(s3_target* target, char* key, int_64bit* size, char* etag, unsigned int etag_len){
+    char curl_prefix[CMDLINE_LENGTH]="";
+    char url[FILENAME_LENGTH_EXT]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    char header_file[FILENAME_LENGTH]="";
+    char size_string[32]="";
+    char randstr[7]="";
+    *size=-1;
+    strcpy(etag,"");
+    generate_random_nstring(randstr,7,1);
+    snprintf(header_file,FILENAME_LENGTH-1,"%ss3_%s.hdr",NOW_TMP_DIR,randstr);
+    s3_curl_prefix(target,curl_prefix,CMDLINE_LENGTH);
+    s3_object_url(target,key,"",url,FILENAME_LENGTH_EXT);
+    snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -I -D %s -o %s \"%s\" 2>>%s",curl_prefix,header_file,NULL_STREAM,url,SYSTEM_CMD_ERROR_LOG);
+    if(system(cmdline)!=0||s3_header_value(header_file,"Content-Length",size_string,32)!=0){
+        rm_file_or_dir(header_file);
+        return 1;
+    }
+    s3_header_value(header_file,"ETag",etag,etag_len);
+    rm_file_or_dir(header_file);
+    *size=strtoll(size_string,NULL,10);
+    return 0;
+}
+
+/*
+ * Upload a local file in parts. The md5s of the parts are taken first by the
+ * concurrent tasks, then the parts are sent with the Content-MD5 headers, so
+ * the server rejects a corrupted part whatever ETag it returns. A part is done
+ * if the request succeeded with the size sent. The failed parts are sent
+ * again, up to PTX_RETRY_MAX extra rounds. The part size is doubled if the file
+ * would need more than S3_PARTS_MAX parts. The upload is completed with the
+ * ETags returned, and the ETag of the object is verified at last if all the
+ * part ETags are the md5s. An upload not completed is aborted, so that the
+ * parts don't stay in the bucket. Not for Windows.
+ * return -1: memory or temp file error
+ * return 1: failed to create the upload, or some parts still failed
+ * return 3: failed to complete the upload, or the final ETag mismatched
+ * return 0: normal exit
+ */
+int s3_multipart_put(s3_target* target, char* local_file, char* key, int_64bit file_size){
+#ifdef _WIN32
+    return 1;
+#else
+    char curl_prefix[CMDLINE_LENGTH]="";
+    char url[FILENAME_LENGTH_EXT]="";
+    char query[CMDLINE_LENGTH]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    char randstr[7]="";
+    char resp_file[FILENAME_LENGTH]="";
+    char body_file[FILENAME_LENGTH]="";
+    char header_file[FILENAME_LENGTH]="";
+    char md5_file[FILENAME_LENGTH]="";
+    char upload_id[LINE_LENGTH_SHORT]="";
+    char encoded_id[LINE_LENGTH_SHORT]="";
+    char size_string[32]="";
+    char md5_string[64]="";
+    char content_md5[32]="";
+    char final_etag[80]="";
+    char expected_etag[80]="";
+    char* resp_buffer=NULL;
+    char* md5_list=NULL;
+    char (*part_etags)[80]=NULL;
+    int part_mb=target->part_mb;
+    int i,j,part,part_num,task_num,round,fail_num,md5_etag_flag;
+    int_64bit part_bytes,part_size;
+    int* part_ids=NULL;
+    fanout_task* tasks=NULL;
+    FILE* file_p=NULL;
+    trace_span span;
+    part_bytes=(int_64bit)part_mb*1048576;
+    while((file_size+part_bytes-1)/part_bytes>S3_PARTS_MAX){
+        part_mb*=2;
+        part_bytes=(int_64bit)part_mb*1048576;
+    }
+    part_num=(int)((file_size+part_bytes-1)/part_bytes);
+    if(part_num<1){
+        part_num=1;
+    }
+    trace_span_start(&span,"s3_multipart_put");
+    generate_random_nstring(randstr,7,1);
+    snprintf(resp_file,FILENAME_LENGTH-1,"%ss3_%s.resp",NOW_TMP_DIR,randstr);
+    snprintf(body_file,FILENAME_LENGTH-1,"%ss3_%s.xml",NOW_TMP_DIR,randstr);
+    s3_curl_prefix(target,curl_prefix,CMDLINE_LENGTH);
+    s3_object_url(target,key,"uploads=",url,FILENAME_LENGTH_EXT);
+    snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -X POST -o %s \"%s\" 2>>%s",curl_prefix,resp_file,url,SYSTEM_CMD_ERROR_LOG);
+    if(system(cmdline)==0){
+        resp_buffer=s3_file_to_buffer(resp_file);
+        if(resp_buffer!=NULL){
+            s3_xml_value(resp_buffer,"UploadId",upload_id,LINE_LENGTH_SHORT);
+            free(resp_buffer);
+        }
+    }
+    rm_file_or_dir(resp_file);
+    if(strlen(upload_id)==0){
+        trace_span_end(&span,1);
+        return 1;
+    }
+    s3_uri_encode(upload_id,encoded_id,LINE_LENGTH_SHORT,0);
+    md5_list=(char*)malloc(part_num*32+1);
+    part_etags=(char(*)[80])malloc(part_num*80);
+    part_ids=(int*)malloc(part_num*sizeof(int));
+    tasks=(fanout_task*)malloc(part_num*sizeof(fanout_task));
+    if(md5_list==NULL||part_etags==NULL||part_ids==NULL||tasks==NULL){
+        free(md5_list);
+        free(part_etags);
+        free(part_ids);
+        free(tasks);
+        fail_num=-1;
+        goto abort_upload;
+    }
+    memset(md5_list,'\0',part_num*32+1);
+    memset(part_etags,'\0',part_num*80);
+    fail_num=0;
+    for(i=0;i<part_num;i++){
+        snprintf(md5_file,FILENAME_LENGTH-1,"%ss3_%s_%d.md5",NOW_TMP_DIR,randstr,i);
+        snprintf(tasks[i].target,63,"md5_%d",i+1);
+        strcpy(tasks[i].privkey_temp,"");
+        snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"dd if=\"%s\" bs=1048576 skip=%d count=%d 2>/dev/null | %s | cut -c1-32 > %s",local_file,i*part_mb,part_mb,MD5SUM_CMD,md5_file);
+        /* Never run a truncated command. */
+        if(strlen(cmdline)>=CMDLINE_LENGTH){
+            fail_num=part_num;
+            break;
+        }
+        strcpy(tasks[i].cmdline,cmdline);
+    }
+    if(fail_num==0){
+        fanout_run(tasks,part_num,target->concurrency,S3_REQUEST_TIMEOUT);
+    }
+    for(i=0;i<part_num;i++){
+        snprintf(md5_file,FILENAME_LENGTH-1,"%ss3_%s_%d.md5",NOW_TMP_DIR,randstr,i);
+        strcpy(md5_string,"");
+        if(fail_num==0&&tasks[i].exit_code==0){
+            file_p=fopen(md5_file,"r");
+            if(file_p!=NULL){
+                fngetline(file_p,md5_string,64);
+                fclose(file_p);
+            }
+        }
+        rm_file_or_dir(md5_file);
+        if(strlen(md5_string)!=32){
+            fail_num=part_num;
+            continue;
+        }
+        memcpy(md5_list+i*32,md5_string,32);
+    }
+    if(fail_num>0){
+        free(md5_list);
+        free(part_etags);
+        free(part_ids);
+        free(tasks);
+        fail_num=1;
+        goto abort_upload;
+    }
+    fail_num=part_num;
+    for(round=0;round<=PTX_RETRY_MAX&&fail_num>0;round++){
+        task_num=0;
+        for(i=0;i<part_num;i++){
+            if(part_etags[i][0]!='\0'){
+                continue;
+            }
+            snprintf(header_file,FILENAME_LENGTH-1,"%ss3_%s_%d.hdr",NOW_TMP_DIR,randstr,i);
+            snprintf(md5_file,FILENAME_LENGTH-1,"%ss3_%s_%d.size",NOW_TMP_DIR,randstr,i);
+            snprintf(query,CMDLINE_LENGTH-1,"partNumber=%d&uploadId=%s",i+1,encoded_id);
+            s3_object_url(target,key,query,url,FILENAME_LENGTH_EXT);
+            snprintf(md5_string,64,"%.32s",md5_list+i*32);
+            s3_content_md5(md5_string,content_md5,32);
+            part_ids[task_num]=i;
+            snprintf(tasks[task_num].target,63,"part_%d",i+1);
+            strcpy(tasks[task_num].privkey_temp,"");
+            /* The part is read into the memory by curl, so that the Content-Length is known. */
+            snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"dd if=\"%s\" bs=1048576 skip=%d count=%d 2>/dev/null | %s -X PUT -H \"Content-Type:\" -H \"Content-MD5: %s\" --data-binary @- -D %s -o %s -w \"%%{size_upload}\\n\" \"%s\" > %s",local_file,i*part_mb,part_mb,curl_prefix,content_md5,header_file,NULL_STREAM,url,md5_file);
+            if(strlen(cmdline)>=CMDLINE_LENGTH){
+                task_num=0;
+                round=PTX_RETRY_MAX;
+                break;
+            }
+            strcpy(tasks[task_num].cmdline,cmdline);
+            task_num++;
+        }
+        fanout_run(tasks,task_num,target->concurrency,S3_REQUEST_TIMEOUT);
+        for(j=0;j<task_num;j++){
+            part=part_ids[j];
+            snprintf(header_file,FILENAME_LENGTH-1,"%ss3_%s_%d.hdr",NOW_TMP_DIR,randstr,part);
+            snprintf(md5_file,FILENAME_LENGTH-1,"%ss3_%s_%d.size",NOW_TMP_DIR,randstr,part);
+            strcpy(size_string,"");
+            part_size=((int_64bit)(part+1)*part_bytes>file_size)?file_size-(int_64bit)part*part_bytes:part_bytes;
+            if(tasks[j].exit_code==0){
+                file_p=fopen(md5_file,"r");
+                if(file_p!=NULL){
+                    fngetline(file_p,size_string,32);
+                    fclose(file_p);
+                }
+                if(strtoll(size_string,NULL,10)==part_size&&s3_header_value(header_file,"ETag",part_etags[part],80)==0&&strlen(part_etags[part])>0){
+                    fail_num--;
+                }
+                else{
+                    strcpy(part_etags[part],"");
+                }
+            }
+            rm_file_or_dir(header_file);
+            rm_file_or_dir(md5_file);
+        }
+    }
+    free(part_ids);
+    free(tasks);
+    if(fail_num>0){
+        free(md5_list);
+        free(part_etags);
+        fail_num=1;
+        goto abort_upload;
+    }
+    file_p=fopen(body_file,"w+");
+    if(file_p==NULL){
+        free(md5_list);
+        free(part_etags);
+        fail_num=-1;
+        goto abort_upload;
+    }
+    /* The ETags of the encrypted parts are not the md5s, then the final ETag can't be verified. */
+    md5_etag_flag=1;
+    fprintf(file_p,"<CompleteMultipartUpload>");
+    for(i=0;i<part_num;i++){
+        fprintf(file_p,"<Part><PartNumber>%d</PartNumber><ETag>\"%s\"</ETag></Part>",i+1,part_etags[i]);
+        if(strlen(part_etags[i])!=32||strncmp(part_etags[i],md5_list+i*32,32)!=0){
+            md5_etag_flag=0;
+        }
+    }
+    fprintf(file_p,"</CompleteMultipartUpload>");
+    fclose(file_p);
+    s3_composite_etag(md5_list,part_num,expected_etag,80);
+    free(md5_list);
+    free(part_etags);
+    snprintf(query,CMDLINE_LENGTH-1,"uploadId=%s",encoded_id);
+    s3_object_url(target,key,query,url,FILENAME_LENGTH_EXT);
+    snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -X POST -H \"Content-Type: application/xml\" --data-binary @%s -o %s \"%s\" 2>>%s",curl_prefix,body_file,resp_file,url,SYSTEM_CMD_ERROR_LOG);
+    fail_num=3;
+    /* An error can come with the status 200 after the upload is accepted, so check the body. */
+    if(system(cmdline)==0){
+        resp_buffer=s3_file_to_buffer(resp_file);
+        if(resp_buffer!=NULL){
+            if(strstr(resp_buffer,"<CompleteMultipartUploadResult")!=NULL){
+                s3_xml_value(resp_buffer,"ETag",final_etag,80);
+                /* Some clouds return their own ETags of the multipart objects. */
+                fail_num=(md5_etag_flag==1&&strchr(final_etag,'-')!=NULL&&strcmp(final_etag,expected_etag)!=0)?3:0;
+            }
+            free(resp_buffer);
+        }
+    }
+    rm_file_or_dir(resp_file);
+    rm_file_or_dir(body_file);
+    if(fail_num==0){
+        trace_span_end(&span,0);
+        return 0;
+    }
+abort_upload:
+    snprintf(query,CMDLINE_LENGTH-1,"uploadId=%s",encoded_id);
+    s3_object_url(target,key,query,url,FILENAME_LENGTH_EXT);
+    snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -X DELETE -o %s \"%s\" 2>>%s",curl_prefix,NULL_STREAM,url,SYSTEM_CMD_ERROR_LOG);
+    system(cmdline);
+    trace_span_end(&span,fail_num);
+    return fail_num;
+#endif
+}
+
+/*
+ * Upload a local file to the key. Files larger than a part go in parts,
+ * smaller ones in a single request verified by the server with Content-MD5.
+ * return -1: failed to get the local file
+ * return 1: failed
+ * return 0: normal exit
+ */
+int s3_put_object(s3_target* target, char* local_file, char* key){
+    char curl_prefix[CMDLINE_LENGTH]="";
+    char url[FILENAME_LENGTH_EXT]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    char md5_string[64]="";
+    char content_md5[32]="";
+    int_64bit file_size;
+    long long file_mtime;
+    int round;
+    if(get_file_size_mtime(local_file,&file_size,&file_mtime)!=0){
+        return -1;
+    }
+    if(file_size>(int_64bit)target->part_mb*1048576){
+        return (s3_multipart_put(target,local_file,key,file_size)==0)?0:1;
+    }
+    if(now_md5_for_file(local_file,md5_string,64)!=0||s3_content_md5(md5_string,content_md5,32)!=0){
+        return -1;
+    }
+    s3_curl_prefix(target,curl_prefix,CMDLINE_LENGTH);
+    s3_object_url(target,key,"",url,FILENAME_LENGTH_EXT);
+    /* curl --fail exits non-zero if the server rejects the Content-MD5. */
+    snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -T \"%s\" -H \"Content-MD5: %s\" -o %s \"%s\" 2>>%s",curl_prefix,local_file,content_md5,NULL_STREAM,url,SYSTEM_CMD_ERROR_LOG);
+    for(round=0;round<=PTX_RETRY_MAX;round++){
+        if(system(cmdline)==0){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Download an object to a local file. Objects larger than a part are fetched
+ * by the concurrent ranged requests, and written in place. The size and the
+ * ETag (if verifiable, see s3_etag_check) are verified at last. The failed
+ * download is removed.
+ * return -1: failed to create the local file
+ * return 1: failed to get the object, or some ranges failed
+ * return 3: verification failed
+ * return 0: normal exit
+ */
+int s3_get_object(s3_target* target, char* key, char* local_file){
+#ifdef _WIN32
+    return 1;
+#else
+    char curl_prefix[CMDLINE_LENGTH]="";
+    char url[FILENAME_LENGTH_EXT]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    char err_file[FILENAME_LENGTH]="";
+    char etag[80]="";
+    char randstr[7]="";
+    int_64bit object_size,part_bytes,range_end,local_size;
+    long long local_mtime;
+    int i,j,part_num,task_num,round,fail_num;
+    int* part_ok=NULL;
+    int* part_ids=NULL;
+    fanout_task* tasks=NULL;
+    FILE* file_p=NULL;
+    trace_span span;
+    if(s3_head_object(target,key,&object_size,etag,80)!=0){
+        return 1;
+    }
+    part_bytes=(int_64bit)target->part_mb*1048576;
+    part_num=(int)((object_size+part_bytes-1)/part_bytes);
+    s3_curl_prefix(target,curl_prefix,CMDLINE_LENGTH);
+    s3_object_url(target,key,"",url,FILENAME_LENGTH_EXT);
+    trace_span_start(&span,"s3_get_object");
+    if(part_num<2){
+        snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -o \"%s\" \"%s\" 2>>%s",curl_prefix,local_file,url,SYSTEM_CMD_ERROR_LOG);
+        fail_num=1;
+        for(round=0;round<=PTX_RETRY_MAX&&fail_num>0;round++){
+            fail_num=(system(cmdline)==0)?0:1;
+        }
+    }
+    else{
+        /* Allocate the full-size file first, so that the ranges can be written in any order. */
+        file_p=fopen(local_file,"wb");
+        if(file_p==NULL){
+            trace_span_end(&span,-1);
+            return -1;
+        }
+        fclose(file_p);
+        if(truncate(local_file,(off_t)object_size)!=0){
+            rm_file_or_dir(local_file);
+            trace_span_end(&span,-1);
+            return -1;
+        }
+        part_ok=(int*)malloc(part_num*sizeof(int));
+        part_ids=(int*)malloc(part_num*sizeof(int));
+        tasks=(fanout_task*)malloc(part_num*sizeof(fanout_task));
+        if(part_ok==NULL||part_ids==NULL||tasks==NULL){
+            free(part_ok);
+            free(part_ids);
+            free(tasks);
+            rm_file_or_dir(local_file);
+            trace_span_end(&span,-1);
+            return -1;
+        }
+        generate_random_nstring(randstr,7,1);
+        for(i=0;i<part_num;i++){
+            part_ok[i]=0;
+        }
+        fail_num=part_num;
+        for(round=0;round<=PTX_RETRY_MAX&&fail_num>0;round++){
+            task_num=0;
+            for(i=0;i<part_num;i++){
+                if(part_ok[i]==1){
+                    continue;
+                }
+                snprintf(err_file,FILENAME_LENGTH-1,"%ss3_%s_%d.err",NOW_TMP_DIR,randstr,i);
+                range_end=((int_64bit)(i+1)*part_bytes>object_size)?object_size-1:(int_64bit)(i+1)*part_bytes-1;
+                part_ids[task_num]=i;
+                snprintf(tasks[task_num].target,63,"range_%d",i);
+                strcpy(tasks[task_num].privkey_temp,"");
+                /* The exit code of the pipe is dd's, so a failed curl leaves the error file. */
+                snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"{ rm -f %s; { %s -r %lld-%lld \"%s\" || echo 1 > %s; } | dd of=\"%s\" bs=1048576 seek=%d conv=notrunc 2>/dev/null && test ! -f %s; }",err_file,curl_prefix,(long long)i*part_bytes,(long long)range_end,url,err_file,local_file,i*target->part_mb,err_file);
+                /* Never run a truncated command, the download fails instead. */
+                if(strlen(cmdline)>=CMDLINE_LENGTH){
+                    task_num=0;
+                    round=PTX_RETRY_MAX;
+                    break;
+                }
+                strcpy(tasks[task_num].cmdline,cmdline);
+                task_num++;
+            }
+            fanout_run(tasks,task_num,target->concurrency,S3_REQUEST_TIMEOUT);
+            for(j=0;j<task_num;j++){
+                if(tasks[j].exit_code==0){
+                    part_ok[part_ids[j]]=1;
+                    fail_num--;
+                }
+                snprintf(err_file,FILENAME_LENGTH-1,"%ss3_%s_%d.err",NOW_TMP_DIR,randstr,part_ids[j]);
+                rm_file_or_dir(err_file);
+            }
+        }
+        free(part_ok);
+        free(part_ids);
+        free(tasks);
+    }
+    if(fail_num>0){
+        rm_file_or_dir(local_file);
+        trace_span_end(&span,1);
+        return 1;
+    }
+    if(get_file_size_mtime(local_file,&local_size,&local_mtime)!=0||local_size!=object_size||s3_etag_check(local_file,local_size,etag,target->part_mb)==1){
+        rm_file_or_dir(local_file);
+        trace_span_end(&span,3);
+        return 3;
+    }
+    trace_span_end(&span,0);
+    return 0;
+#endif
+}
+
+/*
+ * Copy an object inside the bucket by the server side. The objects over 5 GiB
+ * need a multipart copy, which is left to the vendor CLIs.
+ * return 1: failed
+ * return 0: normal exit
+ */
+int s3_copy_object(s3_target* target, char* source_key, char* target_key){
+    char curl_prefix[CMDLINE_LENGTH]="";
+    char url[FILENAME_LENGTH_EXT]="";
+    char encoded_source[FILENAME_LENGTH_EXT]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    char resp_file[FILENAME_LENGTH]="";
+    char randstr[7]="";
+    char* resp_buffer=NULL;
+    int run_flag=1;
+    generate_random_nstring(randstr,7,1);
+    snprintf(resp_file,FILENAME_LENGTH-1,"%ss3_%s.resp",NOW_TMP_DIR,randstr);
+    s3_curl_prefix(target,curl_prefix,CMDLINE_LENGTH);
+    s3_object_url(target,target_key,"",url,FILENAME_LENGTH_EXT);
+    s3_uri_encode(source_key,encoded_source,FILENAME_LENGTH_EXT,1);
+    snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -X PUT -H \"x-amz-copy-source: /%s/%s\" -o %s \"%s\" 2>>%s",curl_prefix,target->bucket,encoded_source,resp_file,url,SYSTEM_CMD_ERROR_LOG);
+    if(system(cmdline)==0){
+        resp_buffer=s3_file_to_buffer(resp_file);
+        if(resp_buffer!=NULL){
+            run_flag=(strstr(resp_buffer,"<CopyObjectResult")!=NULL)?0:1;
+            free(resp_buffer);
+        }
+    }
+    rm_file_or_dir(resp_file);
+    return run_flag;
+}
+
+/*
+ * return 1: failed
+ * return 0: normal exit (also for a key not existing)
+ */
+int s3_delete_object(s3_target* target, char* key){
+    char curl_prefix[CMDLINE_LENGTH]="";
+    char url[FILENAME_LENGTH_EXT]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    s3_curl_prefix(target,curl_prefix,CMDLINE_LENGTH);
+    s3_object_url(target,key,"",url,FILENAME_LENGTH_EXT);
+    snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -X DELETE -o %s \"%s\" 2>>%s",curl_prefix,NULL_STREAM,url,SYSTEM_CMD_ERROR_LOG);
+    return (system(cmdline)==0)?0:1;
+}
+
+/*
+ * List the objects with the prefix (ListObjectsV2, all the pages) to the
+ * list_file, one object per line: SIZE ETAG LAST_MODIFIED KEY. The key is the
+ * last, because it may contain blanks. delimiter_flag 1: list one level, the
+ * sub-folders come as -1 - - PREFIX/.
+ * return -1: failed to create the list file
+ * return 1: failed to list
+ * return 0: normal exit
+ */
+int s3_list_objects(s3_target* target, char* prefix, int delimiter_flag, char* list_file){
+    char curl_prefix[CMDLINE_LENGTH]="";
+    char url[FILENAME_LENGTH_EXT]="";
+    char query[CMDLINE_LENGTH_EXT]="";
+    char encoded_prefix[FILENAME_LENGTH_EXT]="";
+    char encoded_token[CMDLINE_LENGTH]="";
+    char token[LINE_LENGTH_SHORT*4]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    char resp_file[FILENAME_LENGTH]="";
+    char randstr[7]="";
+    char key[FILENAME_LENGTH]="";
+    char etag[80]="";
+    char last_modified[64]="";
+    char size_string[32]="";
+    char truncated[16]="";
+    char* resp_buffer=NULL;
+    char* entry=NULL;
+    char* entry_end=NULL;
+    int run_flag=0;
+    FILE* list_p=NULL;
+    list_p=fopen(list_file,"w+");
+    if(list_p==NULL){
+        return -1;
+    }
+    generate_random_nstring(randstr,7,1);
+    snprintf(resp_file,FILENAME_LENGTH-1,"%ss3_%s.resp",NOW_TMP_DIR,randstr);
+    s3_curl_prefix(target,curl_prefix,CMDLINE_LENGTH);
+    s3_uri_encode(prefix,encoded_prefix,FILENAME_LENGTH_EXT,0);
+    do{
+        s3_uri_encode(token,encoded_token,CMDLINE_LENGTH,0);
+        /* Sorted by the parameter names. */
+        snprintf(query,CMDLINE_LENGTH_EXT-1,"%s%s%s%slist-type=2&prefix=%s",(strlen(token)==0)?"":"continuation-token=",encoded_token,(strlen(token)==0)?"":"&",(delimiter_flag==1)?"delimiter=%2F&":"",encoded_prefix);
+        s3_object_url(target,"",query,url,FILENAME_LENGTH_EXT);
+        snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -o %s \"%s\" 2>>%s",curl_prefix,resp_file,url,SYSTEM_CMD_ERROR_LOG);
+        if(system(cmdline)!=0){
+            run_flag=1;
+            break;
+        }
+        resp_buffer=s3_file_to_buffer(resp_file);
+        if(resp_buffer==NULL||strstr(resp_buffer,"<ListBucketResult")==NULL){
+            free(resp_buffer);
+            run_flag=1;
+            break;
+        }
+        entry=resp_buffer;
+        while((entry=strstr(entry,"<Contents>"))!=NULL){
+            entry_end=strstr(entry,"</Contents>");
+            if(entry_end==NULL){
+                break;
+            }
+            *entry_end='\0';
+            s3_xml_value(entry,"Key",key,FILENAME_LENGTH);
+            s3_xml_value(entry,"ETag",etag,80);
+            s3_xml_value(entry,"LastModified",last_modified,64);
+            s3_xml_value(entry,"Size",size_string,32);
+            fprintf(list_p,"%lld %s %s %s\n",strtoll(size_string,NULL,10),(strlen(etag)==0)?"-":etag,(strlen(last_modified)==0)?"-":last_modified,key);
+            *entry_end='<';
+            entry=entry_end;
+        }
+        entry=resp_buffer;
+        while((entry=strstr(entry,"<CommonPrefixes>"))!=NULL){
+            entry=s3_xml_value(entry,"Prefix",key,FILENAME_LENGTH);
+            if(entry==NULL){
+                break;
+            }
+            fprintf(list_p,"-1 - - %s\n",key);
+        }
+        s3_xml_value(resp_buffer,"IsTruncated",truncated,16);
+        s3_xml_value(resp_buffer,"NextContinuationToken",token,LINE_LENGTH_SHORT*4);
+        free(resp_buffer);
+    }while(strcmp(truncated,"true")==0&&strlen(token)>0);
+    fclose(list_p);
+    rm_file_or_dir(resp_file);
+    return run_flag;
+}
+
+/*
+ * Parse a line of the list_file written by s3_list_objects. The etag holds 80
+ * chars, the last_modified 64 chars.
+ * return -1: invalid line
+ * return 1: a sub-folder line (size -1)
+ * return 0: an object line
+ */
+int s3_list_line_parse(char* line, int_64bit* size, char* etag, char* last_modified, char* key, unsigned int key_len){
+    long long size_value;
+    char* key_start=line;
+    int i;
+    strcpy(key,"");
+    if(sscanf(line,"%lld %79s %63s",&size_value,etag,last_modified)!=3){
+        return -1;
+    }
+    for(i=0;i<3&&key_start!=NULL;i++){
+        key_start=strchr(key_start,' ');
+        if(key_start!=NULL){
+            key_start++;
+        }
+    }
+    if(key_start==NULL||strlen(key_start)==0){
+        return -1;
+    }
+    strncpy(key,key_start,key_len-1);
+    key[key_len-1]='\0';
+    *size=(int_64bit)size_value;
+    return (size_value<0)?1:0;
+}
+
+/*
+ * Run a batch of object operations, option: put, get, copy or delete. The
+ * items smaller than a part are run by the concurrent tasks and verified one by
+ * one: put by the server with Content-MD5, get with the size and the ETag (if
+ * verifiable), copy with the response. An item with a command too long for a
+ * task fails. The failed items are run again, up to PTX_RETRY_MAX extra rounds.
+ * The larger items of put and get go through the multipart functions one after
+ * another. The done of each item is set to 1 if finished. The etag of a put
+ * or copy item is set to the ETag of the new object if known, otherwise "".
+ * return -1: invalid option or memory error
+ * return N>=0: the number of the failed items
+ */
+int s3_batch_run(s3_target* target, s3_item* items, int item_num, char* option){
+    char curl_prefix[CMDLINE_LENGTH]="";
+    char url[FILENAME_LENGTH_EXT]="";
+    char encoded_source[FILENAME_LENGTH_EXT]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    char out_file[FILENAME_LENGTH]="";
+    char local_dir[FILENAME_LENGTH]="";
+    char etag[80]="";
+    char md5_string[64]="";
+    char content_md5[32]="";
+    char randstr[7]="";
+    char* resp_buffer=NULL;
+    char* dir_end=NULL;
+    int_64bit part_bytes=(int_64bit)target->part_mb*1048576;
+    int_64bit local_size;
+    long long local_mtime;
+    int i,j,item,task_num,round,fail_num=0;
+    int* item_ids=NULL;
+    fanout_task* tasks=NULL;
+    trace_span span;
+    if(strcmp(option,"put")!=0&&strcmp(option,"get")!=0&&strcmp(option,"copy")!=0&&strcmp(option,"delete")!=0){
+        return -1;
+    }
+    if(item_num<1){
+        return 0;
+    }
+    item_ids=(int*)malloc(item_num*sizeof(int));
+    tasks=(fanout_task*)malloc(item_num*sizeof(fanout_task));
+    if(item_ids==NULL||tasks==NULL){
+        free(item_ids);
+        free(tasks);
+        return -1;
+    }
+    trace_span_start(&span,"s3_batch_run");
+    generate_random_nstring(randstr,7,1);
+    s3_curl_prefix(target,curl_prefix,CMDLINE_LENGTH);
+    for(i=0;i<item_num;i++){
+        items[i].done=0;
+        if(strcmp(option,"put")==0||strcmp(option,"copy")==0){
+            strcpy(items[i].etag,"");
+        }
+        if(strcmp(option,"put")==0&&get_file_size_mtime(items[i].path,&items[i].size,&local_mtime)!=0){
+            items[i].done=-1;
+            fail_num++;
+        }
+        if(strcmp(option,"get")==0){
+            strncpy(local_dir,items[i].path,FILENAME_LENGTH-1);
+            dir_end=strrchr(local_dir,'/');
+            if(dir_end!=NULL&&dir_end!=local_dir){
+                *dir_end='\0';
+                mk_pdir(local_dir);
+            }
+        }
+    }
+    for(round=0;round<=PTX_RETRY_MAX;round++){
+        task_num=0;
+        for(i=0;i<item_num;i++){
+            if(items[i].done!=0||((strcmp(option,"put")==0||strcmp(option,"get")==0)&&items[i].size>part_bytes)){
+                continue;
+            }
+            snprintf(out_file,FILENAME_LENGTH-1,"%ss3_%s_%d.out",NOW_TMP_DIR,randstr,i);
+            s3_object_url(target,items[i].key,"",url,FILENAME_LENGTH_EXT);
+            if(strcmp(option,"put")==0){
+                if(now_md5_for_file(items[i].path,md5_string,64)!=0||s3_content_md5(md5_string,content_md5,32)!=0){
+                    items[i].done=-1;
+                    fail_num++;
+                    continue;
+                }
+                snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -T \"%s\" -H \"Content-MD5: %s\" -D %s -o %s \"%s\"",curl_prefix,items[i].path,content_md5,out_file,NULL_STREAM,url);
+            }
+            else if(strcmp(option,"get")==0){
+                snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -o \"%s\" \"%s\"",curl_prefix,items[i].path,url);
+            }
+            else if(strcmp(option,"copy")==0){
+                s3_uri_encode(items[i].path,encoded_source,FILENAME_LENGTH_EXT,1);
+                snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -X PUT -H \"x-amz-copy-source: /%s/%s\" -o %s \"%s\"",curl_prefix,target->bucket,encoded_source,out_file,url);
+            }
+            else{
+                snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -X DELETE -o %s \"%s\"",curl_prefix,NULL_STREAM,url);
+            }
+            /* Never run a truncated command, e.g. with a very long key or path. */
+            if(strlen(cmdline)>=CMDLINE_LENGTH){
+                items[i].done=-1;
+                fail_num++;
+                continue;
+            }
+            item_ids[task_num]=i;
+            snprintf(tasks[task_num].target,63,"object_%d",i);
+            strcpy(tasks[task_num].privkey_temp,"");
+            strcpy(tasks[task_num].cmdline,cmdline);
+            task_num++;
+        }
+        if(task_num==0){
+            break;
+        }
+        fanout_run(tasks,task_num,target->concurrency,S3_REQUEST_TIMEOUT);
+        for(j=0;j<task_num;j++){
+            item=item_ids[j];
+            snprintf(out_file,FILENAME_LENGTH-1,"%ss3_%s_%d.out",NOW_TMP_DIR,randstr,item);
+            if(tasks[j].exit_code!=0){
+                rm_file_or_dir(out_file);
+                continue;
+            }
+            if(strcmp(option,"put")==0){
+                /* Verified by the server with the Content-MD5, the ETag may not be an md5. */
+                if(s3_header_value(out_file,"ETag",etag,80)==0){
+                    strcpy(items[item].etag,etag);
+                }
+                items[item].done=1;
+            }
+            else if(strcmp(option,"get")==0){
+                if(get_file_size_mtime(items[item].path,&local_size,&local_mtime)==0&&local_size==items[item].size&&s3_etag_check(items[item].path,local_size,items[item].etag,target->part_mb)!=1){
+                    items[item].done=1;
+                }
+            }
+            else if(strcmp(option,"copy")==0){
+                resp_buffer=s3_file_to_buffer(out_file);
+                if(resp_buffer!=NULL&&strstr(resp_buffer,"<CopyObjectResult")!=NULL){
+                    s3_xml_value(resp_buffer,"ETag",items[item].etag,80);
+                    items[item].done=1;
+                }
+                free(resp_buffer);
+            }
+            else{
+                items[item].done=1;
+            }
+            rm_file_or_dir(out_file);
+        }
+    }
+    free(item_ids);
+    free(tasks);
+    for(i=0;i<item_num;i++){
+        if(items[i].done!=0){
+            continue;
+        }
+        if(strcmp(option,"put")==0&&items[i].size>part_bytes){
+            items[i].done=(s3_multipart_put(target,items[i].path,items[i].key,items[i].size)==0)?1:0;
+        }
+        else if(strcmp(option,"get")==0&&items[i].size>part_bytes){
+            items[i].done=(s3_get_object(target,items[i].key,items[i].path)==0)?1:0;
+        }
+        else if(strcmp(option,"get")==0){
+            rm_file_or_dir(items[i].path);
+        }
+        if(items[i].done!=1){
+            fail_num++;
+        }
+    }
+    trace_span_end(&span,fail_num);
+    return fail_num;
+}
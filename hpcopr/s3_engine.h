@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+ * This code is distributed under the license: MIT License
+ * Originally written by Zhenrong WANG
+ * mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+ */
+
+#ifndef S3_ENGINE_H
+#define S3_ENGINE_H
+
+typedef struct{
+    char endpoint[LINE_LENGTH_SHORT];   /* scheme://host[:port], without the ending slash */
+    char bucket[128];
+    char region[32];
+    char ak[128];
+    char sk[128];
+    int path_style;                     /* 1: endpoint/bucket/key, 0: scheme://bucket.host/key */
+    int part_mb;
+    int concurrency;
+    int index_ttl;                      /* Seconds, 0 disables the local listing index (bucket_index.c) */
+    char config_file[FILENAME_LENGTH];  /* The 0600 curl config with the credentials, see s3_target_credentials */
+} s3_target;
+
+typedef struct{
+    char path[FILENAME_LENGTH];         /* The local file, or the source key of a copy */
+    char key[FILENAME_LENGTH];
+    char etag[80];
+    int_64bit size;
+    int done;
+} s3_item;
+
+int s3_engine_conf(s3_target* target);
+int s3_target_init(bucket_info* binfo, char* cloud_flag, s3_target* target);
+int s3_target_credentials(s3_target* target);
+void s3_target_clear(s3_target* target);
+void s3_uri_encode(char* source, char* dest, unsigned int maxlen, int keep_slash);
+void s3_object_url(s3_target* target, char* key, char* query, char* url, unsigned int maxlen);
+void s3_curl_prefix(s3_target* target, char* prefix, unsigned int maxlen);
+int s3_header_value(char* header_file, char* header_name, char* value, unsigned int maxlen);
+char* s3_xml_value(char* text, char* tag, char* value, unsigned int maxlen);
+char* s3_file_to_buffer(char* filename);
+int s3_range_md5(char* filename, int skip_mb, int count_mb, char* md5_string, unsigned int len);
+int s3_composite_etag(char* md5_list, int part_num, char* etag, unsigned int len);
+int s3_content_md5(char* md5_string, char* content_md5, unsigned int len);
+int s3_etag_check(char* local_file, int_64bit size, char* etag, int part_mb);
+int s3_head_object(s3_target* target, char* key, int_64bit* size, char* etag, unsigned int etag_len);
+int s3_multipart_put(s3_target* target, char* local_file, char* key, int_64bit file_size);
+int s3_put_object(s3_target* target, char* local_file, char* key);
+int s3_get_object(s3_target* target, char* key, char* local_file);
+int s3_copy_object(s3_target* target, char* source_key, char* target_key);
+int s3_delete_object(s3_target* target, char* key);
+int s3_list_objects(s3_target* target, char* prefix, int delimiter_flag, char* list_file);
+int s3_list_line_parse(char* line, int_64bit* size, char* etag, char* last_modified, char* key, unsigned int key_len);
+int s3_batch_run(s3_target* target, s3_item* items, int item_num, char* option);
+
+#endif
@@ -5,13 +5,24 @@
  * mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <time.h>
 
-#ifndef _WIN32
+#ifdef _WIN32
+#include <windows.h>
+#else
 #include <sys/time.h>
 #endif
+#include "now_macros.h"
 #include "time_process.h"
+#include "usage_and_logs.h"
+
+/* The context of the current hpcopr command, used by the trace records. */
+static char trace_command[64]="";
+static char trace_cluster[32]="";
+static char trace_cloud[16]="";
+static trace_span trace_command_span;
 
 void datetime_to_num(char* date_string, char* time_string, struct tm* datetime_num){
     int i;
@@ -71,6 +82,91 @@ void datetime_to_num(char* date_string, char* time_string, struct tm* datetime_n
     datetime_num->tm_isdst=-1; /* For Linux, this is essential. For Windows (mingw), it is not necessary */
 }
 
+void date_epoch_cache_reset(date_epoch_cache* cache){
+    memset(cache,0,sizeof(date_epoch_cache));
+}
+
+/*
+ * Parse the fixed Y-M-D and H:M[:S] layout of the mon_data lines to epoch
+ * seconds. Both strings may end with ',' so the fields are read in place. The
+ * rows come in time order, so mktime only runs for the midnights of a new date
+ * and the seconds of the day are added arithmetically. On the DST switch days
+ * the day is not 86400 seconds, and mktime is used for every time.
+ * return -1: Invalid date or time
+ * return N>=0: The epoch seconds
+ */
+int_64bit datetime_fast_epoch(char* date_string, char* time_string, date_epoch_cache* cache){
+    int date_num[3]={0};
+    int time_num[3]={0};
+    int field=0;
+    int digits=0;
+    char* ptr=NULL;
+    struct tm time_tm;
+    for(ptr=date_string;*ptr!='\0'&&*ptr!=',';ptr++){
+        if(*ptr>='0'&&*ptr<='9'&&digits<5){
+            date_num[field]=date_num[field]*10+(*ptr-'0');
+            digits++;
+        }
+        else if(*ptr=='-'&&digits>0&&field<2){
+            field++;
+            digits=0;
+        }
+        else{
+            return -1;
+        }
+    }
+    if(field!=2||digits==0||date_num[1]<1||date_num[1]>12||date_num[2]<1||date_num[2]>31){
+        return -1;
+    }
+    field=0;
+    digits=0;
+    for(ptr=time_string;*ptr!='\0'&&*ptr!=',';ptr++){
+        if(*ptr>='0'&&*ptr<='9'&&digits<2){
+            time_num[field]=time_num[field]*10+(*ptr-'0');
+            digits++;
+        }
+        else if(*ptr==':'&&digits>0&&field<2){
+            field++;
+            digits=0;
+        }
+        else{
+            return -1;
+        }
+    }
+    if(field<1||digits==0||time_num[0]>23||time_num[1]>59||time_num[2]>60){
+        return -1;
+    }
+    if(cache->day_seconds==0||date_num[0]!=cache->year||date_num[1]!=cache->month||date_num[2]!=cache->mday){
+        cache->year=date_num[0];
+        cache->month=date_num[1];
+        cache->mday=date_num[2];
+        memset(&time_tm,0,sizeof(struct tm));
+        time_tm.tm_year=date_num[0]-1900;
+        time_tm.tm_mon=date_num[1]-1;
+        time_tm.tm_mday=date_num[2];
+        time_tm.tm_isdst=-1;
+        cache->midnight=(int_64bit)mktime(&time_tm);
+        memset(&time_tm,0,sizeof(struct tm));
+        time_tm.tm_year=date_num[0]-1900;
+        time_tm.tm_mon=date_num[1]-1;
+        time_tm.tm_mday=date_num[2]+1;
+        time_tm.tm_isdst=-1;
+        cache->day_seconds=(int_64bit)mktime(&time_tm)-cache->midnight;
+    }
+    if(cache->day_seconds!=86400){
+        memset(&time_tm,0,sizeof(struct tm));
+        time_tm.tm_year=date_num[0]-1900;
+        time_tm.tm_mon=date_num[1]-1;
+        time_tm.tm_mday=date_num[2];
+        time_tm.tm_hour=time_num[0];
+        time_tm.tm_min=time_num[1];
+        time_tm.tm_sec=time_num[2];
+        time_tm.tm_isdst=-1;
+        return (int_64bit)mktime(&time_tm);
+    }
+    return cache->midnight+time_num[0]*3600+time_num[1]*60+time_num[2];
+}
+
 double calc_running_hours(char* prev_date, char* prev_time, char* current_date, char* current_time){
     time_t prev;
     time_t current;
@@ -81,4 +177,80 @@ double calc_running_hours(char* prev_date, char* prev_time, char* current_date,
     prev=mktime(&time_prev);
     current=mktime(&time_current);
     return difftime(current,prev)/3600;
+}
+
+int_64bit get_monotonic_ms(void){
+#ifdef _WIN32
+    return (int_64bit)GetTickCount64();
+#else
+    struct timespec ts;
+    if(clock_gettime(CLOCK_MONOTONIC,&ts)!=0){
+        return (int_64bit)time(NULL)*1000;
+    }
+    return (int_64bit)ts.tv_sec*1000+ts.tv_nsec/1000000;
+#endif
+}
+
+/* 
+ * Set the command context for the trace records. Spans are only recorded after the context is set.
+ * The command span starts here if it has not been started yet.
+ */
+void set_trace_context(char* command, char* cluster_name, char* cloud_flag){
+    if(command==NULL||cluster_name==NULL||cloud_flag==NULL){
+        return;
+    }
+    strncpy(trace_command,command,63);
+    strncpy(trace_cluster,cluster_name,31);
+    strncpy(trace_cloud,cloud_flag,15);
+    if(strlen(trace_command_span.phase)==0){
+        trace_span_start(&trace_command_span,"command");
+    }
+}
+
+void trace_span_start(trace_span* span, char* phase){
+    if(span==NULL||phase==NULL){
+        return;
+    }
+    strncpy(span->phase,phase,31);
+    span->start_ms=get_monotonic_ms();
+    span->start_epoch=(int_64bit)time(NULL);
+}
+
+/*
+ * Append a span record to the trace log:
+ * DATE,TIME,COMMAND,CLUSTER,CLOUD,PHASE,DURATION_MS,EXIT_CODE
+ * return -1: span not started or context not set
+ * return -3: failed to write the trace log
+ */
+int trace_span_end(trace_span* span, int exit_code){
+    time_t start_time;
+    struct tm* time_p=NULL;
+    int_64bit duration_ms;
+    FILE* file_p=NULL;
+    if(span==NULL||strlen(span->phase)==0||strlen(trace_command)==0){
+        return -1;
+    }
+    duration_ms=get_monotonic_ms()-span->start_ms;
+    start_time=(time_t)span->start_epoch;
+    time_p=gmtime(&start_time);
+    file_p=fopen(OPERATION_TRACE_LOG,"a+");
+    if(file_p==NULL){
+        return -3;
+    }
+    fprintf(file_p,"%d-%d-%d,%d:%d:%d,%s,%s,%s,%s,%lld,%d\n",time_p->tm_year+1900,time_p->tm_mon+1,time_p->tm_mday,time_p->tm_hour,time_p->tm_min,time_p->tm_sec,trace_command,(strlen(trace_cluster)==0)?"NULL":trace_cluster,(strlen(trace_cloud)==0)?"NULL":trace_cloud,span->phase,duration_ms,exit_code);
+    fclose(file_p);
+    /* The commands and the tf phases are counted for the operator metrics */
+    if(strcmp(span->phase,"command")==0){
+        update_operator_metrics("command",trace_command,trace_cluster,exit_code,duration_ms,0);
+    }
+    else if(strncmp(span->phase,"tf_",3)==0){
+        update_operator_metrics("tf",span->phase,trace_cloud,exit_code,duration_ms,0);
+    }
+    strcpy(span->phase,"");
+    return 0;
+}
+
+/* Record the whole-command span. It is called by write_operation_log(). */
+int trace_command_end(int exit_code){
+    return trace_span_end(&trace_command_span,exit_code);
 }
\ No newline at end of file
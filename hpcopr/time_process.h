@@ -9,6 +9,13 @@
 #define TIME_PROCESS_H
 
 void datetime_to_num(char* date_string, char* time_string, struct tm* datetime_num);
+void date_epoch_cache_reset(date_epoch_cache* cache);
+int_64bit datetime_fast_epoch(char* date_string, char* time_string, date_epoch_cache* cache);
 double calc_running_hours(char* prev_date, char* prev_time, char* current_date, char* current_time);
+int_64bit get_monotonic_ms(void);
+void set_trace_context(char* command, char* cluster_name, char* cloud_flag);
+void trace_span_start(trace_span* span, char* phase);
+int trace_span_end(trace_span* span, int exit_code);
+int trace_command_end(int exit_code);
 
 #endif
\ No newline at end of file
@@ -9,15 +9,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <fcntl.h>
 
 #ifndef _WIN32
 #include <sys/time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#else
+#include <io.h>
+#include <process.h>
+#include <sys/locking.h>
+#include <sys/stat.h>
 #endif
 
 #include "now_macros.h"
 #include "general_funcs.h"
+#include "time_process.h"
 #include "usage_and_logs.h"
 
+typedef struct{
+    char cloud_flag[16];
+    char phase[32];
+    int_64bit* durations;
+    int count;
+    int capacity;
+} trace_profile_group;
+
 int view_system_logs(char* logfile, char* view_option, char* export_dest){
     char cmdline[CMDLINE_LENGTH]="";
     char logfile_temp[FILENAME_LENGTH]="";
@@ -96,5 +113,311 @@ int write_operation_log(char* cluster_name, char* operation_logfile, int argc, c
     }
     fprintf(file_p,"%d-%d-%d,%d:%d:%d,%s,%s,%s,%d\n",time_p->tm_year+1900,time_p->tm_mon+1,time_p->tm_mday,time_p->tm_hour,time_p->tm_min,time_p->tm_sec,cluster_name,cmdline,description,runflag);
     fclose(file_p);
+    trace_command_end(runflag);
+    return 0;
+}
+
+int compare_duration(const void* a, const void* b){
+    int_64bit duration_a=*(const int_64bit*)a;
+    int_64bit duration_b=*(const int_64bit*)b;
+    if(duration_a<duration_b){
+        return -1;
+    }
+    else if(duration_a>duration_b){
+        return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
+
+/* Nearest-rank percentile of a sorted array */
+int_64bit get_percentile(int_64bit* sorted_durations, int count, int percent){
+    int rank;
+    if(count<1){
+        return 0;
+    }
+    rank=(percent*count+99)/100;
+    if(rank<1){
+        rank=1;
+    }
+    return sorted_durations[rank-1];
+}
+
+/*
+ * Aggregate the trace log and print the p50/p95 durations per phase per cloud.
+ * cmd_filter and cloud_filter can be empty strings ("") to include all the records.
+ * return -1: failed to open the trace log
+ * return -3: memory allocation failed
+ * return -5: failed to export
+ * return 1: no matched records
+ */
+int show_trace_profile(char* trace_logfile, char* cmd_filter, char* cloud_filter, char* export_dest){
+    FILE* file_p=NULL;
+    FILE* file_p_export=NULL;
+    char line_buffer[LINE_LENGTH_SHORT]="";
+    char command[64]="";
+    char cloud_flag[16]="";
+    char phase[32]="";
+    char duration_string[32]="";
+    trace_profile_group groups[TRACE_PROFILE_GROUP_MAX];
+    trace_profile_group* group_p=NULL;
+    int_64bit* durations_new=NULL;
+    int group_num=0;
+    int i;
+    int run_flag=0;
+    file_p=fopen(trace_logfile,"r");
+    if(file_p==NULL){
+        printf(FATAL_RED_BOLD "[ FATAL: ] Failed to open the trace log. Please run some cluster operations first." RESET_DISPLAY "\n");
+        return -1;
+    }
+    while(fngetline(file_p,line_buffer,LINE_LENGTH_SHORT)!=1){
+        get_seq_nstring(line_buffer,',',3,command,64);
+        get_seq_nstring(line_buffer,',',5,cloud_flag,16);
+        get_seq_nstring(line_buffer,',',6,phase,32);
+        get_seq_nstring(line_buffer,',',7,duration_string,32);
+        if(strlen(phase)==0||strlen(duration_string)==0){
+            continue;
+        }
+        if(strlen(cmd_filter)!=0&&strcmp(cmd_filter,command)!=0){
+            continue;
+        }
+        if(strlen(cloud_filter)!=0&&strcmp(cloud_filter,cloud_flag)!=0){
+            continue;
+        }
+        group_p=NULL;
+        for(i=0;i<group_num;i++){
+            if(strcmp(groups[i].cloud_flag,cloud_flag)==0&&strcmp(groups[i].phase,phase)==0){
+                group_p=&groups[i];
+                break;
+            }
+        }
+        if(group_p==NULL){
+            if(group_num==TRACE_PROFILE_GROUP_MAX){
+                continue;
+            }
+            group_p=&groups[group_num];
+            strcpy(group_p->cloud_flag,cloud_flag);
+            strcpy(group_p->phase,phase);
+            group_p->durations=NULL;
+            group_p->count=0;
+            group_p->capacity=0;
+            group_num++;
+        }
+        if(group_p->count==group_p->capacity){
+            durations_new=(int_64bit*)realloc(group_p->durations,sizeof(int_64bit)*(group_p->capacity+64));
+            if(durations_new==NULL){
+                run_flag=-3;
+                break;
+            }
+            group_p->durations=durations_new;
+            group_p->capacity+=64;
+        }
+        group_p->durations[group_p->count]=atoll(duration_string);
+        group_p->count++;
+    }
+    fclose(file_p);
+    if(run_flag!=0){
+        printf(FATAL_RED_BOLD "[ FATAL: ] Failed to allocate memory to aggregate the trace log." RESET_DISPLAY "\n");
+        for(i=0;i<group_num;i++){
+            free(groups[i].durations);
+        }
+        return run_flag;
+    }
+    if(group_num==0){
+        printf(WARN_YELLO_BOLD "[ -WARN- ] No trace records matched." RESET_DISPLAY "\n");
+        return 1;
+    }
+    if(strlen(export_dest)!=0){
+        file_p_export=fopen(export_dest,"w+");
+        if(file_p_export==NULL){
+            printf(FATAL_RED_BOLD "[ FATAL: ] Failed to export the profile to " RESET_DISPLAY WARN_YELLO_BOLD "%s" RESET_DISPLAY FATAL_RED_BOLD " ." RESET_DISPLAY "\n",export_dest);
+            run_flag=-5;
+        }
+        else{
+            fprintf(file_p_export,"CLOUD,PHASE,COUNT,P50_SEC,P95_SEC,MAX_SEC\n");
+        }
+    }
+    printf(GENERAL_BOLD "| %-8s | %-16s | %6s | %10s | %10s | %10s |" RESET_DISPLAY "\n","CLOUD","PHASE","COUNT","P50(s)","P95(s)","MAX(s)");
+    for(i=0;i<group_num;i++){
+        qsort(groups[i].durations,groups[i].count,sizeof(int_64bit),compare_duration);
+        printf("| %-8s | " HIGH_CYAN_BOLD "%-16s" RESET_DISPLAY " | %6d | %10.3lf | %10.3lf | %10.3lf |\n",groups[i].cloud_flag,groups[i].phase,groups[i].count,get_percentile(groups[i].durations,groups[i].count,50)/1000.0,get_percentile(groups[i].durations,groups[i].count,95)/1000.0,groups[i].durations[groups[i].count-1]/1000.0);
+        if(file_p_export!=NULL){
+            fprintf(file_p_export,"%s,%s,%d,%.3lf,%.3lf,%.3lf\n",groups[i].cloud_flag,groups[i].phase,groups[i].count,get_percentile(groups[i].durations,groups[i].count,50)/1000.0,get_percentile(groups[i].durations,groups[i].count,95)/1000.0,groups[i].durations[groups[i].count-1]/1000.0);
+        }
+        free(groups[i].durations);
+    }
+    if(file_p_export!=NULL){
+        fclose(file_p_export);
+        printf(GENERAL_BOLD "[ -DONE- ]" RESET_DISPLAY " The profile has been exported to " HIGH_GREEN_BOLD "%s" RESET_DISPLAY " .\n",export_dest);
+    }
+    return run_flag;
+}
+/*
+ * Update a record of the operator metrics state and render the state to the
+ * OpenMetrics text served by now-server. The state is small, so it is rewritten
+ * as a whole every time, under an exclusive lock of OPERATOR_METRICS_STATE.lock,
+ * so that the concurrent hpcopr processes don't lose each other's updates.
+ * kind "command": name is the command, label is the cluster
+ * kind "tf": name is the tf phase, label is the cloud
+ *     value1 is the exit code, value2 is the duration in ms. Accumulated to
+ *     runs, failures and the duration sum.
+ * kind "cluster": name is the cluster
+ *     value1 is the running compute nodes, value2 is the total compute nodes,
+ *     value3 is the cores of a compute node. Replaced.
+ * return -1: failed to read or write the state
+ * return -3: memory allocation failed
+ * return 0: normal exit
+ */
+int update_operator_metrics(char* kind, char* name, char* label, int_64bit value1, int_64bit value2, int_64bit value3){
+    operator_metric* records=NULL;
+    char state_temp[FILENAME_LENGTH]="";
+    char lock_file[FILENAME_LENGTH]="";
+    char line[LINE_LENGTH_SHORT]="";
+    int record_num=0;
+    int run_flag=0;
+    int lock_fd;
+    int i;
+    FILE* file_p=NULL;
+    if(kind==NULL||name==NULL||label==NULL||strlen(name)==0||strchr(name,' ')!=NULL||strchr(label,' ')!=NULL){
+        return -1;
+    }
+    records=(operator_metric*)malloc(sizeof(operator_metric)*OPERATOR_METRICS_MAX);
+    if(records==NULL){
+        return -3;
+    }
+    snprintf(lock_file,FILENAME_LENGTH-1,"%s.lock",OPERATOR_METRICS_STATE);
+#ifdef _WIN32
+    lock_fd=_open(lock_file,_O_CREAT|_O_RDWR,_S_IREAD|_S_IWRITE);
+    if(lock_fd>-1&&_locking(lock_fd,_LK_LOCK,1)!=0){
+        _close(lock_fd);
+        lock_fd=-1;
+    }
+#else
+    lock_fd=open(lock_file,O_CREAT|O_RDWR,0644);
+    if(lock_fd>-1&&flock(lock_fd,LOCK_EX)!=0){
+        close(lock_fd);
+        lock_fd=-1;
+    }
+#endif
+    if(lock_fd<0){
+        free(records);
+        return -1;
+    }
+    file_p=fopen(OPERATOR_METRICS_STATE,"r");
+    if(file_p!=NULL){
+        while(record_num<OPERATOR_METRICS_MAX&&fgets(line,LINE_LENGTH_SHORT-1,file_p)!=NULL){
+            if(sscanf(line,"%15s %63s %31s %lld %lld %lld %lld",records[record_num].kind,records[record_num].name,records[record_num].label,&records[record_num].values[0],&records[record_num].values[1],&records[record_num].values[2],&records[record_num].updated)==7){
+                record_num++;
+            }
+        }
+        fclose(file_p);
+    }
+    for(i=0;i<record_num;i++){
+        if(strcmp(records[i].kind,kind)==0&&strcmp(records[i].name,name)==0&&strcmp(records[i].label,(strlen(label)==0)?"NULL":label)==0){
+            break;
+        }
+    }
+    if(i==record_num){
+        if(record_num==OPERATOR_METRICS_MAX){
+            run_flag=-1;
+            goto unlock;
+        }
+        memset(&records[i],0,sizeof(operator_metric));
+        strncpy(records[i].kind,kind,15);
+        strncpy(records[i].name,name,63);
+        strncpy(records[i].label,(strlen(label)==0)?"NULL":label,31);
+        record_num++;
+    }
+    if(strcmp(kind,"cluster")==0){
+        records[i].values[0]=value1;
+        records[i].values[1]=value2;
+        records[i].values[2]=value3;
+    }
+    else{
+        records[i].values[0]++;
+        records[i].values[1]+=(value1!=0)?1:0;
+        records[i].values[2]+=value2;
+    }
+    records[i].updated=(int_64bit)time(NULL);
+#ifdef _WIN32
+    snprintf(state_temp,FILENAME_LENGTH-1,"%s.%d.tmp",OPERATOR_METRICS_STATE,(int)_getpid());
+#else
+    snprintf(state_temp,FILENAME_LENGTH-1,"%s.%d.tmp",OPERATOR_METRICS_STATE,(int)getpid());
+#endif
+    file_p=fopen(state_temp,"w+");
+    if(file_p==NULL){
+        run_flag=-1;
+        goto unlock;
+    }
+    for(i=0;i<record_num;i++){
+        fprintf(file_p,"%s %s %s %lld %lld %lld %lld\n",records[i].kind,records[i].name,records[i].label,records[i].values[0],records[i].values[1],records[i].values[2],records[i].updated);
+    }
+    fclose(file_p);
+    remove(OPERATOR_METRICS_STATE);
+    if(rename(state_temp,OPERATOR_METRICS_STATE)!=0||render_operator_metrics(records,record_num,OPERATOR_METRICS_FILE)!=0){
+        run_flag=-1;
+    }
+
+unlock:
+#ifdef _WIN32
+    _locking(lock_fd,_LK_UNLCK,1);
+    _close(lock_fd);
+#else
+    close(lock_fd);
+#endif
+    free(records);
+    return run_flag;
+}
+
+/*
+ * Write the OpenMetrics text of the operator metrics records.
+ * return -1: failed to write
+ * return 0: normal exit
+ */
+int render_operator_metrics(operator_metric* records, int record_num, char* metrics_file){
+    char metrics_temp[FILENAME_LENGTH]="";
+    char families[11][48]={"hpcnow_operator_commands","hpcnow_operator_command_failures","hpcnow_operator_command_duration_seconds","hpcnow_operator_tf_runs","hpcnow_operator_tf_failures","hpcnow_operator_tf_duration_seconds","hpcnow_cluster_running_compute_nodes","hpcnow_cluster_total_compute_nodes","hpcnow_cluster_running_cores","hpcnow_cluster_total_cores","hpcnow_cluster_state_timestamp_seconds"};
+    char family_kinds[11][16]={"command","command","command","tf","tf","tf","cluster","cluster","cluster","cluster","cluster"};
+    char family_types[11][16]={"counter","counter","summary","counter","counter","summary","gauge","gauge","gauge","gauge","gauge"};
+    int i,j;
+    FILE* file_p=NULL;
+    snprintf(metrics_temp,FILENAME_LENGTH-1,"%s.tmp",metrics_file);
+    file_p=fopen(metrics_temp,"w+");
+    if(file_p==NULL){
+        return -1;
+    }
+    for(j=0;j<11;j++){
+        fprintf(file_p,"# TYPE %s %s\n",families[j],family_types[j]);
+        for(i=0;i<record_num;i++){
+            if(strcmp(records[i].kind,family_kinds[j])!=0){
+                continue;
+            }
+            if(j==0||j==1){
+                fprintf(file_p,"%s_total{command=\"%s\",cluster=\"%s\"} %lld\n",families[j],records[i].name,records[i].label,records[i].values[j]);
+            }
+            else if(j==2){
+                fprintf(file_p,"%s_count{command=\"%s\",cluster=\"%s\"} %lld\n",families[j],records[i].name,records[i].label,records[i].values[0]);
+                fprintf(file_p,"%s_sum{command=\"%s\",cluster=\"%s\"} %.3lf\n",families[j],records[i].name,records[i].label,records[i].values[2]/1000.0);
+            }
+            else if(j==3||j==4){
+                fprintf(file_p,"%s_total{phase=\"%s\",cloud=\"%s\"} %lld\n",families[j],records[i].name,records[i].label,records[i].values[j-3]);
+            }
+            else if(j==5){
+                fprintf(file_p,"%s_count{phase=\"%s\",cloud=\"%s\"} %lld\n",families[j],records[i].name,records[i].label,records[i].values[0]);
+                fprintf(file_p,"%s_sum{phase=\"%s\",cloud=\"%s\"} %.3lf\n",families[j],records[i].name,records[i].label,records[i].values[2]/1000.0);
+            }
+            else if(j==6||j==7){
+                fprintf(file_p,"%s{cluster=\"%s\"} %lld\n",families[j],records[i].name,records[i].values[j-6]);
+            }
+            else if(j==8||j==9){
+                fprintf(file_p,"%s{cluster=\"%s\"} %lld\n",families[j],records[i].name,records[i].values[j-8]*records[i].values[2]);
+            }
+            else{
+                fprintf(file_p,"%s{cluster=\"%s\"} %lld\n",families[j],records[i].name,records[i].updated);
+            }
+        }
+    }
+    fprintf(file_p,"# EOF\n");
+    fclose(file_p);
+    remove(metrics_file);
+    return (rename(metrics_temp,metrics_file)==0)?0:-1;
+}
@@ -10,5 +10,10 @@
 
 int view_system_logs(char* logfile, char* view_option, char* export_path);
 int write_operation_log(char* cluster_name, char* operation_logfile, int argc, char** argv, char* description, int runflag);
+int compare_duration(const void* a, const void* b);
+int_64bit get_percentile(int_64bit* sorted_durations, int count, int percent);
+int show_trace_profile(char* trace_logfile, char* cmd_filter, char* cloud_filter, char* export_dest);
+int update_operator_metrics(char* kind, char* name, char* label, int_64bit value1, int_64bit value2, int_64bit value3);
+int render_operator_metrics(operator_metric* records, int record_num, char* metrics_file);
 
 #endif
\ No newline at end of file
@@ -115,6 +115,7 @@ int hpc_user_delete(char* workdir, char* crypto_keyfile, char* sshkey_dir, char*
     char user_registry_file[FILENAME_LENGTH]="";
     char remote_commands[CMDLINE_LENGTH]="";
     char cluster_name[CLUSTER_ID_LENGTH_MAX_PLUS]="";
+    remote_batch batch;
     create_and_get_subdir(workdir,"vault",vaultdir,DIR_LENGTH);
     if(get_cluster_nname(cluster_name,CLUSTER_ID_LENGTH_MAX_PLUS,workdir)!=0){
         delete_decrypted_user_passwords(workdir);
@@ -126,10 +127,14 @@ int hpc_user_delete(char* workdir, char* crypto_keyfile, char* sshkey_dir, char*
         delete_decrypted_user_passwords(workdir);
         return -3;
     }
+    remote_batch_init(&batch,1,0);
     snprintf(remote_commands,CMDLINE_LENGTH-1,"echo y-e-s | hpcmgr users delete %s os",username);
-    if(remote_exec_general(workdir,crypto_keyfile,sshkey_dir,"root",remote_commands,"-n",0,0,"","")==0){
-        snprintf(remote_commands,CMDLINE_LENGTH-1,"cat /root/.cluster_secrets/user_secrets.txt | grep -w %s",username);
-        if(remote_exec_general(workdir,crypto_keyfile,sshkey_dir,"root",remote_commands,"-n",0,0,"","")==0){
+    remote_batch_add(&batch,"exec",remote_commands,"");
+    snprintf(remote_commands,CMDLINE_LENGTH-1,"grep -qw %s /root/.cluster_secrets/user_secrets.txt",username);
+    remote_batch_add(&batch,"exec",remote_commands,"");
+    remote_batch_run(workdir,crypto_keyfile,sshkey_dir,"root",&batch);
+    if(batch.steps[0].exit_code==0){
+        if(batch.steps[1].exit_code==0||batch.steps[1].exit_code<0){
             printf(FATAL_RED_BOLD "[ FATAL: ] Failed to delete the user %s from your cluster." RESET_DISPLAY "\n",username);
             delete_decrypted_user_passwords(workdir);
             return 1;
@@ -138,6 +143,7 @@ int hpc_user_delete(char* workdir, char* crypto_keyfile, char* sshkey_dir, char*
             delete_user_from_registry(user_registry_file,username);
             encrypt_and_delete_user_passwords(workdir,crypto_keyfile);
             delete_user_sshkey(cluster_name,username,sshkey_dir);
+            close_ssh_mux(workdir,crypto_keyfile,username);
             printf(GENERAL_BOLD "[ -INFO- ]" RESET_DISPLAY " Successfully deleted user %s.\n",username);
             return 0;
         }
@@ -267,6 +273,8 @@ int hpc_user_add(char* workdir, char* sshkey_dir, char* crypto_keyfile, char* us
     char user_registry_file[FILENAME_LENGTH]="";
     char remote_commands[CMDLINE_LENGTH]="";
     char cluster_name[CLUSTER_ID_LENGTH_MAX_PLUS]="";
+    char secret_file[FILENAME_LENGTH]="";
+    remote_batch batch;
     FILE* file_p=NULL;
     create_and_get_subdir(workdir,"vault",vaultdir,DIR_LENGTH);
     if(get_cluster_nname(cluster_name,CLUSTER_ID_LENGTH_MAX_PLUS,workdir)!=0){
@@ -282,10 +290,17 @@ int hpc_user_add(char* workdir, char* sshkey_dir, char* crypto_keyfile, char* us
         delete_decrypted_user_passwords(workdir);
         return -5;
     }
-    snprintf(remote_commands,CMDLINE_LENGTH-1,"hpcmgr users add %s '%s'",username,password); /* Added '' to enclose the password string*/
-    if(remote_exec_general(workdir,crypto_keyfile,sshkey_dir,"root",remote_commands,"-n",0,0,"","")==0){
-        snprintf(remote_commands,CMDLINE_LENGTH-1,"cat /root/.cluster_secrets/user_secrets.txt | grep -w %s | grep 'STATUS:ENABLED'",username);
-        if(remote_exec_general(workdir,crypto_keyfile,sshkey_dir,"root",remote_commands,"-n",0,0,"","")==0){
+    remote_batch_init(&batch,1,0);
+    /* The password goes as a 0600 file and is removed by the step using it, not in any command line. */
+    snprintf(secret_file,FILENAME_LENGTH-1,"/root/.cluster_secrets/.user_add_%s.tmp",username);
+    remote_batch_add(&batch,"secret",password,secret_file);
+    snprintf(remote_commands,CMDLINE_LENGTH-1,"hpcmgr users add %s \"$(cat %s)\"; rc=$?; rm -f %s; exit $rc",username,secret_file,secret_file);
+    remote_batch_add(&batch,"exec",remote_commands,"");
+    snprintf(remote_commands,CMDLINE_LENGTH-1,"grep -w %s /root/.cluster_secrets/user_secrets.txt | grep -q 'STATUS:ENABLED'",username);
+    remote_batch_add(&batch,"exec",remote_commands,"");
+    remote_batch_run(workdir,crypto_keyfile,sshkey_dir,"root",&batch);
+    if(batch.steps[0].exit_code==0){
+        if(batch.steps[1].exit_code==0&&batch.steps[2].exit_code==0){
             printf("[ -INFO- ] Updating the local user-info registry ...\n");
             file_p=fopen(user_registry_file,"a");
             fprintf(file_p,"username: %s %s STATUS:ENABLED\n",username,password);
@@ -25,10 +25,11 @@ elif [ "$1" = "build" ]; then
     clang -c ./hpcopr/opr_crypto.c -Wall -o ./installer/ocrypto.o
     clang -c ./hpcopr/cluster_general_funcs.c -Wall -o ./installer/cgfuncs.o
     clang -c ./hpcopr/time_process.c -Wall -o ./installer/tproc.o
+    clang -c ./hpcopr/usage_and_logs.c -Wall -o ./installer/ulogs.o
     clang -c ./hpcopr/general_print_info.c -Wall -o ./installer/gprint.o
     clang -c ./hpcopr/now_md5.c -Wall -o ./installer/md5.o
     clang -c ./hpcopr/now_sha256.c -Wall -o ./installer/sha256.o
-    ar -rc ./installer/libnow.a ./installer/gfuncs.o ./installer/ocrypto.o ./installer/cgfuncs.o ./installer/tproc.o ./installer/md5.o ./installer/gprint.o ./installer/sha256.o
+    ar -rc ./installer/libnow.a ./installer/gfuncs.o ./installer/ocrypto.o ./installer/cgfuncs.o ./installer/tproc.o ./installer/ulogs.o ./installer/md5.o ./installer/gprint.o ./installer/sha256.o
     clang ./installer/installer.c ./installer/libnow.a -Wall -o ./build/installer-dwn-${installer_version_code}.exe
     clang ./now-crypto/now-crypto-v3-aes.c -Wall -Ofast -o ./build/now-crypto-aes-dwn.exe
     chmod +x ./build/*
@@ -38,13 +38,15 @@ elif [ "$1" = "build" ]; then
     ${compiler} -c ./hpcopr/opr_crypto.c -Wall -o ./installer/ocrypto.o
     ${compiler} -c ./hpcopr/cluster_general_funcs.c -Wall -o ./installer/cgfuncs.o
     ${compiler} -c ./hpcopr/time_process.c -Wall -o ./installer/tproc.o
+    ${compiler} -c ./hpcopr/usage_and_logs.c -Wall -o ./installer/ulogs.o
     ${compiler} -c ./hpcopr/general_print_info.c -Wall -o ./installer/gprint.o
     ${compiler} -c ./hpcopr/now_md5.c -Wall -o ./installer/md5.o
     ${compiler} -c ./hpcopr/now_sha256.c -Wall -o ./installer/sha256.o
-    ar -rc ./installer/libnow.a ./installer/gfuncs.o ./installer/ocrypto.o ./installer/cgfuncs.o ./installer/tproc.o ./installer/md5.o ./installer/gprint.o ./installer/sha256.o
+    ar -rc ./installer/libnow.a ./installer/gfuncs.o ./installer/ocrypto.o ./installer/cgfuncs.o ./installer/tproc.o ./installer/ulogs.o ./installer/md5.o ./installer/gprint.o ./installer/sha256.o
     ${compiler} ./installer/installer.c -Wall ./installer/libnow.a -o ./build/installer-lin-${installer_version_code}.exe
     ${compiler} ./now-crypto/now-crypto-v3-aes.c -Wall -Ofast -o ./build/now-crypto-aes-lin.exe
     ${compiler} ./hpcmgr/hpcmgr.c -Wall -o ./build/hpcmgr.exe
+    ${compiler} ./hpcmgr/nowmon_agt.c -Wall -O2 -o ./build/nowmon_agt.exe
     ${compiler} ./now-server/now-server.c -Wall -o ./build/now-server.exe
     chmod +x ./build/*
     rm -rf ./installer/*.a
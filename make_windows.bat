@@ -26,10 +26,11 @@ if "%~1"=="" (
     gcc -c .\hpcopr\opr_crypto.c -Wall -o .\installer\ocrypto.o
     gcc -c .\hpcopr\cluster_general_funcs.c -Wall -o .\installer\cgfuncs.o
     gcc -c .\hpcopr\time_process.c -Wall -o .\installer\tproc.o
+    gcc -c .\hpcopr\usage_and_logs.c -Wall -o .\installer\ulogs.o
     gcc -c .\hpcopr\general_print_info.c -Wall -o .\installer\gprint.o
     gcc -c .\hpcopr\now_md5.c -Wall -o .\installer\md5.o
     gcc -c .\hpcopr\now_sha256.c -Wall -o .\installer\sha256.o
-    ar -rc .\installer\libnow.a .\installer\gfuncs.o .\installer\ocrypto.o .\installer\cgfuncs.o .\installer\tproc.o .\installer\md5.o .\installer\gprint.o .\installer\sha256.o
+    ar -rc .\installer\libnow.a .\installer\gfuncs.o .\installer\ocrypto.o .\installer\cgfuncs.o .\installer\tproc.o .\installer\ulogs.o .\installer\md5.o .\installer\gprint.o .\installer\sha256.o
     gcc .\installer\installer.c .\installer\libnow.a -lnetapi32 -lpthread -Wall -o .\build\installer-win-%installer_version_code%.exe
     gcc .\now-crypto\now-crypto-v3-aes.c -Wall -Ofast -o .\build\now-crypto-aes-win.exe
     del /f /s /q .\installer\*.a > nul
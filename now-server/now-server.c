@@ -13,9 +13,18 @@
  * Example: ./myhpcopr graph -c test0001
  * 
  * Server Init Format:
- * SERVER_EXEC (Optional)--client-io (Optional)port_number(10001~65535)
+ * SERVER_EXEC (Optional)--client-io (Optional)port_number(10001~65535) (Optional)--autoscale
  * Example: ./myserver --client-io 25535
  * 
+ * Metrics Format:
+ * GET /metrics (HTTP) returns the operator metrics rendered by hpcopr as OpenMetrics text.
+ * The text is kept in memory and only reloaded after hpcopr rewrites it.
+ * 
+ * Background Task:
+ * --autoscale runs hpcopr autoscale --loop for the current cluster in a child process
+ * group, the output goes to AUTOSCALE_LOG. The group is killed when the server gets
+ * SIGINT or SIGTERM, and hpcopr refuses a second loop for the same cluster.
+ * 
  * Press Ctrl+C to exit the server.
  */
 
@@ -27,11 +36,92 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #define DEFAULT_PORT 19885
 #define BUFFER_SIZE 1024
 #define CMDLINE_LENGTH 2048
-#define SERVER_VERSION_CODE "0.2.0.0001"
+#define SERVER_VERSION_CODE "0.2.0.0003"
+#define METRICS_FILE "/usr/.hpc-now/now_logs/now-operator-metrics.prom"
+#define METRICS_SIZE_MAX 4194304
+#define AUTOSCALE_LOG "/usr/.hpc-now/now_logs/now-server-autoscale.log"
+
+static volatile pid_t autoscale_pid=0;
+
+/*
+ * Reload the metrics text if the file has changed since the last load.
+ * return -1: no metrics available
+ * return 0: the text in memory is up to date
+ */
+int load_metrics(char** metrics_text, size_t* metrics_len, struct stat* metrics_stat){
+    struct stat file_stat;
+    char* new_text=NULL;
+    size_t read_len;
+    FILE* file_p=NULL;
+    if(stat(METRICS_FILE,&file_stat)!=0||file_stat.st_size<1||file_stat.st_size>METRICS_SIZE_MAX){
+        return (*metrics_text==NULL)?-1:0;
+    }
+    if(*metrics_text!=NULL&&file_stat.st_mtime==metrics_stat->st_mtime&&file_stat.st_size==metrics_stat->st_size&&file_stat.st_ino==metrics_stat->st_ino){
+        return 0;
+    }
+    new_text=(char*)malloc((size_t)file_stat.st_size);
+    file_p=fopen(METRICS_FILE,"r");
+    if(new_text==NULL||file_p==NULL){
+        free(new_text);
+        if(file_p!=NULL){
+            fclose(file_p);
+        }
+        return (*metrics_text==NULL)?-1:0;
+    }
+    read_len=fread(new_text,1,(size_t)file_stat.st_size,file_p);
+    fclose(file_p);
+    free(*metrics_text);
+    *metrics_text=new_text;
+    *metrics_len=read_len;
+    *metrics_stat=file_stat;
+    return 0;
+}
+
+/* Reap the autoscale child only, the hpcopr runs of the clients are waited by system(). */
+void reap_autoscale(int signum){
+    (void)signum;
+    if(autoscale_pid>0&&waitpid(autoscale_pid,NULL,WNOHANG)==autoscale_pid){
+        autoscale_pid=0;
+    }
+}
+
+void stop_server(int signum){
+    if(autoscale_pid>0){
+        kill(-autoscale_pid,SIGTERM);
+        waitpid(autoscale_pid,NULL,0);
+    }
+    _exit(128+signum);
+}
+
+/*
+ * The child leads a new process group, so the shell and the hpcopr under it
+ * are killed together.
+ * return -1: failed to fork
+ * return N>0: the pid of the autoscale child
+ */
+int start_autoscale(void){
+    char cmdline[CMDLINE_LENGTH]="";
+    pid_t pid=fork();
+    if(pid<0){
+        return -1;
+    }
+    if(pid>0){
+        setpgid(pid,pid);
+        autoscale_pid=pid;
+        return (int)pid;
+    }
+    setpgid(0,0);
+    snprintf(cmdline,CMDLINE_LENGTH-1,"hpcopr -b autoscale --loop >> %s 2>&1",AUTOSCALE_LOG);
+    execl("/bin/sh","sh","-c",cmdline,(char*)NULL);
+    _exit(127);
+}
 
 int main(int argc, char** argv){
     int socket_fd,connect_fd;
@@ -39,10 +129,14 @@ int main(int argc, char** argv){
     int port_num=0;
     int i,j;
     struct sockaddr_in server_address;
+    struct sigaction signal_action;
     char ingress_buffer[BUFFER_SIZE]="";
     char egress_buffer[BUFFER_SIZE]="";
     char cmdline[CMDLINE_LENGTH]="";
     char io_stream[32]="";
+    char* metrics_text=NULL;
+    size_t metrics_len=0;
+    struct stat metrics_stat;
     FILE* file_p=NULL;
     
     if(argc==1){
@@ -91,11 +185,33 @@ int main(int argc, char** argv){
         return 127;
     }
     printf("[ -INFO- ] I/O stream: %s.\n",io_stream);
+    memset(&signal_action,0,sizeof(struct sigaction));
+    sigemptyset(&signal_action.sa_mask);
+    signal_action.sa_flags=SA_RESTART;
+    signal_action.sa_handler=reap_autoscale;
+    sigaction(SIGCHLD,&signal_action,NULL);
+    signal_action.sa_handler=stop_server;
+    sigaction(SIGINT,&signal_action,NULL);
+    sigaction(SIGTERM,&signal_action,NULL);
+    for(i=1;i<argc;i++){
+        if(strcmp(argv[i],"--autoscale")!=0){
+            continue;
+        }
+        j=start_autoscale();
+        if(j<0){
+            printf("[ -WARN- ] Failed to start the autoscale task. The service still works.\n");
+        }
+        else{
+            printf("[ -INFO- ] Autoscale task started (PID: %d). Log: %s\n",j,AUTOSCALE_LOG);
+        }
+        break;
+    }
     if((socket_fd=socket(AF_INET,SOCK_STREAM,0))==-1){
         printf("[ FATAL: ] Failed to create a socket: %s(errno: %d)\n",strerror(errno),errno);
         return 1;
     }
     memset(&server_address,0,sizeof(server_address));
+    memset(&metrics_stat,0,sizeof(struct stat));
     server_address.sin_family=AF_INET;
     server_address.sin_addr.s_addr=htonl(INADDR_ANY);
     server_address.sin_port=htons(port_num);
@@ -121,7 +237,21 @@ int main(int argc, char** argv){
             dup2(connect_fd,STDERR_FILENO);
         }
         memset(ingress_buffer,0,sizeof(char)*BUFFER_SIZE);
-        recv(connect_fd,ingress_buffer,BUFFER_SIZE,0);
+        recv(connect_fd,ingress_buffer,BUFFER_SIZE-1,0);
+        if(strncmp(ingress_buffer,"GET /metrics",12)==0){
+            if(load_metrics(&metrics_text,&metrics_len,&metrics_stat)!=0){
+                snprintf(egress_buffer,BUFFER_SIZE-1,"HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+                send(connect_fd,egress_buffer,strlen(egress_buffer),0);
+            }
+            else{
+                snprintf(egress_buffer,BUFFER_SIZE-1,"HTTP/1.1 200 OK\r\nContent-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",(unsigned long)metrics_len);
+                if(send(connect_fd,egress_buffer,strlen(egress_buffer),0)==-1||send(connect_fd,metrics_text,metrics_len,0)==-1){
+                    printf("[ -WARN- ] Failed to send the metrics to the client.\n");
+                }
+            }
+            close(connect_fd);
+            continue;
+        }
         sprintf(cmdline,"hpcopr -b %s",ingress_buffer);
         if(system(cmdline)!=0){
             printf("[ -WARN- ] The hpcopr reported running errors.\n");
@@ -191,11 +191,15 @@ fi
 
 /bin/cp -r ${scripts_path}* /usr/hpc-now/
 chmod +x /usr/hpc-now/*.sh
+if [ -f ${utils_path}nowmon_agt.exe ]; then
+  /bin/cp -r ${utils_path}nowmon_agt.exe /usr/hpc-now/nowmon_agt && chmod +x /usr/hpc-now/nowmon_agt
+fi
 if [ -f /root/hostfile ]; then
   wget ${url_utils}hpcmgr.sh -O /usr/hpc-now/.hpcmgr_main.sh
+  wget ${url_utils}now_chunk.sh -O /usr/hpc-now/now_chunk.sh && chmod +x /usr/hpc-now/now_chunk.sh
 fi
 
-yum -y install gcc bc openssl openssl-devel unzip curl make perl sshpass gtk2 gtk2-devel
+yum -y install gcc bc openssl openssl-devel unzip curl make perl sshpass gtk2 gtk2-devel rsync zstd
 # stop firewall and SELinux 
 systemctl stop firewalld
 systemctl disable firewalld
@@ -599,5 +603,17 @@ rm -rf /root/dun.gpg
 rm -rf /rpmbuild
 echo -e "Installation Finished."
 echo "*/1 * * * *  /usr/hpc-now/nowmon_mgr.sh " >> /var/spool/cron/root
+# Push the samples to the collector on the master every 10 seconds, if the agent is installed.
+# The daemons exit at once if they are running already.
+if [ -x /usr/hpc-now/nowmon_agt ]; then
+  if [ -f /root/hostfile ]; then
+    echo "*/1 * * * *  /usr/hpc-now/nowmon_agt --collect --daemon" >> /var/spool/cron/root
+    echo "*/1 * * * *  /usr/hpc-now/nowmon_agt --push 127.0.0.1 --daemon" >> /var/spool/cron/root
+  else
+    echo "*/1 * * * *  /usr/hpc-now/nowmon_agt --push master --daemon" >> /var/spool/cron/root
+  fi
+fi
 time_current=`date "+%Y-%m-%d %H:%M:%S"`
-echo -e "# $time_current Initialization Finished." >> ${logfile}
\ No newline at end of file
+echo -e "# $time_current Initialization Finished." >> ${logfile}
+# The marker is checked by 'hpcmgr ready' before refreshing the cluster. Keep it as the last step.
+echo -e "$time_current" > /root/.cluster_init_done
@@ -12,7 +12,9 @@ function help_info() {
   echo -e "|          quick      - quick config"
   echo -e "|          master     - refresh only master node"
   echo -e "|          connect    - check cluster connectivity"
+  echo -e "|          ready      - wait for each node to be reachable, then refresh"
   echo -e "|          all        - refresh the whole cluster"
+  echo -e "|          fanout     - run a command on many nodes concurrently"
   echo -e "|          clear      - clear the hostfile_dead_nodes list"
   echo -e "|          applist    - List out the apps in the store"
   echo -e "|          build      - build software from source"
@@ -79,9 +81,9 @@ private_app_registry="/hpc_apps/${current_user}_apps/.private_apps.reg"
 appstore_env="/usr/hpc-now/appstore_env.sh"
 applist_cache="/usr/hpc-now/.applist_cache.txt"
 
-main_menu=('quick' 'master' 'connect' 'all' 'clear' 'applist' 'build' 'install' 'remove' 'submit' 'users' 'appman-conf-update' 'appman-conf-show')
+main_menu=('quick' 'master' 'connect' 'ready' 'fanout' 'all' 'clear' 'applist' 'build' 'install' 'remove' 'submit' 'users' 'appman-conf-update' 'appman-conf-show')
 command_flag='false'
-for i in $(seq 0 13)
+for i in $(seq 0 15)
 do
   if [ $1 = ${main_menu[i]} ]; then
     command_flag='true'
@@ -409,6 +411,122 @@ elif [ $1 = 'quick' ]; then
   echo -e "[ -DONE- ] HPC-NOW Cluster Status:\n"
   sinfo -N
   exit 0
+elif [ $1 = 'ready' ]; then
+  if [ ! -f /root/hostfile ]; then
+    node_invalid_info
+    exit 3
+  fi
+  compute_passwd=`cat /root/.cluster_secrets/compute_passwd.txt`
+  ready_timeout=600
+  start_time=`date +%s`
+  echo -e "[ STEP 1 ] Waiting for the compute nodes to be reachable and initialized ... "
+  cat /root/hostfile | grep compute > /root/hostfile-ready
+  # Each node is probed by its own background loop, so a slow node doesn't use up the deadline of the others.
+  # The keys are not on the nodes yet, so this can't go through 'hpcmgr fanout' (BatchMode).
+  while read iprow
+  do
+    private_ip=`echo -e "$iprow" | awk -F"\t" '{print $1}'`
+    node_name=`echo -e "$iprow" | awk -F"\t" '{print $2}'`
+    (
+      while true
+      do
+        # cluster_initv7.sh writes the marker as its last step. Before that, munge and slurm may be still building.
+        # Nodes initialized by an older script only have the last line of the init log.
+        sshpass -p $compute_passwd ssh -n -q -o StrictHostKeyChecking=no -o ConnectTimeout=3 root@$private_ip "test -f /root/.cluster_init_done || grep -q 'Initialization Finished' /root/cluster_init.log" >> ${logfile} 2>&1
+        if [ $? -eq 0 ]; then
+          sshpass -p $compute_passwd scp -q -r /root/.ssh root@$private_ip:/root/ >> ${logfile} 2>&1
+          echo -e "[ STEP 1 ] $node_name with private IP $private_ip is ready after $((`date +%s`-start_time)) second(s)." | tee -a ${logfile}
+          break
+        fi
+        if [ $((`date +%s`-start_time)) -gt $ready_timeout ]; then
+          echo -e "[ -WARN- ] $node_name with private IP $private_ip is still not reachable or initialized. Skipped." | tee -a ${logfile}
+          break
+        fi
+        sleep 3
+      done
+    ) < /dev/null &
+  done < /root/hostfile-ready
+  wait
+  rm -rf /root/hostfile-ready
+  echo -e "[ STEP 2 ] Refreshing the cluster now ... "
+  if [ -n "$2" ] && [ $2 = 'quick' ]; then
+    hpcmgr quick
+  else
+    hpcmgr connect
+    hpcmgr all
+  fi
+  exit 0
+elif [ $1 = 'fanout' ]; then
+  # hpcmgr fanout NODE_LIST CONCURRENCY TIMEOUT "COMMAND"
+  # NODE_LIST is a file with one node name per line, or 'all' for all the compute nodes.
+  if [ ! -f /root/hostfile ]; then
+    node_invalid_info
+    exit 3
+  fi
+  if [ -z "$5" ]; then
+    echo -e "[ FATAL: ] Usage: hpcmgr fanout NODE_LIST CONCURRENCY TIMEOUT \"COMMAND\". Exit now."
+    exit 3
+  fi
+  fanout_max=$3
+  fanout_timeout=$4
+  if ! [[ $fanout_max =~ ^[0-9]+$ ]] || [ $fanout_max -lt 1 ]; then
+    fanout_max=16
+  fi
+  if ! [[ $fanout_timeout =~ ^[0-9]+$ ]] || [ $fanout_timeout -lt 1 ]; then
+    fanout_timeout=60
+  fi
+  fanout_dir=/tmp/hpcmgr_fanout_$$
+  mkdir -p $fanout_dir
+  if [ $2 = 'all' ]; then
+    cat /root/hostfile | grep compute | awk -F"\t" '{print $2}' > $fanout_dir/nodes
+  elif [ -f $2 ]; then
+    cat $2 > $fanout_dir/nodes
+  else
+    echo -e "[ FATAL: ] The node list $2 is not found. Exit now."
+    rm -rf $fanout_dir
+    exit 3
+  fi
+  while read node_name
+  do
+    if [ -z "$node_name" ]; then
+      continue
+    fi
+    while [ `jobs -rp | wc -l` -ge $fanout_max ]
+    do
+      sleep 0.2
+    done
+    (
+      timeout $fanout_timeout ssh -n -q -o StrictHostKeyChecking=no -o ConnectTimeout=5 -o BatchMode=yes $node_name "$5" > $fanout_dir/$node_name.out 2>&1
+      echo -e "$node_name\t$?" > $fanout_dir/$node_name.rc
+    ) &
+  done < $fanout_dir/nodes
+  wait
+  fanout_failed=0
+  while read node_name
+  do
+    if [ -z "$node_name" ]; then
+      continue
+    fi
+    node_rc=`cat $fanout_dir/$node_name.rc 2>/dev/null | awk -F"\t" '{print $2}'`
+    if [ -z "$node_rc" ]; then
+      node_rc=255
+    fi
+    if [ $node_rc -eq 0 ]; then
+      echo -e "[ -DONE- ] $node_name: exit code 0."
+    elif [ $node_rc -eq 124 ]; then
+      echo -e "[ -WARN- ] $node_name: timed out after $fanout_timeout second(s)."
+      fanout_failed=$((fanout_failed+1))
+    else
+      echo -e "[ -WARN- ] $node_name: exit code $node_rc."
+      fanout_failed=$((fanout_failed+1))
+    fi
+    cat $fanout_dir/$node_name.out 2>/dev/null | sed "s/^/|          /g"
+  done < $fanout_dir/nodes
+  rm -rf $fanout_dir
+  if [ $fanout_failed -ne 0 ]; then
+    exit 1
+  fi
+  exit 0
 elif [ $1 = 'connect' ]; then
   if [ ! -f /root/hostfile ]; then
     node_invalid_info
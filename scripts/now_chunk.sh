@@ -0,0 +1,76 @@
+# Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+# This code is distributed under the license: MIT License
+# Originally written by Zhenrong WANG
+# mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+
+#!/bin/bash
+
+# This script is the remote side of the multi-stream and compressed transfers of 'hpcopr dataman'.
+# The chunk offsets and lengths are in MiB.
+# now_chunk.sh prepare TARGET SIZE_BYTE FILE_NAME : create the target file with the full size, print the real target path
+#                                                  and 1 if it already existed with the same size, otherwise 0
+# now_chunk.sh put TARGET SKIP_MB COUNT_MB        : write the stdin to the range, print the sha256 of the range on disk
+# now_chunk.sh entropy SOURCE                      : print the sampled byte entropy of a file or folder, in milli-bits
+# now_chunk.sh tar SOURCE                          : write a zstd-compressed tar stream of a file or folder to stdout
+# now_chunk.sh untar TARGET                        : extract a zstd-compressed tar stream from stdin, like scp -r to TARGET
+
+if [ -z "$2" ]; then
+  echo -e "[ FATAL: ] Usage: now_chunk.sh prepare|put|entropy|tar|untar TARGET PARAMS. Exit now." >&2
+  exit 1
+fi
+zstd_options="-q -T0 --adapt=min=1,max=15"
+
+if [ $1 = 'prepare' ]; then
+  if [ -z "$3" ]; then
+    exit 1
+  fi
+  target=$2
+  if [ -d $target ]; then
+    target=${target%/}/$4
+  fi
+  mkdir -p `dirname $target` || exit 3
+  if [ -f $target ] && [ `stat -c %s $target` = $3 ]; then
+    existed=1
+  else
+    existed=0
+  fi
+  touch $target && truncate -s $3 $target || exit 3
+  echo -e "$target\n$existed"
+elif [ $1 = 'put' ]; then
+  if [ -z "$4" ] || [ ! -f $2 ]; then
+    exit 1
+  fi
+  dd of=$2 bs=1048576 seek=$3 conv=notrunc status=none || exit 3
+  dd if=$2 bs=1048576 skip=$3 count=$4 status=none | sha256sum | cut -c1-64
+elif [ $1 = 'entropy' ]; then
+  # Exit 9 if zstd is not available, the caller will not compress.
+  which zstd >> /dev/null 2>&1 || exit 9
+  sum=0
+  num=0
+  for file in `find $2 -type f 2>/dev/null | head -n 16`; do
+    entropy=`head -c 65536 $file | od -An -v -tu1 | tr -s ' ' '\n' | grep -v '^$' | sort -n | uniq -c | awk '{n+=$1; c[NR]=$1} END {h=0; for(i in c){p=c[i]/n; h-=p*log(p)/log(2)}; printf "%d", h*1000}'`
+    sum=$((sum+${entropy:-0}))
+    num=$((num+1))
+  done
+  if [ $num -eq 0 ]; then
+    exit 1
+  fi
+  echo $((sum/num))
+elif [ $1 = 'tar' ]; then
+  source=${2%/}
+  tar -cf - -C `dirname $source` `basename $source` | zstd $zstd_options -c
+elif [ $1 = 'untar' ]; then
+  target=${2%/}
+  if [ -d $target ]; then
+    zstd -q -dc | tar -xf - -C $target
+  else
+    mkdir -p `dirname $target` || exit 3
+    tmp_dir=`mktemp -d -p \`dirname $target\`` || exit 3
+    zstd -q -dc | tar -xf - -C $tmp_dir && mv $tmp_dir/`ls -A $tmp_dir | head -n 1` $target
+    result=$?
+    rm -rf $tmp_dir
+    exit $result
+  fi
+else
+  exit 1
+fi
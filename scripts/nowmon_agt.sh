@@ -5,6 +5,12 @@
 
 #!/bin/bash
 
+# Prefer the compiled agent (hpcmgr/nowmon_agt.c), which writes the same line
+# without forking top, lscpu, df, bc and awk. This script may be sourced.
+if [ -x /usr/hpc-now/nowmon_agt ] && /usr/hpc-now/nowmon_agt >> /dev/null 2>&1; then
+    return 0 >> /dev/null 2>&1 || exit 0
+fi
+
 curr_time=$(date "+%Y-%m-%d-%H-%M-%S")
 curr_date=`echo $curr_time | awk -F"-" '{print $1"-"$2"-"$3}'`
 curr_time_m=`echo $curr_time | awk -F"-" '{print $4":"$5}'`
@@ -10,18 +10,41 @@ statefile=/usr/hpc-now/currentstate
 sed -i 's/\r//g' $statefile
 cluster_mon_data=/hpc_data/cluster_data/mon_data.csv
 cluster_core_summary=/hpc_data/cluster_data/mon_cores.dat
-. /usr/hpc-now/nowmon_agt.sh
+# The nodes push their samples to the collector (nowmon_agt --collect) if it is running,
+# otherwise sample the master here and pull the compute nodes below. In both cases the
+# null lines of the stopped nodes are written here.
+push_mode=0
+collector_pid=`cat /usr/hpc-now/.nowmon_col.pid 2>/dev/null`
+if [ -n "$collector_pid" ] && kill -0 $collector_pid >> /dev/null 2>&1; then
+    push_mode=1
+else
+    . /usr/hpc-now/nowmon_agt.sh
+fi
 line=`tail -n 1 /hpc_data/cluster_data/mon_data.csv`
 header=`echo $line | awk -F"," '{for(i=1;i<=3;i++) {printf("%s,",$i)}}'`
 date_time=`echo $line | awk -F"," '{printf("%s %s",$1,$2)}'`
 idle_cores=0
 low_cores=0
+running_node_list=/tmp/nowmon_running_nodes.txt
+rm -rf $running_node_list
 for i in $(seq 1 $NODE_NUM)
 do
     flag=`cat $statefile | grep compute${i}_status | awk '{print $2}'`
     if [ $flag = 'Running' ] || [ $flag = 'running' ] || [ $flag = 'RUNNING' ]; then
-        ssh compute$i "bash /usr/hpc-now/nowmon_agt.sh"
-        cat /hpc_data/cluster_data/mon_data_compute$i.csv >> $cluster_mon_data
+        echo -e "compute$i" >> $running_node_list
+    fi
+done
+# Collect from all the running nodes concurrently, so that the run fits the 1-minute cron window.
+if [ -f $running_node_list ] && [ $push_mode -eq 0 ]; then
+    hpcmgr fanout $running_node_list 32 40 "bash /usr/hpc-now/nowmon_agt.sh" >> /dev/null 2>&1
+fi
+for i in $(seq 1 $NODE_NUM)
+do
+    flag=`cat $statefile | grep compute${i}_status | awk '{print $2}'`
+    if [ $flag = 'Running' ] || [ $flag = 'running' ] || [ $flag = 'RUNNING' ]; then
+        if [ $push_mode -eq 0 ]; then
+            cat /hpc_data/cluster_data/mon_data_compute$i.csv >> $cluster_mon_data
+        fi
 	    idle_cores_i=`awk -F"," '{print $12}' /hpc_data/cluster_data/mon_data_compute$i.csv`
         low_cores_i=`awk -F"," '{print $13}' /hpc_data/cluster_data/mon_data_compute$i.csv`
 	    idle_cores=$((idle_cores+idle_cores_i))
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+ * This code is distributed under the license: MIT License
+ * Originally written by Zhenrong WANG
+ * mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+ */
+
+/*
+ * Drive autoscale_queue_parse and autoscale_decide with fixture queues over a
+ * simulated clock, no cluster needed. Build it from the repo root with the hpcopr
+ * sources, the main() of hpcopr_main.c renamed (it holds the global variables):
+ * gcc -c hpcopr/hpcopr_main.c -Dmain=hpcopr_main -o hpcopr_main.o
+ * gcc test/test_autoscale.c hpcopr_main.o $(ls hpcopr/ | grep '\.c$' | grep -v hpcopr_main | sed 's#^#hpcopr/#') -o test_autoscale.exe
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include "../hpcopr/now_macros.h"
+#include "../hpcopr/general_funcs.h"
+#include "../hpcopr/autoscale.h"
+
+#else
+#include "..\\hpcopr\\now_macros.h"
+#include "..\\hpcopr\\general_funcs.h"
+#include "..\\hpcopr\\autoscale.h"
+#endif
+
+typedef struct{
+    int_64bit now;
+    char queue[256];                    /* The squeue lines, separated by ; */
+    int nodes_on;
+    int idle_cores;
+    int idle_tail;
+    char expect_action[16];
+    int expect_count;
+    int expect_busy;
+    char expect_apply[64];              /* The echoed num_string of the cluster operation */
+} autoscale_fixture;
+
+int write_queue(char* queue_file, char* queue){
+    char* ptr=NULL;
+    FILE* file_p=fopen(queue_file,"w+");
+    if(file_p==NULL){
+        return -1;
+    }
+    for(ptr=queue;*ptr!='\0';ptr++){
+        fputc((*ptr==';')?'\n':*ptr,file_p);
+    }
+    fputc('\n',file_p);
+    fclose(file_p);
+    return 0;
+}
+
+int main(int argc, char** argv){
+    /*
+     * 4 nodes of 8 cores: scale up after the delay, stop at max_nodes, then scale the
+     * idle tail down with a node already down (shutdown_compute_nodes counts it).
+     */
+    autoscale_fixture fixtures[]={
+        {100000,"PENDING|32|;RUNNING|8|compute1",     1,0, 0,"none",    0,1,""},
+        {100060,"PENDING|32|;RUNNING|8|compute1",     1,0, 0,"none",    0,1,""},
+        {100120,"PENDING|32|;RUNNING|8|compute1",     1,0, 0,"turnon",  3,1,"3"},
+        {100180,"PENDING|8|;RUNNING|16|compute[1-2]", 4,0, 0,"none",    0,2,""},
+        {100480,"RUNNING|8|compute1",                 3,16,2,"none",    0,1,""},
+        {101380,"RUNNING|8|compute1",                 3,16,2,"shutdown",2,1,"3"},
+        {101440,"RUNNING|8|compute1",                 1,0, 0,"none",    0,1,""},
+    };
+    char queue_file[FILENAME_LENGTH]="";
+    char (*busy_nodes)[32]=NULL;
+    autoscale_policy policy;
+    autoscale_state state;
+    autoscale_input input;
+    autoscale_action action;
+    int fixture_num=sizeof(fixtures)/sizeof(autoscale_fixture);
+    int busy_num;
+    int fail_num=0;
+    int i;
+    snprintf(queue_file,FILENAME_LENGTH-1,"%s",(argc>1)?argv[1]:"autoscale_queue_test.txt");
+    busy_nodes=(char (*)[32])malloc(sizeof(char)*32*64);
+    if(busy_nodes==NULL){
+        return 1;
+    }
+    memset(&policy,0,sizeof(autoscale_policy));
+    policy.min_nodes=1;
+    policy.max_nodes=4;
+    policy.max_step=4;
+    policy.up_delay=120;
+    policy.down_delay=900;
+    policy.up_cooldown=300;
+    policy.down_cooldown=900;
+    policy.reserve_cores=0;
+    policy.add_nodes=0;
+    memset(&state,0,sizeof(autoscale_state));
+    strcpy(state.last_action,"none");
+    for(i=0;i<fixture_num;i++){
+        memset(&input,0,sizeof(autoscale_input));
+        if(write_queue(queue_file,fixtures[i].queue)!=0){
+            free(busy_nodes);
+            return 1;
+        }
+        busy_num=autoscale_queue_parse(queue_file,&input,busy_nodes,64);
+        input.nodes_all=4;
+        input.nodes_on=fixtures[i].nodes_on;
+        input.node_cores=8;
+        input.idle_cores=fixtures[i].idle_cores;
+        input.idle_tail=fixtures[i].idle_tail;
+        autoscale_decide(&policy,&state,&input,fixtures[i].now,&action);
+        printf("t=%-5lld %-8s %d (%s)\n",fixtures[i].now,action.action,action.count,action.reason);
+        if(busy_num!=fixtures[i].expect_busy||strcmp(action.action,fixtures[i].expect_action)!=0||action.count!=fixtures[i].expect_count){
+            printf("FAILED: expected %s %d with %d busy node(s), got %d busy node(s).\n",fixtures[i].expect_action,fixtures[i].expect_count,fixtures[i].expect_busy,busy_num);
+            fail_num++;
+        }
+        if(strlen(fixtures[i].expect_apply)>0){
+            autoscale_apply("","",&input,&action,1,NULL);
+            printf("EXPECTED: param=\"%s\"\n",fixtures[i].expect_apply);
+        }
+    }
+    remove(queue_file);
+    free(busy_nodes);
+    printf("\nRESULT: %d\n\n",fail_num);
+    if(fail_num==0){
+        return 0;
+    }
+    return 3;
+}
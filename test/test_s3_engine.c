@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+ * This code is distributed under the license: MIT License
+ * Originally written by Zhenrong WANG
+ * mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+ */
+
+/*
+ * Run the native S3 engine against a bucket in the path style, e.g. a local
+ * MinIO: put/get/ls/rm, a multipart upload and a rejected Content-MD5. Run it
+ * with test_s3_minio.sh, or build it like test_autoscale.c and run
+ * test_s3_engine.exe ENDPOINT BUCKET AK SK. Not for Windows.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include "../hpcopr/now_macros.h"
+#include "../hpcopr/general_funcs.h"
+#include "../hpcopr/now_md5.h"
+#include "../hpcopr/cluster_general_funcs.h"
+#include "../hpcopr/s3_engine.h"
+
+#else
+#include "..\\hpcopr\\now_macros.h"
+#include "..\\hpcopr\\general_funcs.h"
+#include "..\\hpcopr\\now_md5.h"
+#include "..\\hpcopr\\cluster_general_funcs.h"
+#include "..\\hpcopr\\s3_engine.h"
+#endif
+
+int fail_num=0;
+
+void test_check(char* step, int result, int expected){
+    if(result==expected){
+        printf("PASSED: %s\n",step);
+        return;
+    }
+    printf("FAILED: %s (%d, expected %d)\n",step,result,expected);
+    fail_num++;
+}
+
+/* A file of about size_kb KiB with the lines numbered, so that the parts differ */
+int test_file_create(char* filename, int size_kb){
+    int_64bit written=0;
+    int_64bit line_num=0;
+    FILE* file_p=fopen(filename,"w+");
+    if(file_p==NULL){
+        return -1;
+    }
+    while(written<(int_64bit)size_kb*1024){
+        written+=fprintf(file_p,"hpc-now s3 engine test line %lld\n",line_num);
+        line_num++;
+    }
+    fclose(file_p);
+    return 0;
+}
+
+int test_same_md5(char* file_a, char* file_b){
+    char md5_a[64]="";
+    char md5_b[64]="";
+    if(now_md5_for_file(file_a,md5_a,64)!=0||now_md5_for_file(file_b,md5_b,64)!=0){
+        return -1;
+    }
+    return (strcmp(md5_a,md5_b)==0)?0:1;
+}
+
+int main(int argc, char** argv){
+    char small_file[FILENAME_LENGTH]="";
+    char large_file[FILENAME_LENGTH]="";
+    char get_file[FILENAME_LENGTH]="";
+    char list_file[FILENAME_LENGTH]="";
+    char curl_prefix[CMDLINE_LENGTH]="";
+    char url[FILENAME_LENGTH_EXT]="";
+    char cmdline[CMDLINE_LENGTH_EXT]="";
+    char content_md5[32]="";
+    char line_buffer[FILENAME_LENGTH_EXT]="";
+    char etag[80]="";
+    char last_modified[64]="";
+    char object_key[FILENAME_LENGTH]="";
+    char config_file[FILENAME_LENGTH]="";
+    int_64bit object_size,local_size;
+    long long local_mtime;
+    int object_num;
+    s3_target target;
+    FILE* file_p=NULL;
+    if(argc<5){
+        printf("\nINVALID_FORMAT! ENDPOINT BUCKET AK SK\n\n");
+        return 1;
+    }
+    memset(&target,0,sizeof(s3_target));
+    strncpy(target.endpoint,argv[1],LINE_LENGTH_SHORT-1);
+    strncpy(target.bucket,argv[2],127);
+    strcpy(target.region,"us-east-1");
+    strncpy(target.ak,argv[3],127);
+    strncpy(target.sk,argv[4],127);
+    target.path_style=1;
+    target.part_mb=S3_PART_MB_MIN;
+    target.concurrency=4;
+    target.index_ttl=0;
+    mk_pdir(NOW_TMP_DIR);
+    if(s3_target_credentials(&target)!=0){
+        printf("\nRESULT: failed to write the credentials\n\n");
+        return 1;
+    }
+    snprintf(small_file,FILENAME_LENGTH-1,"%ss3_test_small.txt",NOW_TMP_DIR);
+    snprintf(large_file,FILENAME_LENGTH-1,"%ss3_test_large.txt",NOW_TMP_DIR);
+    snprintf(get_file,FILENAME_LENGTH-1,"%ss3_test_get.txt",NOW_TMP_DIR);
+    snprintf(list_file,FILENAME_LENGTH-1,"%ss3_test.lst",NOW_TMP_DIR);
+    /* 3 parts of S3_PART_MB_MIN, the last one shorter */
+    if(test_file_create(small_file,4)!=0||test_file_create(large_file,(2*S3_PART_MB_MIN+1)*1024)!=0){
+        printf("\nRESULT: failed to create the test files\n\n");
+        s3_target_clear(&target);
+        return 1;
+    }
+
+    test_check("put a small object",s3_put_object(&target,small_file,"s3test/small.txt"),0);
+    test_check("head the small object",s3_head_object(&target,"s3test/small.txt",&object_size,etag,80),0);
+    get_file_size_mtime(small_file,&local_size,&local_mtime);
+    test_check("small object size",(object_size==local_size)?0:1,0);
+    test_check("verify the small object ETag",s3_etag_check(small_file,object_size,etag,target.part_mb),0);
+    test_check("get the small object",s3_get_object(&target,"s3test/small.txt",get_file),0);
+    test_check("small object content",test_same_md5(small_file,get_file),0);
+
+    test_check("multipart put",s3_put_object(&target,large_file,"s3test/large.txt"),0);
+    test_check("head the multipart object",s3_head_object(&target,"s3test/large.txt",&object_size,etag,80),0);
+    test_check("verify the multipart ETag",s3_etag_check(large_file,object_size,etag,target.part_mb),0);
+    test_check("get the multipart object",s3_get_object(&target,"s3test/large.txt",get_file),0);
+    test_check("multipart object content",test_same_md5(large_file,get_file),0);
+
+    /* The md5 of an empty body never matches the file, the server must reject the put */
+    s3_content_md5("d41d8cd98f00b204e9800998ecf8427e",content_md5,32);
+    s3_curl_prefix(&target,curl_prefix,CMDLINE_LENGTH);
+    s3_object_url(&target,"s3test/bad_md5.txt","",url,FILENAME_LENGTH_EXT);
+    snprintf(cmdline,CMDLINE_LENGTH_EXT-1,"%s -T \"%s\" -H \"Content-MD5: %s\" -o %s \"%s\" 2>%s",curl_prefix,small_file,content_md5,NULL_STREAM,url,NULL_STREAM);
+    test_check("put with a wrong Content-MD5 rejected",(system(cmdline)!=0)?1:0,1);
+    test_check("no object after the rejected put",s3_head_object(&target,"s3test/bad_md5.txt",&object_size,etag,80),1);
+    test_check("no credentials in the command line",(strstr(cmdline,target.sk)==NULL)?0:1,0);
+
+    object_num=0;
+    test_check("list the objects",s3_list_objects(&target,"s3test/",0,list_file),0);
+    file_p=fopen(list_file,"r");
+    if(file_p!=NULL){
+        while(fngetline(file_p,line_buffer,FILENAME_LENGTH_EXT)!=1){
+            if(s3_list_line_parse(line_buffer,&object_size,etag,last_modified,object_key,FILENAME_LENGTH)==0){
+                object_num++;
+            }
+        }
+        fclose(file_p);
+    }
+    test_check("objects listed",object_num,2);
+
+    test_check("delete the small object",s3_delete_object(&target,"s3test/small.txt"),0);
+    test_check("delete the multipart object",s3_delete_object(&target,"s3test/large.txt"),0);
+    object_num=0;
+    s3_list_objects(&target,"s3test/",0,list_file);
+    file_p=fopen(list_file,"r");
+    if(file_p!=NULL){
+        while(fngetline(file_p,line_buffer,FILENAME_LENGTH_EXT)!=1){
+            if(s3_list_line_parse(line_buffer,&object_size,etag,last_modified,object_key,FILENAME_LENGTH)==0){
+                object_num++;
+            }
+        }
+        fclose(file_p);
+    }
+    test_check("objects left after the deletes",object_num,0);
+
+    strcpy(config_file,target.config_file);
+    s3_target_clear(&target);
+    test_check("credentials removed",(file_exist_or_not(config_file)==0)?1:0,0);
+    rm_file_or_dir(small_file);
+    rm_file_or_dir(large_file);
+    rm_file_or_dir(get_file);
+    rm_file_or_dir(list_file);
+    printf("\nRESULT: %d\n\n",fail_num);
+    if(fail_num==0){
+        return 0;
+    }
+    return 3;
+}
@@ -0,0 +1,59 @@
+#!/bin/bash
+
+# Copyright (C) 2022-present Shanghai HPC-NOW Technologies Co., Ltd.
+# This code is distributed under the license: MIT License
+# Originally written by Zhenrong WANG
+# mailto: zhenrongwang@live.com | wangzhenrong@hpc-now.com
+
+# Run test_s3_engine.c against a local MinIO in the path style.
+# A MinIO is started on 127.0.0.1:${MINIO_PORT} with the minio binary in the PATH,
+# unless S3_TEST_ENDPOINT points to a running one. Run it from the repo root as
+# the user of hpcopr, the engine works in /usr/.hpc-now/.tmp/.
+
+endpoint=${S3_TEST_ENDPOINT}
+bucket=${S3_TEST_BUCKET:-hpcnow-s3-test}
+access_key=${S3_TEST_AK:-minioadmin}
+secret_key=${S3_TEST_SK:-minioadmin}
+minio_port=${MINIO_PORT:-19000}
+work_dir=$(mktemp -d)
+minio_pid=""
+
+function clean_up() {
+  if [ -n "${minio_pid}" ]; then
+    kill ${minio_pid} 2>/dev/null
+    wait ${minio_pid} 2>/dev/null
+  fi
+  rm -rf ${work_dir}
+}
+trap clean_up EXIT
+
+if [ ! -f ./hpcopr/s3_engine.c ]; then
+  echo -e "[ FATAL: ] Please run this script from the root of the repository."
+  exit 1
+fi
+if [ -z "${endpoint}" ]; then
+  if ! command -v minio >/dev/null 2>&1; then
+    echo -e "[ FATAL: ] No minio binary found. Install it or set S3_TEST_ENDPOINT."
+    exit 1
+  fi
+  endpoint="http://127.0.0.1:${minio_port}"
+  mkdir -p ${work_dir}/data
+  MINIO_ROOT_USER=${access_key} MINIO_ROOT_PASSWORD=${secret_key} minio server ${work_dir}/data --address 127.0.0.1:${minio_port} >${work_dir}/minio.log 2>&1 &
+  minio_pid=$!
+  for i in $(seq 1 30); do
+    curl -s -f ${endpoint}/minio/health/live >/dev/null 2>&1 && break
+    sleep 1
+  done
+fi
+
+# The credentials go through a 0600 curl config, as the engine does.
+(umask 077 && echo "user = \"${access_key}:${secret_key}\"" > ${work_dir}/s3.cred)
+curl -s -o /dev/null --aws-sigv4 "aws:amz:us-east-1:s3" --config ${work_dir}/s3.cred -X PUT ${endpoint}/${bucket}
+if ! curl -s -f -o /dev/null --aws-sigv4 "aws:amz:us-east-1:s3" --config ${work_dir}/s3.cred -I ${endpoint}/${bucket}; then
+  echo -e "[ FATAL: ] Failed to create or reach the bucket ${bucket} at ${endpoint}."
+  exit 1
+fi
+
+gcc -c ./hpcopr/hpcopr_main.c -Dmain=hpcopr_main -o ${work_dir}/hpcopr_main.o || exit 1
+gcc ./test/test_s3_engine.c ${work_dir}/hpcopr_main.o $(ls ./hpcopr/ | grep '\.c$' | grep -v hpcopr_main | sed 's#^#./hpcopr/#') -o ${work_dir}/test_s3_engine.exe || exit 1
+${work_dir}/test_s3_engine.exe ${endpoint} ${bucket} ${access_key} ${secret_key}